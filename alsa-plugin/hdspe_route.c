@@ -0,0 +1,166 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file hdspe_route.c
+ * @brief Hardware mixer routes of the virtual stereo devices, see
+ * hdspe_route.h.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sound/asound.h>
+
+#include "hdspe.h"
+#include "hdspe_route.h"
+
+_Static_assert(HDSPE_ROUTE_CHANNELS == HDSPE_MAX_CHANNELS,
+	       "HDSPE_ROUTE_CHANNELS");
+
+int hdspe_route_parse_map(struct hdspe_route *r, const char *text)
+{
+	const char *p = strstr(text, "Playback channel mapping:");
+	int logical, dma;
+
+	r->channels = 0;
+	if (!p)
+		return -ENOENT;
+	while ((p = strchr(p, '\n')) != NULL) {
+		p++;
+		if (sscanf(p, "Logical %d DMA %d", &logical, &dma) != 2)
+			break;
+		if (logical != (int)r->channels || dma < 0 ||
+		    dma >= HDSPE_ROUTE_CHANNELS ||
+		    r->channels >= HDSPE_ROUTE_CHANNELS)
+			return -EINVAL;
+		r->map[r->channels++] = dma;
+	}
+	return r->channels ? 0 : -ENOENT;
+}
+
+/* Reads (write false) or writes a crosspoint of the 'Mixer' control. Its
+ * value is [ source destination gain ]: reads take source and destination
+ * in the value, as hdspmixer does. */
+static int hdspe_route_mixer(struct hdspe_route *r, bool write,
+			     unsigned int source, unsigned int output,
+			     unsigned int *gain)
+{
+	struct snd_ctl_elem_value v;
+	int err;
+
+	memset(&v, 0, sizeof(v));
+	v.id.iface = SNDRV_CTL_ELEM_IFACE_HWDEP;
+	snprintf((char *)v.id.name, sizeof(v.id.name), "Mixer");
+	v.value.integer.value[0] = source;
+	v.value.integer.value[1] = output;
+	v.value.integer.value[2] = *gain;
+	err = r->ioctl(r->ctx, write ? SNDRV_CTL_IOCTL_ELEM_WRITE :
+		       SNDRV_CTL_IOCTL_ELEM_READ, &v);
+	if (err < 0)
+		return err;
+	*gain = v.value.integer.value[2];
+	return 0;
+}
+
+int hdspe_route_add(struct hdspe_route *r, unsigned int ch,
+		    unsigned int out, unsigned int gain)
+{
+	struct hdspe_route_xp *xp;
+	unsigned int source, output, old = 0, i;
+	int err;
+
+	if (ch >= r->channels || out >= r->channels)
+		return -EINVAL;
+	source = HDSPE_MIXER_CHANNELS + r->map[ch];
+	output = r->map[out];
+
+	/* Set twice: keep the gain from before the first. */
+	for (i = 0; i < r->n; i++)
+		if (r->xp[i].source == source && r->xp[i].output == output)
+			break;
+	if (i == r->n) {
+		if (r->n >= HDSPE_ROUTE_MAX)
+			return -ENOSPC;
+		err = hdspe_route_mixer(r, false, source, output, &old);
+		if (err < 0)
+			return err;
+	}
+	err = hdspe_route_mixer(r, true, source, output, &gain);
+	if (err < 0)
+		return err;
+
+	xp = &r->xp[i];
+	if (i == r->n) {
+		xp->source = source;
+		xp->output = output;
+		xp->old = old;
+		r->n++;
+	}
+	xp->gain = gain;
+	return 0;
+}
+
+int hdspe_route_stereo(struct hdspe_route *r, const unsigned int ch[2],
+		       const unsigned int *out, unsigned int n_out,
+		       unsigned int gain, bool mute)
+{
+	unsigned int i, k;
+	int err;
+
+	if (n_out == 0 || n_out % 2)
+		return -EINVAL;
+	for (i = 0; i < n_out; i++) {
+		err = hdspe_route_add(r, ch[i % 2], out[i], gain);
+		if (err < 0)
+			return err;
+	}
+	if (!mute)
+		return 0;
+	for (k = 0; k < 2; k++) {
+		for (i = 0; i < n_out; i++)
+			if (out[i] == ch[k])
+				break;
+		if (i < n_out)
+			continue;
+		err = hdspe_route_add(r, ch[k], ch[k], 0);
+		if (err < 0)
+			return err;
+	}
+	return 0;
+}
+
+int hdspe_route_restore(struct hdspe_route *r)
+{
+	struct hdspe_route_xp *xp;
+	unsigned int gain;
+	int err, ret = 0;
+
+	while (r->n > 0) {
+		xp = &r->xp[--r->n];
+		gain = 0;
+		err = hdspe_route_mixer(r, false, xp->source, xp->output,
+					&gain);
+		if (err >= 0 && gain == xp->gain) {
+			gain = xp->old;
+			err = hdspe_route_mixer(r, true, xp->source,
+						xp->output, &gain);
+		}
+		if (err < 0)
+			ret = err;
+	}
+	return ret;
+}
+
+int hdspe_route_gain(struct hdspe_route *r, unsigned int ch, unsigned int out)
+{
+	unsigned int gain = 0;
+	int err;
+
+	if (ch >= r->channels || out >= r->channels)
+		return -EINVAL;
+	err = hdspe_route_mixer(r, false, HDSPE_MIXER_CHANNELS + r->map[ch],
+				r->map[out], &gain);
+	return err < 0 ? err : (int)gain;
+}
@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file hdspe_route.h
+ * @brief Hardware mixer routes of the virtual stereo devices of the
+ * alsa-lib plugin in pcm_hdspe.c: crosspoints of the 'Mixer' control
+ * element, set when a device is opened and restored when it is closed.
+ *
+ * Channels are ALSA playback channel numbers throughout. They are mapped
+ * to the hardware channels of the mixer with the playback channel mapping
+ * of /proc/asound/card<N>/hdspe. The control device is driven through its
+ * ioctls, without alsa-lib, so that the test harness runs this code on
+ * test cards, and this header does not include the kernel's sound/asound.h,
+ * which clashes with alsa-lib's.
+ */
+
+#ifndef HDSPE_ROUTE_H
+#define HDSPE_ROUTE_H
+
+#include <stdbool.h>
+
+#define HDSPE_ROUTE_CHANNELS	64	/* HDSPE_MAX_CHANNELS */
+#define HDSPE_ROUTE_MAX		32	/* crosspoints per device */
+
+struct hdspe_route_xp {
+	unsigned int source;	/* 'Mixer' source: 64 + playback channel */
+	unsigned int output;	/* 'Mixer' destination: output channel */
+	unsigned int gain;	/* as set */
+	unsigned int old;	/* before */
+};
+
+struct hdspe_route {
+	/* ioctl() on the control device: 0 or a negative error code. */
+	int (*ioctl)(void *ctx, unsigned int cmd, void *arg);
+	void *ctx;
+
+	/* Playback channel mapping: ALSA channel to hardware channel. */
+	unsigned int channels;
+	unsigned int map[HDSPE_ROUTE_CHANNELS];
+
+	unsigned int n;
+	struct hdspe_route_xp xp[HDSPE_ROUTE_MAX];
+};
+
+/* Reads the playback channel mapping from the text of the hdspe proc
+ * file. */
+extern int hdspe_route_parse_map(struct hdspe_route *r, const char *text);
+
+/* Routes ALSA playback channel ch to the output of ALSA playback channel
+ * out, at gain (32768 is 0 dB, 0 mutes), and remembers the gain before. */
+extern int hdspe_route_add(struct hdspe_route *r, unsigned int ch,
+			   unsigned int out, unsigned int gain);
+
+/* A virtual stereo device on channels ch[0], ch[1]: left to outputs
+ * out[0], out[2], ..., right to out[1], out[3], ... If mute, the route of
+ * ch[0] and ch[1] to their own outputs is muted unless listed. */
+extern int hdspe_route_stereo(struct hdspe_route *r, const unsigned int ch[2],
+			      const unsigned int *out, unsigned int n_out,
+			      unsigned int gain, bool mute);
+
+/* Sets the crosspoints back to their gain before, unless changed since
+ * by someone else. */
+extern int hdspe_route_restore(struct hdspe_route *r);
+
+/* Current gain from ALSA playback channel ch to the output of ALSA
+ * playback channel out, or a negative error code. */
+extern int hdspe_route_gain(struct hdspe_route *r, unsigned int ch,
+			    unsigned int out);
+
+#endif /* HDSPE_ROUTE_H */
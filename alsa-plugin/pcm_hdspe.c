@@ -0,0 +1,251 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file pcm_hdspe.c
+ * @brief alsa-lib external PCM plugin for RME HDSPe cards: virtual stereo
+ * devices summed and fanned out to any outputs by the card's hardware
+ * mixer, rather than mixed in software by dmix.
+ *
+ * The plugin plays on two channels of a slave PCM, normally a dshare
+ * plugin on the card's playback PCM, so that several clients share the
+ * single playback substream, each on its own channels. On open, it routes
+ * those two channels to the listed outputs through the 'Mixer' control
+ * element, and restores the crosspoints on close:
+ *
+ *	pcm.hdspe_desktop {
+ *		type hdspe
+ *		slave.pcm "hdspe_desktop_share"	# dshare on channels 12, 13
+ *		card 0			# index or id of the card
+ *		channels [ 12 13 ]	# card channels the slave plays on
+ *		outputs [ 0 1 14 15 ]	# outputs of these ALSA channels
+ *		gain 32768		# optional, 0 dB
+ *		mute true		# optional, mute the own outputs
+ *	}
+ *
+ * See doc/asoundrc.hdspe for a complete configuration. Build and install
+ * with 'make alsa-plugin install-alsa-plugin'.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <alsa/asoundlib.h>
+#include <alsa/pcm_external.h>
+
+#include "hdspe_route.h"
+
+struct hdspe_pcm {
+	snd_pcm_extplug_t ext;
+	int ctl_fd;
+	struct hdspe_route route;
+};
+
+static int hdspe_pcm_ctl_ioctl(void *ctx, unsigned int cmd, void *arg)
+{
+	struct hdspe_pcm *p = ctx;
+
+	return ioctl(p->ctl_fd, cmd, arg) < 0 ? -errno : 0;
+}
+
+/* Same format and channels on both sides: a copy into the slave. */
+static snd_pcm_sframes_t
+hdspe_pcm_transfer(snd_pcm_extplug_t *ext,
+		   const snd_pcm_channel_area_t *dst_areas,
+		   snd_pcm_uframes_t dst_offset,
+		   const snd_pcm_channel_area_t *src_areas,
+		   snd_pcm_uframes_t src_offset,
+		   snd_pcm_uframes_t size)
+{
+	snd_pcm_areas_copy(dst_areas, dst_offset, src_areas, src_offset,
+			   ext->channels, size, ext->format);
+	return size;
+}
+
+static void hdspe_pcm_free(struct hdspe_pcm *p)
+{
+	if (p->ctl_fd >= 0) {
+		hdspe_route_restore(&p->route);
+		close(p->ctl_fd);
+	}
+	free(p);
+}
+
+static int hdspe_pcm_close(snd_pcm_extplug_t *ext)
+{
+	hdspe_pcm_free(ext->private_data);
+	return 0;
+}
+
+static const snd_pcm_extplug_callback_t hdspe_pcm_callback = {
+	.transfer = hdspe_pcm_transfer,
+	.close = hdspe_pcm_close,
+};
+
+/* The playback channel mapping of the card. */
+static int hdspe_pcm_read_map(struct hdspe_route *r, long card)
+{
+	static char text[64 * 1024];
+	char path[64];
+	ssize_t n, size = 0;
+	int fd;
+
+	snprintf(path, sizeof(path), "/proc/asound/card%ld/hdspe", card);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	while (size < (ssize_t)sizeof(text) - 1 &&
+	       (n = read(fd, text + size, sizeof(text) - 1 - size)) > 0)
+		size += n;
+	close(fd);
+	text[size] = '\0';
+	return hdspe_route_parse_map(r, text);
+}
+
+static int hdspe_pcm_conf_list(snd_config_t *n, unsigned int *v,
+			       unsigned int max, unsigned int *count)
+{
+	snd_config_iterator_t i, next;
+	long val;
+
+	*count = 0;
+	if (snd_config_get_type(n) != SND_CONFIG_TYPE_COMPOUND)
+		return -EINVAL;
+	snd_config_for_each(i, next, n) {
+		if (*count >= max ||
+		    snd_config_get_integer(snd_config_iterator_entry(i),
+					   &val) < 0 || val < 0)
+			return -EINVAL;
+		v[(*count)++] = val;
+	}
+	return 0;
+}
+
+SND_PCM_PLUGIN_DEFINE_FUNC(hdspe)
+{
+	snd_config_iterator_t i, next;
+	snd_config_t *sconf = NULL;
+	unsigned int ch[2], out[HDSPE_ROUTE_MAX], n_ch = 0, n_out = 0;
+	long card = -1, gain = 32768;
+	int mute = 1, err;
+	struct hdspe_pcm *p;
+	char path[32];
+
+	snd_config_for_each(i, next, conf) {
+		snd_config_t *n = snd_config_iterator_entry(i);
+		const char *id, *str;
+
+		if (snd_config_get_id(n, &id) < 0)
+			continue;
+		if (!strcmp(id, "comment") || !strcmp(id, "type") ||
+		    !strcmp(id, "hint"))
+			continue;
+		if (!strcmp(id, "slave")) {
+			sconf = n;
+			continue;
+		}
+		if (!strcmp(id, "card")) {
+			if (snd_config_get_integer(n, &card) < 0 &&
+			    (snd_config_get_string(n, &str) < 0 ||
+			     (card = snd_card_get_index(str)) < 0)) {
+				SNDERR("Invalid card for %s", id);
+				return -EINVAL;
+			}
+			continue;
+		}
+		if (!strcmp(id, "channels")) {
+			if (hdspe_pcm_conf_list(n, ch, 2, &n_ch) < 0 ||
+			    n_ch != 2) {
+				SNDERR("channels must be two channels");
+				return -EINVAL;
+			}
+			continue;
+		}
+		if (!strcmp(id, "outputs")) {
+			if (hdspe_pcm_conf_list(n, out, HDSPE_ROUTE_MAX,
+						&n_out) < 0 ||
+			    n_out == 0 || n_out % 2) {
+				SNDERR("outputs must be pairs of channels");
+				return -EINVAL;
+			}
+			continue;
+		}
+		if (!strcmp(id, "gain")) {
+			if (snd_config_get_integer(n, &gain) < 0 ||
+			    gain < 0 || gain > 65535) {
+				SNDERR("Invalid gain");
+				return -EINVAL;
+			}
+			continue;
+		}
+		if (!strcmp(id, "mute")) {
+			mute = snd_config_get_bool(n);
+			if (mute < 0) {
+				SNDERR("Invalid mute");
+				return -EINVAL;
+			}
+			continue;
+		}
+		SNDERR("Unknown field %s", id);
+		return -EINVAL;
+	}
+
+	if (!sconf || card < 0 || n_ch != 2 || n_out == 0) {
+		SNDERR("slave, card, channels and outputs are required");
+		return -EINVAL;
+	}
+	if (stream != SND_PCM_STREAM_PLAYBACK) {
+		SNDERR("hdspe is a playback plugin");
+		return -EINVAL;
+	}
+
+	p = calloc(1, sizeof(*p));
+	if (!p)
+		return -ENOMEM;
+	p->route.ioctl = hdspe_pcm_ctl_ioctl;
+	p->route.ctx = p;
+	snprintf(path, sizeof(path), "/dev/snd/controlC%ld", card);
+	p->ctl_fd = open(path, O_RDWR | O_CLOEXEC);
+	if (p->ctl_fd < 0) {
+		err = -errno;
+		SNDERR("Cannot open %s", path);
+		goto error;
+	}
+	err = hdspe_pcm_read_map(&p->route, card);
+	if (err < 0) {
+		SNDERR("Cannot read the channel mapping of card %ld", card);
+		goto error;
+	}
+	err = hdspe_route_stereo(&p->route, ch, out, n_out, gain, mute);
+	if (err < 0) {
+		SNDERR("Cannot set the mixer of card %ld: %s", card,
+		       snd_strerror(err));
+		goto error;
+	}
+
+	p->ext.version = SND_PCM_EXTPLUG_VERSION;
+	p->ext.name = "RME HDSPe hardware mixer route";
+	p->ext.callback = &hdspe_pcm_callback;
+	p->ext.private_data = p;
+	err = snd_pcm_extplug_create(&p->ext, name, root, sconf, stream, mode);
+	if (err < 0)
+		goto error;
+
+	/* Two channels, in the format of the slave: no conversion. */
+	snd_pcm_extplug_set_param(&p->ext, SND_PCM_EXTPLUG_HW_CHANNELS, 2);
+	snd_pcm_extplug_set_slave_param(&p->ext, SND_PCM_EXTPLUG_HW_CHANNELS,
+					2);
+	snd_pcm_extplug_set_param_link(&p->ext, SND_PCM_EXTPLUG_HW_FORMAT, 1);
+
+	*pcmp = p->ext.pcm;
+	return 0;
+
+error:
+	hdspe_pcm_free(p);
+	return err;
+}
+
+SND_PCM_PLUGIN_SYMBOL(hdspe);
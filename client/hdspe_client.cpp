@@ -0,0 +1,540 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file hdspe_client.cpp
+ * @brief C++17 client library for the RME HDSPe driver, see hdspe_client.h.
+ */
+
+#include "hdspe_client.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cmath>
+
+#include "hdspe_ltc_math.h"
+
+namespace hdspe {
+
+/* ------------------------------ Transport ------------------------------ */
+
+static int dev_open(const char *fmt, int card, int flags)
+{
+	char path[32];
+	int fd;
+
+	snprintf(path, sizeof(path), fmt, card);
+	fd = ::open(path, flags | O_CLOEXEC);
+	return fd < 0 ? -errno : fd;
+}
+
+int device_transport::find_card()
+{
+	struct snd_ctl_card_info info;
+	int card, fd, err;
+
+	for (card = 0; card < 32; card++) {
+		fd = dev_open("/dev/snd/controlC%d", card, O_RDONLY);
+		if (fd < 0)
+			continue;
+		memset(&info, 0, sizeof(info));
+		err = ::ioctl(fd, SNDRV_CTL_IOCTL_CARD_INFO, &info);
+		::close(fd);
+		if (err == 0 && strcmp((const char *)info.driver, "HDSPe") == 0)
+			return card;
+	}
+	return -ENODEV;
+}
+
+device_transport::~device_transport()
+{
+	close();
+}
+
+int device_transport::open(int card)
+{
+	void *page;
+
+	if (card < 0)
+		return card;
+	close();
+	ctl_fd_ = dev_open("/dev/snd/controlC%d", card, O_RDWR | O_NONBLOCK);
+	if (ctl_fd_ < 0)
+		return ctl_fd_;
+	hwdep_fd_ = dev_open("/dev/snd/hwC%dD0", card, O_RDWR);
+	if (hwdep_fd_ < 0) {
+		int err = hwdep_fd_;
+
+		close();
+		return err;
+	}
+
+	/* Drivers before the timing page have no mmap: not an error. */
+	page = mmap(nullptr, sizeof(struct hdspe_timing), PROT_READ,
+		    MAP_SHARED, hwdep_fd_, 0);
+	if (page != MAP_FAILED)
+		timing_ = (const struct hdspe_timing *)page;
+	return 0;
+}
+
+void device_transport::close()
+{
+	if (timing_)
+		munmap((void *)timing_, sizeof(struct hdspe_timing));
+	timing_ = nullptr;
+	if (hwdep_fd_ >= 0)
+		::close(hwdep_fd_);
+	if (ctl_fd_ >= 0)
+		::close(ctl_fd_);
+	hwdep_fd_ = ctl_fd_ = -1;
+}
+
+int device_transport::ctl_ioctl(unsigned long cmd, void *arg)
+{
+	return ::ioctl(ctl_fd_, cmd, arg) < 0 ? -errno : 0;
+}
+
+long device_transport::ctl_read(void *buf, size_t count)
+{
+	ssize_t n = ::read(ctl_fd_, buf, count);
+
+	return n < 0 ? -errno : n;
+}
+
+int device_transport::ctl_wait(int timeout_ms)
+{
+	struct pollfd pfd = { ctl_fd_, POLLIN, 0 };
+	int n = ::poll(&pfd, 1, timeout_ms);
+
+	if (n < 0)
+		return errno == EINTR ? 0 : -errno;
+	return n;
+}
+
+int device_transport::hwdep_ioctl(unsigned long cmd, void *arg)
+{
+	int n = ::ioctl(hwdep_fd_, cmd, arg);
+
+	return n < 0 ? -errno : n;
+}
+
+/* ------------------------------ Decoders ------------------------------- */
+
+sample_rate decode_sample_rate(const struct snd_ctl_elem_value &v)
+{
+	sample_rate r;
+
+	r.num = v.value.integer64.value[0];
+	r.den = v.value.integer64.value[1];
+	return r;
+}
+
+ltc_time decode_ltc(const struct snd_ctl_elem_value &v, int fps, bool drop)
+{
+	ltc_time t;
+
+	t.code = v.value.integer64.value[0];
+	t.ltc = hdspe_ltc64_to_ltc32(t.code);
+	t.frame = v.value.integer64.value[1];
+	t.fps = fps;
+	t.drop = drop;
+	hdspe_ltc32_parse(t.ltc, &t.h, &t.m, &t.s, &t.f);
+	return t;
+}
+
+int decode_fps(std::string_view item)
+{
+	std::string s(item);
+
+	return (int)std::lround(strtod(s.c_str(), nullptr));
+}
+
+unsigned int ltc_time::frames() const
+{
+	return fps ? hdspe_ltc32_to_frames(ltc, fps, drop) : 0;
+}
+
+ltc_time ltc_time::at(uint64_t at, double rate_hz) const
+{
+	ltc_time t = *this;
+	int n;
+
+	if (!fps || rate_hz <= 0 || at <= frame)
+		return t;
+	n = (int)((double)(at - frame) * fps / rate_hz);
+	t.ltc = hdspe_ltc32_add_frames(n, ltc, fps, drop);
+	t.code = hdspe_ltc32_to_ltc64(t.ltc);
+	t.frame = frame + (uint64_t)std::llround(n * rate_hz / fps);
+	hdspe_ltc32_parse(t.ltc, &t.h, &t.m, &t.s, &t.f);
+	return t;
+}
+
+std::string ltc_time::str() const
+{
+	char buf[16];
+
+	snprintf(buf, sizeof(buf), "%02d:%02d:%02d%c%02d",
+		 h, m, s, drop ? ';' : ':', f);
+	return buf;
+}
+
+/* ------------------------------ Card model ----------------------------- */
+
+long element::integer(unsigned int i) const
+{
+	if (i >= info_.count)
+		return 0;
+	switch (info_.type) {
+	case SNDRV_CTL_ELEM_TYPE_BOOLEAN:
+	case SNDRV_CTL_ELEM_TYPE_INTEGER:
+		return value_.value.integer.value[i];
+	case SNDRV_CTL_ELEM_TYPE_ENUMERATED:
+		return value_.value.enumerated.item[i];
+	case SNDRV_CTL_ELEM_TYPE_INTEGER64:
+		return (long)value_.value.integer64.value[i];
+	default:
+		return 0;
+	}
+}
+
+long long element::integer64(unsigned int i) const
+{
+	if (info_.type != SNDRV_CTL_ELEM_TYPE_INTEGER64)
+		return integer(i);
+	return i < info_.count ? value_.value.integer64.value[i] : 0;
+}
+
+std::string_view element::item(unsigned int i) const
+{
+	unsigned int n;
+
+	if (info_.type != SNDRV_CTL_ELEM_TYPE_ENUMERATED || i >= info_.count)
+		return {};
+	n = value_.value.enumerated.item[i];
+	return n < items_.size() ? std::string_view(items_[n]) :
+		std::string_view();
+}
+
+card::~card()
+{
+	int off = 0;
+
+	if (subscribed_)
+		t_.ctl_ioctl(SNDRV_CTL_IOCTL_SUBSCRIBE_EVENTS, &off);
+}
+
+int card::read_info(element &e)
+{
+	struct snd_ctl_elem_info info;
+	unsigned int i;
+	int err;
+
+	memset(&info, 0, sizeof(info));
+	info.id = e.info_.id;
+	err = t_.ctl_ioctl(SNDRV_CTL_IOCTL_ELEM_INFO, &info);
+	if (err < 0)
+		return err;
+	e.info_ = info;
+
+	e.items_.clear();
+	if (info.type != SNDRV_CTL_ELEM_TYPE_ENUMERATED)
+		return 0;
+	for (i = 0; i < e.info_.value.enumerated.items; i++) {
+		info.value.enumerated.item = i;
+		err = t_.ctl_ioctl(SNDRV_CTL_IOCTL_ELEM_INFO, &info);
+		if (err < 0)
+			return err;
+		e.items_.emplace_back(info.value.enumerated.name);
+	}
+	return 0;
+}
+
+int card::read_value(element &e)
+{
+	if (!e.readable())
+		return 0;
+	memset(&e.value_, 0, sizeof(e.value_));
+	e.value_.id = e.info_.id;
+	return t_.ctl_ioctl(SNDRV_CTL_IOCTL_ELEM_READ, &e.value_);
+}
+
+/* Subscribes before reading, so that no change goes unnoticed: changes
+ * during the reading are dispatched after, at the cost of a re-read. */
+int card::refresh()
+{
+	struct snd_ctl_elem_list list;
+	std::vector<struct snd_ctl_elem_id> ids;
+	int on = 1, err;
+
+	elements_.clear();
+	by_numid_.clear();
+	by_name_.clear();
+
+	if (!subscribed_) {
+		err = t_.ctl_ioctl(SNDRV_CTL_IOCTL_SUBSCRIBE_EVENTS, &on);
+		if (err < 0)
+			return err;
+		subscribed_ = true;
+	}
+
+	memset(&list, 0, sizeof(list));
+	err = t_.ctl_ioctl(SNDRV_CTL_IOCTL_ELEM_LIST, &list);
+	if (err < 0)
+		return err;
+	ids.resize(list.count);
+	list.space = list.count;
+	list.pids = ids.data();
+	err = t_.ctl_ioctl(SNDRV_CTL_IOCTL_ELEM_LIST, &list);
+	if (err < 0)
+		return err;
+
+	elements_.resize(list.used);
+	for (unsigned int i = 0; i < list.used; i++) {
+		element &e = elements_[i];
+
+		e.info_.id = ids[i];
+		err = read_info(e);
+		if (err >= 0)
+			err = read_value(e);
+		if (err < 0)
+			return err;
+		by_numid_[e.numid()] = i;
+		by_name_[{ std::string(e.name()), e.id().index }] = i;
+	}
+	return 0;
+}
+
+const element *card::find(std::string_view name, unsigned int index) const
+{
+	auto it = by_name_.find({ std::string(name), index });
+
+	return it == by_name_.end() ? nullptr : &elements_[it->second];
+}
+
+void card::notify(const element &e, unsigned int mask)
+{
+	for (auto &cb : callbacks_)
+		cb(e, mask);
+}
+
+int card::dispatch()
+{
+	struct snd_ctl_event ev[16];
+	bool reload = false, polling = false;
+	long n;
+	int err;
+
+	changed_.clear();
+	masks_.clear();
+	do {
+		n = t_.ctl_read(ev, sizeof(ev));
+		if (n == -EAGAIN)
+			break;
+		if (n < 0)
+			return n;
+		for (long i = 0; i < n / (long)sizeof(ev[0]); i++) {
+			unsigned int mask = ev[i].data.elem.mask;
+			size_t k;
+
+			if (ev[i].type != SNDRV_CTL_EVENT_ELEM)
+				continue;
+			auto it = by_numid_.find(ev[i].data.elem.id.numid);
+			if (mask == SNDRV_CTL_EVENT_MASK_REMOVE ||
+			    (mask & SNDRV_CTL_EVENT_MASK_ADD) ||
+			    it == by_numid_.end()) {
+				reload = true;
+				continue;
+			}
+			for (k = 0; k < changed_.size(); k++)
+				if (changed_[k] == it->second)
+					break;
+			if (k == changed_.size()) {
+				changed_.push_back(it->second);
+				masks_.push_back(0);
+			}
+			masks_[k] |= mask;
+		}
+		/* A short read emptied the queue. */
+	} while (n == (long)sizeof(ev));
+
+	if (reload) {
+		err = refresh();
+		if (err < 0)
+			return err;
+		for (const element &e : elements_)
+			notify(e, SNDRV_CTL_EVENT_MASK_ADD);
+		err = rearm_status_polling();
+		return err < 0 ? err : (int)elements_.size();
+	}
+
+	for (size_t k = 0; k < changed_.size(); k++) {
+		element &e = elements_[changed_[k]];
+
+		err = (masks_[k] & SNDRV_CTL_EVENT_MASK_INFO) ? read_info(e) : 0;
+		if (err >= 0 && (masks_[k] & SNDRV_CTL_EVENT_MASK_VALUE))
+			err = read_value(e);
+		if (err < 0)
+			return err;
+		if (e.name() == "Status Polling")
+			polling = true;
+		notify(e, masks_[k]);
+	}
+	if (polling) {
+		err = rearm_status_polling();
+		if (err < 0)
+			return err;
+	}
+	return changed_.size();
+}
+
+int card::run_once(int timeout_ms)
+{
+	int err = t_.ctl_wait(timeout_ms);
+
+	return err <= 0 ? err : dispatch();
+}
+
+int card::run(const std::atomic<bool> &quit)
+{
+	int err;
+
+	while (!quit) {
+		/* Wakes up to check quit. */
+		err = run_once(100);
+		if (err < 0)
+			return err;
+	}
+	return 0;
+}
+
+int card::write(const element &e, const long *values, unsigned int n)
+{
+	auto it = by_numid_.find(e.numid());
+	struct snd_ctl_elem_value v;
+	int err;
+
+	if (it == by_numid_.end())
+		return -ENOENT;
+	if (n > e.count())
+		return -EINVAL;
+	v = e.value_;
+	v.id = e.info_.id;
+	for (unsigned int i = 0; i < n; i++) {
+		switch (e.type()) {
+		case SNDRV_CTL_ELEM_TYPE_BOOLEAN:
+		case SNDRV_CTL_ELEM_TYPE_INTEGER:
+			v.value.integer.value[i] = values[i];
+			break;
+		case SNDRV_CTL_ELEM_TYPE_ENUMERATED:
+			v.value.enumerated.item[i] = values[i];
+			break;
+		case SNDRV_CTL_ELEM_TYPE_INTEGER64:
+			v.value.integer64.value[i] = values[i];
+			break;
+		default:
+			return -EINVAL;
+		}
+	}
+	err = t_.ctl_ioctl(SNDRV_CTL_IOCTL_ELEM_WRITE, &v);
+	if (err < 0)
+		return err;
+	elements_[it->second].value_ = v;
+	return 0;
+}
+
+/* The driver stops status checks after a change, and after a while
+ * without: it resets 'Status Polling' to 0 and notifies it. Set it back
+ * to the maximum of its value and ours, for other clients. */
+int card::rearm_status_polling()
+{
+	const element *e = find("Status Polling");
+
+	if (polling_ <= 0 || !e)
+		return 0;
+	if (e->integer() >= polling_)
+		return 0;
+	return write(*e, polling_);
+}
+
+int card::set_status_polling(int hz)
+{
+	if (hz < 0)
+		return -EINVAL;
+	if (!find("Status Polling"))
+		return -ENOENT;
+	polling_ = hz;
+	return rearm_status_polling();
+}
+
+std::optional<sample_rate> card::raw_sample_rate() const
+{
+	const element *e = find("Raw Sample Rate");
+
+	if (!e || e->count() < 2)
+		return std::nullopt;
+	return decode_sample_rate(e->value());
+}
+
+std::optional<std::string> card::autosync_ref() const
+{
+	const element *e = find("Current AutoSync Reference");
+
+	if (!e)
+		return std::nullopt;
+	return std::string(e->item());
+}
+
+std::vector<sync_source> card::autosync() const
+{
+	const element *st = find("AutoSync Status");
+	const element *fr = find("AutoSync Frequency");
+	const element *ref = find("Current AutoSync Reference");
+	std::vector<sync_source> v;
+
+	if (!st)
+		return v;
+	v.resize(st->count());
+	for (unsigned int i = 0; i < st->count(); i++) {
+		if (ref && i < ref->items().size())
+			v[i].name = ref->items()[i];
+		v[i].status = (sync_status)st->integer(i);
+		if (fr)
+			v[i].freq = fr->item(i);
+	}
+	return v;
+}
+
+std::optional<ltc_time> card::ltc_in() const
+{
+	const element *e = find("LTC In");
+	const element *fps = find("LTC In Frame Rate");
+	const element *drop = find("LTC In Drop Frame");
+
+	if (!e || e->count() < 2 || !fps)
+		return std::nullopt;
+	return decode_ltc(e->value(), decode_fps(fps->item()),
+			  drop && drop->integer());
+}
+
+bool card::timing(struct hdspe_timing &t) const
+{
+	const struct hdspe_timing *p = t_.timing();
+	uint32_t seq;
+
+	if (!p)
+		return false;
+	do {
+		seq = __atomic_load_n(&p->seq, __ATOMIC_ACQUIRE);
+		memcpy(&t, (const void *)p, sizeof(t));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((seq & 1) ||
+		 seq != __atomic_load_n(&p->seq, __ATOMIC_RELAXED));
+	return true;
+}
+
+} /* namespace hdspe */
@@ -0,0 +1,274 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file hdspe_client.h
+ * @brief C++17 client library for the RME HDSPe driver: a typed model of
+ * the card's control elements, kept up to date from control change events
+ * rather than by polling, decoders for the elements whose values need
+ * interpretation, and the hwdep ioctls and timing page without
+ * intermediate copies.
+ *
+ * Typical use:
+ *
+ *	hdspe::device_transport dev;
+ *	if (dev.open(hdspe::device_transport::find_card()) < 0) ...
+ *	hdspe::card card(dev);
+ *	card.refresh();
+ *	card.set_status_polling(10);
+ *	card.on_change([&](const hdspe::element &e, unsigned int mask) {
+ *		if (e.name() == "AutoSync Status") ... card.autosync() ...
+ *	});
+ *	card.run(quit);
+ *
+ * Errors are returned as negative error codes, as by the kernel. The
+ * library does not throw, other than std::bad_alloc.
+ */
+
+#ifndef HDSPE_CLIENT_H
+#define HDSPE_CLIENT_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sound/asound.h>
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "hdspe.h"
+
+namespace hdspe {
+
+/* ------------------------------ Transport ------------------------------ */
+
+/* The control and hwdep devices of one card. Each call is one system
+ * call on the devices; the test harness substitutes the emulated card. */
+class transport {
+public:
+	virtual ~transport() = default;
+
+	/* ioctl() on the control device. */
+	virtual int ctl_ioctl(unsigned long cmd, void *arg) = 0;
+	/* Non-blocking read() of control events: bytes read, or -EAGAIN. */
+	virtual long ctl_read(void *buf, size_t count) = 0;
+	/* poll() for control events: > 0 if readable, 0 on timeout. A
+	 * negative timeout waits indefinitely. */
+	virtual int ctl_wait(int timeout_ms) = 0;
+
+	/* ioctl() on the hwdep device. */
+	virtual int hwdep_ioctl(unsigned long cmd, void *arg) = 0;
+	/* The timing page, mapped read-only, or nullptr. */
+	virtual const struct hdspe_timing *timing() const = 0;
+};
+
+/* /dev/snd/controlC<card> and /dev/snd/hwC<card>D0. */
+class device_transport : public transport {
+public:
+	device_transport() = default;
+	~device_transport() override;
+	device_transport(const device_transport &) = delete;
+	device_transport &operator=(const device_transport &) = delete;
+
+	/* Number of the first card of this driver, or -ENODEV. */
+	static int find_card();
+
+	int open(int card);
+	void close();
+
+	/* For integration in an existing poll loop: POLLIN means call
+	 * card::dispatch(). */
+	int ctl_fd() const { return ctl_fd_; }
+	int hwdep_fd() const { return hwdep_fd_; }
+
+	int ctl_ioctl(unsigned long cmd, void *arg) override;
+	long ctl_read(void *buf, size_t count) override;
+	int ctl_wait(int timeout_ms) override;
+	int hwdep_ioctl(unsigned long cmd, void *arg) override;
+	const struct hdspe_timing *timing() const override { return timing_; }
+
+private:
+	int ctl_fd_ = -1;
+	int hwdep_fd_ = -1;
+	const struct hdspe_timing *timing_ = nullptr;
+};
+
+/* ------------------------------ Decoders ------------------------------- */
+
+/* 'Raw Sample Rate': the exact rate as a fraction, numerator first. */
+struct sample_rate {
+	uint64_t num = 0;
+	uint64_t den = 0;
+
+	double hz() const { return den ? (double)num / (double)den : 0.0; }
+};
+
+extern sample_rate decode_sample_rate(const struct snd_ctl_elem_value &v);
+
+/* 'AutoSync Status' items, as enum hdspe_sync_status. */
+enum class sync_status {
+	no_lock = HDSPE_SYNC_STATUS_NO_LOCK,
+	lock = HDSPE_SYNC_STATUS_LOCK,
+	sync = HDSPE_SYNC_STATUS_SYNC,
+	not_available = HDSPE_SYNC_STATUS_NOT_AVAILABLE,
+};
+
+/* One clock source, from 'AutoSync Status' and 'AutoSync Frequency',
+ * named as in 'Current AutoSync Reference'. */
+struct sync_source {
+	std::string name;
+	sync_status status = sync_status::not_available;
+	std::string freq;      /* 'AutoSync Frequency' item, e.g. "48 kHz" */
+};
+
+/* 'LTC In', with 'LTC In Frame Rate' and 'LTC In Drop Frame'. */
+struct ltc_time {
+	uint64_t code = 0;     /* 64-bit LTC frame, as in the control */
+	uint32_t ltc = 0;      /* 32-bit BCD time code, hdspe_ltc_math.h */
+	uint64_t frame = 0;    /* frame count at the start of the LTC frame */
+	int fps = 0;           /* 24, 25 or 30 */
+	bool drop = false;
+	int h = 0, m = 0, s = 0, f = 0;
+
+	/* Frames since midnight. */
+	unsigned int frames() const;
+	/* The time code running at frame count at, at rate_hz, from this
+	 * one: valid while the time code runs forward at nominal speed. */
+	ltc_time at(uint64_t at, double rate_hz) const;
+	/* hh:mm:ss:ff, or hh:mm:ss;ff in drop frame format. */
+	std::string str() const;
+};
+
+extern ltc_time decode_ltc(const struct snd_ctl_elem_value &v, int fps,
+			   bool drop);
+/* Frames per second of a 'LTC In Frame Rate' item: "29.97 fps" is 30. */
+extern int decode_fps(std::string_view item);
+
+/* ------------------------------ Card model ----------------------------- */
+
+/* A control element: its info, item names if enumerated, and the value
+ * last read. */
+class element {
+public:
+	const struct snd_ctl_elem_id &id() const { return info_.id; }
+	unsigned int numid() const { return info_.id.numid; }
+	std::string_view name() const
+		{ return (const char *)info_.id.name; }
+	snd_ctl_elem_type_t type() const { return info_.type; }
+	unsigned int count() const { return info_.count; }
+	bool readable() const
+		{ return info_.access & SNDRV_CTL_ELEM_ACCESS_READ; }
+	bool writable() const
+		{ return info_.access & SNDRV_CTL_ELEM_ACCESS_WRITE; }
+	const struct snd_ctl_elem_info &info() const { return info_; }
+	const struct snd_ctl_elem_value &value() const { return value_; }
+
+	/* Value i, of integer, boolean and enumerated elements. */
+	long integer(unsigned int i = 0) const;
+	long long integer64(unsigned int i = 0) const;
+	const std::vector<std::string> &items() const { return items_; }
+	/* Name of the item of value i, "" if not enumerated. */
+	std::string_view item(unsigned int i = 0) const;
+
+private:
+	friend class card;
+
+	struct snd_ctl_elem_info info_ = {};
+	struct snd_ctl_elem_value value_ = {};
+	std::vector<std::string> items_;
+};
+
+class card {
+public:
+	/* Called for each element whose value or info changed, with the
+	 * SNDRV_CTL_EVENT_MASK_* bits of the event. */
+	using callback = std::function<void(const element &, unsigned int)>;
+
+	explicit card(transport &t) : t_(t) {}
+	~card();
+	card(const card &) = delete;
+	card &operator=(const card &) = delete;
+
+	/* Reads all elements and subscribes to control events. */
+	int refresh();
+
+	/* Reads the queued control events and re-reads the elements they
+	 * name, once per element however many events are queued, and
+	 * re-enables status polling when the driver stopped it. Returns
+	 * the number of elements changed. Call when the control device is
+	 * readable. */
+	int dispatch();
+	/* Waits up to timeout_ms for events (-1: no timeout) and
+	 * dispatches them. */
+	int run_once(int timeout_ms);
+	/* The event loop: until quit is set or an error. */
+	int run(const std::atomic<bool> &quit);
+
+	void on_change(callback cb) { callbacks_.push_back(std::move(cb)); }
+
+	/* Status checks in the driver, at up to hz per second: the driver
+	 * notifies the status elements as they change, see 'Status
+	 * Polling' in doc/controls.md. 0 stops asking for them. */
+	int set_status_polling(int hz);
+
+	const std::vector<element> &elements() const { return elements_; }
+	const element *find(std::string_view name,
+			    unsigned int index = 0) const;
+
+	/* Writes values [0, n) of an integer, boolean or enumerated
+	 * element, and updates the model. */
+	int write(const element &e, const long *values, unsigned int n);
+	int write(const element &e, long value) { return write(e, &value, 1); }
+
+	/* The status elements, decoded from the model: no system call. */
+	std::optional<sample_rate> raw_sample_rate() const;
+	std::optional<std::string> autosync_ref() const;
+	std::vector<sync_source> autosync() const;
+	std::optional<ltc_time> ltc_in() const;
+
+	/* hwdep ioctls, straight into the caller's structure. */
+	template <typename T>
+	int ioctl(unsigned long cmd, T &arg)
+	{
+		return t_.hwdep_ioctl(cmd, &arg);
+	}
+	int status(struct hdspe_status &s)
+		{ return ioctl(SNDRV_HDSPE_IOCTL_GET_STATUS, s); }
+	int card_info(struct hdspe_card_info &i)
+		{ return ioctl(SNDRV_HDSPE_IOCTL_GET_CARD_INFO, i); }
+	int tco_status(struct hdspe_tco_status &s)
+		{ return ioctl(SNDRV_HDSPE_IOCTL_GET_LTC, s); }
+	int dma_pos(struct hdspe_dma_pos &p)
+		{ return ioctl(SNDRV_HDSPE_IOCTL_GET_DMA_POS, p); }
+	int latency(struct hdspe_latency &l)
+		{ return ioctl(SNDRV_HDSPE_IOCTL_GET_LATENCY, l); }
+
+	/* A consistent copy of the timing page, without a system call:
+	 * false if it is not mapped. */
+	bool timing(struct hdspe_timing &t) const;
+
+private:
+	int read_info(element &e);
+	int read_value(element &e);
+	void notify(const element &e, unsigned int mask);
+	int rearm_status_polling();
+
+	transport &t_;
+	std::vector<element> elements_;
+	std::unordered_map<unsigned int, size_t> by_numid_;
+	std::map<std::pair<std::string, unsigned int>, size_t> by_name_;
+	std::vector<callback> callbacks_;
+	std::vector<size_t> changed_;
+	std::vector<unsigned int> masks_;
+	bool subscribed_ = false;
+	int polling_ = 0;      /* desired 'Status Polling' */
+};
+
+} /* namespace hdspe */
+
+#endif /* HDSPE_CLIENT_H */
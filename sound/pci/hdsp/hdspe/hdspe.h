@@ -882,6 +882,26 @@ struct hdspe_card_info {
 
 #define HDSPE_MIXER_CHANNELS HDSPE_MAX_CHANNELS
 
+/* Hardware monitoring profile: unity gain routes the driver sets up for
+ * the channels in use at the current speed mode, see the 'Monitoring
+ * Profile' control. DAW routes playback channel i to output i,
+ * passthrough input i to output i. */
+enum hdspe_monitor_profile {
+	HDSPE_MONITOR_OFF          = 0,
+	HDSPE_MONITOR_DAW          = 1,
+	HDSPE_MONITOR_PASSTHROUGH  = 2,
+	HDSPE_MONITOR_BOTH         = 3,   /* DAW | PASSTHROUGH */
+	HDSPE_MONITOR_PROFILE_COUNT = 4,
+	HDSPE_MONITOR_FORCE_32_BIT = 0xffffffff
+};
+
+#define HDSPE_MONITOR_PROFILE_NAME(i) \
+	(i == HDSPE_MONITOR_OFF         ? "Off" :		\
+	 i == HDSPE_MONITOR_DAW         ? "DAW" :		\
+	 i == HDSPE_MONITOR_PASSTHROUGH ? "Passthrough" :	\
+	 i == HDSPE_MONITOR_BOTH        ? "DAW+Passthrough" :	\
+	 "???")
+
 struct hdspe_channelfader {
 	uint32_t in[HDSPE_MIXER_CHANNELS];
 	uint32_t pb[HDSPE_MIXER_CHANNELS];
@@ -898,6 +918,371 @@ struct hdspe_mixer_ioctl {
 /* use indirect access due to the limit of ioctl bit size */
 #define SNDRV_HDSPE_IOCTL_GET_MIXER _IOR('H', 0x44, struct hdspe_mixer_ioctl)
 
+/* ------------------- Mixer automation ring -------------------------- */
+
+/*
+ * Single producer, single consumer ring of timestamped mixer crosspoint
+ * changes, mmap()ed read-write from the hwdep device at offset
+ * HDSPE_MIXER_RING_OFFSET, HDSPE_MIXER_RING_BYTES long. Mapping it
+ * requires exclusive use of the card, as for the 'Mixer' control, and
+ * enables period interrupts while mapped.
+ *
+ * User space fills event[head], with frame in non-decreasing order, then
+ * advances head (modulo size) with a release store. At each period
+ * interrupt, the driver applies the events with frame <= the frame count
+ * at that interrupt (see struct hdspe_timing), in one batch, and
+ * advances tail with a release store. Events with frame 0 are applied at
+ * the next period interrupt. The ring is full if (head + 1) % size ==
+ * tail. Invalid events are skipped and counted.
+ */
+
+#define HDSPE_MIXER_RING_VERSION 1
+#define HDSPE_MIXER_RING_OFFSET  0x10000
+#define HDSPE_MIXER_RING_BYTES   0x10000
+
+struct hdspe_mixer_event {
+	uint64_t frame;          /* target frame count, 0 for asap */
+	uint16_t output;         /* 0 .. HDSPE_MIXER_CHANNELS-1 */
+	uint16_t source;         /* input, or HDSPE_MIXER_CHANNELS + playback */
+	uint16_t gain;           /* HDSPE_UNITY_GAIN is 0 dB */
+	uint16_t reserved;
+};
+
+struct hdspe_mixer_ring {
+	/* Written by user space. */
+	uint32_t head;           /* next event to fill */
+	uint32_t reserved0[15];
+
+	/* Written by the driver. */
+	uint32_t tail;           /* next event to apply */
+	uint32_t version;        /* HDSPE_MIXER_RING_VERSION */
+	uint32_t size;           /* number of events in the ring */
+	uint32_t invalid;        /* number of invalid events skipped */
+	uint64_t applied;        /* number of events applied */
+	uint64_t frame;          /* frame count at the last batch */
+	uint32_t reserved1[8];
+
+	struct hdspe_mixer_event event[];
+};
+
+/* ------------- Clock reference statistics IOCTL --------------- */
+
+/*
+ * Frequency and stability of the clock references, measured at every
+ * audio period interrupt while enabled:
+ * - the system clock, from the PLL readback (locked to the current
+ *   AutoSync reference, or the internal clock),
+ * - the TCO word clock / video input, from the TCO fs period counter.
+ * Deviations are relative to the nearest standard sample rate, in parts
+ * per billion. The Allan deviation is estimated for each configured
+ * averaging window from consecutive window averages, with an exponential
+ * moving average over the last ~16 window pairs. Statistics of a meter
+ * restart when its nominal rate changes.
+ */
+
+#define HDSPE_REF_STATS_WINDOWS 4
+
+enum hdspe_ref_meter_id {
+	HDSPE_REF_METER_SYSTEM     = 0,
+	HDSPE_REF_METER_TCO        = 1,
+	HDSPE_REF_METER_COUNT      = 2,
+	HDSPE_REF_METER_FORCE_32BIT= 0xffffffff
+};
+
+/* Averaging windows, in audio periods. 0 disables a window. Setting
+ * all windows to 0 stops measuring. Setting the configuration resets
+ * all statistics. */
+struct hdspe_ref_stats_config {
+	uint32_t window[HDSPE_REF_STATS_WINDOWS];
+};
+
+struct hdspe_ref_meter_stats {
+	uint64_t count;            /* number of measurements, 0 if none */
+	uint64_t freq;             /* last measured frequency, in mHz */
+	uint32_t nominal_rate;     /* nearest standard sample rate, in Hz */
+	int32_t  dev;              /* last deviation from nominal, ppb */
+	int32_t  dev_min;          /* minimum deviation, ppb */
+	int32_t  dev_max;          /* maximum deviation, ppb */
+	uint32_t adev[HDSPE_REF_STATS_WINDOWS]; /* Allan deviation, ppb */
+	uint32_t adev_count[HDSPE_REF_STATS_WINDOWS]; /* window pairs seen */
+};
+
+struct hdspe_ref_stats {
+	// API version (this structs size and layout may change with version)
+	uint32_t                      version;
+	enum hdspe_clock_source       autosync_ref;  /* system clock source */
+	struct hdspe_ref_stats_config config;
+	struct hdspe_ref_meter_stats  meter[HDSPE_REF_METER_COUNT];
+};
+
+#define SNDRV_HDSPE_IOCTL_SET_REF_STATS \
+	_IOW('H', 0x4a, struct hdspe_ref_stats_config)
+#define SNDRV_HDSPE_IOCTL_GET_REF_STATS \
+	_IOR('H', 0x4b, struct hdspe_ref_stats)
+
+/* ------------- AES channel status side channel --------------- */
+
+/*
+ * With Clear TMS off, captured samples carry the AES channel status and
+ * user bits in their least significant byte. The driver can assemble
+ * them into 192-bit blocks for selected capture channels, while capture
+ * is running in 32-bit integer format. Blocks are read from the hwdep
+ * device as struct hdspe_aes_cs records. read() returns whole records
+ * only, or -EAGAIN if none are available. Use poll() to wait for them.
+ */
+
+struct hdspe_aes_cs_config {
+	uint64_t channels;    /* bit i selects capture channel i, 0 = off */
+	uint32_t mask;        /* clear the status bits in the captured audio */
+	uint32_t reserved;
+};
+
+struct hdspe_aes_cs {
+	uint32_t channel;     /* capture channel */
+	uint32_t lost;        /* total blocks lost so far, reader too slow */
+	uint64_t frame;       /* frame count (LTC time) at block start */
+	uint8_t  status[24];  /* channel status, bit 0 of byte 0 first */
+	uint8_t  user[24];    /* user bits, idem */
+};
+
+#define SNDRV_HDSPE_IOCTL_SET_AES_CS \
+	_IOW('H', 0x4c, struct hdspe_aes_cs_config)
+
+/* ------------- Frame-scheduled control changes IOCTL --------------- */
+
+/*
+ * SNDRV_HDSPE_IOCTL_SCHEDULE_CTL queues a value change of the control
+ * element with given numid, for the first period boundary at or after
+ * the given frame count (LTC time, see the 'LTC Time' control). Boolean,
+ * integer, enumerated and 64-bit integer elements with up to
+ * HDSPE_SCHED_CTL_VALUES values can be scheduled. All values of the
+ * element are set. Elements that are read-only or locked by a control
+ * file (SNDRV_CTL_IOCTL_ELEM_LOCK) are refused with -EPERM, when
+ * scheduling and when applying the change. Values out of the range of
+ * the element are refused with -EINVAL. The returned seq identifies
+ * the change for SNDRV_HDSPE_IOCTL_GET_SCHED_CTL, which reports the frame
+ * count at which it was applied, and the result: -EINPROGRESS while
+ * pending, 1 if the value changed, 0 if not, or a negative error code.
+ *
+ * Known limit: the period interrupt only releases a change. It is applied
+ * right after, by a kernel work item, so it takes effect at a frame that
+ * depends on scheduling, normally within the period after the boundary.
+ * 'applied' is the frame count read from the hardware buffer pointer
+ * right after the new value was written, so 'applied - frame' is the
+ * actual lateness. Changes that need to be sample accurate must be set
+ * up ahead of time with other means, like the LTC output start.
+ *
+ * At most 64 changes are kept, pending or done: SCHEDULE_CTL returns
+ * -EBUSY if all of them are pending. GET_SCHED_CTL returns -ENOENT once
+ * the slot of a change done has been reused.
+ */
+
+#define HDSPE_SCHED_CTL_VALUES 4
+
+struct hdspe_sched_ctl {
+	uint32_t numid;       /* control element numid */
+	uint32_t seq;         /* sequence number, set by SCHEDULE_CTL */
+	uint64_t frame;       /* target frame count */
+	uint64_t applied;     /* frame count at which it was applied */
+	int32_t  result;      /* see above */
+	uint32_t reserved;
+	int64_t  value[HDSPE_SCHED_CTL_VALUES];
+};
+
+#define SNDRV_HDSPE_IOCTL_SCHEDULE_CTL \
+	_IOWR('H', 0x4d, struct hdspe_sched_ctl)
+#define SNDRV_HDSPE_IOCTL_GET_SCHED_CTL \
+	_IOWR('H', 0x4e, struct hdspe_sched_ctl)
+
+/* ------------------ Port latency tables IOCTL ---------------------- */
+
+/*
+ * SNDRV_HDSPE_IOCTL_GET_LATENCY reports the converter and transport
+ * latency of each logical capture (in) and playback (out) channel, in
+ * samples at the sample rate, for the given speed mode, or the current
+ * speed mode if speed is HDSPE_SPEED_INVALID. This is on top of the DMA
+ * buffer latency reported by ALSA. Values are nominal unless they were
+ * calibrated with the 'Input Latency' and 'Output Latency' controls.
+ * Channels beyond in_channels / out_channels report 0.
+ */
+
+struct hdspe_latency {
+	uint32_t speed;          /* enum hdspe_speed, in and out */
+	uint32_t in_channels;    /* logical capture channels */
+	uint32_t out_channels;   /* logical playback channels */
+	uint32_t reserved;
+	uint16_t in[HDSPE_MAX_CHANNELS];
+	uint16_t out[HDSPE_MAX_CHANNELS];
+};
+
+#define SNDRV_HDSPE_IOCTL_GET_LATENCY \
+	_IOWR('H', 0x4f, struct hdspe_latency)
+
+/* ------------------- DMA buffer export IOCTLs ---------------------- */
+
+/*
+ * SNDRV_HDSPE_IOCTL_EXPORT_DMABUF returns a dma-buf file descriptor for
+ * the playback (stream 0) or capture (stream 1) DMA area of PCM device 0,
+ * for other processes (mmap()) and devices (dma_buf_attach()) to consume
+ * or produce audio in place. The area holds HDSPE_MAX_CHANNELS rings of
+ * channel_bytes each, one per DMA channel. offset[] is the byte offset of
+ * the ring of each logical channel at the current speed mode, or -1.
+ * Rings hold buffer_frames 32-bit samples, integer or float as the card
+ * is set to. Audio is transferred only while the PCM stream (or, for
+ * capture, a shared capture) has hw_params set. Fails with EBUSY unless
+ * the caller has exclusive use of the card and the stream is not open by
+ * another process. When the card goes away, the dma-buf is revoked:
+ * mappings are removed and further access fails.
+ *
+ * SNDRV_HDSPE_IOCTL_GET_DMA_POS returns the hardware position in the
+ * rings, and the frame count, which is only valid while period
+ * interrupts are on (running is nonzero).
+ */
+
+struct hdspe_dmabuf {
+	uint32_t stream;         /* in: SNDRV_PCM_STREAM_* */
+	int32_t  fd;             /* out: dma-buf file descriptor */
+	uint64_t size;           /* out: DMA area size, in bytes */
+	uint32_t channel_bytes;  /* out: ring stride, in bytes */
+	uint32_t buffer_frames;  /* out: ring size, in frames */
+	uint32_t channels;       /* out: logical channels */
+	uint32_t float_format;   /* out: 1 if 32-bit float, 0 if integer */
+	int32_t  offset[HDSPE_MAX_CHANNELS];
+};
+
+struct hdspe_dma_pos {
+	uint64_t frame;          /* frame count */
+	uint64_t time_ns;        /* CLOCK_MONOTONIC time of reading */
+	uint32_t hw_pointer;     /* position in the rings, in frames */
+	uint32_t buffer_frames;  /* ring size, in frames */
+	uint32_t running;        /* period interrupts on: frame is valid */
+	uint32_t reserved;
+};
+
+#define SNDRV_HDSPE_IOCTL_EXPORT_DMABUF \
+	_IOWR('H', 0x50, struct hdspe_dmabuf)
+#define SNDRV_HDSPE_IOCTL_GET_DMA_POS \
+	_IOR('H', 0x51, struct hdspe_dma_pos)
+
+/* ------------------- Video frame timeline IOCTL -------------------- */
+
+/*
+ * SNDRV_HDSPE_IOCTL_GET_VIDEO_FRAME looks up the video frame containing
+ * audio frame 'frame' (LTC time, see the 'LTC Time' control) on the video
+ * frame timeline of the TCO module, see the 'TCO Video Timeline' control.
+ * 'frame' may be before the last video frame edge, but not more than
+ * 2^40 frames (over 60 days at 192 kHz) away from it: ERANGE. Fails with
+ * ENODEV without TCO module, and with ENODATA without video reference.
+ * The same timeline is in the timing page, see hdspe_timing_video_frame(), for
+ * clients that want to avoid the system call.
+ */
+
+struct hdspe_video_frame {
+	uint64_t frame;          /* in: audio frame count */
+	int64_t  index;          /* out: index of the video frame */
+	uint64_t edge;           /* out: frame count at its leading edge */
+	uint32_t phase;          /* out: its cadence phase, 0 .. spf_den-1 */
+	uint32_t spf_num;        /* out: audio frames per video frame, as */
+	uint32_t spf_den;        /* ... the fraction spf_num / spf_den */
+	uint32_t ltc_aligned;    /* out: 1 if edges are aligned to LTC in */
+};
+
+#define SNDRV_HDSPE_IOCTL_GET_VIDEO_FRAME \
+	_IOWR('H', 0x52, struct hdspe_video_frame)
+
+/* ----------------------- Timing page -------------------------------- */
+
+/*
+ * The hwdep device can be mmap()ed read-only, one page at offset 0, for
+ * struct hdspe_timing, which the interrupt handler updates at every period
+ * interrupt. Stale while period interrupts are off: see irq_time_ns.
+ * Read it like a seqcount:
+ *
+ *	do {
+ *		seq = __atomic_load_n(&t->seq, __ATOMIC_ACQUIRE);
+ *		copy = *t;
+ *		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+ *	} while ((seq & 1) || seq != __atomic_load_n(&t->seq,
+ *						      __ATOMIC_RELAXED));
+ */
+
+#define HDSPE_TIMING_VERSION 2    /* 2: video frame timeline */
+
+struct hdspe_timing {
+	uint32_t seq;             /* odd while being updated */
+	uint32_t version;         /* HDSPE_TIMING_VERSION */
+	uint64_t frame_count;     /* frame count at the last period interrupt */
+	uint64_t irq_time_ns;     /* CLOCK_MONOTONIC time of that interrupt */
+	uint64_t irq_count;       /* number of period interrupts */
+	uint32_t buf_ptr;         /* raw status register BUF_PTR field */
+	uint32_t hw_pointer;      /* hardware pointer, in frames */
+	uint32_t buffer_size;     /* hardware buffer size, in frames */
+	uint32_t period_size;     /* hardware period size, in frames */
+	uint32_t pcm_period_size; /* ALSA period size, in frames */
+	uint32_t running;         /* bit 0: playback, 1: capture, 2..: shared */
+	uint64_t rate_num;        /* sample rate is rate_num / rate_den, see */
+	uint64_t rate_den;        /* ... the 'Raw Sample Rate' control. rate_den
+				   * is read when period interrupts are
+				   * enabled, and at each status check
+				   * ('Status Polling' control) */
+	uint32_t tco;             /* TCO present: ltc fields are valid */
+	uint32_t ltc;             /* current LTC in, see 'LTC In' control */
+	uint64_t ltc_frame_count; /* frame count at the start of ltc */
+	uint64_t video_edge;      /* TCO video frame timeline, as in the */
+	uint64_t video_frame;     /* ... 'TCO Video Timeline' control: */
+	uint32_t video_spf_num;   /* ... video_spf_num is 0 without TCO */
+	uint32_t video_spf_den;   /* ... or video reference */
+	uint32_t video_edge_rem;
+	uint32_t video_phase;
+};
+
+/* Index of the video frame containing audio frame <frame>, from a copy of
+ * the timing page with t->video_spf_num != 0. Same result as
+ * SNDRV_HDSPE_IOCTL_GET_VIDEO_FRAME, in O(1) and without system call. */
+static inline int64_t hdspe_timing_video_frame(const struct hdspe_timing* t,
+					       uint64_t frame)
+{
+	int64_t x = ((int64_t)(frame - t->video_edge) + 1) * t->video_spf_den
+		- t->video_edge_rem - 1;
+	int64_t q = x / (int64_t)t->video_spf_num;
+
+	if (x < 0 && q * (int64_t)t->video_spf_num != x)
+		q--;
+	return (int64_t)t->video_frame + q;
+}
+
+/* ----------------------- LTC codes ---------------------------------- */
+
+/*
+ * The 'LTC In', 'LTC Out' and 'LTC Out Status' controls carry the 64 data
+ * bits of the SMPTE 12-1 code. The TCO module, the timing page and the
+ * time code arithmetic in hdspe_ltc_math.c use a 32-bit code holding the
+ * time digits only: the user bits are dropped, and are 0 when expanding.
+ */
+static inline uint64_t hdspe_ltc32_to_ltc64(uint32_t ltc)
+{
+	return ((uint64_t)(ltc & 0xf0000000) << 28) |
+	       ((uint64_t)(ltc & 0x0f000000) << 24) |
+	       ((uint64_t)(ltc & 0x00f00000) << 20) |
+	       ((uint64_t)(ltc & 0x000f0000) << 16) |
+	       ((uint64_t)(ltc & 0x0000f000) << 12) |
+	       ((uint64_t)(ltc & 0x00000f00) <<  8) |
+	       ((uint64_t)(ltc & 0x000000f0) <<  4) |
+	       ((uint64_t)(ltc & 0x0000000f) <<  0);
+}
+
+static inline uint32_t hdspe_ltc64_to_ltc32(uint64_t tc)
+{
+	return ((tc >> 28) & 0xf0000000) |
+	       ((tc >> 24) & 0x0f000000) |
+	       ((tc >> 20) & 0x00f00000) |
+	       ((tc >> 16) & 0x000f0000) |
+	       ((tc >> 12) & 0x0000f000) |
+	       ((tc >>  8) & 0x00000f00) |
+	       ((tc >>  4) & 0x000000f0) |
+	       ((tc >>  0) & 0x0000000f);
+}
+
 /* typedefs for compatibility to user-space */
 typedef struct hdspe_peak_rms hdspe_peak_rms_t;
 typedef struct hdspe_config_info hdspe_config_info_t;
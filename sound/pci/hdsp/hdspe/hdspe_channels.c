@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * hdspe_channels.c
+ * @brief RME HDSPe derived channel map tables.
+ *
+ * The model tables (hdspe_tables) map logical channels to DMA channels,
+ * per speed mode. At initialization, the inverse maps (DMA channel to
+ * logical channel), the port of each logical channel and the bitmaps of
+ * DMA channels in use are derived from them, for each speed mode, and
+ * checked for consistency. The driver refuses a card whose tables do not
+ * pass: a DMA channel mapped twice would have two ALSA channels share a
+ * buffer, or the mixer mute a channel in use.
+ *
+ * A speed mode change then switches tables, and the mixer only touches
+ * the channels in the difference of the old and new bitmaps, see
+ * hdspe_mixer_update_channel_map().
+ */
+
+#include "hdspe.h"
+#include "hdspe_core.h"
+
+#include <linux/bitmap.h>
+
+/* Length of the port part of a port name: up to the '.' */
+static size_t hdspe_port_len(const char* name)
+{
+	const char* dot = strchr(name, '.');
+
+	return dot ? dot - name : strlen(name);
+}
+
+static int hdspe_init_channel_map(struct hdspe* hdspe,
+				  struct hdspe_channel_map* m,
+				  const char* what,
+				  const signed char* dma,
+				  const char * const *names,
+				  unsigned int channels)
+{
+	const char* port = NULL;
+	size_t port_len = 0;
+	unsigned int i, mapped = 0;
+
+	memset(m, 0, sizeof(*m));
+	memset(m->logical, -1, sizeof(m->logical));
+
+	if (channels > HDSPE_MAX_CHANNELS || (channels > 0 && !dma)) {
+		dev_err(hdspe->card->dev, "%s: bad channel count %u.\n",
+			what, channels);
+		return -EINVAL;
+	}
+	m->channels = channels;
+
+	for (i = 0; i < channels; i++) {
+		int d = dma[i];
+
+		if (!names || !names[i]) {
+			dev_err(hdspe->card->dev, "%s: channel %u has no name.\n",
+				what, i);
+			return -EINVAL;
+		}
+		if (!port || hdspe_port_len(names[i]) != port_len ||
+		    strncmp(names[i], port, port_len) != 0) {
+			port = names[i];
+			port_len = hdspe_port_len(port);
+			m->ports++;
+		}
+		m->port[i] = m->ports - 1;
+
+		if (d < 0)
+			continue;	/* not available in this mode */
+		if (d >= HDSPE_MAX_CHANNELS) {
+			dev_err(hdspe->card->dev,
+				"%s: channel %u maps to DMA channel %d.\n",
+				what, i, d);
+			return -EINVAL;
+		}
+		if (m->logical[d] >= 0) {
+			dev_err(hdspe->card->dev,
+				"%s: channels %d and %u share DMA channel %d.\n",
+				what, m->logical[d], i, d);
+			return -EINVAL;
+		}
+		m->logical[d] = i;
+		__set_bit(d, m->used);
+		mapped++;
+	}
+
+	/* Self-check: the maps are each others inverse. */
+	for (i = 0; i < HDSPE_MAX_CHANNELS; i++) {
+		int l = m->logical[i];
+		if (test_bit(i, m->used) != (l >= 0) ||
+		    (l >= 0 && dma[l] != i)) {
+			dev_err(hdspe->card->dev,
+				"%s: inverse map mismatch at DMA channel %u.\n",
+				what, i);
+			return -EINVAL;
+		}
+	}
+	if (bitmap_weight(m->used, HDSPE_MAX_CHANNELS) != mapped) {
+		dev_err(hdspe->card->dev, "%s: used channel count mismatch.\n",
+			what);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+int hdspe_init_channel_maps(struct hdspe* hdspe)
+{
+	struct hdspe_tables* t = &hdspe->t;
+	int err;
+
+	err = hdspe_init_channel_map(hdspe, &hdspe->chmap_in[HDSPE_SPEED_SINGLE],
+				     "ss in", t->channel_map_in_ss,
+				     t->port_names_in_ss, t->ss_in_channels);
+	if (err < 0)
+		return err;
+	err = hdspe_init_channel_map(hdspe, &hdspe->chmap_out[HDSPE_SPEED_SINGLE],
+				     "ss out", t->channel_map_out_ss,
+				     t->port_names_out_ss, t->ss_out_channels);
+	if (err < 0)
+		return err;
+	err = hdspe_init_channel_map(hdspe, &hdspe->chmap_in[HDSPE_SPEED_DOUBLE],
+				     "ds in", t->channel_map_in_ds,
+				     t->port_names_in_ds, t->ds_in_channels);
+	if (err < 0)
+		return err;
+	err = hdspe_init_channel_map(hdspe, &hdspe->chmap_out[HDSPE_SPEED_DOUBLE],
+				     "ds out", t->channel_map_out_ds,
+				     t->port_names_out_ds, t->ds_out_channels);
+	if (err < 0)
+		return err;
+	err = hdspe_init_channel_map(hdspe, &hdspe->chmap_in[HDSPE_SPEED_QUAD],
+				     "qs in", t->channel_map_in_qs,
+				     t->port_names_in_qs, t->qs_in_channels);
+	if (err < 0)
+		return err;
+	return hdspe_init_channel_map(hdspe, &hdspe->chmap_out[HDSPE_SPEED_QUAD],
+				      "qs out", t->channel_map_out_qs,
+				      t->port_names_out_qs, t->qs_out_channels);
+}
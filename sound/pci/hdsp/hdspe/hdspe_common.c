@@ -275,7 +275,8 @@ void hdspe_dds_range(struct hdspe* hdspe, u32* min, u32* max)
 {
 	u64 fconst = freq_const[hdspe->io_type];
 	*min = (u32)div_u64(fconst, 51750); /* 207kHz / 4 */
-	*max = (u32)div_u64(fconst, 27000);
+	/* The MADIface period at 27 kHz does not fit the 32-bit register. */
+	*max = (u32)min_t(u64, div_u64(fconst, 27000), U32_MAX);
 }
 
 u32 hdspe_get_dds(struct hdspe* hdspe)
@@ -330,13 +331,21 @@ u32 hdspe_read_system_sample_rate(struct hdspe* hdspe)
 	return hdspe_dds_sample_rate(hdspe, hdspe_read_pll_freq(hdspe));
 }
 
-void hdspe_read_sample_rate_status(struct hdspe* hdspe,
-				   struct hdspe_status* status)
+/* Sample rate is numerator / hdspe_read_pll_freq(). */
+u64 hdspe_sample_rate_numerator(struct hdspe* hdspe)
 {
 	struct hdspe_control_reg_common control = hdspe->reg.control.common;
-	status->sample_rate_numerator = freq_const[hdspe->io_type] *
+	return freq_const[hdspe->io_type] *
 		(control.qs ? 4 : control.ds ? 2 : 1);
+}
+
+void hdspe_read_sample_rate_status(struct hdspe* hdspe,
+				   struct hdspe_status* status)
+{
+	status->sample_rate_numerator = hdspe_sample_rate_numerator(hdspe);
 	status->sample_rate_denominator = hdspe_read_pll_freq(hdspe);
+	/* The timing page rate, not read at every period interrupt. */
+	WRITE_ONCE(hdspe->timing_pll_freq, status->sample_rate_denominator);
 	status->internal_sample_rate_denominator =
 		le32_to_cpu(hdspe->reg.pll_freq);
 	status->buffer_size = hdspe_period_size(hdspe);
@@ -345,6 +354,144 @@ void hdspe_read_sample_rate_status(struct hdspe* hdspe,
 	status->playback_pid = hdspe->playback_pid;
 }
 
+u32 hdspe_nominal_sample_rate(u32 rate)
+{
+	u32 best = 0;
+	enum hdspe_freq f;
+
+	for (f = HDSPE_FREQ_32KHZ; f <= HDSPE_FREQ_192KHZ; f++) {
+		u32 r = hdspe_freq_sample_rate(f);
+		if (abs((int)r - (int)rate) < abs((int)best - (int)rate))
+			best = r;
+	}
+	return best;
+}
+
+int hdspe_ref_stats_configure(struct hdspe* hdspe,
+			      const struct hdspe_ref_stats_config* cfg)
+{
+	bool enable = false;
+	int i;
+
+	for (i = 0; i < HDSPE_REF_STATS_WINDOWS; i++) {
+		if (cfg->window[i] > 1000000)
+			return -EINVAL;
+		if (cfg->window[i] > 0)
+			enable = true;
+	}
+
+	spin_lock_irq(&hdspe->lock);
+	memcpy(hdspe->ref_window, cfg->window, sizeof(hdspe->ref_window));
+	memset(hdspe->ref_meter, 0, sizeof(hdspe->ref_meter));
+	if (enable && !hdspe->ref_stats)
+		hdspe_period_irq_get(hdspe);
+	else if (!enable && hdspe->ref_stats)
+		hdspe_period_irq_put(hdspe);
+	hdspe->ref_stats = enable;
+	spin_unlock_irq(&hdspe->lock);
+
+	return 0;
+}
+
+void hdspe_ref_stats_read(struct hdspe* hdspe, struct hdspe_ref_stats* s)
+{
+	int i, j;
+
+	memset(s, 0, sizeof(*s));
+	s->version = HDSPE_VERSION;
+	s->autosync_ref = hdspe->m.get_autosync_ref(hdspe);
+
+	spin_lock_irq(&hdspe->lock);
+	memcpy(s->config.window, hdspe->ref_window, sizeof(s->config.window));
+	for (i = 0; i < HDSPE_REF_METER_COUNT; i++) {
+		struct hdspe_ref_meter* m = &hdspe->ref_meter[i];
+		struct hdspe_ref_meter_stats* o = &s->meter[i];
+
+		o->count = m->count;
+		o->freq = m->freq;
+		o->nominal_rate = m->nominal;
+		o->dev = m->dev;
+		o->dev_min = m->dev_min;
+		o->dev_max = m->dev_max;
+		for (j = 0; j < HDSPE_REF_STATS_WINDOWS; j++) {
+			o->adev[j] = int_sqrt64(m->win[j].avar);
+			o->adev_count[j] = m->win[j].count;
+		}
+	}
+	spin_unlock_irq(&hdspe->lock);
+}
+
+/* Add a measured frequency <freq> (mHz) to the statistics of meter <m>.
+ * The Allan variance of a window is half the mean square difference of
+ * consecutive window averages, here as a moving average with weight
+ * 1/16. */
+static void hdspe_ref_meter_update(struct hdspe* hdspe,
+				   struct hdspe_ref_meter* m, u64 freq)
+{
+	u32 nominal = hdspe_nominal_sample_rate(div_u64(freq + 500, 1000));
+	s32 dev;
+	int i;
+
+	if (nominal != m->nominal) {
+		memset(m, 0, sizeof(*m));
+		m->nominal = nominal;
+	}
+
+	dev = div_s64(((s64)freq - (s64)nominal * 1000) * 1000000, nominal);
+	m->freq = freq;
+	m->dev = dev;
+	if (m->count == 0 || dev < m->dev_min)
+		m->dev_min = dev;
+	if (m->count == 0 || dev > m->dev_max)
+		m->dev_max = dev;
+	m->count++;
+
+	for (i = 0; i < HDSPE_REF_STATS_WINDOWS; i++) {
+		struct hdspe_ref_window* w = &m->win[i];
+		u32 len = hdspe->ref_window[i];
+		s64 avg, d;
+		u64 var;
+
+		if (len == 0)
+			continue;
+		w->sum += dev;
+		if (++w->n < len)
+			continue;
+
+		avg = div_s64(w->sum, len);
+		if (w->have_prev) {
+			d = avg - w->prev;
+			var = (u64)(d * d) / 2;
+			w->avar = w->count == 0 ? var :
+				w->avar - (w->avar >> 4) + (var >> 4);
+			w->count++;
+		}
+		w->prev = avg;
+		w->have_prev = true;
+		w->n = 0;
+		w->sum = 0;
+	}
+}
+
+void hdspe_ref_stats_period(struct hdspe* hdspe)
+{
+	struct hdspe_control_reg_common control = hdspe->reg.control.common;
+	u32 dds = hdspe_read_pll_freq(hdspe);
+	u64 tco = hdspe->tco ? hdspe_tco_fs_freq(hdspe) : 0;
+
+	spin_lock(&hdspe->lock);
+	if (dds != 0)
+		hdspe_ref_meter_update(hdspe,
+			&hdspe->ref_meter[HDSPE_REF_METER_SYSTEM],
+			mul_u64_u32_div(freq_const[hdspe->io_type],
+					1000 * (control.qs ? 4 : control.ds ? 2 : 1),
+					dds));
+	if (tco != 0)
+		hdspe_ref_meter_update(hdspe,
+			&hdspe->ref_meter[HDSPE_REF_METER_TCO], tco);
+	spin_unlock(&hdspe->lock);
+}
+
 static int hdspe_write_system_sample_rate(struct hdspe* hdspe, u32 rate)
 {
 	int changed = false;
@@ -400,8 +547,16 @@ void hdspe_set_channel_map(struct hdspe* hdspe, enum hdspe_speed speed)
 
 	default: {}
 	};
+	if (speed < HDSPE_SPEED_COUNT)
+		hdspe->channel_map_speed = speed;
 
 	hdspe_mixer_update_channel_map(hdspe);
+
+	/* Port latencies follow the speed mode. */
+	if (hdspe->cid.latency_in) {
+		HDSPE_CTL_NOTIFY(latency_in);
+		HDSPE_CTL_NOTIFY(latency_out);
+	}
 }
 
 int hdspe_set_sample_rate(struct hdspe * hdspe, u32 desired_rate)
@@ -129,7 +129,31 @@ int hdspe_control_put(struct snd_kcontrol *kcontrol, int val,
 
 /* -------------- status polling ------------------- */
 
-HDSPE_RW_INT1_HDSPE_METHODS(status_polling, 0, HZ, 1)
+/* Status polling runs off the period interrupt. Called with hdspe->lock
+ * held. */
+HDSPE_GETTER(status_polling)
+
+static int hdspe_put_status_polling(struct hdspe* hdspe, int val)
+{
+	int changed = val != hdspe->status_polling;
+	if (val > 0 && hdspe->status_polling == 0)
+		hdspe_period_irq_get(hdspe);
+	else if (val == 0 && hdspe->status_polling > 0)
+		hdspe_period_irq_put(hdspe);
+	hdspe->status_polling = val;
+	return changed;
+}
+
+HDSPE_RW_INT1_METHODS(status_polling, 0, HZ, 1,
+		      hdspe_get_status_polling, hdspe_put_status_polling, false)
+
+static void hdspe_stop_status_polling(struct hdspe* hdspe)
+{
+	spin_lock_irq(&hdspe->lock);
+	hdspe_put_status_polling(hdspe, 0); /* user must re-enable */
+	spin_unlock_irq(&hdspe->lock);
+	HDSPE_CTL_NOTIFY(status_polling);
+}
 
 void hdspe_status_work(struct work_struct *work)
 {
@@ -198,16 +222,14 @@ void hdspe_status_work(struct work_struct *work)
 
 	if (changed) {
 		hdspe->last_status_change_jiffies = 0;
-		hdspe->status_polling = 0; /* disable - user must re-enable */
-		HDSPE_CTL_NOTIFY(status_polling);
+		hdspe_stop_status_polling(hdspe);
 	} else if (jiffies > hdspe->last_status_change_jiffies + 2*HZ) {
 		dev_dbg(hdspe->card->dev,
 			"%s: polling timeout expired: jiffies=%lu, last_status_change_jiffied=%lu, delta=%ld, 2*HZ=%d.\n", __func__,
 			jiffies, hdspe->last_status_change_jiffies,
 			jiffies - hdspe->last_status_change_jiffies, 2*HZ);
 		hdspe->last_status_change_jiffies = 0;
-		hdspe->status_polling = 0; /* disable - user must re-enable */
-		HDSPE_CTL_NOTIFY(status_polling);
+		hdspe_stop_status_polling(hdspe);
 	}
 }
 
@@ -876,6 +898,16 @@ int snd_hdspe_create_controls(struct snd_card *card,
 	if (err < 0)
 		return err;
 
+	/* Port latency controls, in hdspe_latency.c */
+	err = hdspe_create_latency_controls(hdspe);
+	if (err < 0)
+		return err;
+
+	/* Capture side channel controls, in hdspe_tms.c */
+	err = hdspe_create_tms_controls(hdspe);
+	if (err < 0)
+		return err;
+
 	/* TCO controls, in hdspe_tco.c */
 	if (hdspe->tco) {
 		err = hdspe_create_tco_controls(hdspe);
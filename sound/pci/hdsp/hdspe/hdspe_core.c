@@ -40,6 +40,7 @@
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/pci.h>
+#include <linux/platform_device.h>
 
 #include <sound/pcm.h>
 #include <sound/initval.h>
@@ -59,6 +60,22 @@ MODULE_PARM_DESC(id, "ID string for RME HDSPE interface.");
 module_param_array(enable, bool, NULL, 0444);
 MODULE_PARM_DESC(enable, "Enable/disable specific HDSPE soundcards.");
 
+static uint monitoring = HDSPE_MONITOR_DAW;
+
+module_param(monitoring, uint, 0444);
+MODULE_PARM_DESC(monitoring, "Initial hardware monitoring profile: 0 off, 1 DAW (default), 2 passthrough, 3 both.");
+
+#ifdef CONFIG_SND_HDSPE_EMU
+static char *emulate;			  /* card model to emulate */
+static bool emulate_tco;		  /* with TCO module */
+
+module_param(emulate, charp, 0444);
+MODULE_PARM_DESC(emulate, "Create an emulated card: madi, aes, raydat, aio or aio_pro.");
+
+module_param(emulate_tco, bool, 0444);
+MODULE_PARM_DESC(emulate_tco, "Emulated card has a TCO module.");
+#endif /*CONFIG_SND_HDSPE_EMU*/
+
 
 MODULE_AUTHOR
 (
@@ -76,12 +93,6 @@ MODULE_LICENSE("GPL");
 // This driver can obsolete old snd-hdspm driver.
 MODULE_ALIAS("snd-hdspm");
 
-
-/* RME PCI vendor ID as it is reported by the RME AIO PRO card */
-#ifndef PCI_VENDOR_ID_RME
-#define PCI_VENDOR_ID_RME 0x1d18
-#endif /*PCI_VENDOR_ID_RME*/
-
 static const struct pci_device_id snd_hdspe_ids[] = {
 	{.vendor = PCI_VENDOR_ID_XILINX,
 	 .device = PCI_DEVICE_ID_XILINX_HAMMERFALL_DSP_MADI,
@@ -103,20 +114,33 @@ static const struct pci_device_id snd_hdspe_ids[] = {
 MODULE_DEVICE_TABLE(pci, snd_hdspe_ids);
 
 
-/* interrupt handler */
+/* interrupt handler. hdspe_period_irq_get() and hdspe_period_irq_put()
+ * update the frame counter under hdspe->lock, possibly on another CPU, so
+ * status0 is read and the frame counter updated under that lock here too.
+ * A status0 value read before taking the lock could undo a frame counter
+ * resync done meanwhile, or have a hardware pointer wrap counted twice.
+ * The MIDI input interrupt enables in the control register shadow are
+ * changed under hdspe->lock as well, like IE_AUDIO. */
 static irqreturn_t snd_hdspe_interrupt(int irq, void *dev_id)
 {
 	struct hdspe *hdspe = (struct hdspe *) dev_id;
+	union hdspe_status0_reg status0;
 	int i, audio, midi, schedule = 0;
 
-	hdspe->reg.status0 = hdspe_read_status0_nocache(hdspe);
+	spin_lock(&hdspe->lock);
+	status0 = hdspe->reg.status0 = hdspe_read_status0_nocache(hdspe);
+
+	audio = status0.common.IRQ;
+	midi = status0.raw & hdspe->midiIRQPendingMask;
+	hdspe_irq_phase(hdspe, HDSPE_IRQ_STATUS0);
 
-	audio = hdspe->reg.status0.common.IRQ;
-	midi = hdspe->reg.status0.raw & hdspe->midiIRQPendingMask;
+	if (audio)
+		hdspe_update_frame_count(hdspe);
+	spin_unlock(&hdspe->lock);
 
 #ifdef TIME_INTERRUPT_INTERVAL
 	u64 now = ktime_get_raw_fast_ns();
-	dev_dbg(hdspe->card->dev, "snd_hdspe_interrupt %10llu us LAT=%d	BUF_PTR=%05u BUF_ID=%u %s\n",
+	hdspe_dbg_hot(hdspe, "snd_hdspe_interrupt %10llu us LAT=%d	BUF_PTR=%05u BUF_ID=%u %s\n",
 		(now - hdspe->last_interrupt_time) / 1000,
 		hdspe->reg.control.common.LAT,
 		le16_to_cpu(hdspe->reg.status0.common.BUF_PTR)<<6,
@@ -136,20 +160,42 @@ static irqreturn_t snd_hdspe_interrupt(int irq, void *dev_id)
 
 		hdspe_write(hdspe, HDSPE_interruptConfirmation, 0);
 		hdspe->irq_count++;
-		
-		hdspe_update_frame_count(hdspe);
+		hdspe_irq_phase(hdspe, HDSPE_IRQ_FRAME_COUNT);
 
 		if (hdspe->tco) {
 			/* LTC In update must happen before user
 			 * space is notified of a new period */
 			hdspe_tco_period_elapsed(hdspe);
 		}
+		hdspe_irq_phase(hdspe, HDSPE_IRQ_TCO);
+
+		if (hdspe->ref_stats)
+			hdspe_ref_stats_period(hdspe);
 
-		if (hdspe->capture_substream)
-			snd_pcm_period_elapsed(hdspe->capture_substream);
+		hdspe_timing_update(hdspe);
 
-		if (hdspe->playback_substream)
-			snd_pcm_period_elapsed(hdspe->playback_substream);
+		/* Before user space gets to see the captured period. */
+		if (hdspe->tms)
+			hdspe_tms_period(hdspe);
+
+		if (hdspe->sched)
+			hdspe_sched_period(hdspe);
+
+		if (READ_ONCE(hdspe->mixer_ring))
+			hdspe_mixer_ring_period(hdspe);
+		hdspe_irq_phase(hdspe, HDSPE_IRQ_CLIENTS);
+
+		if (hdspe_pcm_period_elapsed(hdspe)) {
+			if (hdspe->capture_substream)
+				snd_pcm_period_elapsed(hdspe->capture_substream);
+
+			if (hdspe->playback_substream)
+				snd_pcm_period_elapsed(hdspe->playback_substream);
+		}
+
+		if (hdspe->shared_running)
+			hdspe_shared_capture_period_elapsed(hdspe);
+		hdspe_irq_phase(hdspe, HDSPE_IRQ_PCM);
 
 		/* status polling at user controlled rate */
 		if (hdspe->status_polling > 0 &&
@@ -158,6 +204,7 @@ static irqreturn_t snd_hdspe_interrupt(int irq, void *dev_id)
 			hdspe->last_status_jiffies = jiffies;
 			schedule_work(&hdspe->status_work);
 		}
+		hdspe_irq_phase(hdspe, HDSPE_IRQ_STATUS_POLL);
 	}
 
 	if (midi) {
@@ -166,10 +213,11 @@ static irqreturn_t snd_hdspe_interrupt(int irq, void *dev_id)
 		//}
 
 		schedule = 0;
+		spin_lock(&hdspe->lock);
 		for (i = 0; i < hdspe->midiPorts; i++) {
 			if ((hdspe_read(hdspe,
 					hdspe->midi[i].statusIn) & 0xff) &&
-			    (hdspe->reg.status0.raw & hdspe->midi[i].irq)) {
+			    (status0.raw & hdspe->midi[i].irq)) {
 				/* we disable interrupts for this input until
 				 * processing is done */
 				hdspe->reg.control.raw &= ~hdspe->midi[i].ie;
@@ -177,18 +225,21 @@ static irqreturn_t snd_hdspe_interrupt(int irq, void *dev_id)
 				schedule = 1;
 			}
 		}
-
-		if (schedule) {
+		if (schedule)
 			hdspe_write_control(hdspe);
+		spin_unlock(&hdspe->lock);
+
+		if (schedule)
 			queue_work(system_highpri_wq, &hdspe->midi_work);
-		}
+		hdspe_irq_phase(hdspe, HDSPE_IRQ_MIDI);
 	}
 	
 	return IRQ_HANDLED;
 }
 
-/* Start audio and TCO MTC interrupts. Other MIDI interrupts
- * are enabled when the MIDI devices are created. */
+/* Start the audio engine and TCO MTC interrupts. Audio period interrupts
+ * are enabled only if there are users, see hdspe_period_irq_get(). Other
+ * MIDI interrupts are enabled when the MIDI devices are created. */
 static void hdspe_start_interrupts(struct hdspe* hdspe)
 {
 
@@ -202,8 +253,10 @@ static void hdspe_start_interrupts(struct hdspe* hdspe)
 		hdspe->reg.control.raw |= m->ie;	
 	}
 
-	hdspe->reg.control.common.START =
-	hdspe->reg.control.common.IE_AUDIO = true;
+	hdspe->reg.control.common.START = true;
+	hdspe->reg.control.common.IE_AUDIO = hdspe->period_irq_users > 0;
+	if (!hdspe->reg.control.common.IE_AUDIO)
+		hdspe->period_irq_off_time = ktime_get();
 
 	hdspe_write_control(hdspe);
 
@@ -261,6 +314,9 @@ static int snd_hdspe_create_alsa_devices(struct snd_card *card,
 		dev_err(card->dev, "error registering card.\n");
 		return err;
 	}
+
+	/* In the card proc directory, which exists now. */
+	hdspe_mixer_proc_init(hdspe);
 	
 	dev_dbg(card->dev, "... yes now\n");
 
@@ -271,6 +327,8 @@ static int snd_hdspe_create_alsa_devices(struct snd_card *card,
  * revision and build, serial no, io_type, mixer and TCO. */
 static int hdspe_init(struct hdspe* hdspe)
 {
+	int err;
+
 	hdspe->pcm = NULL;
 	hdspe->hwdep = NULL;
 	hdspe->capture_substream = hdspe->playback_substream = NULL;
@@ -299,6 +357,10 @@ static int hdspe_init(struct hdspe* hdspe)
 	default            : snd_BUG();
 	}
 
+	err = hdspe_init_channel_maps(hdspe);      // after the model tables
+	if (err < 0)
+		return err;
+	hdspe_init_latency(hdspe);
 	hdspe_read_status0_nocache(hdspe);          // init reg.status0
 	hdspe_write_internal_pitch(hdspe, 1000000); // init reg.pll_freq
 
@@ -406,7 +468,8 @@ static int snd_hdspe_init_all(struct hdspe *hdspe)
 	int err;
 
 	/* Mixer */
-	err = hdspe_init_mixer(hdspe);
+	err = hdspe_init_mixer(hdspe, monitoring < HDSPE_MONITOR_PROFILE_COUNT
+			       ? monitoring : HDSPE_MONITOR_DAW);
 	if (err < 0)
 		return err;
 
@@ -425,40 +488,14 @@ static int snd_hdspe_init_all(struct hdspe *hdspe)
 	return 0;
 }
 
-static int snd_hdspe_create(struct hdspe *hdspe)
+/* Grab the PCI resources of a real card: memory region and interrupt. */
+static int snd_hdspe_attach_pci(struct hdspe *hdspe)
 {
 	struct snd_card *card = hdspe->card;
 	struct pci_dev *pci = hdspe->pci;
 	int err;
 	unsigned long io_extent;
 
-	hdspe->irq = -1;
-	hdspe->port = 0;
-	hdspe->iobase = NULL;
-
-	snd_hdspe_work_start(hdspe);
-
-	pci_read_config_word(hdspe->pci,
-			PCI_CLASS_REVISION, &hdspe->firmware_rev);
-	hdspe->vendor_id = pci->vendor;
-
-	dev_dbg(card->dev,
-		"PCI vendor %04x, device %04x, class revision %x\n",
-		pci->vendor, pci->device, hdspe->firmware_rev);
-	
-	strcpy(card->mixername, "RME HDSPe");
-	strcpy(card->driver, "HDSPe");
-
-	/* Determine card model */
-	hdspe->io_type = hdspe_get_io_type(hdspe->vendor_id,
-					   hdspe->firmware_rev);
-	if (hdspe->io_type == HDSPE_IO_TYPE_INVALID) {
-		dev_err(card->dev,
-			"unknown firmware revision %d (0x%x)\n",
-			hdspe->firmware_rev, hdspe->firmware_rev);
-		return -ENODEV;
-	}
-
 	/* Determine supported power states */
 
 	dev_dbg(card->dev, "Low power state D1 is supported: %u\n", pci->d1_support);
@@ -525,12 +562,56 @@ static int snd_hdspe_create(struct hdspe *hdspe)
 	hdspe->irq = pci->irq;
 	card->sync_irq = hdspe->irq;
 
+	return 0;
+}
+
+static int snd_hdspe_create(struct hdspe *hdspe)
+{
+	struct snd_card *card = hdspe->card;
+	struct pci_dev *pci = hdspe->pci;
+	int err;
+
+	hdspe->irq = -1;
+	hdspe->port = 0;
+
+	snd_hdspe_work_start(hdspe);
+
+	/* An emulated card has its model set by hdspe_emu_new() already. */
+	if (pci) {
+		pci_read_config_word(hdspe->pci,
+				PCI_CLASS_REVISION, &hdspe->firmware_rev);
+		hdspe->vendor_id = pci->vendor;
+
+		dev_dbg(card->dev,
+			"PCI vendor %04x, device %04x, class revision %x\n",
+			pci->vendor, pci->device, hdspe->firmware_rev);
+	}
+	
+	strcpy(card->mixername, "RME HDSPe");
+	strcpy(card->driver, "HDSPe");
+
+	/* Determine card model */
+	hdspe->io_type = hdspe_get_io_type(hdspe->vendor_id,
+					   hdspe->firmware_rev);
+	if (hdspe->io_type == HDSPE_IO_TYPE_INVALID) {
+		dev_err(card->dev,
+			"unknown firmware revision %d (0x%x)\n",
+			hdspe->firmware_rev, hdspe->firmware_rev);
+		return -ENODEV;
+	}
+
+	if (pci) {
+		err = snd_hdspe_attach_pci(hdspe);
+		if (err < 0)
+			return err;
+	}
+
 	/* Firmware build */
 	hdspe->fw_build = le32_to_cpu(hdspe_read(hdspe, HDSPE_RD_FLASH)) >> 12;
 	dev_dbg(card->dev, "firmware build %d\n", hdspe->fw_build);
 
 	/* Serial number */
-	if (pci->vendor == PCI_VENDOR_ID_RME || hdspe->fw_build >= 200)
+	if (hdspe->vendor_id == PCI_VENDOR_ID_RME || hdspe->fw_build >= 200)
 		hdspe->serial = snd_hdspe_get_serial_rev2(hdspe);
 	else
 		hdspe->serial = snd_hdspe_get_serial_rev1(hdspe);
@@ -570,15 +651,20 @@ static int snd_hdspe_create(struct hdspe *hdspe)
 			 "%s at 0x%lx irq %d",
 			 hdspe->card_name, hdspe->port, hdspe->irq);
 	}
+	if (hdspe_is_emulated(hdspe))
+		snprintf(card->longname, sizeof(card->longname),
+			 "%s (emulated)", hdspe->card_name);
 	
 	return 0;
 }
 
 static void snd_hdspe_work_stop(struct hdspe *hdspe)
 {
-	if (hdspe->port) 
+	if (hdspe->iobase) 
 	{
 		hdspe_stop_interrupts(hdspe);
+		if (hdspe_is_emulated(hdspe))
+			hdspe_emu_stop(hdspe);
 		cancel_work_sync(&hdspe->midi_work);
 		cancel_work_sync(&hdspe->status_work);
 	}
@@ -586,7 +672,7 @@ static void snd_hdspe_work_stop(struct hdspe *hdspe)
 
 static void snd_hdspe_deinit_all(struct hdspe *hdspe)
 {
-	if (hdspe->port) 
+	if (hdspe->iobase) 
 	{
 		hdspe_terminate(hdspe);
 		hdspe_terminate_tco(hdspe);
@@ -598,6 +684,13 @@ static int snd_hdspe_free(struct hdspe * hdspe)
 {
 	snd_hdspe_work_stop(hdspe);
 	snd_hdspe_deinit_all(hdspe);
+	hdspe_tms_free(hdspe);
+	hdspe_sched_free(hdspe);
+
+	if (hdspe_is_emulated(hdspe)) {
+		hdspe_emu_free(hdspe);
+		return 0;
+	}
 
 	if (hdspe->irq >= 0)
 		free_irq(hdspe->irq, (void *) hdspe);
@@ -608,7 +701,7 @@ static int snd_hdspe_free(struct hdspe * hdspe)
 	if (hdspe->port)
 		pci_release_regions(hdspe->pci);
 
-	if (pci_is_enabled(hdspe->pci))
+	if (hdspe->pci && pci_is_enabled(hdspe->pci))
 		pci_disable_device(hdspe->pci);
 
 	return 0;
@@ -618,8 +711,11 @@ static void snd_hdspe_card_free(struct snd_card *card)
 {
 	struct hdspe *hdspe = card->private_data;
 
-	if (hdspe)
+	if (hdspe) {
+		hdspe_dmabuf_revoke(hdspe);
 		snd_hdspe_free(hdspe);
+		hdspe_timing_free(hdspe);
+	}
 }
 
 static int snd_hdspe_probe(struct pci_dev *pci,
@@ -648,6 +744,7 @@ static int snd_hdspe_probe(struct pci_dev *pci,
 	hdspe->card = card;
 	hdspe->dev = dev;
 	hdspe->pci = pci;
+	INIT_LIST_HEAD(&hdspe->dmabufs);
 
 	err = snd_hdspe_create(hdspe);
 	if (err < 0)
@@ -670,9 +767,16 @@ free_card:
 	return err;
 }
 
+/* Card removal. Exported DMA areas do not hold up snd_card_free(). */
+static void snd_hdspe_disconnect(struct snd_card *card)
+{
+	hdspe_dmabuf_revoke(card->private_data);
+	snd_card_free(card);
+}
+
 static void snd_hdspe_remove(struct pci_dev *pci)
 {
-	snd_card_free(pci_get_drvdata(pci));
+	snd_hdspe_disconnect(pci_get_drvdata(pci));
 }
 
 #ifdef CONFIG_PM
@@ -781,13 +885,14 @@ static int snd_hdspe_resume(struct pci_dev *dev)
 	hdspe_write_settings(hdspe);
 	hdspe_write_control(hdspe);
 	hdspe_write_pll_freq(hdspe);			/* keep sample rate */
+	hdspe_tco_resume(hdspe);
 
 	/* Resume mixer? hdspe_init_mixer just allocates memory ... */
 
 	/* (5) Restart the chip or hardware */
 	/* Restart any halted hardware or operations */
 	// Technically, this redundantly sets START and IE_AUDIO in 
-	// reg.control.common to true, which already happened via 
+	// reg.control.common, which already happened via 
 	// hdspe->savedRegisters
 
 	hdspe_start_interrupts(hdspe);
@@ -938,4 +1043,132 @@ static struct pci_driver hdspe_driver = {
 #endif /* CONFIG_PM */
 };
 
-module_pci_driver(hdspe_driver);
+#ifdef CONFIG_SND_HDSPE_EMU
+/* Emulated card, see hdspe_emu.c. Created at module load time if the
+ * emulate parameter is set. */
+static int snd_hdspe_emu_probe(struct platform_device *pdev)
+{
+	struct hdspe *hdspe;
+	struct snd_card *card;
+	int err;
+
+	err = snd_card_new(&pdev->dev, SNDRV_DEFAULT_IDX1, SNDRV_DEFAULT_STR1,
+			   THIS_MODULE, sizeof(*hdspe), &card);
+	if (err < 0)
+		return err;
+
+	card->private_free = snd_hdspe_card_free;
+
+	hdspe = card->private_data;
+	hdspe->card = card;
+	INIT_LIST_HEAD(&hdspe->dmabufs);
+
+	err = hdspe_emu_new(hdspe, emulate, emulate_tco, snd_hdspe_interrupt);
+	if (err < 0)
+		goto free_card;
+
+	err = snd_hdspe_create(hdspe);
+	if (err < 0)
+		goto free_card;
+
+	err = snd_card_register(card);
+	if (err < 0)
+		goto free_card;
+
+	platform_set_drvdata(pdev, card);
+
+	hdspe_start_interrupts(hdspe);
+
+	return 0;
+
+free_card:
+	snd_card_free(card);
+	return err;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 11, 0)
+static void snd_hdspe_emu_remove(struct platform_device *pdev)
+{
+	snd_hdspe_disconnect(platform_get_drvdata(pdev));
+}
+#else
+static int snd_hdspe_emu_remove(struct platform_device *pdev)
+{
+	snd_hdspe_disconnect(platform_get_drvdata(pdev));
+	return 0;
+}
+#endif
+
+static struct platform_driver hdspe_emu_driver = {
+	.driver = {
+		.name = "snd-hdspe-emu",
+	},
+	.probe = snd_hdspe_emu_probe,
+	.remove = snd_hdspe_emu_remove,
+};
+
+static struct platform_device *hdspe_emu_device;
+
+static int snd_hdspe_emu_init(void)
+{
+	struct platform_device_info info = {
+		.name = "snd-hdspe-emu",
+		.id = PLATFORM_DEVID_NONE,
+		.dma_mask = DMA_BIT_MASK(32),
+	};
+	int err;
+
+	if (!emulate)
+		return 0;
+
+	err = platform_driver_register(&hdspe_emu_driver);
+	if (err < 0)
+		return err;
+
+	hdspe_emu_device = platform_device_register_full(&info);
+	if (IS_ERR(hdspe_emu_device)) {
+		platform_driver_unregister(&hdspe_emu_driver);
+		err = PTR_ERR(hdspe_emu_device);
+		hdspe_emu_device = NULL;
+		return err;
+	}
+
+	return 0;
+}
+
+static void snd_hdspe_emu_exit(void)
+{
+	if (!hdspe_emu_device)
+		return;
+
+	platform_device_unregister(hdspe_emu_device);
+	platform_driver_unregister(&hdspe_emu_driver);
+}
+#else
+static inline int snd_hdspe_emu_init(void) { return 0; }
+static inline void snd_hdspe_emu_exit(void) {}
+#endif /*CONFIG_SND_HDSPE_EMU*/
+
+static int __init hdspe_module_init(void)
+{
+	int err;
+
+	err = pci_register_driver(&hdspe_driver);
+	if (err < 0)
+		return err;
+
+	err = snd_hdspe_emu_init();
+	if (err < 0)
+		pci_unregister_driver(&hdspe_driver);
+
+	return err;
+}
+
+static void __exit hdspe_module_exit(void)
+{
+	snd_hdspe_emu_exit();
+	pci_unregister_driver(&hdspe_driver);
+}
+
+module_init(hdspe_module_init);
+module_exit(hdspe_module_exit);
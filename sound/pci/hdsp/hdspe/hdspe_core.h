@@ -10,23 +10,38 @@
  * and hardware kindly made available by Amptec Belgium (www.amptec.be).
  */
 
-/* TODO: undefine in production version */
-#define DEBUG
-#define CONFIG_SND_DEBUG
+/* Debug builds: make HDSPE_DEBUG=1 (defines DEBUG and CONFIG_SND_DEBUG). */
 //#define TIME_INTERRUPT_INTERVAL
-#define DAW_MODE
-//#define PASSTHROUGH_MODE
 
 #ifndef __SOUND_HDSPE_CORE_H
 #define __SOUND_HDSPE_CORE_H
 
 #include <linux/io.h>
 #include <linux/delay.h>
+#include <linux/interrupt.h>
+#include <linux/poll.h>
 
 #include <sound/core.h>
 #include <sound/control.h>
 #include <sound/info.h>
 
+/**
+ * hdspe_dbg_hot - debug output on the hot paths only: the interrupt
+ * handler, the period work it triggers (frame counter, TCO, scheduled
+ * controls) and the PCM and MIDI triggers, which run with interrupts off.
+ * Compiled out entirely unless building with HDSPE_DEBUG=1. Control, proc
+ * and setup paths use dev_dbg(), which can be switched on at run time
+ * through dynamic debug, e.g.
+ * echo 'module snd_hdspe +p' > /sys/kernel/debug/dynamic_debug/control
+ */
+#ifdef HDSPE_DEBUG
+#define hdspe_dbg_hot(hdspe, fmt, ...) \
+	dev_dbg((hdspe)->card->dev, fmt, ##__VA_ARGS__)
+#else
+#define hdspe_dbg_hot(hdspe, fmt, ...) \
+	no_printk(fmt, ##__VA_ARGS__)
+#endif /*HDSPE_DEBUG*/
+
 // #define HDSPE_HDSP_REV  60  //  HDSPe PCIe/ExpressCard
 #define HDSPE_MADI_REV		210  // TODO: use
 #define HDSPE_RAYDAT_REV	211
@@ -34,6 +49,11 @@
 #define HDSPE_MADIFACE_REV	213
 #define HDSPE_AES_REV		240  // TODO: use
 
+/* RME PCI vendor ID as it is reported by the RME AIO PRO card */
+#ifndef PCI_VENDOR_ID_RME
+#define PCI_VENDOR_ID_RME 0x1d18
+#endif /*PCI_VENDOR_ID_RME*/
+
 /* --- Write registers. ---
   These are defined as byte-offsets from the iobase value.  */
 
@@ -773,13 +793,35 @@ struct hdspe_midi {
 	int istimer;		/* timer in use */	
 };
 
+/* Clock reference frequency and stability measurement */
+struct hdspe_ref_window {
+	u32 n;                   /* measurements in current window            */
+	s64 sum;                 /* sum of deviations in current window, ppb  */
+	s64 prev;                /* previous window average deviation, ppb    */
+	bool have_prev;          /* prev is valid                             */
+	u64 avar;                /* Allan variance estimate, ppb^2            */
+	u32 count;               /* number of window pairs seen               */
+};
+
+struct hdspe_ref_meter {
+	u64 count;               /* number of measurements                    */
+	u64 freq;                /* last measured frequency, mHz              */
+	u32 nominal;             /* nearest standard sample rate, Hz          */
+	s32 dev;                 /* last deviation from nominal, ppb          */
+	s32 dev_min, dev_max;    /* deviation range, ppb                      */
+	struct hdspe_ref_window win[HDSPE_REF_STATS_WINDOWS];
+};
+
 //#define DEBUG_LTC
 //#define DEBUG_MTC
 struct hdspe_tco {
 	spinlock_t lock;
 
-	/* cached control registers */
-	u32 reg[4];
+	/* control register shadow, see hdspe_tco_set_reg() */
+	u32 reg[4];              /* register values wanted                    */
+	u32 hw_reg[4];           /* register values last written to the card  */
+	u8 dirty;                /* bit n set: reg[n] changed since commit    */
+	u32 reg_writes[4];       /* number of writes, per register            */
 
 	enum hdspe_tco_source input;
 	enum hdspe_ltc_frame_rate ltc_fps;
@@ -793,9 +835,13 @@ struct hdspe_tco {
 	/* LTC out control */
 	u32 ltc_out;             /* requested start LTC for output            */
 	u64 ltc_out_frame_count; /* start LTC output at this frame count      */
+	bool ltc_out_relocate;   /* wait for exact start time, keep running   */
+	u32 ltc_out_set;         /* time code last set for output ...         */
+	u64 ltc_out_set_frame_count; /* ... starting at this frame count      */
 	bool ltc_set;            /* time code set - need reset at next period */
 	bool ltc_run;            /* time code output is running               */
 	bool ltc_flywheel;       /* loop back time code output to input       */
+	bool period_irq;         /* holds a period interrupt reference        */
 
 	/* Current LTC in */
 	bool ltc_changed;        /* set when new LTC has been received        */
@@ -803,6 +849,18 @@ struct hdspe_tco {
 	u64 ltc_time;            /* frame_count at start of current period    */
 	u64 ltc_in_frame_count;  /* frame count at start of current LTC       */
 
+	/* Video frame timeline: video frame edge n >= video_frame is at
+	 * video_edge + (video_edge_rem + (n - video_frame) * video_spf_num)
+	 * / video_spf_den audio frames. See hdspe_tco_video_frame_at(). */
+	u32 video_spf_num;       /* samples per video frame numerator, 0 if   */
+	u32 video_spf_den;       /* ... no video reference: denominator       */
+	u32 video_edge_rem;      /* edge sub-sample position, 1/den samples   */
+	u32 video_phase;         /* cadence phase of video_frame, 0..den-1    */
+	u64 video_edge;          /* frame count at last video frame edge      */
+	u64 video_frame;         /* index of the video frame starting there   */
+	u64 video_check;         /* frame count at last video reference check */
+	bool video_ltc_aligned;  /* edges aligned to LTC input frame starts   */
+
 	/* for status polling */
 	struct hdspe_tco_status last_status;
 
@@ -842,6 +900,29 @@ struct hdspe_methods {
 				    struct hdspe_status* new_status);
 };
 
+/**
+ * Nominal latency of the ports with given name prefix, in samples at the
+ * sample rate of each speed mode, on top of the DMA buffer latency.
+ * See hdspe_latency.c.
+ */
+struct hdspe_port_latency {
+	const char* port;
+	u16 in[HDSPE_SPEED_COUNT];
+	u16 out[HDSPE_SPEED_COUNT];
+};
+
+/**
+ * Channel map tables of one direction and speed mode, derived from the
+ * model tables by hdspe_init_channel_maps(). See hdspe_channels.c.
+ */
+struct hdspe_channel_map {
+	unsigned char channels;                   /* logical channels */
+	unsigned char ports;                      /* number of ports */
+	signed char logical[HDSPE_MAX_CHANNELS];  /* DMA -> logical, or -1 */
+	unsigned char port[HDSPE_MAX_CHANNELS];   /* logical -> port index */
+	DECLARE_BITMAP(used, HDSPE_MAX_CHANNELS); /* DMA channels in use */
+};
+
 /**
  * Card dependant tables. Initialized by hdspe_init_[madi|aes|raio].
  */
@@ -875,6 +956,10 @@ struct hdspe_tables {
 
 	const char * const *clock_source_names;
 
+	/* Port latencies, terminated by a NULL port. Ports not listed have
+	 * no latency beyond the DMA buffer. May be NULL. */
+	const struct hdspe_port_latency *port_latency;
+
 };
 
 /* status element ids for status change notification */
@@ -910,16 +995,39 @@ struct hdspe_ctl_ids {
 	struct snd_ctl_elem_id* ltc_run;
 	struct snd_ctl_elem_id* ltc_jam_sync;
 	struct snd_ctl_elem_id* video_in_fps;
+	struct snd_ctl_elem_id* video_timeline;
+	struct snd_ctl_elem_id* ltc_out_status;
+	struct snd_ctl_elem_id* iec61937_bursts;
+	struct snd_ctl_elem_id* latency_in;
+	struct snd_ctl_elem_id* latency_out;
   /*	struct snd_ctl_elem_id* wck_out_rate; */
 };
 
+/* the size of a substream (1 mono data stream) */
+#define HDSPE_CHANNEL_BUFFER_SAMPLES  (16*1024)
+#define HDSPE_CHANNEL_BUFFER_BYTES    (4*HDSPE_CHANNEL_BUFFER_SAMPLES)
+
+/* the size of the area we need to allocate for DMA transfers. the
+   size is the same regardless of the number of channels, and
+   also the latency to use.
+   for one direction !!!
+*/
+#define HDSPE_DMA_AREA_BYTES (HDSPE_MAX_CHANNELS * HDSPE_CHANNEL_BUFFER_BYTES)
+#define HDSPE_DMA_AREA_KILOBYTES (HDSPE_DMA_AREA_BYTES/1024)
+
+/* Number of shared read-only capture substreams, see hdspe_pcm.c */
+#define HDSPE_SHARED_CAPTURES	4
+
 struct hdspe {
-	struct pci_dev *pci;		/* pci info */
+	struct pci_dev *pci;		/* pci info, NULL if emulated */
 	int vendor_id;			/* PCI vendor ID: Xilinx or RME */
 	int dev;			/* hardware vars... */
 	int irq;
 	unsigned long port;
 	void __iomem *iobase;
+#ifdef CONFIG_SND_HDSPE_EMU
+	struct hdspe_emu *emu;		/* emulated card, see hdspe_emu.c */
+#endif /*CONFIG_SND_HDSPE_EMU*/
 
 	u16 firmware_rev;		/* determines io_type (card model) */
 	u16 reserved;
@@ -935,11 +1043,20 @@ struct hdspe {
 	struct snd_card *card;		/* one card */
 	struct snd_pcm *pcm;		/* has one pcm */
 	struct snd_hwdep *hwdep;	/* and a hwdep for additional ioctl */
+	void* timing_page;		/* struct hdspe_timing, mmap()ed */
+	u32 timing_pll_freq;		/* RD_PLL_FREQ at the last status read */
   
 	/* Only one playback and/or capture stream */
         struct snd_pcm_substream *capture_substream;
         struct snd_pcm_substream *playback_substream;
 
+	/* Shared read-only capture substreams, on PCM device 1 */
+	struct snd_pcm *shared_pcm;
+	struct snd_pcm_substream *shared_capture[HDSPE_SHARED_CAPTURES];
+	u32 shared_running;	     /* running shared captures, bit mask */
+	u32 capture_dma_users;	     /* see hdspe_enable_capture_dma() */
+	struct list_head dmabufs;    /* exported DMA areas, hdspe_dmabuf.c */
+
 	/* MIDI */
 	struct hdspe_midi midi[HDSPE_MAX_MIDI];
 	struct work_struct midi_work;
@@ -968,6 +1085,15 @@ struct hdspe {
 	/* Mixer vars */
 	/* full mixer accessible over mixer ioctl or hwdep-device */
 	struct hdspe_mixer *mixer;
+	/* DMA channels the mixer was last set up for, see
+	 * hdspe_mixer_update_channel_map(). */
+	DECLARE_BITMAP(mixer_used_in, HDSPE_MAX_CHANNELS);
+	DECLARE_BITMAP(mixer_used_out, HDSPE_MAX_CHANNELS);
+	bool mixer_used_valid;
+	enum hdspe_monitor_profile monitor_profile;
+	struct hdspe_mixer_ring *mixer_ring;  /* automation, or NULL */
+	u32 mixer_ring_tail;	     /* driver copy of mixer_ring->tail */
+	int mixer_ring_maps;	     /* mappings of the ring, under lock */
 	struct hdspe_peak_rms peak_rms;
 	/* fast alsa mixer */
 	struct snd_kcontrol *playback_mixer_ctls[HDSPE_MAX_CHANNELS];
@@ -987,6 +1113,17 @@ struct hdspe {
 	const signed char *channel_map_out;
 	const char * const *port_names_in;
 	const char * const *port_names_out;
+	enum hdspe_speed channel_map_speed;
+	struct hdspe_channel_map chmap_in[HDSPE_SPEED_COUNT];
+	struct hdspe_channel_map chmap_out[HDSPE_SPEED_COUNT];
+
+	/* Per logical channel latency, see hdspe_latency.c */
+	u16 latency_in[HDSPE_SPEED_COUNT][HDSPE_MAX_CHANNELS];
+	u16 latency_out[HDSPE_SPEED_COUNT][HDSPE_MAX_CHANNELS];
+	bool latency_delay;         /* add port latency to PCM delay */
+	/* Port latency last added to runtime->delay, per substream: playback
+	 * and capture of PCM device 0, then the shared captures. */
+	u32 pcm_port_delay[2 + HDSPE_SHARED_CAPTURES];
 
 	unsigned char *playback_buffer;	/* suitably aligned address */
 	unsigned char *capture_buffer;	/* suitably aligned address */
@@ -1018,9 +1155,74 @@ struct hdspe {
 	u32 last_hw_pointer;        /* previous period hw pointer */
 	u32 hw_buffer_size;         /* sample buffer size, in nr of samples */
 	u32 period_size;            /* current period size, in nr of samples */
+	u32 pcm_period_size;        /* ALSA period size, see hdspe_pcm.c */
+	u64 pcm_period_frame;       /* frame_count at next ALSA period */
+	u32 pcm_period_late_max;    /* max. ALSA period report lateness */
+
+	int period_irq_users;       /* see hdspe_period_irq_get() */
+	ktime_t period_irq_off_time;/* when period interrupts were disabled */
+
+	struct hdspe_tms* tms;      /* channel status side channel, or NULL */
+	struct hdspe_sched* sched;  /* scheduled control changes, or NULL */
+
+	/* Clock reference statistics, see hdspe_ref_stats_period() */
+	bool ref_stats;             /* measuring, holds a period irq ref */
+	u32 ref_window[HDSPE_REF_STATS_WINDOWS];
+	struct hdspe_ref_meter ref_meter[HDSPE_REF_METER_COUNT];
 };
 
 
+/**
+ * hdspe_emu.c
+ */
+#ifdef CONFIG_SND_HDSPE_EMU
+extern int hdspe_emu_new(struct hdspe *hdspe, const char *model, bool tco,
+			 irq_handler_t handler);
+extern void hdspe_emu_stop(struct hdspe *hdspe);
+extern void hdspe_emu_free(struct hdspe *hdspe);
+extern void hdspe_emu_write(struct hdspe *hdspe, u32 reg, __le32 val);
+extern __le32 hdspe_emu_read(struct hdspe *hdspe, u32 reg);
+extern void hdspe_emu_proc_init(struct hdspe *hdspe);
+
+static inline bool hdspe_is_emulated(struct hdspe *hdspe)
+{
+	return hdspe->emu != NULL;
+}
+
+/* Phases of the interrupt handler, timed by the emulated card interrupt
+ * benchmark, see hdspe_emu_bench(). */
+enum hdspe_irq_phase {
+	HDSPE_IRQ_STATUS0,	/* status0 read */
+	HDSPE_IRQ_FRAME_COUNT,	/* frame count, interrupt confirmation */
+	HDSPE_IRQ_TCO,		/* TCO LTC input */
+	HDSPE_IRQ_CLIENTS,	/* ref stats, TMS, scheduler, mixer, timing */
+	HDSPE_IRQ_PCM,		/* PCM period elapsed */
+	HDSPE_IRQ_STATUS_POLL,	/* status polling check */
+	HDSPE_IRQ_MIDI,		/* MIDI input checks */
+	HDSPE_IRQ_PHASE_COUNT
+};
+
+extern void hdspe_emu_irq_phase(struct hdspe *hdspe,
+				enum hdspe_irq_phase phase);
+
+/* Marks the end of an interrupt handler phase. */
+#define hdspe_irq_phase(hdspe, phase)				\
+	do {							\
+		if (unlikely(hdspe_is_emulated(hdspe)))		\
+			hdspe_emu_irq_phase(hdspe, phase);	\
+	} while (0)
+#else
+static inline bool hdspe_is_emulated(struct hdspe *hdspe)
+{
+	return false;
+}
+
+static inline void hdspe_emu_stop(struct hdspe *hdspe) {}
+static inline void hdspe_emu_free(struct hdspe *hdspe) {}
+
+#define hdspe_irq_phase(hdspe, phase) do {} while (0)
+#endif /*CONFIG_SND_HDSPE_EMU*/
+
 /**
  * Write/read to/from HDSPE with Adresses in Bytes
  * not words but only 32Bit writes are allowed.
@@ -1029,12 +1231,22 @@ struct hdspe {
 static inline __attribute__((always_inline))
 void hdspe_write(struct hdspe * hdspe, u32 reg, __le32 val)
 {
+#ifdef CONFIG_SND_HDSPE_EMU
+	if (unlikely(hdspe->emu)) {
+		hdspe_emu_write(hdspe, reg, val);
+		return;
+	}
+#endif /*CONFIG_SND_HDSPE_EMU*/
 	writel(val, hdspe->iobase + reg);
 }
 
 static inline __attribute__((always_inline))
 __le32 hdspe_read(struct hdspe * hdspe, u32 reg)
 {
+#ifdef CONFIG_SND_HDSPE_EMU
+	if (unlikely(hdspe->emu))
+		return hdspe_emu_read(hdspe, reg);
+#endif /*CONFIG_SND_HDSPE_EMU*/
 	return readl(hdspe->iobase + reg);
 #ifdef FROM_WIN_DRIVER
 	if (!deviceExtension->bShutdown) {
@@ -1125,9 +1337,36 @@ u32 hdspe_read_pll_freq(struct hdspe* hdspe)
 extern int snd_hdspe_create_pcm(struct snd_card *card,
 				struct hdspe *hdspe);
 
-/* Current period size in samples. */
+/* Current (hardware) period size in samples. */
 extern u32 hdspe_period_size(struct hdspe *hdspe);
 
+/* Hardware period size for an ALSA period of @pcm_frames frames on
+ * RayDAT, AIO and AIO Pro: the largest power of two dividing it, at most
+ * 4096, so that ALSA period boundaries fall on hardware period
+ * interrupts. For periods that are no multiple of 32 frames it is 32,
+ * the smallest, and boundaries are reported less than 32 frames late. */
+static inline u32 hdspe_raio_interrupt_interval(u32 pcm_frames)
+{
+	u32 frames = pcm_frames & -pcm_frames; /* lowest bit set */
+
+	frames = clamp(frames, 32u, 4096u);
+	return (pcm_frames % frames == 0) ? frames : 32;
+}
+
+/* Called from the interrupt handler, after hdspe_update_frame_count().
+ * Returns true if an ALSA period ended. The ALSA period size may be 
+ * a multiple of the hardware period size, or not even a power of two. */
+extern bool hdspe_pcm_period_elapsed(struct hdspe* hdspe);
+
+/* Called from the interrupt handler at every period interrupt, if
+ * hdspe->shared_running is set. */
+extern void hdspe_shared_capture_period_elapsed(struct hdspe* hdspe);
+
+/* Frame count now, from the hardware buffer pointer, in between period
+ * interrupts. Valid while period interrupts are enabled. Called with
+ * hdspe->lock held. */
+extern u64 hdspe_frame_count_now(struct hdspe* hdspe);
+
 /* Get current hardware frame counter. Wraps every 16K frames or sooner
  * for MADI and AES cards. */
 extern snd_pcm_uframes_t hdspe_hw_pointer(struct hdspe *hdspe);
@@ -1141,6 +1380,16 @@ extern snd_pcm_uframes_t hdspe_hw_pointer(struct hdspe *hdspe);
  * than once since the previous invocation. */
 extern void hdspe_update_frame_count(struct hdspe* hdspe);
 
+/* Audio period interrupts are enabled only while someone needs them:
+ * running substreams, TCO LTC input tracking or output scheduling, status
+ * polling and frame counter clients. Each user takes a reference with
+ * hdspe_period_irq_get() and drops it with hdspe_period_irq_put(), with
+ * hdspe->lock held. The audio engine keeps running in between, and 
+ * hdspe->frame_count is re-derived from the hardware pointer when
+ * period interrupts are enabled again. */
+extern void hdspe_period_irq_get(struct hdspe* hdspe);
+extern void hdspe_period_irq_put(struct hdspe* hdspe);
+
 /**
  * hdspe_midi.c
  */
@@ -1160,6 +1409,11 @@ extern void hdspe_midi_work(struct work_struct *work);
 extern int snd_hdspe_create_hwdep(struct snd_card *card,
 				  struct hdspe *hdspe);
 
+/* Update the mmap()able timing page. Called from the interrupt handler
+ * at every period interrupt, after the LTC update. */
+extern void hdspe_timing_update(struct hdspe* hdspe);
+extern void hdspe_timing_free(struct hdspe* hdspe);
+
 extern void hdspe_get_card_info(struct hdspe* hdspe, struct hdspe_card_info *s);
 
 /**
@@ -1225,7 +1479,8 @@ extern void hdspe_status_work(struct work_struct* work);
 /**
  * hdspe_mixer.c
  */
-extern int hdspe_init_mixer(struct hdspe* hdspe);
+extern int hdspe_init_mixer(struct hdspe* hdspe,
+			    enum hdspe_monitor_profile profile);
 
 extern void hdspe_terminate_mixer(struct hdspe* hdspe);
 
@@ -1238,8 +1493,20 @@ extern int hdspe_update_simple_mixer_controls(struct hdspe * hdspe);
 extern void hdspe_mixer_read_proc(struct snd_info_entry *entry,
 				  struct snd_info_buffer *buffer);
 
+/* Creates the streaming "mixer.csv" export / import proc file, in the
+ * card proc directory. Call after snd_card_register(). */
+extern void hdspe_mixer_proc_init(struct hdspe* hdspe);
+
 extern void hdspe_mixer_update_channel_map(struct hdspe* hdspe);
 
+/* Map the mixer automation ring, hwdep mmap() helper. */
+extern int hdspe_mixer_ring_mmap(struct hdspe* hdspe,
+				 struct vm_area_struct* vma);
+
+/* Apply the due mixer automation events. Called from the interrupt
+ * handler at every period interrupt. */
+extern void hdspe_mixer_ring_period(struct hdspe* hdspe);
+
 /**
  * hdspe_tco.c
  */
@@ -1247,6 +1514,9 @@ extern int hdspe_init_tco(struct hdspe* hdspe);
 
 extern void hdspe_terminate_tco(struct hdspe* hdspe);
 
+/* Rewrite the TCO registers from the shadow, after resume. */
+extern void hdspe_tco_resume(struct hdspe* hdspe);
+
 extern int hdspe_create_tco_controls(struct hdspe* hdspe);
 
 extern void hdspe_tco_read_status(struct hdspe* hdspe,
@@ -1261,6 +1531,16 @@ extern void hdspe_tco_mtc(struct hdspe* hdspe,
 
 /* Scheduled from the audio interrupt handler */
 extern void hdspe_tco_period_elapsed(struct hdspe* hdspe);
+
+/* Frequency measured by the TCO fs period counter, in mHz. 0 if none. */
+extern u64 hdspe_tco_fs_freq(struct hdspe* hdspe);
+
+/* The video frame containing audio frame v->frame, according to the TCO
+ * video frame timeline, for SNDRV_HDSPE_IOCTL_GET_VIDEO_FRAME. v->frame
+ * may be before the last video frame edge. Returns -ENODEV if there is no
+ * TCO module, -ENODATA if there is no video reference. */
+extern int hdspe_tco_video_frame_at(struct hdspe* hdspe,
+				    struct hdspe_video_frame* v);
 	
 /* TCO module status polling */
 extern bool hdspe_tco_notify_status_change(struct hdspe* hdspe);
@@ -1334,6 +1614,59 @@ extern u32 hdspe_read_system_pitch(struct hdspe* hdspe);
  * from 32kHz, 44.1kHz, etc... because of DDS (non-neutral system pitch). */
 extern u32 hdspe_read_system_sample_rate(struct hdspe* hdspe);
 
+/* Nearest standard sample rate (32 kHz ... 192 kHz) to <rate> Hz. */
+extern u32 hdspe_nominal_sample_rate(u32 rate);
+
+/* Start (non-zero windows) or stop (all windows zero) measuring clock
+ * reference statistics, and reset them. */
+extern int hdspe_ref_stats_configure(struct hdspe* hdspe,
+				     const struct hdspe_ref_stats_config* cfg);
+
+/* Copy out the current clock reference statistics. */
+extern void hdspe_ref_stats_read(struct hdspe* hdspe,
+				 struct hdspe_ref_stats* s);
+
+/* Called from the interrupt handler, after hdspe_update_frame_count(),
+ * if hdspe->ref_stats is set. */
+extern void hdspe_ref_stats_period(struct hdspe* hdspe);
+
+/* AES channel status side channel, see hdspe_tms.c */
+extern int hdspe_tms_configure(struct hdspe* hdspe,
+			       const struct hdspe_aes_cs_config* cfg);
+extern void hdspe_tms_period(struct hdspe* hdspe);
+extern long hdspe_tms_read(struct hdspe* hdspe, char __user *buf,
+			   long count);
+extern __poll_t hdspe_tms_poll(struct hdspe* hdspe, struct file *file,
+			       poll_table *wait);
+extern void hdspe_tms_free(struct hdspe* hdspe);
+extern int hdspe_create_tms_controls(struct hdspe* hdspe);
+
+/* Frame-scheduled control changes, see hdspe_sched.c */
+extern int hdspe_sched_ctl(struct hdspe* hdspe, struct hdspe_sched_ctl* ctl);
+extern int hdspe_sched_ctl_result(struct hdspe* hdspe,
+				  struct hdspe_sched_ctl* ctl);
+extern void hdspe_sched_period(struct hdspe* hdspe);
+extern void hdspe_sched_free(struct hdspe* hdspe);
+
+/* DMA buffer export, see hdspe_dmabuf.c */
+extern int hdspe_dmabuf_export(struct hdspe* hdspe, struct hdspe_dmabuf* d);
+extern void hdspe_dmabuf_revoke(struct hdspe* hdspe);
+extern void hdspe_get_dma_pos(struct hdspe* hdspe, struct hdspe_dma_pos* pos);
+
+/* Derived channel map tables, see hdspe_channels.c */
+extern int hdspe_init_channel_maps(struct hdspe* hdspe);
+
+/* Port latency tables, see hdspe_latency.c */
+extern void hdspe_init_latency(struct hdspe* hdspe);
+extern int hdspe_get_latency(struct hdspe* hdspe, struct hdspe_latency* l);
+extern u32 hdspe_latency_delay(struct hdspe* hdspe, int stream,
+			       unsigned int channels);
+extern int hdspe_create_latency_controls(struct hdspe* hdspe);
+
+/* Numerator of the current sample rate, in the current speed mode. The
+ * denominator is hdspe_read_pll_freq(). */
+extern u64 hdspe_sample_rate_numerator(struct hdspe* hdspe);
+
 /* Read current system sample rate from hardware - read_status() helper. */
 extern void hdspe_read_sample_rate_status(struct hdspe* hdspe,
 					  struct hdspe_status* status);
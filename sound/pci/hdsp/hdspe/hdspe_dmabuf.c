@@ -0,0 +1,376 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * hdspe_dmabuf.c
+ * @brief RME HDSPe DMA buffer export as dma-buf.
+ *
+ * The playback and capture DMA areas of PCM device 0 are the buffers
+ * preallocated for its substreams, which stay in place for the lifetime
+ * of the card, see snd_hdspe_preallocate_memory(). They are exported
+ * read-write, as a whole, with SNDRV_HDSPE_IOCTL_EXPORT_DMABUF, for
+ * other processes to mmap() and other devices to attach, by the client
+ * that has exclusive use of the card and owns the stream.
+ *
+ * A dma-buf does not hold on to the card: it keeps references on the
+ * pages of the area instead, so they outlive the card. When the card goes
+ * away, hdspe_dmabuf_revoke() unmaps them from all processes, and the
+ * dma-buf refuses new mappings, attachments and CPU access from then on.
+ */
+
+#include "hdspe.h"
+#include "hdspe_core.h"
+
+#include <linux/version.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/pid.h>
+#include <linux/pid_namespace.h>
+#include <linux/sched/signal.h>
+#include <linux/vmalloc.h>
+#include <sound/pcm.h>
+
+#if IS_ENABLED(CONFIG_DMA_SHARED_BUFFER)
+
+#include <linux/dma-buf.h>
+#include <linux/dma-mapping.h>
+#include <linux/scatterlist.h>
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+MODULE_IMPORT_NS("DMA_BUF");
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(5, 16, 0)
+MODULE_IMPORT_NS(DMA_BUF);
+#endif
+
+/* Protects the exported dma-buf lists of all cards, and the hdspe
+ * pointer of each dma-buf: NULL once revoked. The dma-bufs hold a
+ * reference on the module. */
+static DEFINE_MUTEX(hdspe_dmabuf_mutex);
+
+struct hdspe_dmabuf_priv {
+	struct hdspe* hdspe;		/* NULL once revoked */
+	struct snd_dma_buffer* dmab;
+	struct dma_buf* dmabuf;
+	struct list_head list;		/* in hdspe->dmabufs */
+	unsigned int npages;
+	struct page* pages[];		/* referenced */
+};
+
+static bool hdspe_dmabuf_revoked(struct hdspe_dmabuf_priv* p)
+{
+	bool revoked;
+
+	mutex_lock(&hdspe_dmabuf_mutex);
+	revoked = !p->hdspe;
+	mutex_unlock(&hdspe_dmabuf_mutex);
+	return revoked;
+}
+
+static struct sg_table* hdspe_dmabuf_map(struct dma_buf_attachment* attach,
+					 enum dma_data_direction dir)
+{
+	struct hdspe_dmabuf_priv* p = attach->dmabuf->priv;
+	struct sg_table* sgt;
+	int err;
+
+	if (hdspe_dmabuf_revoked(p))
+		return ERR_PTR(-ENODEV);
+
+	sgt = kzalloc(sizeof(*sgt), GFP_KERNEL);
+	if (!sgt)
+		return ERR_PTR(-ENOMEM);
+
+	err = sg_alloc_table_from_pages(sgt, p->pages, p->npages, 0,
+					(unsigned long)p->npages << PAGE_SHIFT,
+					GFP_KERNEL);
+	if (err < 0)
+		goto free_sgt;
+
+	err = dma_map_sgtable(attach->dev, sgt, dir, 0);
+	if (err < 0)
+		goto free_table;
+
+	return sgt;
+
+free_table:
+	sg_free_table(sgt);
+free_sgt:
+	kfree(sgt);
+	return ERR_PTR(err);
+}
+
+static void hdspe_dmabuf_unmap(struct dma_buf_attachment* attach,
+			       struct sg_table* sgt,
+			       enum dma_data_direction dir)
+{
+	dma_unmap_sgtable(attach->dev, sgt, dir, 0);
+	sg_free_table(sgt);
+	kfree(sgt);
+}
+
+static void hdspe_dmabuf_release(struct dma_buf* dmabuf)
+{
+	struct hdspe_dmabuf_priv* p = dmabuf->priv;
+	unsigned int i;
+
+	mutex_lock(&hdspe_dmabuf_mutex);
+	if (p->hdspe)
+		list_del(&p->list);
+	mutex_unlock(&hdspe_dmabuf_mutex);
+
+	for (i = 0; i < p->npages; i++)
+		put_page(p->pages[i]);
+	kvfree(p);
+}
+
+static int hdspe_dmabuf_mmap(struct dma_buf* dmabuf,
+			     struct vm_area_struct* vma)
+{
+	struct hdspe_dmabuf_priv* p = dmabuf->priv;
+	int err = -ENODEV;
+
+	/* Not racing with hdspe_dmabuf_revoke(). */
+	mutex_lock(&hdspe_dmabuf_mutex);
+	if (p->hdspe)
+		err = vm_map_pages(vma, p->pages, p->npages);
+	mutex_unlock(&hdspe_dmabuf_mutex);
+	return err;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+/* The buffer may be non-coherent, see snd_dma_buffer_sync(). p->dmab is
+ * part of the card, which is there as long as p->hdspe is set. */
+static int hdspe_dmabuf_sync(struct hdspe_dmabuf_priv* p,
+			     enum snd_dma_sync_mode mode)
+{
+	int err = -ENODEV;
+
+	mutex_lock(&hdspe_dmabuf_mutex);
+	if (p->hdspe) {
+		snd_dma_buffer_sync(p->dmab, mode);
+		err = 0;
+	}
+	mutex_unlock(&hdspe_dmabuf_mutex);
+	return err;
+}
+
+static int hdspe_dmabuf_begin_cpu_access(struct dma_buf* dmabuf,
+					 enum dma_data_direction dir)
+{
+	return hdspe_dmabuf_sync(dmabuf->priv, SNDRV_DMA_SYNC_CPU);
+}
+
+static int hdspe_dmabuf_end_cpu_access(struct dma_buf* dmabuf,
+				       enum dma_data_direction dir)
+{
+	return hdspe_dmabuf_sync(dmabuf->priv, SNDRV_DMA_SYNC_DEVICE);
+}
+#endif
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0)
+/* A mapping of the referenced pages, not p->dmab->area, which goes away
+ * with the card. */
+static int hdspe_dmabuf_vmap(struct dma_buf* dmabuf, struct iosys_map* map)
+{
+	struct hdspe_dmabuf_priv* p = dmabuf->priv;
+	void* vaddr;
+
+	if (hdspe_dmabuf_revoked(p))
+		return -ENODEV;
+
+	vaddr = vm_map_ram(p->pages, p->npages, NUMA_NO_NODE);
+	if (!vaddr)
+		return -ENOMEM;
+
+	iosys_map_set_vaddr(map, vaddr);
+	return 0;
+}
+
+static void hdspe_dmabuf_vunmap(struct dma_buf* dmabuf,
+				struct iosys_map* map)
+{
+	struct hdspe_dmabuf_priv* p = dmabuf->priv;
+
+	vm_unmap_ram(map->vaddr, p->npages);
+}
+#endif
+
+static const struct dma_buf_ops hdspe_dmabuf_ops = {
+	.map_dma_buf = hdspe_dmabuf_map,
+	.unmap_dma_buf = hdspe_dmabuf_unmap,
+	.release = hdspe_dmabuf_release,
+	.mmap = hdspe_dmabuf_mmap,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+	.begin_cpu_access = hdspe_dmabuf_begin_cpu_access,
+	.end_cpu_access = hdspe_dmabuf_end_cpu_access,
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0)
+	.vmap = hdspe_dmabuf_vmap,
+	.vunmap = hdspe_dmabuf_vunmap,
+#endif
+};
+
+static int hdspe_dmabuf_create(struct hdspe* hdspe,
+			       struct snd_dma_buffer* dmab)
+{
+	DEFINE_DMA_BUF_EXPORT_INFO(exp_info);
+	unsigned int i, npages = HDSPE_DMA_AREA_BYTES >> PAGE_SHIFT;
+	struct hdspe_dmabuf_priv* p;
+	struct dma_buf* dmabuf;
+	int fd;
+
+	p = kvzalloc(struct_size(p, pages, npages), GFP_KERNEL);
+	if (!p)
+		return -ENOMEM;
+
+	p->hdspe = hdspe;
+	p->dmab = dmab;
+	for (i = 0; i < npages; i++) {
+		p->pages[i] = snd_sgbuf_get_page(dmab, (size_t)i << PAGE_SHIFT);
+		if (!p->pages[i]) {
+			fd = -EFAULT;
+			goto put_pages;
+		}
+		get_page(p->pages[i]);
+		p->npages++;
+	}
+
+	exp_info.ops = &hdspe_dmabuf_ops;
+	exp_info.size = HDSPE_DMA_AREA_BYTES;
+	exp_info.flags = O_RDWR;
+	exp_info.priv = p;
+
+	dmabuf = dma_buf_export(&exp_info);
+	if (IS_ERR(dmabuf)) {
+		fd = PTR_ERR(dmabuf);
+		goto put_pages;
+	}
+	p->dmabuf = dmabuf;
+
+	mutex_lock(&hdspe_dmabuf_mutex);
+	list_add(&p->list, &hdspe->dmabufs);
+	mutex_unlock(&hdspe_dmabuf_mutex);
+
+	fd = dma_buf_fd(dmabuf, O_CLOEXEC);
+	if (fd < 0)
+		dma_buf_put(dmabuf);	/* releases p */
+	return fd;
+
+put_pages:
+	for (i = 0; i < p->npages; i++)
+		put_page(p->pages[i]);
+	kvfree(p);
+	return fd;
+}
+
+/* Whether the stream is not open, or open by the calling process. */
+static bool hdspe_dmabuf_owns_stream(pid_t pid)
+{
+	struct task_struct* t;
+	bool owner;
+
+	if (pid < 0)
+		return true;
+
+	rcu_read_lock();
+	t = pid_task(find_pid_ns(pid, &init_pid_ns), PIDTYPE_PID);
+	owner = t && same_thread_group(t, current);
+	rcu_read_unlock();
+	return owner;
+}
+
+int hdspe_dmabuf_export(struct hdspe* hdspe, struct hdspe_dmabuf* d)
+{
+	struct snd_dma_buffer* dmab;
+	unsigned int i;
+	int fd;
+
+	if (d->stream > SNDRV_PCM_STREAM_LAST)
+		return -EINVAL;
+
+	/* The area is handed out read-write: not to anyone but the client
+	 * of the stream. */
+	if (!snd_hdspe_use_is_exclusive(hdspe))
+		return -EBUSY;
+	if (!hdspe_dmabuf_owns_stream(d->stream == SNDRV_PCM_STREAM_PLAYBACK
+				      ? hdspe->playback_pid
+				      : hdspe->capture_pid))
+		return -EBUSY;
+
+	dmab = &hdspe->pcm->streams[d->stream].substream->dma_buffer;
+	if (!dmab->area || dmab->bytes < HDSPE_DMA_AREA_BYTES)
+		return -ENOMEM;
+
+	fd = hdspe_dmabuf_create(hdspe, dmab);
+	if (fd < 0)
+		return fd;
+
+	d->fd = fd;
+	d->size = HDSPE_DMA_AREA_BYTES;
+	d->channel_bytes = HDSPE_CHANNEL_BUFFER_BYTES;
+
+	spin_lock_irq(&hdspe->lock);
+	d->buffer_frames = hdspe->hw_buffer_size;
+	d->float_format = hdspe->m.get_float_format(hdspe);
+	if (d->stream == SNDRV_PCM_STREAM_PLAYBACK) {
+		d->channels = hdspe->max_channels_out;
+		for (i = 0; i < HDSPE_MAX_CHANNELS; i++)
+			d->offset[i] = i < d->channels
+				&& hdspe->channel_map_out[i] >= 0
+				? hdspe->channel_map_out[i]
+				  * HDSPE_CHANNEL_BUFFER_BYTES : -1;
+	} else {
+		d->channels = hdspe->max_channels_in;
+		for (i = 0; i < HDSPE_MAX_CHANNELS; i++)
+			d->offset[i] = i < d->channels
+				&& hdspe->channel_map_in[i] >= 0
+				? hdspe->channel_map_in[i]
+				  * HDSPE_CHANNEL_BUFFER_BYTES : -1;
+	}
+	spin_unlock_irq(&hdspe->lock);
+
+	return 0;
+}
+
+/* Called when the card goes away: no process keeps the area mapped, and
+ * the dma-bufs do not give access to it anymore. Devices that attached
+ * before keep the pages, which are not freed until the dma-buf is. */
+void hdspe_dmabuf_revoke(struct hdspe* hdspe)
+{
+	struct hdspe_dmabuf_priv *p, *n;
+
+	mutex_lock(&hdspe_dmabuf_mutex);
+	list_for_each_entry_safe(p, n, &hdspe->dmabufs, list) {
+		p->hdspe = NULL;
+		list_del(&p->list);
+		unmap_mapping_range(p->dmabuf->file->f_mapping, 0, 0, 1);
+	}
+	mutex_unlock(&hdspe_dmabuf_mutex);
+}
+
+#else /* !CONFIG_DMA_SHARED_BUFFER */
+
+int hdspe_dmabuf_export(struct hdspe* hdspe, struct hdspe_dmabuf* d)
+{
+	return -EOPNOTSUPP;
+}
+
+void hdspe_dmabuf_revoke(struct hdspe* hdspe)
+{
+}
+
+#endif /* CONFIG_DMA_SHARED_BUFFER */
+
+void hdspe_get_dma_pos(struct hdspe* hdspe, struct hdspe_dma_pos* pos)
+{
+	u64 frame;
+
+	memset(pos, 0, sizeof(*pos));
+	spin_lock_irq(&hdspe->lock);
+	frame = hdspe_frame_count_now(hdspe);
+	pos->time_ns = ktime_get_ns();
+	pos->running = hdspe->period_irq_users > 0;
+	pos->frame = pos->running ? frame : 0;
+	/* The hardware pointer is the frame count modulo 16K. */
+	pos->hw_pointer = frame & (hdspe->hw_buffer_size - 1);
+	pos->buffer_frames = hdspe->hw_buffer_size;
+	spin_unlock_irq(&hdspe->lock);
+}
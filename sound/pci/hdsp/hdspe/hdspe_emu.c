@@ -0,0 +1,483 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * hdspe_emu.c
+ * @brief RME HDSPe emulated card, for exercising and benchmarking the
+ * driver without hardware.
+ *
+ * Only built with HDSPE_EMU=1. If the card is emulated, hdspe_read() and
+ * hdspe_write() end up here instead of at the PCI BAR. Written values are
+ * kept in a register file. Status registers are synthesized: the card is
+ * its own clock master, has no external inputs and, optionally, a TCO
+ * module without LTC, video or word clock input. An hrtimer advances the
+ * hardware buffer pointer by one period at the current sample rate and
+ * calls the driver interrupt handler, as long as START and IE_AUDIO are
+ * set in the control register. With START set and IE_AUDIO cleared, the
+ * buffer pointer is advanced by the time elapsed when IE_AUDIO is set
+ * again, as the hardware does. No audio data is moved: playback data is
+ * discarded and capture buffers keep whatever they contain. MIDI output
+ * is discarded and there is never any MIDI input.
+ *
+ * The "irq_bench" proc file of an emulated card times the interrupt
+ * handler: writing "<iterations> [<read_ns> [<midi>]]" to it, while no
+ * stream is running, calls the handler that many times in a tight loop,
+ * each time with a period interrupt pending, <read_ns> ns simulated
+ * register read latency and, if <midi> is non-zero, the MIDI interrupt
+ * bits set. Reading the file reports the average and maximum cycle
+ * count (get_cycles()) of each handler phase, see enum hdspe_irq_phase.
+ * Different models and TCO configurations are timed by loading the
+ * module with other emulate and emulate_tco parameters.
+ */
+
+#include "hdspe.h"
+#include "hdspe_core.h"
+
+#include <linux/delay.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
+#include <linux/pci_ids.h>
+#include <linux/sched/signal.h>
+#include <linux/version.h>
+#include <linux/vmalloc.h>
+#include <linux/timex.h>
+
+#define HDSPE_EMU_IO_EXTENT	65536	  /* register window, in bytes */
+#define HDSPE_EMU_HW_BUFFER	(1 << 14) /* BUF_PTR range, in frames */
+#define HDSPE_EMU_FW_BUILD	300	  /* firmware build to report */
+#define HDSPE_EMU_TCO_FW	11	  /* TCO firmware version to report */
+#define HDSPE_EMU_BENCH_MAX	10000000  /* interrupt benchmark iterations */
+
+struct hdspe_emu_bench {
+	u64 iterations;
+	u32 read_ns;		/* simulated register read latency */
+	bool midi;		/* MIDI interrupt bits set */
+	u64 sum[HDSPE_IRQ_PHASE_COUNT];
+	u64 max[HDSPE_IRQ_PHASE_COUNT];
+	u64 total_sum, total_min, total_max;
+};
+
+struct hdspe_emu {
+	struct hdspe *hdspe;
+	irq_handler_t handler;	/* driver interrupt handler */
+	struct hrtimer timer;	/* period "interrupt" */
+	spinlock_t lock;	/* protects the state below */
+
+	bool tco;		/* emulate a TCO module */
+	bool running;		/* START and IE_AUDIO are set */
+	ktime_t idle_since;	/* START set, IE_AUDIO cleared at this time */
+	bool irq;		/* audio interrupt pending */
+	bool buf_id;		/* toggles every period */
+	u32 period;		/* period size, in frames */
+	u32 hw_pointer;		/* hardware buffer position, in frames */
+
+	const char *model;	/* emulated model name */
+	bool bench;		/* interrupt benchmark in progress */
+	u32 read_ns;		/* simulated register read latency */
+	bool bench_midi;	/* report MIDI interrupts pending */
+	cycles_t phase_start;	/* benchmark: end of the previous phase */
+	u64 phase[HDSPE_IRQ_PHASE_COUNT]; /* cycles in this handler call */
+	struct hdspe_emu_bench result;	  /* last benchmark */
+
+	u32 wr[HDSPE_EMU_IO_EXTENT / 4]; /* last value written, per register */
+};
+
+static const struct hdspe_emu_model {
+	const char *name;
+	int vendor_id;
+	u16 firmware_rev;
+} hdspe_emu_models[] = {
+	{ "madi",    PCI_VENDOR_ID_XILINX, 0xd2 },
+	{ "aes",     PCI_VENDOR_ID_XILINX, 0xf0 },
+	{ "raydat",  PCI_VENDOR_ID_XILINX, HDSPE_RAYDAT_REV },
+	{ "aio",     PCI_VENDOR_ID_XILINX, HDSPE_AIO_REV },
+	{ "aio_pro", PCI_VENDOR_ID_RME,    HDSPE_AIO_REV }
+};
+
+static bool hdspe_emu_is_raio(struct hdspe *hdspe)
+{
+	return hdspe->io_type == HDSPE_RAYDAT ||
+		hdspe->io_type == HDSPE_AIO ||
+		hdspe->io_type == HDSPE_AIO_PRO;
+}
+
+/* Period duration, at the current (DDS) sample rate. */
+static ktime_t hdspe_emu_interval(struct hdspe_emu *emu)
+{
+	u32 rate = hdspe_read_system_sample_rate(emu->hdspe);
+
+	if (rate == 0)
+		rate = 48000;
+	return ns_to_ktime(div_u64((u64)emu->period * NSEC_PER_SEC, rate));
+}
+
+static enum hrtimer_restart hdspe_emu_tick(struct hrtimer *timer)
+{
+	struct hdspe_emu *emu = container_of(timer, struct hdspe_emu, timer);
+
+	spin_lock(&emu->lock);
+	if (!emu->running) {
+		spin_unlock(&emu->lock);
+		return HRTIMER_NORESTART;
+	}
+	if (emu->bench) {
+		/* The handler does not run concurrently with itself. */
+		spin_unlock(&emu->lock);
+		goto forward;
+	}
+	emu->hw_pointer = (emu->hw_pointer + emu->period)
+		& (HDSPE_EMU_HW_BUFFER - 1);
+	emu->buf_id = !emu->buf_id;
+	emu->irq = true;
+	spin_unlock(&emu->lock);
+
+	emu->handler(-1, emu->hdspe);
+
+forward:
+	hrtimer_forward_now(timer, hdspe_emu_interval(emu));
+	return HRTIMER_RESTART;
+}
+
+/* Advance the buffer pointer by the periods elapsed since idle_since. */
+static void hdspe_emu_catch_up(struct hdspe_emu *emu)
+{
+	u32 rate = hdspe_read_system_sample_rate(emu->hdspe);
+	u64 ns = ktime_to_ns(ktime_sub(ktime_get(), emu->idle_since));
+	u64 periods = div_u64(mul_u64_u32_div(ns, rate ? rate : 48000,
+					      NSEC_PER_SEC), emu->period);
+
+	emu->hw_pointer = (emu->hw_pointer + (u32)periods * emu->period)
+		& (HDSPE_EMU_HW_BUFFER - 1);
+	emu->buf_id ^= periods & 1;
+}
+
+/* Called with emu->lock held, after a write to the control register. */
+static bool hdspe_emu_update_control(struct hdspe_emu *emu)
+{
+	union hdspe_control_reg control;
+	bool was_running = emu->running;
+	bool idle;
+	int n;
+
+	control.raw = cpu_to_le32(emu->wr[HDSPE_WR_CONTROL / 4]);
+	n = control.common.LAT;
+	emu->period = (n == 7 && hdspe_emu_is_raio(emu->hdspe))
+		? 32 : 64 << n;
+	emu->running = control.common.START && control.common.IE_AUDIO;
+	idle = control.common.START && !control.common.IE_AUDIO;
+
+	if (emu->running && !was_running && emu->idle_since)
+		hdspe_emu_catch_up(emu);
+	if (idle && !emu->idle_since)
+		emu->idle_since = ktime_get();
+	else if (!idle)
+		emu->idle_since = 0;
+
+	return emu->running && !was_running;
+}
+
+void hdspe_emu_write(struct hdspe *hdspe, u32 reg, __le32 val)
+{
+	struct hdspe_emu *emu = hdspe->emu;
+	unsigned long flags;
+	bool start = false;
+
+	if (reg >= HDSPE_EMU_IO_EXTENT)
+		return;
+
+	spin_lock_irqsave(&emu->lock, flags);
+	emu->wr[reg / 4] = le32_to_cpu(val);
+	switch (reg) {
+	case HDSPE_WR_CONTROL:
+		start = hdspe_emu_update_control(emu);
+		break;
+	case HDSPE_interruptConfirmation:
+		emu->irq = false;
+		break;
+	}
+	spin_unlock_irqrestore(&emu->lock, flags);
+
+	/* A stopped timer is not restarted by hdspe_emu_tick(). */
+	if (start)
+		hrtimer_start(&emu->timer, hdspe_emu_interval(emu),
+			      HRTIMER_MODE_REL);
+}
+
+static __le32 hdspe_emu_status0(struct hdspe_emu *emu)
+{
+	struct hdspe *hdspe = emu->hdspe;
+	union hdspe_status0_reg status0;
+	unsigned long flags;
+
+	status0.raw = 0;
+	spin_lock_irqsave(&emu->lock, flags);
+	status0.common.IRQ = emu->irq;
+	status0.common.BUF_PTR = cpu_to_le16((emu->hw_pointer * 4) >> 6);
+	status0.common.BUF_ID = emu->buf_id;
+	spin_unlock_irqrestore(&emu->lock, flags);
+
+	if (emu->bench_midi)
+		status0.raw |= hdspe->midiIRQPendingMask;
+	if (emu->tco && hdspe->io_type == HDSPE_MADI)
+		status0.madi.tco_detect = true;
+	if (emu->tco && hdspe->io_type == HDSPE_AES)
+		status0.aes.tco_detect = true;
+
+	return status0.raw;
+}
+
+__le32 hdspe_emu_read(struct hdspe *hdspe, u32 reg)
+{
+	struct hdspe_emu *emu = hdspe->emu;
+	union hdspe_status1_reg status1;
+	union hdspe_status2_reg status2;
+
+	if (unlikely(emu->read_ns))
+		ndelay(emu->read_ns);
+
+	switch (reg) {
+	case HDSPE_RD_STATUS0:
+		return hdspe_emu_status0(emu);
+
+	case HDSPE_RD_STATUS1:
+		status1.raw = 0;
+		if (hdspe_emu_is_raio(hdspe))
+			status1.raio.sync_ref = 15;	/* internal clock */
+		return status1.raw;
+
+	case HDSPE_RD_STATUS2:
+		status2.raw = 0;
+		if (emu->tco && hdspe_emu_is_raio(hdspe))
+			status2.raio.tco_detect = true;
+		return status2.raw;
+
+	case HDSPE_RD_PLL_FREQ:
+		return cpu_to_le32(emu->wr[HDSPE_WR_PLL_FREQ / 4]);
+
+	case HDSPE_RD_FLASH:
+		return cpu_to_le32(HDSPE_EMU_FW_BUILD << 12);
+
+	case HDSPE_RD_BARCODE0:		/* serial number "99990000" + card */
+		return cpu_to_le32(0x39393939);
+
+	case HDSPE_RD_BARCODE1:
+		return cpu_to_le32(0x30303030 +
+				   ((hdspe->card->number % 10) << 24));
+
+	case HDSPE_RD_TCO+12:
+		return cpu_to_le32(emu->tco ? HDSPE_EMU_TCO_FW << 24 : 0);
+
+	default:
+		/* TCO status, MIDI FIFO fill levels, levels meters: 0. */
+		return 0;
+	}
+}
+
+int hdspe_emu_new(struct hdspe *hdspe, const char *model, bool tco,
+		  irq_handler_t handler)
+{
+	struct hdspe_emu *emu;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(hdspe_emu_models); i++) {
+		if (strcmp(model, hdspe_emu_models[i].name) == 0)
+			break;
+	}
+	if (i >= ARRAY_SIZE(hdspe_emu_models)) {
+		dev_err(hdspe->card->dev, "unknown card model '%s' to emulate.\n",
+			model);
+		return -EINVAL;
+	}
+
+	emu = vzalloc(sizeof(*emu));
+	if (!emu)
+		return -ENOMEM;
+
+	emu->hdspe = hdspe;
+	emu->model = hdspe_emu_models[i].name;
+	emu->handler = handler;
+	emu->tco = tco;
+	emu->period = 64;
+	spin_lock_init(&emu->lock);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+	hrtimer_setup(&emu->timer, hdspe_emu_tick,
+		      CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+#else
+	hrtimer_init(&emu->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	emu->timer.function = hdspe_emu_tick;
+#endif
+
+	hdspe->emu = emu;
+	hdspe->vendor_id = hdspe_emu_models[i].vendor_id;
+	hdspe->firmware_rev = hdspe_emu_models[i].firmware_rev;
+	/* Never dereferenced: all register access goes through
+	 * hdspe_emu_read() and hdspe_emu_write(). */
+	hdspe->iobase = (void __iomem *)emu->wr;
+
+	dev_info(hdspe->card->dev, "emulating HDSPe %s%s.\n",
+		 model, tco ? " with TCO" : "");
+
+	return 0;
+}
+
+/* ------------------- interrupt handler benchmark -------------------- */
+
+static const char * const hdspe_irq_phase_names[HDSPE_IRQ_PHASE_COUNT] = {
+	[HDSPE_IRQ_STATUS0] = "status0",
+	[HDSPE_IRQ_FRAME_COUNT] = "frame count",
+	[HDSPE_IRQ_TCO] = "tco",
+	[HDSPE_IRQ_CLIENTS] = "clients",
+	[HDSPE_IRQ_PCM] = "pcm",
+	[HDSPE_IRQ_STATUS_POLL] = "status poll",
+	[HDSPE_IRQ_MIDI] = "midi"
+};
+
+/* Called from the interrupt handler at the end of each phase. */
+void hdspe_emu_irq_phase(struct hdspe *hdspe, enum hdspe_irq_phase phase)
+{
+	struct hdspe_emu *emu = hdspe->emu;
+	cycles_t now;
+
+	if (!emu->bench)
+		return;
+
+	now = get_cycles();
+	emu->phase[phase] += now - emu->phase_start;
+	emu->phase_start = now;
+}
+
+static int hdspe_emu_bench(struct hdspe_emu *emu, u64 iterations,
+			   u32 read_ns, bool midi)
+{
+	struct hdspe_emu_bench *r = &emu->result;
+	unsigned long flags;
+	cycles_t start, cycles;
+	u64 i;
+	int p;
+
+	spin_lock_irqsave(&emu->lock, flags);
+	if (emu->running || emu->bench) {
+		spin_unlock_irqrestore(&emu->lock, flags);
+		return -EBUSY;
+	}
+	emu->bench = true;
+	spin_unlock_irqrestore(&emu->lock, flags);
+
+	memset(r, 0, sizeof(*r));
+	r->read_ns = read_ns;
+	r->midi = midi;
+	r->total_min = U64_MAX;
+	emu->read_ns = read_ns;
+	emu->bench_midi = midi;
+
+	for (i = 0; i < iterations; i++) {
+		spin_lock_irqsave(&emu->lock, flags);
+		emu->hw_pointer = (emu->hw_pointer + emu->period)
+			& (HDSPE_EMU_HW_BUFFER - 1);
+		emu->buf_id = !emu->buf_id;
+		emu->irq = true;
+		spin_unlock(&emu->lock);
+
+		/* As hdspe_emu_tick(), with interrupts off. */
+		memset(emu->phase, 0, sizeof(emu->phase));
+		start = emu->phase_start = get_cycles();
+		emu->handler(-1, emu->hdspe);
+		cycles = get_cycles() - start;
+		local_irq_restore(flags);
+
+		for (p = 0; p < HDSPE_IRQ_PHASE_COUNT; p++) {
+			r->sum[p] += emu->phase[p];
+			r->max[p] = max(r->max[p], emu->phase[p]);
+		}
+		r->total_sum += cycles;
+		r->total_min = min_t(u64, r->total_min, cycles);
+		r->total_max = max_t(u64, r->total_max, cycles);
+		r->iterations++;
+
+		if ((i & 1023) == 1023) {
+			if (fatal_signal_pending(current))
+				break;
+			cond_resched();
+		}
+	}
+
+	spin_lock_irqsave(&emu->lock, flags);
+	emu->read_ns = 0;
+	emu->bench_midi = false;
+	emu->bench = false;
+	spin_unlock_irqrestore(&emu->lock, flags);
+	return 0;
+}
+
+static void hdspe_emu_bench_read(struct snd_info_entry *entry,
+				 struct snd_info_buffer *buffer)
+{
+	struct hdspe *hdspe = entry->private_data;
+	struct hdspe_emu *emu = hdspe->emu;
+	struct hdspe_emu_bench *r = &emu->result;
+	int p;
+
+	snd_iprintf(buffer, "Model\t\t: %s%s\n", emu->model,
+		    emu->tco ? " with TCO" : "");
+	snd_iprintf(buffer, "Iterations\t: %llu\n", r->iterations);
+	snd_iprintf(buffer, "Read latency\t: %u ns\n", r->read_ns);
+	snd_iprintf(buffer, "MIDI pending\t: %d\n", r->midi);
+	if (r->iterations == 0)
+		return;
+
+	snd_iprintf(buffer, "\nPhase\t\t     avg cycles      max cycles\n");
+	for (p = 0; p < HDSPE_IRQ_PHASE_COUNT; p++)
+		snd_iprintf(buffer, "%-12s\t%12llu    %12llu\n",
+			    hdspe_irq_phase_names[p],
+			    div64_u64(r->sum[p], r->iterations), r->max[p]);
+	snd_iprintf(buffer, "%-12s\t%12llu    %12llu (min %llu)\n", "total",
+		    div64_u64(r->total_sum, r->iterations), r->total_max,
+		    r->total_min);
+}
+
+static void hdspe_emu_bench_write(struct snd_info_entry *entry,
+				  struct snd_info_buffer *buffer)
+{
+	struct hdspe *hdspe = entry->private_data;
+	unsigned long long iterations = 0;
+	unsigned int read_ns = 0, midi = 0;
+	char line[64];
+	int err;
+
+	if (snd_info_get_line(buffer, line, sizeof(line)))
+		return;
+	if (sscanf(line, "%llu %u %u", &iterations, &read_ns, &midi) < 1 ||
+	    iterations > HDSPE_EMU_BENCH_MAX || read_ns > NSEC_PER_MSEC) {
+		dev_warn(hdspe->card->dev, "irq_bench: invalid '%s'.\n", line);
+		return;
+	}
+
+	err = hdspe_emu_bench(hdspe->emu, iterations, read_ns, midi);
+	if (err < 0)
+		dev_warn(hdspe->card->dev,
+			 "irq_bench: card busy, stop all streams first.\n");
+}
+
+void hdspe_emu_proc_init(struct hdspe *hdspe)
+{
+	snd_card_rw_proc_new(hdspe->card, "irq_bench", hdspe,
+			     hdspe_emu_bench_read, hdspe_emu_bench_write);
+}
+
+/* Wait for a running period timer to finish, after the driver cleared
+ * START or IE_AUDIO. Must not be called from the interrupt handler. */
+void hdspe_emu_stop(struct hdspe *hdspe)
+{
+	hrtimer_cancel(&hdspe->emu->timer);
+}
+
+void hdspe_emu_free(struct hdspe *hdspe)
+{
+	struct hdspe_emu *emu = hdspe->emu;
+
+	if (!emu)
+		return;
+
+	hrtimer_cancel(&emu->timer);
+	hdspe->iobase = NULL;
+	hdspe->emu = NULL;
+	vfree(emu);
+}
@@ -15,6 +15,10 @@
 
 #include <sound/hwdep.h>
 
+#include <linux/version.h>
+#include <linux/mm.h>
+#include <linux/compat.h>
+
 #ifdef OLDSTUFF
 /* AutoSync external sync source frequency class. Returns 0 if
  * no valid external reference. */
@@ -53,6 +57,13 @@ void hdspe_get_card_info(struct hdspe* hdspe, struct hdspe_card_info *s)
 		s->expansion |= HDSPE_EXPANSION_TCO;
 }
 
+/* Copy the mixer shadow to <dest>, for SNDRV_HDSPE_IOCTL_GET_MIXER. */
+static int hdspe_hwdep_get_mixer(struct hdspe *hdspe, void __user *dest)
+{
+	return copy_to_user(dest, hdspe->mixer, sizeof(struct hdspe_mixer))
+		? -EFAULT : 0;
+}
+
 static int snd_hdspe_hwdep_ioctl(struct snd_hwdep *hw, struct file *file,
 		unsigned int cmd, unsigned long arg)
 {
@@ -68,12 +79,22 @@ static int snd_hdspe_hwdep_ioctl(struct snd_hwdep *hw, struct file *file,
 	struct hdspe_status status;
 	struct hdspe_card_info card_info;
 	struct hdspe_tco_status tco_status;
+	struct hdspe_ref_stats_config ref_config;
+	struct hdspe_ref_stats ref_stats;
+	struct hdspe_aes_cs_config aes_cs_config;
+	struct hdspe_sched_ctl sched_ctl;
+	struct hdspe_latency latency;
+	int err;
 	long unsigned int s;
 	int i = 0;
 
 	switch (cmd) {
 
 	case SNDRV_HDSPE_IOCTL_GET_CARD_INFO:
+		/* Declared with the size of struct hdspe_status: the user
+		 * buffer is at least that large. */
+		BUILD_BUG_ON(sizeof(card_info) > sizeof(struct hdspe_status));
+		memset(&card_info, 0, sizeof(card_info));  /* padding */
 		hdspe->m.get_card_info(hdspe, &card_info);
 		if (copy_to_user(argp, &card_info,
 				 sizeof(struct hdspe_card_info)))
@@ -81,6 +102,8 @@ static int snd_hdspe_hwdep_ioctl(struct snd_hwdep *hw, struct file *file,
 		break;
 
 	case SNDRV_HDSPE_IOCTL_GET_STATUS:
+		/* read_status() leaves the status of other models alone. */
+		memset(&status, 0, sizeof(status));
 		hdspe->m.read_status(hdspe, &status);
 		if (copy_to_user(argp, &status, sizeof(struct hdspe_status)))
 			return -EFAULT;
@@ -91,6 +114,7 @@ static int snd_hdspe_hwdep_ioctl(struct snd_hwdep *hw, struct file *file,
 			dev_dbg(hdspe->card->dev, "%s: %d: EINVAL\n", __func__, __LINE__);
 			return -EINVAL;
 		} else {
+			memset(&tco_status, 0, sizeof(tco_status));
 			hdspe_tco_read_status(hdspe, &tco_status);
 		}
 		if (copy_to_user(argp, &tco_status,
@@ -101,31 +125,28 @@ static int snd_hdspe_hwdep_ioctl(struct snd_hwdep *hw, struct file *file,
 	case SNDRV_HDSPE_IOCTL_GET_PEAK_RMS:
 		levels = &hdspe->peak_rms;
 		for (i = 0; i < HDSPE_MAX_CHANNELS; i++) {
-			levels->input_peaks[i] =
-				readl(hdspe->iobase +
-						HDSPE_MADI_INPUT_PEAK + i*4);
-			levels->playback_peaks[i] =
-				readl(hdspe->iobase +
-						HDSPE_MADI_PLAYBACK_PEAK + i*4);
-			levels->output_peaks[i] =
-				readl(hdspe->iobase +
-						HDSPE_MADI_OUTPUT_PEAK + i*4);
+			levels->input_peaks[i] = hdspe_read(hdspe,
+				HDSPE_MADI_INPUT_PEAK + i*4);
+			levels->playback_peaks[i] = hdspe_read(hdspe,
+				HDSPE_MADI_PLAYBACK_PEAK + i*4);
+			levels->output_peaks[i] = hdspe_read(hdspe,
+				HDSPE_MADI_OUTPUT_PEAK + i*4);
 
 			levels->input_rms[i] =
-				((uint64_t) readl(hdspe->iobase +
+				((uint64_t)hdspe_read(hdspe,
 					HDSPE_MADI_INPUT_RMS_H + i*4) << 32) |
-				(uint64_t) readl(hdspe->iobase +
-						HDSPE_MADI_INPUT_RMS_L + i*4);
+				(uint64_t)hdspe_read(hdspe,
+					HDSPE_MADI_INPUT_RMS_L + i*4);
 			levels->playback_rms[i] =
-				((uint64_t)readl(hdspe->iobase +
-					HDSPE_MADI_PLAYBACK_RMS_H+i*4) << 32) |
-				(uint64_t)readl(hdspe->iobase +
+				((uint64_t)hdspe_read(hdspe,
+					HDSPE_MADI_PLAYBACK_RMS_H + i*4) << 32) |
+				(uint64_t)hdspe_read(hdspe,
 					HDSPE_MADI_PLAYBACK_RMS_L + i*4);
 			levels->output_rms[i] =
-				((uint64_t)readl(hdspe->iobase +
+				((uint64_t)hdspe_read(hdspe,
 					HDSPE_MADI_OUTPUT_RMS_H + i*4) << 32) |
-				(uint64_t)readl(hdspe->iobase +
-						HDSPE_MADI_OUTPUT_RMS_L + i*4);
+				(uint64_t)hdspe_read(hdspe,
+					HDSPE_MADI_OUTPUT_RMS_L + i*4);
 		}
 
 		levels->speed = hdspe_speed_mode(hdspe);
@@ -246,8 +267,82 @@ static int snd_hdspe_hwdep_ioctl(struct snd_hwdep *hw, struct file *file,
 	case SNDRV_HDSPE_IOCTL_GET_MIXER:
 		if (copy_from_user(&mixer, argp, sizeof(mixer)))
 			return -EFAULT;
-		if (copy_to_user((void __user *)mixer.mixer, hdspe->mixer,
-				 sizeof(*mixer.mixer)))
+		return hdspe_hwdep_get_mixer(hdspe,
+					     (void __user *)mixer.mixer);
+
+	case SNDRV_HDSPE_IOCTL_SET_REF_STATS:
+		if (copy_from_user(&ref_config, argp, sizeof(ref_config)))
+			return -EFAULT;
+		return hdspe_ref_stats_configure(hdspe, &ref_config);
+
+	case SNDRV_HDSPE_IOCTL_SET_AES_CS:
+		if (copy_from_user(&aes_cs_config, argp,
+				   sizeof(aes_cs_config)))
+			return -EFAULT;
+		return hdspe_tms_configure(hdspe, &aes_cs_config);
+
+	case SNDRV_HDSPE_IOCTL_SCHEDULE_CTL:
+	case SNDRV_HDSPE_IOCTL_GET_SCHED_CTL:
+		if (copy_from_user(&sched_ctl, argp, sizeof(sched_ctl)))
+			return -EFAULT;
+		err = cmd == SNDRV_HDSPE_IOCTL_SCHEDULE_CTL
+			? hdspe_sched_ctl(hdspe, &sched_ctl)
+			: hdspe_sched_ctl_result(hdspe, &sched_ctl);
+		if (err < 0)
+			return err;
+		if (copy_to_user(argp, &sched_ctl, sizeof(sched_ctl)))
+			return -EFAULT;
+		break;
+
+	case SNDRV_HDSPE_IOCTL_GET_LATENCY:
+		if (copy_from_user(&latency, argp, sizeof(latency)))
+			return -EFAULT;
+		err = hdspe_get_latency(hdspe, &latency);
+		if (err < 0)
+			return err;
+		if (copy_to_user(argp, &latency, sizeof(latency)))
+			return -EFAULT;
+		break;
+
+	case SNDRV_HDSPE_IOCTL_EXPORT_DMABUF: {
+		/* In a block of its own, to keep the stack frame small. */
+		struct hdspe_dmabuf dmabuf;
+
+		if (copy_from_user(&dmabuf, argp, sizeof(dmabuf)))
+			return -EFAULT;
+		err = hdspe_dmabuf_export(hdspe, &dmabuf);
+		if (err < 0)
+			return err;
+		if (copy_to_user(argp, &dmabuf, sizeof(dmabuf)))
+			return -EFAULT;
+		break;
+	}
+
+	case SNDRV_HDSPE_IOCTL_GET_DMA_POS: {
+		struct hdspe_dma_pos pos;
+
+		hdspe_get_dma_pos(hdspe, &pos);
+		if (copy_to_user(argp, &pos, sizeof(pos)))
+			return -EFAULT;
+		break;
+	}
+
+	case SNDRV_HDSPE_IOCTL_GET_VIDEO_FRAME: {
+		struct hdspe_video_frame video;
+
+		if (copy_from_user(&video, argp, sizeof(video)))
+			return -EFAULT;
+		err = hdspe_tco_video_frame_at(hdspe, &video);
+		if (err < 0)
+			return err;
+		if (copy_to_user(argp, &video, sizeof(video)))
+			return -EFAULT;
+		break;
+	}
+
+	case SNDRV_HDSPE_IOCTL_GET_REF_STATS:
+		hdspe_ref_stats_read(hdspe, &ref_stats);
+		if (copy_to_user(argp, &ref_stats, sizeof(ref_stats)))
 			return -EFAULT;
 		break;
 
@@ -258,6 +353,123 @@ static int snd_hdspe_hwdep_ioctl(struct snd_hwdep *hw, struct file *file,
 	return 0;
 }
 
+#ifdef CONFIG_COMPAT
+/* 32-bit user space: struct hdspe_mixer_ioctl holds a 32-bit pointer, so
+ * GET_MIXER has another ioctl number, which reached the default case
+ * before. Other ioctls are passed on as they are. */
+#define SNDRV_HDSPE_IOCTL_GET_MIXER32 _IOR('H', 0x44, compat_uptr_t)
+
+static int snd_hdspe_hwdep_ioctl_compat(struct snd_hwdep *hw,
+					struct file *file,
+					unsigned int cmd, unsigned long arg)
+{
+	struct hdspe *hdspe = hw->private_data;
+	compat_uptr_t ptr;
+
+	if (cmd != SNDRV_HDSPE_IOCTL_GET_MIXER32)
+		return snd_hdspe_hwdep_ioctl(hw, file, cmd,
+					     (unsigned long)compat_ptr(arg));
+
+	if (get_user(ptr, (compat_uptr_t __user *)compat_ptr(arg)))
+		return -EFAULT;
+	return hdspe_hwdep_get_mixer(hdspe, compat_ptr(ptr));
+}
+#else
+#define snd_hdspe_hwdep_ioctl_compat	snd_hdspe_hwdep_ioctl
+#endif /*CONFIG_COMPAT*/
+
+/* Timing page. Written at every period interrupt, with a seqcount of its
+ * own in the page for lock-free readers in user space. No register is read
+ * here: the PLL frequency is the one of the last status read, which
+ * hdspe_status_work() does when checking for rate and sync changes, and of
+ * when period interrupts were last enabled. */
+
+#define hdspe_timing_page(hdspe) \
+	((struct hdspe_timing*)(hdspe)->timing_page)
+
+void hdspe_timing_update(struct hdspe* hdspe)
+{
+	struct hdspe_timing* t = hdspe_timing_page(hdspe);
+	struct hdspe_tco* c = hdspe->tco;
+
+	if (!t)
+		return;
+
+	WRITE_ONCE(t->seq, t->seq + 1);
+	smp_wmb();
+
+	t->frame_count = hdspe->frame_count;
+	t->irq_time_ns = ktime_get_ns();
+	t->irq_count++;
+	t->buf_ptr = le16_to_cpu(hdspe->reg.status0.common.BUF_PTR);
+	t->hw_pointer = hdspe_hw_pointer(hdspe);
+	t->buffer_size = hdspe->hw_buffer_size;
+	t->period_size = hdspe->period_size;
+	t->pcm_period_size = hdspe->pcm_period_size;
+	t->running = hdspe->running | (hdspe->shared_running << 2);
+	t->rate_num = hdspe_sample_rate_numerator(hdspe);
+	t->rate_den = READ_ONCE(hdspe->timing_pll_freq);
+	t->tco = c != NULL;
+	if (c) {
+		spin_lock(&c->lock);
+		t->ltc = c->ltc_in;
+		t->ltc_frame_count = c->ltc_in_frame_count;
+		t->video_edge = c->video_edge;
+		t->video_frame = c->video_frame;
+		t->video_spf_num = c->video_spf_num;
+		t->video_spf_den = c->video_spf_den;
+		t->video_edge_rem = c->video_edge_rem;
+		t->video_phase = c->video_phase;
+		spin_unlock(&c->lock);
+	}
+
+	smp_wmb();
+	WRITE_ONCE(t->seq, t->seq + 1);
+}
+
+static int snd_hdspe_hwdep_mmap(struct snd_hwdep *hw, struct file *file,
+				struct vm_area_struct *vma)
+{
+	struct hdspe *hdspe = hw->private_data;
+
+	if (vma->vm_pgoff == HDSPE_MIXER_RING_OFFSET >> PAGE_SHIFT)
+		return hdspe_mixer_ring_mmap(hdspe, vma);
+
+	if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start > PAGE_SIZE)
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+	vm_flags_mod(vma, VM_DONTEXPAND | VM_DONTDUMP, VM_MAYWRITE);
+#else
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+#endif
+	return vm_insert_page(vma, vma->vm_start,
+			      virt_to_page(hdspe->timing_page));
+}
+
+/* Called after the interrupt handler has been released. Pages still
+ * mapped hold a reference of their own. */
+void hdspe_timing_free(struct hdspe* hdspe)
+{
+	free_page((unsigned long)hdspe->timing_page);
+	hdspe->timing_page = NULL;
+}
+
+static long snd_hdspe_hwdep_read(struct snd_hwdep *hw, char __user *buf,
+				 long count, loff_t *offset)
+{
+	return hdspe_tms_read(hw->private_data, buf, count);
+}
+
+static __poll_t snd_hdspe_hwdep_poll(struct snd_hwdep *hw, struct file *file,
+				     poll_table *wait)
+{
+	return hdspe_tms_poll(hw->private_data, file, wait);
+}
+
 int snd_hdspe_create_hwdep(struct snd_card *card,
 			   struct hdspe *hdspe)
 {
@@ -272,9 +484,17 @@ int snd_hdspe_create_hwdep(struct snd_card *card,
 	hw->private_data = hdspe;
 	strcpy(hw->name, "HDSPE hwdep interface");
 
+	hdspe->timing_page = (void*)get_zeroed_page(GFP_KERNEL);
+	if (!hdspe->timing_page)
+		return -ENOMEM;
+	hdspe_timing_page(hdspe)->version = HDSPE_TIMING_VERSION;
+
 	hw->ops.open = snd_hdspe_hwdep_dummy_op;
 	hw->ops.ioctl = snd_hdspe_hwdep_ioctl;
-	hw->ops.ioctl_compat = snd_hdspe_hwdep_ioctl;
+	hw->ops.ioctl_compat = snd_hdspe_hwdep_ioctl_compat;
+	hw->ops.read = snd_hdspe_hwdep_read;
+	hw->ops.poll = snd_hdspe_hwdep_poll;
+	hw->ops.mmap = snd_hdspe_hwdep_mmap;
 	hw->ops.release = snd_hdspe_hwdep_dummy_op;
 
 	return 0;
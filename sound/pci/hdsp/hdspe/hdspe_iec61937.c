@@ -0,0 +1,261 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * hdspe_iec61937.c
+ * @brief RME HDSPe IEC 61937 / SMPTE 337 non-PCM burst detection.
+ *
+ * Compressed audio (AC-3, DTS, Dolby E, ...) is carried over AES in
+ * bursts, starting with a pair of sync words Pa, Pb in the left and right
+ * subframe of a frame, followed by burst info Pc and length code Pd in
+ * the next frame. Sync words are 16, 20 or 24 bits (SMPTE 337), MSB
+ * aligned in the audio sample.
+ */
+
+#include "hdspe_iec61937.h"
+
+/* Sync word size if <a>, <b> (24-bit audio) are Pa, Pb, 0 if not. */
+static u32 hdspe_iec61937_sync(u32 a, u32 b)
+{
+	switch (a >> 16) {
+	case 0xf8: return (a >> 8) == 0xf872 && (b >> 8) == 0x4e1f ? 16 : 0;
+	case 0x6f: return (a >> 4) == 0x6f872 && (b >> 4) == 0x54e1f ? 20 : 0;
+	case 0x96: return a == 0x96f872 && b == 0xa54e1f ? 24 : 0;
+	}
+	return 0;
+}
+
+static void hdspe_iec61937_info(struct hdspe_iec61937* b, u32 size,
+				__le32 l, __le32 r)
+{
+	b->size = size;
+	b->pc = (le32_to_cpu(l) >> 8) >> (24 - size);
+	b->pd = (le32_to_cpu(r) >> 8) >> (24 - size);
+	b->pending = 0;
+}
+
+bool hdspe_iec61937_scan(struct hdspe_iec61937* b,
+			 const __le32* l, const __le32* r, u32 n, u64 frame)
+{
+	u32 size = b->size, type = b->pc & 0x7f;
+	u32 i = 0;
+
+	if (n == 0)
+		return false;
+
+	if (b->pending) {
+		hdspe_iec61937_info(b, b->pending, l[0], r[0]);
+		i = 1;
+	}
+
+	for (; i < n; i++) {
+		u32 s = hdspe_iec61937_sync(le32_to_cpu(l[i]) >> 8,
+					    le32_to_cpu(r[i]) >> 8);
+		if (s == 0)
+			continue;
+
+		b->last_sync = frame + i;
+		if (i + 1 == n) {
+			b->pending = s;
+			break;
+		}
+		i++;
+		hdspe_iec61937_info(b, s, l[i], r[i]);
+	}
+
+	if (b->size != 0 && !b->pending &&
+	    frame + n - b->last_sync > HDSPE_IEC61937_TIMEOUT) {
+		b->size = 0;
+		b->pc = 0;
+		b->pd = 0;
+	}
+
+	return b->size != size || (b->pc & 0x7f) != type;
+}
+
+#ifdef UNIT_TESTING
+/////////////////////////////////////////////////////////////////////////////
+// Unit testing and timing, in user space, with synthetic bursts:
+// gcc -DUNIT_TESTING -O2 -o iec61937_test hdspe_iec61937.c && ./iec61937_test
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_FRAMES (1 << 20)
+
+static u32 test_l[TEST_FRAMES], test_r[TEST_FRAMES];
+
+double get_time(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+	return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+/* PCM noise, 24-bit audio in bits 31..8. */
+void gen_pcm(u32 from, u32 to)
+{
+	for (u32 i = from; i < to; i++) {
+		test_l[i] = (u32)mrand48() & 0xffffff00;
+		test_r[i] = (u32)mrand48() & 0xffffff00;
+	}
+}
+
+/* Bursts of word size <size>, data type <pc> and length <pd>, repeated
+ * every <period> frames, with noise as payload. */
+void gen_bursts(u32 from, u32 to, u32 size, u32 pc, u32 pd, u32 period)
+{
+	static const u32 pa[3] = { 0xf872, 0x6f872, 0x96f872 };
+	static const u32 pb[3] = { 0x4e1f, 0x54e1f, 0xa54e1f };
+	int k = (size - 16) / 4;
+	int shift = 32 - size;
+
+	gen_pcm(from, to);
+	for (u32 i = from; i + 1 < to; i += period) {
+		test_l[i] = pa[k] << shift;
+		test_r[i] = pb[k] << shift;
+		test_l[i+1] = pc << shift;
+		test_r[i+1] = pd << shift;
+	}
+}
+
+struct segment {
+	const char* name;
+	u32 frames;
+	u32 size, pc, pd, period;   /* size 0 = PCM */
+};
+
+static const struct segment test_segments[] = {
+	{ "PCM",                 40000,  0,  0,     0,    0 },
+	{ "AC-3 16-bit",         60000, 16,  1, 49152, 1536 },
+	{ "Dolby E 20-bit",      60000, 20, 28, 30000, 1920 },
+	{ "DTS type I 24-bit",   60000, 24, 11,  8192,  512 },
+	{ "E-AC-3 16-bit",      100000, 16, 21, 61440, 6144 },
+	{ "PCM",                 80000,  0,  0,     0,    0 },
+};
+
+/* Feed the stream in random period sizes, and check the reported state
+ * at the end of each segment, and the number of change events. */
+int test_segments_random_periods(void)
+{
+	struct hdspe_iec61937 b;
+	int nseg = sizeof(test_segments) / sizeof(test_segments[0]);
+	u32 start[16], total = 0;
+	int events = 0, ok = 1, s;
+	u32 pos = 0;
+
+	for (s = 0; s < nseg; s++) {
+		const struct segment* g = &test_segments[s];
+		start[s] = total;
+		if (g->size)
+			gen_bursts(total, total + g->frames,
+				   g->size, g->pc, g->pd, g->period);
+		else
+			gen_pcm(total, total + g->frames);
+		total += g->frames;
+	}
+	start[nseg] = total;
+
+	memset(&b, 0, sizeof(b));
+	s = 0;
+	while (pos < total) {
+		u32 n = 32 + lrand48() % 4065;
+		if (pos + n > total)
+			n = total - pos;
+		/* stop at segment ends, to check the state there */
+		if (pos + n > start[s + 1])
+			n = start[s + 1] - pos;
+		if (hdspe_iec61937_scan(&b, test_l + pos, test_r + pos,
+					n, pos))
+			events++;
+		pos += n;
+
+		if (pos == start[s + 1]) {
+			const struct segment* g = &test_segments[s];
+			/* PCM after bursts: not before the timeout. */
+			u32 size = g->size;
+			if (!size && s > 0 && g->frames <= HDSPE_IEC61937_TIMEOUT)
+				size = test_segments[s - 1].size;
+			if (b.size != size ||
+			    (size && (b.pc != g->pc || b.pd != g->pd))) {
+				fprintf(stderr, "%s: got size %u pc %u pd %u, expected %u %u %u.\n",
+					g->name, b.size, b.pc, b.pd,
+					size, g->pc, g->pd);
+				ok = 0;
+			}
+			s++;
+		}
+	}
+
+	if (events != nseg - 1) {
+		fprintf(stderr, "%d change events, expected %d.\n",
+			events, nseg - 1);
+		ok = 0;
+	}
+	return ok;
+}
+
+/* Sync words in the last frame of a period, Pc / Pd in the next. */
+int test_split_sync(void)
+{
+	struct hdspe_iec61937 b;
+	int ok = 1;
+
+	memset(&b, 0, sizeof(b));
+	gen_bursts(0, 4096, 16, 1, 1234, 1536);
+	test_l[1537] = 2 << 16;		/* next burst has another type */
+	ok &= hdspe_iec61937_scan(&b, test_l, test_r, 1537, 0);
+	ok &= b.size == 16 && b.pc == 1 && b.pending == 16;
+	ok &= hdspe_iec61937_scan(&b, test_l + 1537, test_r + 1537, 100, 1537);
+	ok &= b.size == 16 && b.pc == 2 && b.pd == 1234 && b.pending == 0;
+	ok &= b.last_sync == 1536;
+	if (!ok)
+		fprintf(stderr, "split sync: size %u pc %u pd %u pending %u.\n",
+			b.size, b.pc, b.pd, b.pending);
+	return ok;
+}
+
+int test(int (*testfun)(void), const char* testname)
+{
+	double t = get_time();
+	int ok = testfun();
+	fprintf(stderr, "%s test %s, took %.3f msec.\n", testname,
+		ok ? "passed" : "FAILED", (get_time()-t)*1e3);
+	return ok;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Timing: scanning one channel pair, in nanoseconds per frame.
+
+void bench(const char* name, u32 period)
+{
+	struct hdspe_iec61937 b;
+	double t;
+
+	memset(&b, 0, sizeof(b));
+	t = get_time();
+	for (u32 pos = 0; pos + period <= TEST_FRAMES; pos += period)
+		hdspe_iec61937_scan(&b, test_l + pos, test_r + pos,
+				    period, pos);
+	t = get_time() - t;
+	fprintf(stderr, "%-28s %6.2f nsec/frame.\n", name,
+		t * 1e9 / TEST_FRAMES);
+}
+
+int main(int argc, char** argv)
+{
+	int ok = 1;
+	srand48(time(NULL));
+	ok &= test(test_segments_random_periods, "Burst segments");
+	ok &= test(test_split_sync, "Split sync words");
+
+	gen_pcm(0, TEST_FRAMES);
+	bench("PCM, 64 frame periods", 64);
+	bench("PCM, 1024 frame periods", 1024);
+	gen_bursts(0, TEST_FRAMES, 16, 1, 49152, 1536);
+	bench("AC-3, 1024 frame periods", 1024);
+
+	fprintf(stderr, ok ? "All tests passed.\n" : "Tests FAILED.\n");
+	return ok ? 0 : 1;
+}
+#endif /*UNIT_TESTING*/
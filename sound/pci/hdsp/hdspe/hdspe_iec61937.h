@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file hdspe_iec61937.h
+ * @brief RME HDSPe IEC 61937 / SMPTE 337 non-PCM burst detection.
+ */
+
+#ifndef HDSPE_IEC61937_H
+#define HDSPE_IEC61937_H
+
+#ifdef UNIT_TESTING
+#include <stdint.h>
+#include <stdbool.h>
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef uint32_t __le32;
+#define le32_to_cpu(x) (x)	/* little endian hosts only */
+#else
+#include <linux/types.h>
+#include <asm/byteorder.h>
+#endif /*UNIT_TESTING*/
+
+/* No sync words for this many frames means PCM audio. Longer than the
+ * longest burst repetition period (15360 frames, MAT / Dolby TrueHD). */
+#define HDSPE_IEC61937_TIMEOUT	32768
+
+/**
+ * struct hdspe_iec61937: burst detection state of a channel pair.
+ * @size: sync word size: 16, 20 or 24 bits, or 0 if PCM audio.
+ * @pc: burst info Pc of the last burst. Bits 0..6 are the data type.
+ * @pd: length code Pd of the last burst.
+ * @pending: sync word size if the last frame scanned held the sync words,
+ * and Pc / Pd are in the next frame.
+ * @last_sync: frame count at the last sync words.
+ */
+struct hdspe_iec61937 {
+	u32 size;
+	u32 pc;
+	u32 pd;
+	u32 pending;
+	u64 last_sync;
+};
+
+/**
+ * hdspe_iec61937_scan: Scan audio for burst sync words Pa / Pb.
+ * @b: detection state of the channel pair.
+ * @l: left channel (Pa, Pc) 32-bit samples, audio in bits 31..8.
+ * @r: right channel (Pb, Pd) samples.
+ * @n: number of samples.
+ * @frame: frame count of the first sample.
+ * Returns true if the sync word size or data type changed.
+ */
+extern bool hdspe_iec61937_scan(struct hdspe_iec61937* b,
+				const __le32* l, const __le32* r,
+				u32 n, u64 frame);
+
+#endif /* HDSPE_IEC61937_H */
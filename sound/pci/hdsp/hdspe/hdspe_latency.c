@@ -0,0 +1,244 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * hdspe_latency.c
+ * @brief RME HDSPe per-port converter and transport latency.
+ *
+ * ALSA reports the latency of the DMA buffers. Analog ports add the
+ * group delay of the AD / DA converters on top of that, which differs
+ * per speed mode. The model tables (hdspe_tables::port_latency) list
+ * nominal values per port name prefix. They are expanded into per logical
+ * channel tables for each speed mode at initialization, which can be
+ * calibrated with the 'Input Latency' and 'Output Latency' controls.
+ * Clients get them through these controls, the
+ * SNDRV_HDSPE_IOCTL_GET_LATENCY hwdep ioctl, or, if the 'Port Latency
+ * In PCM Delay' control is on, in the PCM delay: the largest latency of
+ * the channels of the stream is added to it.
+ */
+
+#include "hdspe.h"
+#include "hdspe_core.h"
+#include "hdspe_control.h"
+
+static const struct hdspe_port_latency* hdspe_find_port_latency(
+	struct hdspe* hdspe, const char* port)
+{
+	const struct hdspe_port_latency* l = hdspe->t.port_latency;
+
+	for (; l && l->port; l++) {
+		if (strncmp(port, l->port, strlen(l->port)) == 0)
+			return l;
+	}
+	return NULL;
+}
+
+static void hdspe_init_speed_latency(struct hdspe* hdspe,
+				     enum hdspe_speed speed,
+				     const char * const *names_in, int n_in,
+				     const char * const *names_out, int n_out)
+{
+	const struct hdspe_port_latency* l;
+	int i;
+
+	for (i = 0; i < n_in; i++) {
+		l = hdspe_find_port_latency(hdspe, names_in[i]);
+		hdspe->latency_in[speed][i] = l ? l->in[speed] : 0;
+	}
+	for (i = 0; i < n_out; i++) {
+		l = hdspe_find_port_latency(hdspe, names_out[i]);
+		hdspe->latency_out[speed][i] = l ? l->out[speed] : 0;
+	}
+}
+
+void hdspe_init_latency(struct hdspe* hdspe)
+{
+	struct hdspe_tables* t = &hdspe->t;
+
+	memset(hdspe->latency_in, 0, sizeof(hdspe->latency_in));
+	memset(hdspe->latency_out, 0, sizeof(hdspe->latency_out));
+	hdspe_init_speed_latency(hdspe, HDSPE_SPEED_SINGLE,
+				 t->port_names_in_ss, t->ss_in_channels,
+				 t->port_names_out_ss, t->ss_out_channels);
+	hdspe_init_speed_latency(hdspe, HDSPE_SPEED_DOUBLE,
+				 t->port_names_in_ds, t->ds_in_channels,
+				 t->port_names_out_ds, t->ds_out_channels);
+	hdspe_init_speed_latency(hdspe, HDSPE_SPEED_QUAD,
+				 t->port_names_in_qs, t->qs_in_channels,
+				 t->port_names_out_qs, t->qs_out_channels);
+	hdspe->latency_delay = false;
+}
+
+int hdspe_get_latency(struct hdspe* hdspe, struct hdspe_latency* l)
+{
+	enum hdspe_speed speed = l->speed;
+
+	spin_lock_irq(&hdspe->lock);
+	if (speed == HDSPE_SPEED_INVALID)
+		speed = hdspe->channel_map_speed;
+	if (speed >= HDSPE_SPEED_COUNT) {
+		spin_unlock_irq(&hdspe->lock);
+		return -EINVAL;
+	}
+
+	memset(l, 0, sizeof(*l));
+	l->speed = speed;
+	switch (speed) {
+	case HDSPE_SPEED_SINGLE:
+		l->in_channels = hdspe->t.ss_in_channels;
+		l->out_channels = hdspe->t.ss_out_channels;
+		break;
+	case HDSPE_SPEED_DOUBLE:
+		l->in_channels = hdspe->t.ds_in_channels;
+		l->out_channels = hdspe->t.ds_out_channels;
+		break;
+	default:
+		l->in_channels = hdspe->t.qs_in_channels;
+		l->out_channels = hdspe->t.qs_out_channels;
+	}
+	memcpy(l->in, hdspe->latency_in[speed], sizeof(l->in));
+	memcpy(l->out, hdspe->latency_out[speed], sizeof(l->out));
+	spin_unlock_irq(&hdspe->lock);
+	return 0;
+}
+
+/* Called from the PCM pointer callback. */
+u32 hdspe_latency_delay(struct hdspe* hdspe, int stream,
+			unsigned int channels)
+{
+	const u16* lat = (stream == SNDRV_PCM_STREAM_PLAYBACK)
+		? hdspe->latency_out[hdspe->channel_map_speed]
+		: hdspe->latency_in[hdspe->channel_map_speed];
+	u32 delay = 0;
+	unsigned int i;
+
+	if (!hdspe->latency_delay)
+		return 0;
+
+	for (i = 0; i < channels && i < HDSPE_MAX_CHANNELS; i++)
+		delay = max_t(u32, delay, lat[i]);
+	return delay;
+}
+
+static int snd_hdspe_info_latency(struct snd_kcontrol* kcontrol,
+				  struct snd_ctl_elem_info *uinfo)
+{
+	struct hdspe *hdspe = snd_kcontrol_chip(kcontrol);
+
+	uinfo->type = SNDRV_CTL_ELEM_TYPE_INTEGER;
+	uinfo->count = kcontrol->private_value == SNDRV_PCM_STREAM_PLAYBACK
+		? hdspe->t.ss_out_channels : hdspe->t.ss_in_channels;
+	uinfo->value.integer.min = 0;
+	uinfo->value.integer.max = 65535;
+	uinfo->value.integer.step = 1;
+	return 0;
+}
+
+#define snd_hdspe_info_latency_in snd_hdspe_info_latency
+#define snd_hdspe_info_latency_out snd_hdspe_info_latency
+
+/* The channels of the current speed mode. Those beyond are 0. */
+static u16* hdspe_latency_table(struct hdspe* hdspe, int stream,
+				unsigned int* channels)
+{
+	if (stream == SNDRV_PCM_STREAM_PLAYBACK) {
+		*channels = hdspe->max_channels_out;
+		return hdspe->latency_out[hdspe->channel_map_speed];
+	}
+	*channels = hdspe->max_channels_in;
+	return hdspe->latency_in[hdspe->channel_map_speed];
+}
+
+static int snd_hdspe_get_latency(struct snd_kcontrol *kcontrol,
+				 struct snd_ctl_elem_value *ucontrol)
+{
+	struct hdspe *hdspe = snd_kcontrol_chip(kcontrol);
+	unsigned int i, n;
+	const u16* lat;
+
+	spin_lock_irq(&hdspe->lock);
+	lat = hdspe_latency_table(hdspe, kcontrol->private_value, &n);
+	for (i = 0; i < HDSPE_MAX_CHANNELS; i++)
+		ucontrol->value.integer.value[i] = i < n ? lat[i] : 0;
+	spin_unlock_irq(&hdspe->lock);
+	return 0;
+}
+
+#define snd_hdspe_get_latency_in snd_hdspe_get_latency
+#define snd_hdspe_get_latency_out snd_hdspe_get_latency
+
+static int snd_hdspe_put_latency(struct snd_kcontrol *kcontrol,
+				 struct snd_ctl_elem_value *ucontrol)
+{
+	struct hdspe *hdspe = snd_kcontrol_chip(kcontrol);
+	unsigned int i, n;
+	int changed = 0;
+	u16* lat;
+
+	spin_lock_irq(&hdspe->lock);
+	lat = hdspe_latency_table(hdspe, kcontrol->private_value, &n);
+	for (i = 0; i < n; i++) {
+		long val = ucontrol->value.integer.value[i];
+		if (val < 0 || val > 65535) {
+			spin_unlock_irq(&hdspe->lock);
+			return -EINVAL;
+		}
+	}
+	for (i = 0; i < n; i++) {
+		changed |= lat[i] != ucontrol->value.integer.value[i];
+		lat[i] = ucontrol->value.integer.value[i];
+	}
+	spin_unlock_irq(&hdspe->lock);
+	return changed;
+}
+
+#define snd_hdspe_put_latency_in snd_hdspe_put_latency
+#define snd_hdspe_put_latency_out snd_hdspe_put_latency
+
+static int snd_hdspe_get_latency_delay(struct snd_kcontrol *kcontrol,
+				       struct snd_ctl_elem_value *ucontrol)
+{
+	struct hdspe *hdspe = snd_kcontrol_chip(kcontrol);
+
+	ucontrol->value.integer.value[0] = hdspe->latency_delay;
+	return 0;
+}
+
+static int snd_hdspe_put_latency_delay(struct snd_kcontrol *kcontrol,
+				       struct snd_ctl_elem_value *ucontrol)
+{
+	struct hdspe *hdspe = snd_kcontrol_chip(kcontrol);
+	bool val = ucontrol->value.integer.value[0];
+	int changed;
+
+	spin_lock_irq(&hdspe->lock);
+	changed = hdspe->latency_delay != val;
+	hdspe->latency_delay = val;
+	spin_unlock_irq(&hdspe->lock);
+	return changed;
+}
+
+static const struct snd_kcontrol_new snd_hdspe_controls_latency[] = {
+	HDSPE_RW_BOOL_KCTL(CARD, "Port Latency In PCM Delay", latency_delay)
+};
+
+int hdspe_create_latency_controls(struct hdspe* hdspe)
+{
+	struct snd_kcontrol_new in = HDSPE_RWV_KCTL(
+		CARD, "Input Latency", latency_in);
+	struct snd_kcontrol_new out = HDSPE_RWV_KCTL(
+		CARD, "Output Latency", latency_out);
+	int err;
+
+	in.private_value = SNDRV_PCM_STREAM_CAPTURE;
+	err = hdspe_add_control_id(hdspe, &in, &hdspe->cid.latency_in);
+	if (err < 0)
+		return err;
+
+	out.private_value = SNDRV_PCM_STREAM_PLAYBACK;
+	err = hdspe_add_control_id(hdspe, &out, &hdspe->cid.latency_out);
+	if (err < 0)
+		return err;
+
+	return hdspe_add_controls(
+		hdspe, ARRAY_SIZE(snd_hdspe_controls_latency),
+		snd_hdspe_controls_latency);
+}
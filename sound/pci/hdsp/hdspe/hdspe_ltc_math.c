@@ -8,6 +8,10 @@
 
 #include "hdspe_ltc_math.h"
 
+#if defined(UNIT_TESTING) || !defined(__KERNEL__)
+typedef uint32_t u32;
+#endif /*UNIT_TESTING || !__KERNEL__*/
+
 int hdspe_ltc_fpd(int fps, int df)
 {
 	return df ? 24*107892 : 24*60*60*fps;
@@ -280,13 +284,19 @@ unsigned int hdspe_ltc32_diff_frames(u32 ltc1, u32 ltc2, int fps, int df)
 
 #ifdef UNIT_TESTING
 /////////////////////////////////////////////////////////////////////////////
-// Unit testing.
+// Unit testing and timing, in user space:
+// gcc -DUNIT_TESTING -O2 -o ltc_test hdspe_ltc_math.c && ./ltc_test
 
 #include <time.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 
+int ltc_cmp(int h, int m, int s, int f, int h1, int m1, int s1, int f1)
+{
+	return h != h1 ? h - h1 : m != m1 ? m - m1 : s != s1 ? s - s1 : f - f1;
+}
+
 int test_compose_parse(int h, int m, int s, int f, int fps, int df)
 {
 	int h1, m1, s1, f1;	
@@ -309,7 +319,7 @@ int test_incr_decr_32(int h, int m, int s, int f, int fps, int df)
 	int frames = hdspe_ltc32_to_frames(ltc, fps, df);
 	u32 ltc1 = hdspe_ltc32_incr(ltc, fps, df);
 	int frames1 = hdspe_ltc32_to_frames(ltc1, fps, df);
-	if (frames1 != frames+1) {
+	if (frames1 != (frames+1) % hdspe_ltc_fpd(fps, df)) {
 		fprintf(stderr, "%08x %d %sfps (frames=%d) +1 = %08x (frames %d)\n",
 			ltc, fps, df ? "d" : "", frames,
 			ltc1, frames1);
@@ -369,6 +379,42 @@ int test_add_diff_32(int h, int m, int s, int f, int fps, int df)
 	return 1;
 }
 
+/* Properties that must hold for any pair of valid codes: differences
+ * in both directions add up to a full day (or zero), adding the
+ * difference back reproduces the code, and frame counts outside the
+ * day wrap. */
+int test_diff_properties_32(int h, int m, int s, int f, int fps, int df)
+{
+	int fpd = hdspe_ltc_fpd(fps, df);
+	u32 ltc = hdspe_ltc32_compose(h, m, s, f);
+	u32 ltc1 = hdspe_ltc32_from_frames(lrand48() % fpd, fps, df);
+	int d12 = hdspe_ltc32_diff_frames(ltc, ltc1, fps, df);
+	int d21 = hdspe_ltc32_diff_frames(ltc1, ltc, fps, df);
+	int frames = hdspe_ltc32_to_frames(ltc, fps, df);
+	if ((d12 + d21) % fpd != 0) {
+		fprintf(stderr, "hdspe_ltc32_diff_frames: %08x - %08x = %d, reverse %d.\n",
+			ltc, ltc1, d12, d21);
+		return 0;
+	}
+	if (hdspe_ltc32_cmp(hdspe_ltc32_add_frames(d12, ltc1, fps, df), ltc) != 0) {
+		fprintf(stderr, "hdspe_ltc32_add_frames: %08x + %d != %08x.\n",
+			ltc1, d12, ltc);
+		return 0;
+	}
+	if (hdspe_ltc32_cmp(hdspe_ltc32_from_frames(frames + fpd, fps, df), ltc) != 0 ||
+	    hdspe_ltc32_cmp(hdspe_ltc32_from_frames(frames - fpd, fps, df), ltc) != 0) {
+		fprintf(stderr, "hdspe_ltc32_from_frames: %d +/- %d does not wrap.\n",
+			frames, fpd);
+		return 0;
+	}
+	if ((hdspe_ltc32_cmp(ltc, ltc1) > 0) != (frames > hdspe_ltc32_to_frames(ltc1, fps, df))) {
+		fprintf(stderr, "hdspe_ltc32_cmp: %08x <> %08x disagrees with frames.\n",
+			ltc, ltc1);
+		return 0;
+	}
+	return 1;
+}
+
 int test_format(int fps, int df,
 		int (*testfun)(int h, int m, int s, int f, int fps, int df),
 		char* testname)
@@ -415,13 +461,85 @@ int test(int (*testfun)(int h, int m, int s, int f, int fps, int df),
 	return ok;
 }
 
+/////////////////////////////////////////////////////////////////////////////
+// Timing: the routines called from the TCO period interrupt handler,
+// over a full day of 30 drop-frame codes, in nanoseconds per call.
+
+#define BENCH_FPS 30
+#define BENCH_DF 1
+
+volatile u32 bench_sink;
+
+void bench(const char *name, u32 (*fun)(u32 ltc, int frames))
+{
+	int fpd = hdspe_ltc_fpd(BENCH_FPS, BENCH_DF);
+	u32 *codes = malloc(fpd * sizeof(u32));
+	u32 acc = 0;
+	for (int i = 0; i < fpd; i++)
+		codes[i] = hdspe_ltc32_from_frames(i, BENCH_FPS, BENCH_DF);
+	double t = get_time();
+	for (int i = 0; i < fpd; i++)
+		acc += fun(codes[i], i);
+	t = get_time() - t;
+	bench_sink = acc;
+	free(codes);
+	fprintf(stderr, "%-24s %6.1f nsec/call.\n", name, t * 1e9 / fpd);
+}
+
+u32 bench_from_frames(u32 ltc, int frames)
+{
+	return hdspe_ltc32_from_frames(frames, BENCH_FPS, BENCH_DF);
+}
+
+u32 bench_to_frames(u32 ltc, int frames)
+{
+	return hdspe_ltc32_to_frames(ltc, BENCH_FPS, BENCH_DF);
+}
+
+u32 bench_incr(u32 ltc, int frames)
+{
+	return hdspe_ltc32_incr(ltc, BENCH_FPS, BENCH_DF);
+}
+
+u32 bench_decr(u32 ltc, int frames)
+{
+	return hdspe_ltc32_decr(ltc, BENCH_FPS, BENCH_DF);
+}
+
+u32 bench_add_frames(u32 ltc, int frames)
+{
+	return hdspe_ltc32_add_frames(frames & 0xff, ltc, BENCH_FPS, BENCH_DF);
+}
+
+u32 bench_diff_frames(u32 ltc, int frames)
+{
+	return hdspe_ltc32_diff_frames(ltc, 0x12345612, BENCH_FPS, BENCH_DF);
+}
+
+u32 bench_running(u32 ltc, int frames)
+{
+	return hdspe_ltc32_running(ltc, ltc + 1, BENCH_FPS, BENCH_DF);
+}
+
 int main(int argc, char** agrv)
 {
-	test(test_compose_parse, "32-bit LTC compose/parse");
-	test(test_to_from_frames_32, "32-bit LTC to/from frames conversion");
-	test(test_incr_decr_32, "32-bit LTC increment/decrement");
-	test(test_add_diff_32, "32-bit LTC add/diff/running");	
-	return 0;
+	int ok = 1;
+	srand48(time(NULL));
+	ok &= test(test_compose_parse, "32-bit LTC compose/parse");
+	ok &= test(test_to_from_frames_32, "32-bit LTC to/from frames conversion");
+	ok &= test(test_incr_decr_32, "32-bit LTC increment/decrement");
+	ok &= test(test_add_diff_32, "32-bit LTC add/diff/running");	
+	ok &= test(test_diff_properties_32, "32-bit LTC diff/cmp properties");
+
+	bench("hdspe_ltc32_from_frames", bench_from_frames);
+	bench("hdspe_ltc32_to_frames", bench_to_frames);
+	bench("hdspe_ltc32_incr", bench_incr);
+	bench("hdspe_ltc32_decr", bench_decr);
+	bench("hdspe_ltc32_add_frames", bench_add_frames);
+	bench("hdspe_ltc32_diff_frames", bench_diff_frames);
+	bench("hdspe_ltc32_running", bench_running);
+
+	fprintf(stderr, ok ? "All tests passed.\n" : "Tests FAILED.\n");
+	return ok ? 0 : 1;
 }
 #endif /*UNIT_TESTING*/
-
@@ -11,7 +11,17 @@
 #ifndef HDSPE_LTC_MATH_H
 #define HDSPE_LTC_MATH_H
 
+/* No kernel dependencies: also built into user space clients, and into
+ * the self-test in hdspe_ltc_math.c. Hence uint32_t rather than u32. */
+#if defined(UNIT_TESTING) || !defined(__KERNEL__)
+#include <stdint.h>
+#else
 #include <linux/types.h>
+#endif /*UNIT_TESTING || !__KERNEL__*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 /**
  * hdspe_ltc_fpd: Frames per day. 
@@ -30,7 +40,8 @@ extern int hdspe_ltc_fpd(int fps, int df);
  * @s seconds.
  * @f: frames.
  */
-extern void hdspe_ltc32_parse(u32 ltc, int *h, int *m, int *s, int *f);
+extern void hdspe_ltc32_parse(uint32_t ltc,
+			      int *h, int *m, int *s, int *f);
 
 /**
  * hdspe_ltc32_compose: Convert hours, minutes, seconds and frames quadruple 
@@ -41,14 +52,14 @@ extern void hdspe_ltc32_parse(u32 ltc, int *h, int *m, int *s, int *f);
  * @f: frames 0 .. @fps-1
  * Returns 32-bit LTC code.
  */
-extern u32 hdspe_ltc32_compose(int h, int m, int s, int f);
+extern uint32_t hdspe_ltc32_compose(int h, int m, int s, int f);
 
 /**
  * hdspe_ltc32_cmp: Compare two 32-bit LTC codes. 
  * @ltc1, @ltc2: two LTC codes to compare.
  * Returns >0 if @ltc1 > @ltc2, <0 if @ltc1 < @ltc2 and 0 if equal. 
  */
-extern int hdspe_ltc32_cmp(u32 ltc1, u32 ltc2);
+extern int hdspe_ltc32_cmp(uint32_t ltc1, uint32_t ltc2);
 
 /**
  * hdspe_ltc32_to_frames: Convert 32-bit LTC code to frames since midnight.
@@ -57,7 +68,7 @@ extern int hdspe_ltc32_cmp(u32 ltc1, u32 ltc2);
  * @df: 30DF drop frame LTC format (TRUE or FALSE).
  * Returns number of frames since midnight.
  */
-extern unsigned int hdspe_ltc32_to_frames(u32 ltc, int fps, int df);
+extern unsigned int hdspe_ltc32_to_frames(uint32_t ltc, int fps, int df);
 
 /**
  * hdspe_ltc32_from_frames: Convert frame count since midnight to 
@@ -68,7 +79,7 @@ extern unsigned int hdspe_ltc32_to_frames(u32 ltc, int fps, int df);
  * @df: 30DF drop frame LTC format (TRUE or FALSE).
  * Returns 32-bit LTC code.
  */
-extern u32 hdspe_ltc32_from_frames(int frames, int fps, int df);
+extern uint32_t hdspe_ltc32_from_frames(int frames, int fps, int df);
 
 /**
  * hdspe_ltc32_decr: Decrement 32-bit LTC by one frame.
@@ -78,7 +89,7 @@ extern u32 hdspe_ltc32_from_frames(int frames, int fps, int df);
  * Returns 32-bit LTC code, one frame less than @ltc. Returns 23:59:59:@fps-1
  * if @ltc is 00:00:00:00.
  */
-extern u32 hdspe_ltc32_decr(u32 ltc, int fps, int df);
+extern uint32_t hdspe_ltc32_decr(uint32_t ltc, int fps, int df);
 
 /**
  * hdspe_ltc32_incr: Increment 32-bit LTC by one frame.
@@ -88,7 +99,7 @@ extern u32 hdspe_ltc32_decr(u32 ltc, int fps, int df);
  * Returns 32-bit LTC code, one frame ahead of @ltc. Returns 00:00:00:00
  * if @ltc is 23:59:59:@fps-1.
  */
-extern u32 hdspe_ltc32_incr(u32 ltc, int fps, int df);
+extern uint32_t hdspe_ltc32_incr(uint32_t ltc, int fps, int df);
 
 /**
  * hdspe_ltc32_running: LTC running direction.
@@ -99,7 +110,8 @@ extern u32 hdspe_ltc32_incr(u32 ltc, int fps, int df);
  * one frame before ltc1, and 0 in other cases. Use this to determine LTC
  * running direction (1 = forward, -1 = backward, 0 = stationary or jumping).
  */
-extern int hdspe_ltc32_running(u32 ltc1, u32 ltc2, int fps, int df);
+extern int hdspe_ltc32_running(uint32_t ltc1, uint32_t ltc2,
+			       int fps, int df);
 
 /**
  * hdspe_ltc32_add_frames: add n frames to 32-bit LTC code. 
@@ -110,7 +122,7 @@ extern int hdspe_ltc32_running(u32 ltc1, u32 ltc2, int fps, int df);
  * Returns @ltc + @n frames. LTC code wraps from 23:59:59:@fps-1 to 
  * 00:00:00:00 and back.
  */
-extern u32 hdspe_ltc32_add_frames(int n, u32 ltc, int fps, int df);
+extern uint32_t hdspe_ltc32_add_frames(int n, uint32_t ltc, int fps, int df);
 
 /**
  * hdspe_ltc32_diff_frames: return LTC code difference in frames.
@@ -120,7 +132,11 @@ extern u32 hdspe_ltc32_add_frames(int n, u32 ltc, int fps, int df);
  * Returns @ltc1 - @ltc2 in frames. Return value is always in the range 
  * 0 ... fpd()-1. 
  */
-extern unsigned int hdspe_ltc32_diff_frames(u32 ltc1, u32 ltc2,
-				      int fps, int df);
+extern unsigned int hdspe_ltc32_diff_frames(uint32_t ltc1, uint32_t ltc2,
+					    int fps, int df);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* HDSPE_LTC_MATH_H */
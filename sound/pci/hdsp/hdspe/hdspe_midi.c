@@ -158,7 +158,7 @@ snd_hdspe_midi_input_trigger(struct snd_rawmidi_substream *substream, int up)
 	return;
 
 	if (changed)
-		dev_dbg(hdspe->card->dev,
+		hdspe_dbg_hot(hdspe,
 			"%s: MIDI port %d input %s. IE=0x%08x.\n",
 			__func__, hmidi->id, up ? "UP" : "DOWN", hmidi->ie);
 }
@@ -206,7 +206,7 @@ snd_hdspe_midi_output_trigger(struct snd_rawmidi_substream *substream, int up)
 	if (up)
 		snd_hdspe_midi_output_write(hmidi);
 	
-	dev_dbg(hmidi->hdspe->card->dev,
+	hdspe_dbg_hot(hmidi->hdspe,
 		"%s: MIDI port %d output %s.\n",
 		__func__, hmidi->id, up ? "UP" : "DOWN");
 }
@@ -15,6 +15,13 @@
 #include "hdspe_control.h"
 
 #include <linux/slab.h>
+#include <linux/bitmap.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/version.h>
 
 
 /* for each output channel (chan) I have an Input (in) and Playback (pb) Fader
@@ -99,55 +106,283 @@ void hdspe_mixer_read_proc(struct snd_info_entry *entry,
 	}
 }
 
-void hdspe_mixer_update_channel_map(struct hdspe* hdspe)
+/* ------------------- mixer export / import ---------------------- */
+
+/* The "mixer.csv" proc file lists the non-zero crosspoints of the
+ * hardware mixer as "destination,source,gain" records. Sources are
+ * numbered as for the "Mixer" control element: 0..63 are the hardware
+ * inputs, 64..127 the playback channels.
+ *
+ * Reading goes through a seq_file iterator: one step per destination,
+ * each taking a snapshot of its row under the mixer lock, so the dump is
+ * streamed without a text buffer for the whole matrix and no lock is held
+ * across steps.
+ *
+ * Records written to the file set the corresponding crosspoints as the
+ * lines come in, in any number of write() calls of any size. A "reset"
+ * line clears the whole matrix first, so that writing back a saved dump
+ * after it restores the mixer exactly. Bad records and over-long lines
+ * are skipped, and counted in a warning when the file is closed.
+ *
+ * Being a seq_file, the file is made with proc_create_data() in the card
+ * proc directory, which exists only once the card is registered: see
+ * hdspe_mixer_proc_init(). It goes with that directory. */
+
+#define HDSPE_MIXER_SOURCES	(2 * HDSPE_MIXER_CHANNELS)
+
+struct hdspe_mixer_csv {
+	struct hdspe *hdspe;
+	u16 gain[HDSPE_MIXER_SOURCES];	/* row of the current step */
+	unsigned int bad;		/* bad records written */
+	bool skip;			/* skipping an over-long line */
+	int len;
+	char line[32];			/* partial input line */
+};
+
+static u16 hdspe_read_xpoint_gain(struct hdspe *hdspe, unsigned int dest,
+				  unsigned int src)
+{
+	return src >= HDSPE_MIXER_CHANNELS
+		? hdspe_read_pb_gain(hdspe, dest, src - HDSPE_MIXER_CHANNELS)
+		: hdspe_read_in_gain(hdspe, dest, src);
+}
+
+/* Position 0 is the header line, position dest+1 the row of dest. */
+static void *hdspe_mixer_seq_start(struct seq_file *m, loff_t *pos)
+{
+	if (*pos == 0)
+		return SEQ_START_TOKEN;
+	return *pos <= HDSPE_MIXER_CHANNELS ? pos : NULL;
+}
+
+static void *hdspe_mixer_seq_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	(*pos)++;
+	return *pos <= HDSPE_MIXER_CHANNELS ? pos : NULL;
+}
+
+static void hdspe_mixer_seq_stop(struct seq_file *m, void *v)
+{
+}
+
+static int hdspe_mixer_seq_show(struct seq_file *m, void *v)
+{
+	struct hdspe_mixer_csv *csv = m->private;
+	struct hdspe *hdspe = csv->hdspe;
+	unsigned int dest, src;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_puts(m, "# destination,source,gain\n");
+		return 0;
+	}
+
+	dest = *(loff_t *)v - 1;
+	spin_lock_irq(&hdspe->lock);
+	for (src = 0; src < HDSPE_MIXER_SOURCES; src++)
+		csv->gain[src] = hdspe_read_xpoint_gain(hdspe, dest, src);
+	spin_unlock_irq(&hdspe->lock);
+
+	for (src = 0; src < HDSPE_MIXER_SOURCES; src++)
+		if (csv->gain[src] != 0)
+			seq_printf(m, "%u,%u,%u\n", dest, src, csv->gain[src]);
+	return 0;
+}
+
+static const struct seq_operations hdspe_mixer_seq_ops = {
+	.start = hdspe_mixer_seq_start,
+	.next = hdspe_mixer_seq_next,
+	.stop = hdspe_mixer_seq_stop,
+	.show = hdspe_mixer_seq_show
+};
+
+/* Clear one output at a time, not to keep interrupts disabled for too
+ * long. */
+static void hdspe_mixer_reset(struct hdspe *hdspe)
 {
 	int i, j;
-	bool used[HDSPE_MAX_CHANNELS];
 
-	dev_dbg(hdspe->card->dev, "%s:\n", __func__);
-	
-	/* mute all unused playback channels */
-	for (i = 0; i < HDSPE_MIXER_CHANNELS; i ++) {
-		used[i] = false;
+	for (i = 0; i < HDSPE_MIXER_CHANNELS; i++) {
+		spin_lock_irq(&hdspe->lock);
+		for (j = 0; j < HDSPE_MIXER_CHANNELS; j++) {
+			hdspe_write_in_gain(hdspe, i, j, 0);
+			hdspe_write_pb_gain(hdspe, i, j, 0);
+		}
+		spin_unlock_irq(&hdspe->lock);
+	}
+}
+
+/* Parse and apply a single "destination,source,gain" record, or "reset".
+ * Empty lines and lines starting with '#' are ignored. */
+static int hdspe_mixer_import_line(struct hdspe *hdspe, char *line)
+{
+	unsigned int dest, src, gain;
+
+	line = strim(line);
+	if (*line == '\0' || *line == '#')
+		return 0;
+
+	if (strcmp(line, "reset") == 0) {
+		hdspe_mixer_reset(hdspe);
+		return 0;
 	}
-	for (i = 0; i < HDSPE_MIXER_CHANNELS; i ++) {
-		int c = hdspe->channel_map_out[i];
-		if (c >= 0)
-			used[c] = true;
+
+	if (sscanf(line, "%u,%u,%u", &dest, &src, &gain) != 3 ||
+	    dest >= HDSPE_MIXER_CHANNELS || src >= HDSPE_MIXER_SOURCES ||
+	    gain > 0xFFFF)
+		return -EINVAL;
+
+	spin_lock_irq(&hdspe->lock);
+	if (src >= HDSPE_MIXER_CHANNELS)
+		hdspe_write_pb_gain(hdspe, dest, src - HDSPE_MIXER_CHANNELS,
+				    gain);
+	else
+		hdspe_write_in_gain(hdspe, dest, src, gain);
+	spin_unlock_irq(&hdspe->lock);
+
+	return 0;
+}
+
+/* Apply the line collected in csv->line[], unless it was too long. */
+static void hdspe_mixer_csv_line(struct hdspe_mixer_csv *csv)
+{
+	csv->line[csv->len] = '\0';
+	if (csv->skip || hdspe_mixer_import_line(csv->hdspe, csv->line) < 0)
+		csv->bad++;
+	csv->len = 0;
+	csv->skip = false;
+}
+
+static ssize_t hdspe_mixer_csv_write(struct file *file,
+				     const char __user *ubuf,
+				     size_t count, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+	struct hdspe_mixer_csv *csv = m->private;
+	char buf[128];
+	size_t done, n, i;
+
+	if (!snd_hdspe_use_is_exclusive(csv->hdspe))
+		return -EBUSY;
+
+	for (done = 0; done < count; done += n) {
+		n = min(count - done, sizeof(buf));
+		if (copy_from_user(buf, ubuf + done, n))
+			return -EFAULT;
+
+		for (i = 0; i < n; i++) {
+			if (buf[i] == '\n')
+				hdspe_mixer_csv_line(csv);
+			else if (csv->len < sizeof(csv->line) - 1)
+				csv->line[csv->len++] = buf[i];
+			else
+				csv->skip = true;
+		}
+	}
+
+	return count;
+}
+
+static int hdspe_mixer_csv_open(struct inode *inode, struct file *file)
+{
+	struct hdspe_mixer_csv *csv;
+
+	csv = __seq_open_private(file, &hdspe_mixer_seq_ops, sizeof(*csv));
+	if (!csv)
+		return -ENOMEM;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
+	csv->hdspe = pde_data(inode);
+#else
+	csv->hdspe = PDE_DATA(inode);
+#endif
+	return 0;
+}
+
+static int hdspe_mixer_csv_release(struct inode *inode, struct file *file)
+{
+	struct seq_file *m = file->private_data;
+	struct hdspe_mixer_csv *csv = m->private;
+
+	/* last record without trailing newline */
+	if (csv->len > 0 || csv->skip)
+		hdspe_mixer_csv_line(csv);
+	if (csv->bad)
+		dev_warn(csv->hdspe->card->dev,
+			 "mixer.csv: %u invalid records skipped.\n", csv->bad);
+
+	return seq_release_private(inode, file);
+}
+
+static const struct proc_ops hdspe_mixer_csv_ops = {
+	.proc_open = hdspe_mixer_csv_open,
+	.proc_read = seq_read,
+	.proc_write = hdspe_mixer_csv_write,
+	.proc_lseek = seq_lseek,
+	.proc_release = hdspe_mixer_csv_release
+};
+
+void hdspe_mixer_proc_init(struct hdspe *hdspe)
+{
+#ifdef CONFIG_SND_PROC_FS
+	struct snd_info_entry *root = hdspe->card->proc_root;
+
+	if (!root || !root->p ||
+	    !proc_create_data("mixer.csv", 0644, root->p,
+			      &hdspe_mixer_csv_ops, hdspe))
+		dev_warn(hdspe->card->dev, "Could not create mixer.csv.\n");
+#endif /*CONFIG_SND_PROC_FS*/
+}
+
+/* Mute the mixer outputs and inputs whose DMA channel is not used in the
+ * current speed mode, and set up the monitoring profile routes of those
+ * that are. Only the channels that changed since the previous call are
+ * touched: all of them the first time. */
+void hdspe_mixer_update_channel_map(struct hdspe* hdspe)
+{
+	const struct hdspe_channel_map* in =
+		&hdspe->chmap_in[hdspe->channel_map_speed];
+	const struct hdspe_channel_map* out =
+		&hdspe->chmap_out[hdspe->channel_map_speed];
+	DECLARE_BITMAP(changed, HDSPE_MAX_CHANNELS);
+	unsigned int i, j;
+
+	dev_dbg(hdspe->card->dev, "%s:\n", __func__);
+
+	if (!hdspe->mixer_used_valid) {
+		bitmap_complement(hdspe->mixer_used_out, out->used,
+				  HDSPE_MAX_CHANNELS);
+		bitmap_complement(hdspe->mixer_used_in, in->used,
+				  HDSPE_MAX_CHANNELS);
+		hdspe->mixer_used_valid = true;
 	}
-	for (i = 0; i < HDSPE_MIXER_CHANNELS; i ++) {
-		if (!used[i]) {
+
+	/* mute all unused playback channels */
+	bitmap_xor(changed, hdspe->mixer_used_out, out->used,
+		   HDSPE_MAX_CHANNELS);
+	for_each_set_bit(i, changed, HDSPE_MIXER_CHANNELS) {
+		if (!test_bit(i, out->used)) {
 			for (j = 0; j < HDSPE_MIXER_CHANNELS; j ++) {
 				hdspe_write_in_gain(hdspe, i, j, 0);
 				hdspe_write_pb_gain(hdspe, i, j, 0);
 			}
-		} else {
-#ifdef DAW_MODE
+		} else if (hdspe->monitor_profile & HDSPE_MONITOR_DAW) {
 			hdspe_write_pb_gain(hdspe, i, i, HDSPE_UNITY_GAIN);
-#endif /*DAW_MODE*/
 		}
 	}
-	
+	bitmap_copy(hdspe->mixer_used_out, out->used, HDSPE_MAX_CHANNELS);
+
 	/* mute all unused capture channels */
-	for (i = 0; i < HDSPE_MIXER_CHANNELS; i ++) {
-		used[i] = false;
-	}
-	for (i = 0; i < HDSPE_MIXER_CHANNELS; i ++) {
-		int c = hdspe->channel_map_in[i];
-		if (c >=0)
-			used[c] = true;
-	}
-	for (i = 0; i < HDSPE_MIXER_CHANNELS; i ++) {	
-		if (!used[i]) {
+	bitmap_xor(changed, hdspe->mixer_used_in, in->used,
+		   HDSPE_MAX_CHANNELS);
+	for_each_set_bit(i, changed, HDSPE_MIXER_CHANNELS) {
+		if (!test_bit(i, in->used)) {
 			for (j = 0; j < HDSPE_MIXER_CHANNELS; j ++) {
 				hdspe_write_in_gain(hdspe, j, i, 0);
 			}
-		} else {
-#ifdef PASSTHROUGH_MODE
+		} else if (hdspe->monitor_profile & HDSPE_MONITOR_PASSTHROUGH) {
 			hdspe_write_in_gain(hdspe, i, i, HDSPE_UNITY_GAIN);
-#endif /*PASSTHROUGH_MODE*/
-		}		
+		}
 	}
+	bitmap_copy(hdspe->mixer_used_in, in->used, HDSPE_MAX_CHANNELS);
 }
 
 static void hdspe_clear_mixer(struct hdspe * hdspe, u16 sgain)
@@ -383,8 +618,74 @@ static int hdspe_nr_out_channels(struct hdspe* hdspe)
 	return 0;
 }
 
+/* Switch monitoring profile: set or clear the routes that differ, for the
+ * channels in use. Called with hdspe->lock held. */
+static void hdspe_mixer_set_monitor_profile(struct hdspe *hdspe,
+					    enum hdspe_monitor_profile profile)
+{
+	unsigned int changed = hdspe->monitor_profile ^ profile;
+	unsigned int i;
+
+	hdspe->monitor_profile = profile;
+
+	if (changed & HDSPE_MONITOR_DAW) {
+		u16 gain = (profile & HDSPE_MONITOR_DAW) ? HDSPE_UNITY_GAIN : 0;
+		for_each_set_bit(i, hdspe->mixer_used_out, HDSPE_MIXER_CHANNELS)
+			hdspe_write_pb_gain(hdspe, i, i, gain);
+	}
+	if (changed & HDSPE_MONITOR_PASSTHROUGH) {
+		u16 gain = (profile & HDSPE_MONITOR_PASSTHROUGH)
+			? HDSPE_UNITY_GAIN : 0;
+		for_each_set_bit(i, hdspe->mixer_used_in, HDSPE_MIXER_CHANNELS)
+			hdspe_write_in_gain(hdspe, i, i, gain);
+	}
+}
+
+static int snd_hdspe_info_monitor_profile(struct snd_kcontrol *kcontrol,
+					  struct snd_ctl_elem_info *uinfo)
+{
+	static const char *const texts[HDSPE_MONITOR_PROFILE_COUNT] = {
+		HDSPE_MONITOR_PROFILE_NAME(0),
+		HDSPE_MONITOR_PROFILE_NAME(1),
+		HDSPE_MONITOR_PROFILE_NAME(2),
+		HDSPE_MONITOR_PROFILE_NAME(3)
+	};
+	ENUMERATED_CTL_INFO(uinfo, texts);
+	return 0;
+}
+
+static int snd_hdspe_get_monitor_profile(struct snd_kcontrol *kcontrol,
+					 struct snd_ctl_elem_value *ucontrol)
+{
+	struct hdspe *hdspe = snd_kcontrol_chip(kcontrol);
+
+	ucontrol->value.enumerated.item[0] = hdspe->monitor_profile;
+	return 0;
+}
+
+static int snd_hdspe_put_monitor_profile(struct snd_kcontrol *kcontrol,
+					 struct snd_ctl_elem_value *ucontrol)
+{
+	struct hdspe *hdspe = snd_kcontrol_chip(kcontrol);
+	unsigned int val = ucontrol->value.enumerated.item[0];
+	int changed;
+
+	if (!snd_hdspe_use_is_exclusive(hdspe))
+		return -EBUSY;
+	if (val >= HDSPE_MONITOR_PROFILE_COUNT)
+		return -EINVAL;
+
+	spin_lock_irq(&hdspe->lock);
+	changed = val != hdspe->monitor_profile;
+	if (changed)
+		hdspe_mixer_set_monitor_profile(hdspe, val);
+	spin_unlock_irq(&hdspe->lock);
+	return changed;
+}
+
 static const struct snd_kcontrol_new snd_hdspe_controls_mixer[] = {
-	HDSPE_MIXER("Mixer", 0)
+	HDSPE_MIXER("Mixer", 0),
+	HDSPE_RW_KCTL(CARD, "Monitoring Profile", monitor_profile)
 };
 
 int hdspe_create_mixer_controls(struct hdspe* hdspe)
@@ -415,7 +716,8 @@ int hdspe_create_mixer_controls(struct hdspe* hdspe)
 	return 0;
 }
 
-int hdspe_init_mixer(struct hdspe* hdspe)
+int hdspe_init_mixer(struct hdspe* hdspe,
+		     enum hdspe_monitor_profile profile)
 {
 	dev_dbg(hdspe->card->dev, "kmalloc Mixer memory of %zd Bytes\n",
 		sizeof(*hdspe->mixer));
@@ -424,11 +726,145 @@ int hdspe_init_mixer(struct hdspe* hdspe)
 		return -ENOMEM;
 	
 	hdspe_clear_mixer(hdspe, 0 * HDSPE_UNITY_GAIN);
+	/* Routes set up with the first channel map, by hdspe_init(). */
+	hdspe->monitor_profile = profile;
 	
 	return 0;
 }
 
+/* Mixer automation ring. Applied by the interrupt handler, at period
+ * boundaries, under hdspe->lock. Only the driver copy of tail is trusted:
+ * user space may scribble on the shared one. */
+
+#define HDSPE_MIXER_RING_SIZE \
+	((HDSPE_MIXER_RING_BYTES - sizeof(struct hdspe_mixer_ring)) \
+	 / sizeof(struct hdspe_mixer_event))
+
+void hdspe_mixer_ring_period(struct hdspe* hdspe)
+{
+	struct hdspe_mixer_ring* r = hdspe->mixer_ring;
+	u64 frame = hdspe->frame_count;
+	u32 head, tail, n = 0, invalid = 0;
+
+	spin_lock(&hdspe->lock);
+	if (hdspe->mixer_ring_maps == 0)
+		goto unlock;
+
+	head = smp_load_acquire(&r->head);
+	if (head >= HDSPE_MIXER_RING_SIZE)
+		goto unlock;
+
+	for (tail = hdspe->mixer_ring_tail; tail != head;
+	     tail = (tail + 1) % HDSPE_MIXER_RING_SIZE) {
+		struct hdspe_mixer_event ev = r->event[tail];
+
+		if (ev.frame > frame)
+			break;
+		if (ev.output >= HDSPE_MIXER_CHANNELS ||
+		    ev.source >= HDSPE_MIXER_SOURCES) {
+			invalid++;
+			continue;
+		}
+		if (ev.source >= HDSPE_MIXER_CHANNELS)
+			hdspe_write_pb_gain(hdspe, ev.output,
+					    ev.source - HDSPE_MIXER_CHANNELS,
+					    ev.gain);
+		else
+			hdspe_write_in_gain(hdspe, ev.output, ev.source,
+					    ev.gain);
+		n++;
+	}
+
+	hdspe->mixer_ring_tail = tail;
+	r->applied += n;
+	r->invalid += invalid;
+	r->frame = frame;
+	smp_store_release(&r->tail, tail);
+
+unlock:
+	spin_unlock(&hdspe->lock);
+}
+
+static void hdspe_mixer_ring_vm_open(struct vm_area_struct* vma)
+{
+	struct hdspe* hdspe = vma->vm_private_data;
+
+	spin_lock_irq(&hdspe->lock);
+	if (hdspe->mixer_ring_maps++ == 0)
+		hdspe_period_irq_get(hdspe);
+	spin_unlock_irq(&hdspe->lock);
+}
+
+static void hdspe_mixer_ring_vm_close(struct vm_area_struct* vma)
+{
+	struct hdspe* hdspe = vma->vm_private_data;
+
+	spin_lock_irq(&hdspe->lock);
+	if (--hdspe->mixer_ring_maps == 0)
+		hdspe_period_irq_put(hdspe);
+	spin_unlock_irq(&hdspe->lock);
+}
+
+static const struct vm_operations_struct hdspe_mixer_ring_vm_ops = {
+	.open = hdspe_mixer_ring_vm_open,
+	.close = hdspe_mixer_ring_vm_close,
+};
+
+/* Allocate hdspe->mixer_ring, if not done yet. It is freed with the
+ * mixer. */
+static int hdspe_mixer_ring_alloc(struct hdspe* hdspe)
+{
+	struct hdspe_mixer_ring* new;
+
+	if (READ_ONCE(hdspe->mixer_ring))
+		return 0;
+
+	new = vmalloc_user(HDSPE_MIXER_RING_BYTES);
+	if (!new)
+		return -ENOMEM;
+	new->version = HDSPE_MIXER_RING_VERSION;
+	new->size = HDSPE_MIXER_RING_SIZE;
+
+	spin_lock_irq(&hdspe->lock);
+	if (!hdspe->mixer_ring) {
+		hdspe->mixer_ring_tail = 0;
+		WRITE_ONCE(hdspe->mixer_ring, new);
+		new = NULL;
+	}
+	spin_unlock_irq(&hdspe->lock);
+
+	vfree(new);	/* lost a race with another caller */
+	return 0;
+}
+
+int hdspe_mixer_ring_mmap(struct hdspe* hdspe, struct vm_area_struct* vma)
+{
+	int err;
+
+	if (vma->vm_end - vma->vm_start > HDSPE_MIXER_RING_BYTES)
+		return -EINVAL;
+	if (!snd_hdspe_use_is_exclusive(hdspe))
+		return -EBUSY;
+
+	err = hdspe_mixer_ring_alloc(hdspe);
+	if (err < 0)
+		return err;
+
+	err = remap_vmalloc_range(vma, hdspe->mixer_ring, 0);
+	if (err < 0)
+		return err;
+
+	vma->vm_ops = &hdspe_mixer_ring_vm_ops;
+	vma->vm_private_data = hdspe;
+	hdspe_mixer_ring_vm_open(vma);
+	return 0;
+}
+
 void hdspe_terminate_mixer(struct hdspe* hdspe)
 {
+	/* Not mapped anymore: the card is freed after the last hwdep file
+	 * release, and mappings hold on to their file. */
+	vfree(hdspe->mixer_ring);
+	hdspe->mixer_ring = NULL;
         kfree(hdspe->mixer);	
 }
@@ -12,24 +12,13 @@
 #include "hdspe_core.h"
 
 #include <linux/pci.h>
+#include <linux/math64.h>
 
 #include <sound/pcm.h>
 #include <sound/pcm_params.h>
 
 //#define DEBUG_FRAME_COUNT
 
-/* the size of a substream (1 mono data stream) */
-#define HDSPE_CHANNEL_BUFFER_SAMPLES  (16*1024)
-#define HDSPE_CHANNEL_BUFFER_BYTES    (4*HDSPE_CHANNEL_BUFFER_SAMPLES)
-
-/* the size of the area we need to allocate for DMA transfers. the
-   size is the same regardless of the number of channels, and
-   also the latency to use.
-   for one direction !!!
-*/
-#define HDSPE_DMA_AREA_BYTES (HDSPE_MAX_CHANNELS * HDSPE_CHANNEL_BUFFER_BYTES)
-#define HDSPE_DMA_AREA_KILOBYTES (HDSPE_DMA_AREA_BYTES/1024)
-
 /*------------------------------------------------------------
    memory interface
  ------------------------------------------------------------*/
@@ -43,7 +32,7 @@ static int snd_hdspe_preallocate_memory(struct hdspe *hdspe)
 	wanted = HDSPE_DMA_AREA_BYTES;
 
 	snd_pcm_lib_preallocate_pages_for_all(pcm, SNDRV_DMA_TYPE_DEV_SG,
-					      &hdspe->pci->dev,
+					      hdspe->card->dev,
 					      wanted, wanted);
 	dev_dbg(hdspe->card->dev, "Preallocated %zd Bytes for DMA.\n", wanted);
 	return 0;
@@ -75,6 +64,44 @@ static inline void snd_hdspe_enable_in(struct hdspe * hdspe, int i, int v)
 	hdspe_write(hdspe, HDSPE_inputEnableBase + (4 * i), v);
 }
 
+/* Point the input DMA channels of the first <channels> logical channels
+ * to the buffer of <substream> and enable them. The capture substream
+ * and the shared captures all use the same DMA buffer, see
+ * snd_hdspe_shared_hw_params(). Input DMA stays enabled as long as any
+ * of them has hw_params set: bit 0 of hdspe->capture_dma_users is the
+ * capture substream, bit i+1 shared capture i.
+ * Called with hdspe->lock held. */
+static void hdspe_enable_capture_dma(struct hdspe *hdspe,
+				     struct snd_pcm_substream *substream,
+				     unsigned int channels, int user)
+{
+	unsigned int i;
+
+	for (i = 0; i < channels; ++i) {
+		int c = hdspe->channel_map_in[i];
+
+		if (c < 0)
+			continue;
+		hdspe_set_channel_dma_addr(hdspe, substream,
+					   HDSPE_pageAddressBufferIn, c);
+		snd_hdspe_enable_in(hdspe, c, 1);
+	}
+	hdspe->capture_dma_users |= BIT(user);
+}
+
+/* Called with hdspe->lock held. */
+static void hdspe_disable_capture_dma(struct hdspe *hdspe, int user)
+{
+	int i;
+
+	hdspe->capture_dma_users &= ~BIT(user);
+	if (hdspe->capture_dma_users)
+		return;
+
+	for (i = 0; i < HDSPE_MAX_CHANNELS; ++i)
+		snd_hdspe_enable_in(hdspe, i, 0);
+}
+
 static inline void snd_hdspe_enable_out(struct hdspe * hdspe, int i, int v)
 {
 	hdspe_write(hdspe, HDSPE_outputEnableBase + (4 * i), v);
@@ -107,7 +134,7 @@ u32 hdspe_period_size(struct hdspe *hdspe)
 	if ((7 == n) && hdspe_is_raydat_or_aio(hdspe))
 		n = -1;
 
-	return 64 << n; // 1 << (n + 6);
+	return 1 << (n + 6);
 }
 
 /* Sets hdspe->period_size and hdspe->hw_buffer_size according to the
@@ -117,12 +144,30 @@ static void hdspe_set_period_size(struct hdspe* hdspe)
 	hdspe->period_size = hdspe_period_size(hdspe);
 	hdspe->hw_buffer_size = hdspe_is_raydat_or_aio(hdspe) ? ((1<<16)/4)
 		  : 2 * hdspe->period_size;
+	hdspe->pcm_period_size = hdspe->period_size;
 }
 
-static int hdspe_set_interrupt_interval(struct hdspe *hdspe, unsigned int frames)
+/* Sets the ALSA period size, and the hardware period size.
+ * MADI and AES cards only support power of two ALSA period sizes: their
+ * DMA buffer is two hardware periods, which the ALSA buffer has to be,
+ * and the hardware period is a power of two.
+ * RayDAT, AIO and AIO Pro have a 16K frames hardware buffer, independent
+ * of the period size, and support any ALSA period size. The hardware
+ * period is set by hdspe_raio_interrupt_interval(). If it divides the
+ * ALSA period size, hdspe_pcm_period_elapsed() reports ALSA period
+ * boundaries at the hardware period interrupt they fall on. Otherwise
+ * the hardware period is 32 frames, and ALSA period boundaries are
+ * reported at the first interrupt after them, less than 32 frames late:
+ * software period boundaries on the frame counter. */
+static int hdspe_set_interrupt_interval(struct hdspe *hdspe,
+					unsigned int pcm_frames)
 {
+	unsigned int frames = pcm_frames;
 	int n;
 
+	if (hdspe_is_raydat_or_aio(hdspe))
+		frames = hdspe_raio_interrupt_interval(pcm_frames);
+
 	spin_lock_irq(&hdspe->lock);
 
 	if (32 == frames) {
@@ -150,9 +195,14 @@ static int hdspe_set_interrupt_interval(struct hdspe *hdspe, unsigned int frames
 	hdspe_write_control(hdspe);
 
 	hdspe_set_period_size(hdspe);
+	hdspe->pcm_period_size = pcm_frames;
 
 	spin_unlock_irq(&hdspe->lock);
 
+	if (pcm_frames != frames)
+		dev_dbg(hdspe->card->dev, "%s: period %u frames, hardware %u.\n",
+			__func__, pcm_frames, frames);
+
 	snd_ctl_notify(hdspe->card, SNDRV_CTL_EVENT_MASK_VALUE,
 		       hdspe->cid.buffer_size);
 	
@@ -168,7 +218,7 @@ snd_pcm_uframes_t hdspe_hw_pointer(struct hdspe *hdspe)
 }
 
 /* Called right from the interrupt handler in order to update the frame
- * counter. In absence of xruns, the frame counter increments by
+ * counter, with hdspe->lock held, as by hdspe_period_irq_put(). In absence of xruns, the frame counter increments by
  * hdspe_period_size() frames each period. This routine will correctly
  * determine the frame counter even in the presence of xruns or late
  * interrupt handling, as long as the hardware pointer did not wrap more 
@@ -192,7 +242,7 @@ void hdspe_update_frame_count(struct hdspe* hdspe)
 		static u64 last_frame_count =0;
 		static u64 last_hw_pointer =0;
 		hw_pointer = hdspe_hw_pointer(hdspe);
-		dev_dbg(hdspe->card->dev, "%s: hw_pointer=%u (delta %llu), frame_count=%llu (delta=%llu)\n",
+		hdspe_dbg_hot(hdspe, "%s: hw_pointer=%u (delta %llu), frame_count=%llu (delta=%llu)\n",
 			__func__,
 			hw_pointer,
 			hw_pointer > last_hw_pointer
@@ -206,6 +256,104 @@ void hdspe_update_frame_count(struct hdspe* hdspe)
 #endif /*DEBUG_FRAME_COUNT*/
 }
 
+/* Called from the interrupt handler, after hdspe_update_frame_count().
+ * Returns true if an ALSA period boundary was crossed. */
+bool hdspe_pcm_period_elapsed(struct hdspe* hdspe)
+{
+	u64 late;
+
+	if (hdspe->pcm_period_size == hdspe->period_size)
+		return true;
+	if (hdspe->frame_count < hdspe->pcm_period_frame)
+		return false;
+
+	late = hdspe->frame_count - hdspe->pcm_period_frame;
+	if (late > hdspe->pcm_period_late_max)
+		hdspe->pcm_period_late_max = late;
+	do {
+		hdspe->pcm_period_frame += hdspe->pcm_period_size;
+	} while (hdspe->pcm_period_frame <= hdspe->frame_count);
+
+	return true;
+}
+
+u64 hdspe_frame_count_now(struct hdspe* hdspe)
+{
+	u32 hw_pointer = le16_to_cpu(
+		hdspe_read_status0_nocache(hdspe).common.BUF_PTR) << 4;
+
+	return (u64)hdspe->hw_pointer_wrap_count * ((1<<16)/4)
+		+ hdspe->last_hw_pointer
+		+ ((hw_pointer - hdspe->last_hw_pointer) & ((1<<16)/4 - 1));
+}
+
+/* Start of the first ALSA period when streams start running. Called with
+ * hdspe->lock held, after hdspe_period_irq_get(). */
+static void hdspe_pcm_period_start(struct hdspe* hdspe)
+{
+	hdspe->pcm_period_frame =
+		hdspe_frame_count_now(hdspe) + hdspe->pcm_period_size;
+	hdspe->pcm_period_late_max = 0;
+}
+
+/* Re-derive the frame counter when period interrupts are enabled again.
+ * The hardware pointer kept running meanwhile, but its wraps were not
+ * counted. Estimate them from the time elapsed, which needs to be
+ * accurate to within half a wrap (8K frames) only. */
+static void hdspe_resync_frame_count(struct hdspe* hdspe)
+{
+	u32 hw_pointer, delta, rate;
+	u64 ns, frames, wraps = 0;
+
+	hdspe->reg.status0 = hdspe_read_status0_nocache(hdspe);
+	hw_pointer = le16_to_cpu(hdspe->reg.status0.common.BUF_PTR) << 4;
+	delta = (hw_pointer - hdspe->last_hw_pointer) & ((1<<16)/4 - 1);
+
+	rate = hdspe_read_system_sample_rate(hdspe);
+	ns = ktime_to_ns(ktime_sub(ktime_get(), hdspe->period_irq_off_time));
+	frames = mul_u64_u32_div(ns, rate, NSEC_PER_SEC);
+	if (frames > delta)
+		wraps = div_u64(frames - delta + (1<<16)/8, (1<<16)/4);
+	if (hw_pointer < hdspe->last_hw_pointer)
+		wraps ++;
+
+	hdspe->hw_pointer_wrap_count += wraps;
+	hdspe->last_hw_pointer = hw_pointer;
+	hdspe->frame_count =
+		(u64)hdspe->hw_pointer_wrap_count * ((1<<16)/4)
+		+ (hw_pointer & ~(hdspe->period_size - 1));
+
+	hdspe_dbg_hot(hdspe, "%s: %llu ns idle, %llu wraps, frame_count=%llu\n",
+		      __func__, ns, wraps, hdspe->frame_count);
+}
+
+void hdspe_period_irq_get(struct hdspe* hdspe)
+{
+	if (hdspe->period_irq_users++ > 0)
+		return;
+
+	hdspe_resync_frame_count(hdspe);
+	WRITE_ONCE(hdspe->timing_pll_freq, hdspe_read_pll_freq(hdspe));
+	hdspe->reg.control.common.IE_AUDIO = true;
+	hdspe_write_control(hdspe);
+}
+
+void hdspe_period_irq_put(struct hdspe* hdspe)
+{
+	if (WARN_ON(hdspe->period_irq_users <= 0))
+		return;
+	if (--hdspe->period_irq_users > 0)
+		return;
+
+	hdspe->reg.control.common.IE_AUDIO = false;
+	hdspe_write_control(hdspe);
+
+	/* Last frame counter update before going idle. */
+	hdspe->reg.status0 = hdspe_read_status0_nocache(hdspe);
+	hdspe_update_frame_count(hdspe);
+	hdspe->period_irq_off_time = ktime_get();
+}
+
 /* should I silence all or only opened ones ? doit all for first even is 4MB*/
 static void hdspe_silence_playback(struct hdspe *hdspe)
 {
@@ -221,13 +369,31 @@ static void hdspe_silence_playback(struct hdspe *hdspe)
 		buf += HDSPE_CHANNEL_BUFFER_BYTES;
 	}
 
-	dev_dbg(hdspe->card->dev, "hdspe_silence_playback()\n");
+	hdspe_dbg_hot(hdspe, "hdspe_silence_playback()\n");
+}
+
+/* Port latency added to runtime->delay of <substream>. */
+static u32* hdspe_pcm_port_delay(struct hdspe *hdspe,
+				 struct snd_pcm_substream *substream)
+{
+	if (substream->pcm == hdspe->shared_pcm)
+		return &hdspe->pcm_port_delay[2 + substream->number];
+	return &hdspe->pcm_port_delay[substream->stream];
 }
 
+/* runtime->delay is the port latency on top of whatever else the ALSA
+ * core or a plugin put there: replace only what was added before. */
 static snd_pcm_uframes_t snd_hdspe_hw_pointer(struct snd_pcm_substream
 					      *substream)
 {
 	struct hdspe *hdspe = snd_pcm_substream_chip(substream);
+	u32 *added = hdspe_pcm_port_delay(hdspe, substream);
+	u32 delay = hdspe_latency_delay(
+		hdspe, substream->stream, substream->runtime->channels);
+
+	substream->runtime->delay += (snd_pcm_sframes_t)delay -
+				     (snd_pcm_sframes_t)*added;
+	*added = delay;
 	return hdspe_hw_pointer(hdspe);
 }
 
@@ -312,12 +478,12 @@ static int snd_hdspe_hw_params(struct snd_pcm_substream *substream,
 			return -EBUSY;
 		}
 
-		if (params_period_size(params) != hdspe->period_size) {
+		if (params_period_size(params) != hdspe->pcm_period_size) {
 			spin_unlock_irq(&hdspe->lock);
 			dev_warn(hdspe->card->dev,
  "Requested period size %d does not match actual latency used by process %d.\n",
 				 params_period_size(params),
-				 hdspe->period_size);
+				 hdspe->pcm_period_size);
 			_snd_pcm_hw_param_setempty(params,
 					SNDRV_PCM_HW_PARAM_PERIOD_SIZE);
 			return -EBUSY;
@@ -384,16 +550,10 @@ static int snd_hdspe_hw_params(struct snd_pcm_substream *substream,
 			"Allocated sample buffer for playback at %p\n",
 				hdspe->playback_buffer);
 	} else {
-		for (i = 0; i < params_channels(params); ++i) {
-			int c = hdspe->channel_map_in[i];
-
-			if (c < 0)
-				continue;
-			hdspe_set_channel_dma_addr(hdspe, substream,
-						   HDSPE_pageAddressBufferIn,
-						   c);
-			snd_hdspe_enable_in(hdspe, c, 1);
-		}
+		spin_lock_irq(&hdspe->lock);
+		hdspe_enable_capture_dma(hdspe, substream,
+					 params_channels(params), 0);
+		spin_unlock_irq(&hdspe->lock);
 
 		hdspe->capture_buffer =
 			(unsigned char *) substream->runtime->dma_area;
@@ -440,8 +600,10 @@ static int snd_hdspe_hw_free(struct snd_pcm_substream *substream)
 
 		hdspe->playback_buffer = NULL;
 	} else {
-		for (i = 0; i < HDSPE_MAX_CHANNELS; ++i)
-			snd_hdspe_enable_in(hdspe, i, 0);
+		/* Shared captures may still be reading. */
+		spin_lock_irq(&hdspe->lock);
+		hdspe_disable_capture_dma(hdspe, 0);
+		spin_unlock_irq(&hdspe->lock);
 
 		hdspe->capture_buffer = NULL;
 	}
@@ -532,35 +694,35 @@ static int snd_hdspe_trigger(struct snd_pcm_substream *substream, int cmd)
 
 	switch (cmd) {
 	case SNDRV_PCM_TRIGGER_START:
-		dev_dbg(hdspe->card->dev, "SNDRV_PCM_TRIGGER_START\n");
+		hdspe_dbg_hot(hdspe, "SNDRV_PCM_TRIGGER_START\n");
 		running |= 1 << substream->stream;
 		break;
 
 	case SNDRV_PCM_TRIGGER_RESUME:
-		dev_dbg(hdspe->card->dev, "SNDRV_PCM_TRIGGER_RESUME\n");
+		hdspe_dbg_hot(hdspe, "SNDRV_PCM_TRIGGER_RESUME\n");
 		running |= 1 << substream->stream;
 		break;
 
 	case SNDRV_PCM_TRIGGER_STOP:
-		dev_dbg(hdspe->card->dev, "SNDRV_PCM_TRIGGER_STOP\n");
+		hdspe_dbg_hot(hdspe, "SNDRV_PCM_TRIGGER_STOP\n");
 		running &= ~(1 << substream->stream);
 		break;
 
 	case SNDRV_PCM_TRIGGER_SUSPEND:
-		dev_dbg(hdspe->card->dev, "SNDRV_PCM_TRIGGER_SUSPEND\n");
+		hdspe_dbg_hot(hdspe, "SNDRV_PCM_TRIGGER_SUSPEND\n");
 		running &= ~(1 << substream->stream);
 		break;
 
 	case SNDRV_PCM_TRIGGER_PAUSE_PUSH:
-		dev_dbg(hdspe->card->dev, "SNDRV_PCM_TRIGGER_PAUSE_PUSH\n");
+		hdspe_dbg_hot(hdspe, "SNDRV_PCM_TRIGGER_PAUSE_PUSH\n");
 		break;
 
 	case SNDRV_PCM_TRIGGER_PAUSE_RELEASE:
-		dev_dbg(hdspe->card->dev, "SNDRV_PCM_TRIGGER_PAUSE_RELEASE\n");
+		hdspe_dbg_hot(hdspe, "SNDRV_PCM_TRIGGER_PAUSE_RELEASE\n");
 		break;
 
 	default:
-		dev_dbg(hdspe->card->dev, "Unhandled trigger received with %d\n", cmd);
+		hdspe_dbg_hot(hdspe, "Unhandled trigger received with %d\n", cmd);
 		snd_BUG();
 		spin_unlock(&hdspe->lock);
 		return -EINVAL;
@@ -601,19 +763,24 @@ _ok:
 
 	snd_pcm_trigger_done(substream, substream);
 
-	// Since we have audio interrupts enabled all the time, 
-	// no explicit start or stop is necessary
+	// The audio engine runs all the time, so no explicit start or stop
+	// is necessary. Period interrupts are needed only while streams run.
 
 	// But if interrupts are stopped during suspend does this need handling?
 	// does the memory allocated need to be freed or reset function called?
 
+	if (running && !hdspe->running) {
+		hdspe_period_irq_get(hdspe);
+		hdspe_pcm_period_start(hdspe);
+	} else if (!running && hdspe->running)
+		hdspe_period_irq_put(hdspe);
 	hdspe->running = running;
 	spin_unlock(&hdspe->lock);
 
 	snd_ctl_notify(hdspe->card, SNDRV_CTL_EVENT_MASK_VALUE,
 		       hdspe->cid.running);
 
-	dev_dbg(hdspe->card->dev,"snd_hdspe_trigger()\n");
+	hdspe_dbg_hot(hdspe, "snd_hdspe_trigger()\n");
 
 	return 0;
 }
@@ -622,7 +789,7 @@ static int snd_hdspe_prepare(struct snd_pcm_substream *substream)
 {
 	struct hdspe *hdspe = snd_pcm_substream_chip(substream);
 
-	dev_dbg(hdspe->card->dev,"snd_hdspe_prepare()\n");
+	dev_dbg(hdspe->card->dev, "snd_hdspe_prepare()\n");
 
 	return 0;
 }
@@ -874,6 +1041,7 @@ static int snd_hdspe_open(struct snd_pcm_substream *substream)
 	snd_pcm_set_sync(substream);
 	runtime->hw = (playback) ? snd_hdspe_playback_subinfo :
 		snd_hdspe_capture_subinfo;
+	*hdspe_pcm_port_delay(hdspe, substream) = 0;
 
 	if (playback) {
 		hdspe->playback_pid = current->pid;
@@ -886,15 +1054,19 @@ static int snd_hdspe_open(struct snd_pcm_substream *substream)
 	spin_unlock_irq(&hdspe->lock);
 
 	snd_pcm_hw_constraint_msbits(runtime, 0, 32, 24);
-	snd_pcm_hw_constraint_pow2(runtime, 0, SNDRV_PCM_HW_PARAM_PERIOD_SIZE);
 
 	switch (hdspe->io_type) {
 	case HDSPE_AIO:		
 	case HDSPE_RAYDAT:
 	case HDSPE_AIO_PRO:		
+		/* Any period size, e.g. 48 frames for 1 ms or 1920
+		 * frames for a 25 fps video frame at 48 kHz. Multiples of
+		 * 32 frames end on a hardware period interrupt, others
+		 * are reported less than 32 frames late, see
+		 * hdspe_set_interrupt_interval(). */
 		snd_pcm_hw_constraint_minmax(runtime,
 					     SNDRV_PCM_HW_PARAM_PERIOD_SIZE,
-					     32, 4096);
+					     32, 8192);
 		/* RayDAT & AIO have a fixed buffer of 16384 samples per channel */
 		snd_pcm_hw_constraint_single(runtime,
 					     SNDRV_PCM_HW_PARAM_BUFFER_SIZE,
@@ -902,6 +1074,11 @@ static int snd_hdspe_open(struct snd_pcm_substream *substream)
 		break;
 
 	default:
+		/* The ALSA buffer is the DMA buffer of two hardware
+		 * periods, so ALSA and hardware periods are the same:
+		 * powers of two, as encoded by the LAT bits. */
+		snd_pcm_hw_constraint_pow2(runtime, 0,
+					   SNDRV_PCM_HW_PARAM_PERIOD_SIZE);
 		snd_pcm_hw_constraint_minmax(runtime,
 					     SNDRV_PCM_HW_PARAM_PERIOD_SIZE,
 					     64, 8192);
@@ -955,6 +1132,213 @@ static int snd_hdspe_release(struct snd_pcm_substream *substream)
 	return 0;
 }
 
+/* Shared read-only capture.
+ *
+ * PCM device 1 has HDSPE_SHARED_CAPTURES capture substreams reading the
+ * capture DMA buffer of device 0 in place: they mmap the same pages and
+ * report the same hardware pointer, but each has its own application
+ * pointer and xrun detection. They have no say over the sample rate,
+ * period size or sample format: hw_params fails with -EBUSY unless the
+ * parameters match the current card settings, i.e. the system sample
+ * rate, the hardware buffer size, and a period size that is a multiple
+ * of the hardware period size. While running, they hold a period
+ * interrupt reference, and get a period elapsed call at every period
+ * interrupt. Without device 0 capture, they enable input DMA themselves.
+ */
+
+static struct snd_pcm_substream *hdspe_capture_primary(struct hdspe *hdspe)
+{
+	return hdspe->pcm->streams[SNDRV_PCM_STREAM_CAPTURE].substream;
+}
+
+void hdspe_shared_capture_period_elapsed(struct hdspe *hdspe)
+{
+	int i;
+
+	for (i = 0; i < HDSPE_SHARED_CAPTURES; i++) {
+		if (hdspe->shared_running & BIT(i))
+			snd_pcm_period_elapsed(hdspe->shared_capture[i]);
+	}
+}
+
+static int snd_hdspe_shared_open(struct snd_pcm_substream *substream)
+{
+	struct hdspe *hdspe = snd_pcm_substream_chip(substream);
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	u32 rate, period_size, buffer_size;
+
+	runtime->hw = snd_hdspe_capture_subinfo;
+	runtime->hw.info &= ~(SNDRV_PCM_INFO_SYNC_START |
+			      SNDRV_PCM_INFO_PAUSE);
+
+	spin_lock_irq(&hdspe->lock);
+	hdspe->shared_capture[substream->number] = substream;
+	*hdspe_pcm_port_delay(hdspe, substream) = 0;
+	rate = hdspe_read_system_sample_rate(hdspe);
+	period_size = hdspe->period_size;
+	buffer_size = hdspe->hw_buffer_size;
+	spin_unlock_irq(&hdspe->lock);
+
+	snd_pcm_hw_constraint_msbits(runtime, 0, 32, 24);
+	snd_pcm_hw_constraint_single(runtime, SNDRV_PCM_HW_PARAM_RATE, rate);
+	snd_pcm_hw_constraint_single(runtime, SNDRV_PCM_HW_PARAM_BUFFER_SIZE,
+				     buffer_size);
+	snd_pcm_hw_constraint_step(runtime, 0, SNDRV_PCM_HW_PARAM_PERIOD_SIZE,
+				   period_size);
+
+	snd_pcm_hw_rule_add(runtime, 0, SNDRV_PCM_HW_PARAM_CHANNELS,
+			    snd_hdspe_hw_rule_in_channels, hdspe,
+			    SNDRV_PCM_HW_PARAM_CHANNELS, -1);
+	snd_pcm_hw_rule_add(runtime, 0, SNDRV_PCM_HW_PARAM_CHANNELS,
+			    snd_hdspe_hw_rule_in_channels_rate, hdspe,
+			    SNDRV_PCM_HW_PARAM_RATE, -1);
+
+	return 0;
+}
+
+static int snd_hdspe_shared_release(struct snd_pcm_substream *substream)
+{
+	struct hdspe *hdspe = snd_pcm_substream_chip(substream);
+
+	spin_lock_irq(&hdspe->lock);
+	hdspe->shared_capture[substream->number] = NULL;
+	spin_unlock_irq(&hdspe->lock);
+
+	return 0;
+}
+
+static int snd_hdspe_shared_hw_params(struct snd_pcm_substream *substream,
+				      struct snd_pcm_hw_params *params)
+{
+	struct hdspe *hdspe = snd_pcm_substream_chip(substream);
+	struct snd_dma_buffer *dmab = &hdspe_capture_primary(hdspe)->dma_buffer;
+	u32 rate;
+	int err = 0;
+
+	/* The buffer preallocated for device 0 capture, which uses it too,
+	 * see snd_pcm_lib_malloc_pages(). */
+	if (!dmab->area || dmab->bytes < HDSPE_DMA_AREA_BYTES)
+		return -ENOMEM;
+
+	spin_lock_irq(&hdspe->lock);
+	rate = hdspe_read_system_sample_rate(hdspe);
+	if (params_rate(params) != rate ||
+	    params_buffer_size(params) != hdspe->hw_buffer_size ||
+	    params_period_size(params) % hdspe->period_size != 0 ||
+	    hdspe->m.get_float_format(hdspe))
+		err = -EBUSY;
+	spin_unlock_irq(&hdspe->lock);
+
+	if (err < 0) {
+		dev_warn(hdspe->card->dev,
+ "Shared capture %d Hz, %u frames periods does not match %u Hz, %u frames hardware periods.\n",
+			 params_rate(params), params_period_size(params),
+			 rate, hdspe->period_size);
+		return err;
+	}
+
+	snd_pcm_set_runtime_buffer(substream, dmab);
+
+	spin_lock_irq(&hdspe->lock);
+	hdspe_enable_capture_dma(hdspe, substream, params_channels(params),
+				 substream->number + 1);
+	spin_unlock_irq(&hdspe->lock);
+
+	dev_dbg(hdspe->card->dev, "%s: shared capture %d\n",
+		__func__, substream->number);
+
+	return 0;
+}
+
+static int snd_hdspe_shared_hw_free(struct snd_pcm_substream *substream)
+{
+	struct hdspe *hdspe = snd_pcm_substream_chip(substream);
+
+	spin_lock_irq(&hdspe->lock);
+	hdspe_disable_capture_dma(hdspe, substream->number + 1);
+	spin_unlock_irq(&hdspe->lock);
+
+	snd_pcm_set_runtime_buffer(substream, NULL);
+
+	return 0;
+}
+
+static int snd_hdspe_shared_ioctl(struct snd_pcm_substream *substream,
+				  unsigned int cmd, void *arg)
+{
+	struct hdspe *hdspe = snd_pcm_substream_chip(substream);
+
+	switch (cmd) {
+	case SNDRV_PCM_IOCTL1_RESET:
+		/* Start from where the hardware is now. The hardware
+		 * pointer is only kept up to date while period interrupts
+		 * are on. */
+		spin_lock_irq(&hdspe->lock);
+		if (hdspe->period_irq_users == 0)
+			hdspe->reg.status0 = hdspe_read_status0_nocache(hdspe);
+		substream->runtime->status->hw_ptr = hdspe_hw_pointer(hdspe);
+		spin_unlock_irq(&hdspe->lock);
+		return 0;
+
+	case SNDRV_PCM_IOCTL1_CHANNEL_INFO:
+		return snd_hdspe_channel_info(substream, arg);
+
+	default:
+		break;
+	}
+
+	return snd_pcm_lib_ioctl(substream, cmd, arg);
+}
+
+static int snd_hdspe_shared_trigger(struct snd_pcm_substream *substream,
+				    int cmd)
+{
+	struct hdspe *hdspe = snd_pcm_substream_chip(substream);
+	u32 bit = BIT(substream->number);
+	bool start;
+
+	switch (cmd) {
+	case SNDRV_PCM_TRIGGER_START:
+	case SNDRV_PCM_TRIGGER_RESUME:
+		start = true;
+		break;
+
+	case SNDRV_PCM_TRIGGER_STOP:
+	case SNDRV_PCM_TRIGGER_SUSPEND:
+		start = false;
+		break;
+
+	default:
+		return -EINVAL;
+	}
+
+	spin_lock(&hdspe->lock);
+	if (start && !(hdspe->shared_running & bit)) {
+		hdspe_period_irq_get(hdspe);
+		hdspe->shared_running |= bit;
+	} else if (!start && (hdspe->shared_running & bit)) {
+		hdspe->shared_running &= ~bit;
+		hdspe_period_irq_put(hdspe);
+	}
+	spin_unlock(&hdspe->lock);
+
+	hdspe_dbg_hot(hdspe, "%s: shared capture %d %s\n", __func__,
+		      substream->number, start ? "started" : "stopped");
+
+	return 0;
+}
+
+static const struct snd_pcm_ops snd_hdspe_shared_ops = {
+	.open = snd_hdspe_shared_open,
+	.close = snd_hdspe_shared_release,
+	.ioctl = snd_hdspe_shared_ioctl,
+	.hw_params = snd_hdspe_shared_hw_params,
+	.hw_free = snd_hdspe_shared_hw_free,
+	.prepare = snd_hdspe_prepare,
+	.trigger = snd_hdspe_shared_trigger,
+	.pointer = snd_hdspe_hw_pointer,
+};
+
 static const struct snd_pcm_ops snd_hdspe_ops = {
 	.open = snd_hdspe_open,
 	.close = snd_hdspe_release,
@@ -999,6 +1383,22 @@ int snd_hdspe_create_pcm(struct snd_card *card,
 
 	hdspe_set_period_size(hdspe);
 
+	/* Shared read-only capture, without buffers of its own. */
+	hdspe->shared_running = 0;
+	hdspe->capture_dma_users = 0;
+	err = snd_pcm_new(card, hdspe->card_name, 1, 0,
+			  HDSPE_SHARED_CAPTURES, &pcm);
+	if (err < 0)
+		return err;
+
+	hdspe->shared_pcm = pcm;
+	pcm->private_data = hdspe;
+	snprintf(pcm->name, sizeof(pcm->name), "%s Shared Capture",
+		 hdspe->card_name);
+
+	snd_pcm_set_ops(pcm, SNDRV_PCM_STREAM_CAPTURE,
+			&snd_hdspe_shared_ops);
+
 	dev_dbg(hdspe->card->dev,"snd_hdspe_create_pcm()\n");
 
 	return 0;
@@ -117,22 +117,33 @@ void hdspe_proc_read_common2(struct snd_info_buffer *buffer,
 		    status0.common.BUF_ID,
 		    status0.common.BUF_ID * s->buffer_size*4);
 	snd_iprintf(buffer, "LAT\t: %d\n", hdspe->reg.control.common.LAT);
+	snd_iprintf(buffer, "Period size\t: %u (ALSA), %u (hardware)\n",
+		    hdspe->pcm_period_size, hdspe->period_size);
+	snd_iprintf(buffer, "Period late\t: %u frames max.\n",
+		    hdspe->pcm_period_late_max);
 	
 	snd_iprintf(buffer, "\n");
 	snd_iprintf(buffer, "Running     \t: %d\n", hdspe->running);
+	snd_iprintf(buffer, "Period IRQ users\t: %d\n", hdspe->period_irq_users);
 	snd_iprintf(buffer, "Capture PID \t: %d\n", hdspe->capture_pid);
 	snd_iprintf(buffer, "Playback PID\t: %d\n", hdspe->playback_pid);
+	snd_iprintf(buffer, "Shared capture\t: 0x%x running, DMA users 0x%x\n",
+		    hdspe->shared_running, hdspe->capture_dma_users);
 	
 	snd_iprintf(buffer, "\n");
 	snd_iprintf(buffer, "Capture channel mapping:\n");
 	for (i = 0 ; i < hdspe->max_channels_in; i ++) {
-		snd_iprintf(buffer, "Logical %d DMA %d '%s'\n",
-			    i, hdspe->channel_map_in[i], hdspe->port_names_in[i]);
+		snd_iprintf(buffer, "Logical %d DMA %d '%s' port %u latency %u\n",
+			    i, hdspe->channel_map_in[i], hdspe->port_names_in[i],
+			    hdspe->chmap_in[hdspe->channel_map_speed].port[i],
+			    hdspe->latency_in[hdspe->channel_map_speed][i]);
 	}
 	snd_iprintf(buffer, "\nPlayback channel mapping:\n");
 	for (i = 0 ; i < hdspe->max_channels_out; i ++) {
-		snd_iprintf(buffer, "Logical %d DMA %d '%s'\n",
-			    i, hdspe->channel_map_out[i], hdspe->port_names_out[i]);
+		snd_iprintf(buffer, "Logical %d DMA %d '%s' port %u latency %u\n",
+			    i, hdspe->channel_map_out[i], hdspe->port_names_out[i],
+			    hdspe->chmap_out[hdspe->channel_map_speed].port[i],
+			    hdspe->latency_out[hdspe->channel_map_speed][i]);
 	}
 }
 
@@ -190,6 +201,10 @@ void snd_hdspe_proc_init(struct hdspe *hdspe)
 		snd_card_ro_proc_new(hdspe->card, "tco", hdspe,
 				     snd_hdspe_proc_read_tco);
 	snd_card_ro_proc_new(hdspe->card, "mixer", hdspe, hdspe_mixer_read_proc);
+#ifdef CONFIG_SND_HDSPE_EMU
+	if (hdspe_is_emulated(hdspe))
+		hdspe_emu_proc_init(hdspe);
+#endif
 
 #ifdef CONFIG_SND_DEBUG
 	/* debug file to read all hdspe registers */
@@ -884,6 +884,19 @@ static void hdspe_raydat_init_tables(struct hdspe* hdspe)
 		hdspe, ARRAY_SIZE(raydat_autosync_ref), raydat_autosync_ref);
 }
 
+/* Nominal group delay of the delta-sigma AD / DA converters, in samples
+ * at single, double and quad speed, also for the AI4S / AO4S expansion
+ * boards. Digital ports only pass the FPGA and have no latency beyond the
+ * DMA buffer. Not measured: calibrate with the 'Input Latency' and
+ * 'Output Latency' controls. RayDAT, MADI and AES have digital ports
+ * only. */
+static const struct hdspe_port_latency hdspe_aio_port_latency[] = {
+	{ "Analog.", { 39, 39, 9 }, { 29, 29, 9 } },
+	{ "Phone.",  {  0,  0, 0 }, { 29, 29, 9 } },
+	{ "AEB.",    { 39, 39, 9 }, { 29, 29, 9 } },
+	{ NULL }
+};
+
 static const struct hdspe_tables hdspe_aio_tables = {
 	.ss_in_channels = AIO_IN_SS_CHANNELS,
 	.ds_in_channels = AIO_IN_DS_CHANNELS,
@@ -908,6 +921,8 @@ static const struct hdspe_tables hdspe_aio_tables = {
 	.port_names_out_qs = texts_ports_aio_out_qs,
 
 	.clock_source_names = hdspe_aio_clock_source_names,
+
+	.port_latency = hdspe_aio_port_latency,
 };
 
 static void hdspe_aio_init_tables(struct hdspe* hdspe)
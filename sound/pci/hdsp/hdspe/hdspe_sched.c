@@ -0,0 +1,448 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * hdspe_sched.c
+ * @brief RME HDSPe frame-scheduled control element changes.
+ *
+ * Control element value changes can be queued for a target frame count
+ * (LTC time, see the 'LTC Time' control) with the
+ * SNDRV_HDSPE_IOCTL_SCHEDULE_CTL hwdep ioctl. The period interrupt
+ * handler releases them at the first period boundary at or after the
+ * target frame, and a high priority work item applies them right after
+ * the interrupt, through the put() method of the control element, in
+ * order of target frame. put() methods take hdspe->lock with interrupts
+ * disabled, so they cannot be called from the interrupt handler itself.
+ *
+ * A change therefore reaches the hardware some time after the period
+ * boundary that released it, depending on how soon the work item runs:
+ * usually well within the next period, but that is not guaranteed. The
+ * frame count at which a change was actually applied, taken from the
+ * hardware buffer pointer right after put() returned, not the frame count
+ * of the releasing interrupt, and the put() result are kept for
+ * SNDRV_HDSPE_IOCTL_GET_SCHED_CTL until the slot is reused.
+ *
+ * While changes are pending, a period interrupt reference is held.
+ */
+
+#include "hdspe.h"
+#include "hdspe_core.h"
+
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+
+#define HDSPE_SCHED_SLOTS	64
+
+enum hdspe_sched_state {
+	HDSPE_SCHED_FREE = 0,
+	HDSPE_SCHED_PENDING,	/* waiting for the target frame */
+	HDSPE_SCHED_DUE,	/* released by the interrupt handler */
+	HDSPE_SCHED_DONE	/* applied, result available */
+};
+
+struct hdspe_sched_slot {
+	enum hdspe_sched_state state;
+	snd_ctl_elem_type_t type;
+	unsigned int count;
+	struct hdspe_sched_ctl ctl;
+};
+
+struct hdspe_sched {
+	struct hdspe* hdspe;
+	spinlock_t lock;          /* protects the slots, seq and next_frame */
+	struct work_struct work;
+	u32 seq;                  /* last sequence number handed out */
+	u64 next_frame;           /* earliest pending target frame */
+	bool period_irq;          /* holds a period interrupt reference */
+	struct hdspe_sched_slot slot[HDSPE_SCHED_SLOTS];
+
+	struct snd_ctl_elem_value value;   /* for put(), by the work only */
+};
+
+/* Frame count now, from the hardware buffer pointer. Valid while period
+ * interrupts are enabled. */
+static u64 hdspe_sched_frame_now(struct hdspe* hdspe)
+{
+	u64 frame;
+
+	spin_lock_irq(&hdspe->lock);
+	frame = hdspe_frame_count_now(hdspe);
+	spin_unlock_irq(&hdspe->lock);
+
+	return frame;
+}
+
+/* Look up the control element with given numid, and the index of the
+ * element in it. Called with card->controls_rwsem held. */
+static struct snd_kcontrol* hdspe_sched_find_kctl(struct hdspe* hdspe,
+						  u32 numid, unsigned* ioff)
+{
+	struct snd_kcontrol* kctl = snd_ctl_find_numid(hdspe->card, numid);
+
+	if (kctl)
+		*ioff = numid - kctl->id.numid;
+	return kctl;
+}
+
+/* The permission checks of snd_ctl_elem_write(), for a writer that is no
+ * control file: the element must be writable, and not locked by a control
+ * file with SNDRV_CTL_IOCTL_ELEM_LOCK. The lock may be taken after the
+ * change was scheduled, so this is checked again when applying it.
+ * Exclusive use of the card is checked by the put() methods that need it.
+ * Called with card->controls_rwsem held. */
+static int hdspe_sched_may_write(struct snd_kcontrol* kctl, unsigned ioff)
+{
+	struct snd_kcontrol_volatile* vd = &kctl->vd[ioff];
+
+	if (!kctl->put || !(vd->access & SNDRV_CTL_ELEM_ACCESS_WRITE) ||
+	    vd->owner)
+		return -EPERM;
+	return 0;
+}
+
+/* Apply the change in slot <sl>, a copy taken under the lock. */
+static void hdspe_sched_apply(struct hdspe_sched* s,
+			      struct hdspe_sched_slot* sl)
+{
+	struct hdspe* hdspe = s->hdspe;
+	struct snd_ctl_elem_value* v = &s->value;
+	struct snd_kcontrol* kctl;
+	unsigned i, ioff = 0;
+	int rc;
+
+	memset(v, 0, sizeof(*v));
+
+	down_read(&hdspe->card->controls_rwsem);
+	kctl = hdspe_sched_find_kctl(hdspe, sl->ctl.numid, &ioff);
+	if (!kctl) {
+		rc = -ENOENT;
+		goto unlock;
+	}
+	rc = hdspe_sched_may_write(kctl, ioff);
+	if (rc < 0)
+		goto unlock;
+	snd_ctl_build_ioff(&v->id, kctl, ioff);
+
+	for (i = 0; i < sl->count; i++) {
+		switch (sl->type) {
+		case SNDRV_CTL_ELEM_TYPE_INTEGER64:
+			v->value.integer64.value[i] = sl->ctl.value[i];
+			break;
+		case SNDRV_CTL_ELEM_TYPE_ENUMERATED:
+			v->value.enumerated.item[i] = sl->ctl.value[i];
+			break;
+		default:	/* BOOLEAN, INTEGER */
+			v->value.integer.value[i] = sl->ctl.value[i];
+		}
+	}
+
+	rc = kctl->put(kctl, v);
+
+unlock:
+	sl->ctl.applied = hdspe_sched_frame_now(hdspe);
+	up_read(&hdspe->card->controls_rwsem);
+
+	sl->ctl.result = rc < 0 ? rc : rc > 0;
+	if (rc > 0)
+		snd_ctl_notify(hdspe->card, SNDRV_CTL_EVENT_MASK_VALUE, &v->id);
+
+	hdspe_dbg_hot(hdspe, "%s: seq %u numid %u: frame %llu, applied %llu, result %d.\n",
+		      __func__, sl->ctl.seq, sl->ctl.numid, sl->ctl.frame,
+		      sl->ctl.applied, sl->ctl.result);
+}
+
+/* Index of the due slot with the earliest target frame, or -1. */
+static int hdspe_sched_next_due(struct hdspe_sched* s)
+{
+	int i, next = -1;
+
+	for (i = 0; i < HDSPE_SCHED_SLOTS; i++) {
+		struct hdspe_sched_slot* sl = &s->slot[i];
+		if (sl->state != HDSPE_SCHED_DUE)
+			continue;
+		if (next < 0 ||
+		    sl->ctl.frame < s->slot[next].ctl.frame ||
+		    (sl->ctl.frame == s->slot[next].ctl.frame &&
+		     (s32)(sl->ctl.seq - s->slot[next].ctl.seq) < 0))
+			next = i;
+	}
+	return next;
+}
+
+static void hdspe_sched_work(struct work_struct* work)
+{
+	struct hdspe_sched* s = container_of(work, struct hdspe_sched, work);
+	struct hdspe* hdspe = s->hdspe;
+	struct hdspe_sched_slot sl;
+	int i;
+
+	for (;;) {
+		spin_lock_irq(&s->lock);
+		i = hdspe_sched_next_due(s);
+		if (i >= 0)
+			sl = s->slot[i];
+		spin_unlock_irq(&s->lock);
+		if (i < 0)
+			break;
+
+		hdspe_sched_apply(s, &sl);
+
+		spin_lock_irq(&s->lock);
+		s->slot[i].ctl.applied = sl.ctl.applied;
+		s->slot[i].ctl.result = sl.ctl.result;
+		s->slot[i].state = HDSPE_SCHED_DONE;
+		spin_unlock_irq(&s->lock);
+	}
+
+	/* No more need for period interrupts if nothing is pending. */
+	spin_lock_irq(&hdspe->lock);
+	spin_lock(&s->lock);
+	if (s->period_irq && s->next_frame == U64_MAX &&
+	    hdspe_sched_next_due(s) < 0) {
+		s->period_irq = false;
+		hdspe_period_irq_put(hdspe);
+	}
+	spin_unlock(&s->lock);
+	spin_unlock_irq(&hdspe->lock);
+}
+
+/* Allocate hdspe->sched, if not done yet. It is freed with the card. */
+static int hdspe_sched_alloc(struct hdspe* hdspe)
+{
+	struct hdspe_sched* new;
+
+	if (READ_ONCE(hdspe->sched))
+		return 0;
+
+	new = vzalloc(sizeof(*new));
+	if (!new)
+		return -ENOMEM;
+	new->hdspe = hdspe;
+	spin_lock_init(&new->lock);
+	INIT_WORK(&new->work, hdspe_sched_work);
+	new->next_frame = U64_MAX;
+
+	spin_lock_irq(&hdspe->lock);
+	if (!hdspe->sched) {
+		hdspe->sched = new;
+		new = NULL;
+	}
+	spin_unlock_irq(&hdspe->lock);
+
+	vfree(new);	/* lost a race with another caller */
+	return 0;
+}
+
+/* The value range checks snd_ctl_elem_write() only does with
+ * CONFIG_SND_CTL_INPUT_VALIDATION: put() methods count on them. */
+static int hdspe_sched_check_values(const struct snd_ctl_elem_info* info,
+				    const s64* value)
+{
+	s64 min, max, step;
+	unsigned i;
+
+	switch (info->type) {
+	case SNDRV_CTL_ELEM_TYPE_BOOLEAN:
+		min = 0;
+		max = 1;
+		step = 0;
+		break;
+	case SNDRV_CTL_ELEM_TYPE_INTEGER:
+		min = info->value.integer.min;
+		max = info->value.integer.max;
+		step = info->value.integer.step;
+		break;
+	case SNDRV_CTL_ELEM_TYPE_INTEGER64:
+		min = info->value.integer64.min;
+		max = info->value.integer64.max;
+		step = info->value.integer64.step;
+		break;
+	default:	/* ENUMERATED */
+		min = 0;
+		max = (s64)info->value.enumerated.items - 1;
+		step = 0;
+	}
+
+	for (i = 0; i < info->count; i++) {
+		if (value[i] < min || value[i] > max)
+			return -EINVAL;
+		if (step > 0 && div64_s64(value[i] - min, step) * step !=
+		    value[i] - min)
+			return -EINVAL;
+	}
+	return 0;
+}
+
+/* Check that the control element exists, is writable and has at most
+ * HDSPE_SCHED_CTL_VALUES integer, boolean or enumerated values, and that
+ * <value> is in range. */
+static int hdspe_sched_check_ctl(struct hdspe* hdspe, u32 numid,
+				 const s64* value,
+				 snd_ctl_elem_type_t* type, unsigned* count)
+{
+	struct snd_ctl_elem_info* info;
+	struct snd_kcontrol* kctl;
+	unsigned ioff = 0;
+	int err;
+
+	info = kzalloc(sizeof(*info), GFP_KERNEL);
+	if (!info)
+		return -ENOMEM;
+
+	down_read(&hdspe->card->controls_rwsem);
+	kctl = hdspe_sched_find_kctl(hdspe, numid, &ioff);
+	if (!kctl) {
+		err = -ENOENT;
+		goto unlock;
+	}
+	err = hdspe_sched_may_write(kctl, ioff);
+	if (err < 0)
+		goto unlock;
+	snd_ctl_build_ioff(&info->id, kctl, ioff);
+	err = kctl->info(kctl, info);
+	if (err < 0)
+		goto unlock;
+
+	switch (info->type) {
+	case SNDRV_CTL_ELEM_TYPE_BOOLEAN:
+	case SNDRV_CTL_ELEM_TYPE_INTEGER:
+	case SNDRV_CTL_ELEM_TYPE_ENUMERATED:
+	case SNDRV_CTL_ELEM_TYPE_INTEGER64:
+		break;
+	default:
+		err = -EINVAL;
+		goto unlock;
+	}
+	if (info->count == 0 || info->count > HDSPE_SCHED_CTL_VALUES) {
+		err = -EINVAL;
+		goto unlock;
+	}
+	err = hdspe_sched_check_values(info, value);
+	if (err < 0)
+		goto unlock;
+	*type = info->type;
+	*count = info->count;
+
+unlock:
+	up_read(&hdspe->card->controls_rwsem);
+	kfree(info);
+	return err;
+}
+
+int hdspe_sched_ctl(struct hdspe* hdspe, struct hdspe_sched_ctl* ctl)
+{
+	struct hdspe_sched* s;
+	struct hdspe_sched_slot* sl = NULL;
+	snd_ctl_elem_type_t type;
+	unsigned count;
+	int i, err;
+
+	err = hdspe_sched_check_ctl(hdspe, ctl->numid, ctl->value,
+				    &type, &count);
+	if (err < 0)
+		return err;
+	err = hdspe_sched_alloc(hdspe);
+	if (err < 0)
+		return err;
+	s = hdspe->sched;
+
+	spin_lock_irq(&hdspe->lock);
+	spin_lock(&s->lock);
+
+	/* A free slot, or else the oldest one done. */
+	for (i = 0; i < HDSPE_SCHED_SLOTS; i++) {
+		struct hdspe_sched_slot* t = &s->slot[i];
+		if (t->state == HDSPE_SCHED_FREE) {
+			sl = t;
+			break;
+		}
+		if (t->state == HDSPE_SCHED_DONE &&
+		    (!sl || (s32)(t->ctl.seq - sl->ctl.seq) < 0))
+			sl = t;
+	}
+	if (!sl) {
+		err = -EBUSY;
+		goto unlock;
+	}
+
+	ctl->seq = ++s->seq;
+	ctl->applied = 0;
+	ctl->result = -EINPROGRESS;
+	sl->ctl = *ctl;
+	sl->type = type;
+	sl->count = count;
+	sl->state = HDSPE_SCHED_PENDING;
+	if (ctl->frame < s->next_frame)
+		s->next_frame = ctl->frame;
+
+	if (!s->period_irq) {
+		s->period_irq = true;
+		hdspe_period_irq_get(hdspe);
+	}
+
+unlock:
+	spin_unlock(&s->lock);
+	spin_unlock_irq(&hdspe->lock);
+	return err;
+}
+
+int hdspe_sched_ctl_result(struct hdspe* hdspe, struct hdspe_sched_ctl* ctl)
+{
+	struct hdspe_sched* s = hdspe->sched;
+	int i, err = -ENOENT;
+
+	if (!s)
+		return -ENOENT;
+
+	spin_lock_irq(&s->lock);
+	for (i = 0; i < HDSPE_SCHED_SLOTS; i++) {
+		if (s->slot[i].state != HDSPE_SCHED_FREE &&
+		    s->slot[i].ctl.seq == ctl->seq) {
+			*ctl = s->slot[i].ctl;
+			err = 0;
+			break;
+		}
+	}
+	spin_unlock_irq(&s->lock);
+	return err;
+}
+
+void hdspe_sched_period(struct hdspe* hdspe)
+{
+	struct hdspe_sched* s = hdspe->sched;
+	u64 frame = hdspe->frame_count;
+	bool due = false;
+	int i;
+
+	spin_lock(&s->lock);
+	if (frame >= s->next_frame) {
+		s->next_frame = U64_MAX;
+		for (i = 0; i < HDSPE_SCHED_SLOTS; i++) {
+			struct hdspe_sched_slot* sl = &s->slot[i];
+			if (sl->state != HDSPE_SCHED_PENDING)
+				continue;
+			if (sl->ctl.frame <= frame) {
+				sl->state = HDSPE_SCHED_DUE;
+				due = true;
+			} else if (sl->ctl.frame < s->next_frame) {
+				s->next_frame = sl->ctl.frame;
+			}
+		}
+	}
+	spin_unlock(&s->lock);
+
+	if (due)
+		queue_work(system_highpri_wq, &s->work);
+}
+
+void hdspe_sched_free(struct hdspe* hdspe)
+{
+	struct hdspe_sched* s;
+
+	spin_lock_irq(&hdspe->lock);
+	s = hdspe->sched;
+	hdspe->sched = NULL;
+	spin_unlock_irq(&hdspe->lock);
+
+	if (s)
+		cancel_work_sync(&s->work);
+	vfree(s);
+}
@@ -18,6 +18,8 @@
 
 #include <linux/slab.h>
 #include <linux/bitfield.h>
+#include <linux/gcd.h>
+#include <linux/math64.h>
 
 #ifdef DEBUG_LTC
 #define LTC_TIMER_FREQ 100
@@ -178,6 +180,7 @@
 #define HDSPE_TCO1_LTC_Format_MSB		0x00000800
 
 #define HDSPE_TCO1_STATUS_MASK                  0x00000c7f
+#define HDSPE_TCO1_SETTINGS_MASK		0x00000e06
 
 #define HDSPE_TCO2_TC_run			0x00010000
 #define HDSPE_TCO2_WCK_IO_ratio_LSB		0x00020000
@@ -196,6 +199,11 @@
 #define HDSPE_TCO2_set_input_MSB		0x40000000
 #define HDSPE_TCO2_set_freq_from_app		0x80000000
 
+/* The sync bits 7, 15, 23 and 31 of each control register are never written
+ * to the card. HDSPE_TCO2_set_freq_from_app uses bit 31 of the register 2
+ * shadow for driver state. */
+#define HDSPE_TCO_WRITE_MASK			0x7f7f7f7f
+
 #ifdef CONFIG_SND_DEBUG
 static const char* const tco1_bitNames[32] = {
 	"TCO_lock",
@@ -320,7 +328,7 @@ u32 hdspe_read_tco(struct hdspe* hdspe, unsigned n)
 static inline __attribute__((always_inline))
 void hdspe_write_tco(struct hdspe* hdspe, unsigned n, u32 value)
 {
-	value &= 0x7f7f7f7f;
+	value &= HDSPE_TCO_WRITE_MASK;
 	hdspe_write(hdspe, HDSPE_WR_TCO+n*4, cpu_to_le32(value));
 }
 
@@ -375,19 +383,91 @@ static void hdspe_tco_copy_control(struct hdspe* hdspe,
 	s->wck_out_speed       = hdspe->tco->wck_out_speed;
 }
 
+/* Called from process context: the TCO lock is also taken by the
+ * interrupt handler. */
 void hdspe_tco_read_status(struct hdspe* hdspe, struct hdspe_tco_status* s)
 {
-        spin_lock(&hdspe->tco->lock);
+	unsigned long flags;
+
+	spin_lock_irqsave(&hdspe->tco->lock, flags);
 	s->version = HDSPE_VERSION;
 	s->fw_version = hdspe->tco->fw_version;
 	s->ltc_in = hdspe_read_tco(hdspe, 0);
 	hdspe_tco_read_status1(hdspe, s);
 	hdspe_tco_read_status2(hdspe, s);
 	hdspe_tco_copy_control(hdspe, s);
-        spin_unlock(&hdspe->tco->lock);
+	spin_unlock_irqrestore(&hdspe->tco->lock, flags);
+}
+
+/*
+ * TCO control register shadow. c->reg[] holds the register values the
+ * driver wants, c->hw_reg[] the values last written to the card. Changes
+ * go to c->reg[] with hdspe_tco_set_reg(), which marks the register dirty,
+ * and reach the card with hdspe_tco_commit(), which writes only the dirty
+ * registers that differ from what the card already has, in register order.
+ * c->reg[] keeps all bits, including driver state in the sync bits, see
+ * HDSPE_TCO_WRITE_MASK; c->hw_reg[] holds the bits actually written.
+ * Control changes are committed at the next period interrupt if period
+ * interrupts are enabled, so that a burst of control changes ends up in
+ * a single write per register. Otherwise they are committed right away.
+ * Called with c->lock held.
+ */
+static void hdspe_tco_set_reg(struct hdspe_tco* c, unsigned n, u32 value)
+{
+	if (c->reg[n] != value) {
+		c->reg[n] = value;
+		c->dirty |= 1 << n;
+	}
+}
+
+static void hdspe_tco_commit(struct hdspe* hdspe)
+{
+	struct hdspe_tco* c = hdspe->tco;
+	unsigned n;
+	u32 value;
+
+	for (n = 0; c->dirty; n++) {
+		if (!(c->dirty & (1 << n)))
+			continue;
+		c->dirty &= ~(1 << n);
+		value = c->reg[n] & HDSPE_TCO_WRITE_MASK;
+		if (value == c->hw_reg[n])
+			continue;
+		hdspe_write_tco(hdspe, n, value);
+		c->hw_reg[n] = value;
+		c->reg_writes[n]++;
+	}
+}
+
+/* Commit the TCO settings now, or at the next period interrupt if period
+ * interrupts are enabled. In the latter case, a period interrupt reference
+ * is held until then, see hdspe_tco_period_elapsed(). */
+static void hdspe_tco_schedule_commit(struct hdspe* hdspe)
+{
+	struct hdspe_tco* c = hdspe->tco;
+	unsigned long flags;
+	bool deferred;
+
+	spin_lock_irqsave(&hdspe->lock, flags);
+	deferred = hdspe->reg.control.common.IE_AUDIO;
+	if (deferred && !c->period_irq) {
+		c->period_irq = true;
+		hdspe_period_irq_get(hdspe);
+	}
+	spin_unlock_irqrestore(&hdspe->lock, flags);
+
+	if (!deferred) {
+		spin_lock_irqsave(&c->lock, flags);
+		hdspe_tco_commit(hdspe);
+		spin_unlock_irqrestore(&c->lock, flags);
+	}
 }
 
-static void hdspe_tco_write_settings(struct hdspe* hdspe)
+/* Update the TCO settings in the register shadow. Only the settings
+ * fields of register 1 are replaced: the time code and offset to set, in
+ * register 0 and the upper half of register 1, and a pending set_TC
+ * request are left alone. */
+static void hdspe_tco_update_settings(struct hdspe* hdspe)
 {
 	static const int pullbits[HDSPE_PULL_COUNT] = {
 		0,
@@ -397,7 +477,7 @@ static void hdspe_tco_write_settings(struct hdspe* hdspe)
 		HDSPE_TCO2_set_pull_down|HDSPE_TCO2_set_01_4
 	};
 	
-	u32* reg;
+	u32 reg[4];
 	bool sys_48kHz = (hdspe->reg.control.common.freq == 3);
 	
 	struct hdspe_tco* c = hdspe->tco;
@@ -405,9 +485,8 @@ static void hdspe_tco_write_settings(struct hdspe* hdspe)
 		snd_BUG();
 		return;
 	}
-	reg = c->reg;
 
-	reg[0] = reg[1] = reg[2] = reg[3] = 0;
+	reg[1] = reg[2] = reg[3] = 0;
 
 	reg[1] |= FIELD_PREP(HDSPE_TCO1_WCK_Input_Range_MSB|
 			     HDSPE_TCO1_WCK_Input_Range_LSB, c->wck_out_speed);
@@ -433,10 +512,10 @@ static void hdspe_tco_write_settings(struct hdspe* hdspe)
 	reg[2] |= FIELD_PREP(HDSPE_TCO2_TC_run, c->ltc_run);
 	reg[2] |= FIELD_PREP(HDSPE_TCO2_set_flywheel, c->ltc_flywheel);
 
-	hdspe_write_tco(hdspe, 0, reg[0]);
-	hdspe_write_tco(hdspe, 1, reg[1]);
-	hdspe_write_tco(hdspe, 2, reg[2]);
-	hdspe_write_tco(hdspe, 3, reg[3]);
+	hdspe_tco_set_reg(c, 1, (c->reg[1] & ~HDSPE_TCO1_SETTINGS_MASK) |
+			  reg[1]);
+	hdspe_tco_set_reg(c, 2, reg[2]);
+	hdspe_tco_set_reg(c, 3, reg[3]);
 }
 
 void hdspe_tco_set_app_sample_rate(struct hdspe* hdspe)
@@ -446,22 +525,26 @@ void hdspe_tco_set_app_sample_rate(struct hdspe* hdspe)
 	 * with TCO card frequency, and TCO sample rate is "From App". */
 	struct hdspe_tco* c = hdspe->tco;
 	bool tco_48kHz, sys_48kHz;
+	unsigned long flags;
 	if (!c)
 		return;
 
 	if (c->sample_rate != HDSPE_TCO_SAMPLE_RATE_FROM_APP)
 		return;
 	
+	spin_lock_irqsave(&c->lock, flags);
 	tco_48kHz = FIELD_GET(HDSPE_TCO2_set_freq, c->reg[2]);
 	sys_48kHz = (hdspe->reg.control.common.freq == 3);
 	
 	if (tco_48kHz != sys_48kHz) {
-		c->reg[2] &= ~HDSPE_TCO2_set_freq;
-		c->reg[2] |= FIELD_PREP(HDSPE_TCO2_set_freq, sys_48kHz);
-		hdspe_write_tco(hdspe, 2, c->reg[2]);
+		/* Not deferred: the card follows the new rate right away. */
+		hdspe_tco_set_reg(c, 2, (c->reg[2] & ~HDSPE_TCO2_set_freq) |
+				  FIELD_PREP(HDSPE_TCO2_set_freq, sys_48kHz));
+		hdspe_tco_commit(hdspe);
 		dev_dbg(hdspe->card->dev, "%s: 48kHz %s.\n",
 			__func__, sys_48kHz ? "ON" : "OFF");
 	}
+	spin_unlock_irqrestore(&c->lock, flags);
 }
 
 ////////////////////////////////////////////////////////////////////////////
@@ -479,9 +562,9 @@ static void hdspe_tco_set_timecode(struct hdspe* hdspe,
 	struct hdspe_tco* c = hdspe->tco;
 	/* offset is stored as two groups of 7 bits */
 	uint32_t offset2 = ((offset & 0x3f80)<<1) | (offset & 0x7f);
-	hdspe_write_tco(hdspe, 0, timecode);
-	hdspe_write_tco(hdspe, 1, (offset2 << 16) | HDSPE_TCO1_set_TC |
-			(c->reg[1] & 0xffff));
+	hdspe_tco_set_reg(c, 0, timecode);
+	hdspe_tco_set_reg(c, 1, (offset2 << 16) | HDSPE_TCO1_set_TC |
+			  (c->reg[1] & 0xffff));
 	c->ltc_set = true;
 
 	dev_dbg(hdspe->card->dev,
@@ -496,7 +579,7 @@ static void hdspe_tco_reset_timecode(struct hdspe* hdspe)
 {
 	struct hdspe_tco* c = hdspe->tco;
 	
-	hdspe_write_tco(hdspe, 1, c->reg[1] & 0xffff & ~HDSPE_TCO1_set_TC);
+	hdspe_tco_set_reg(c, 1, c->reg[1] & 0xffff & ~HDSPE_TCO1_set_TC);
 	c->ltc_set = false;
 
 	dev_dbg(hdspe->card->dev, "%s\n", __func__);
@@ -559,7 +642,14 @@ static u32 hdspe_ltc_offset(u32 fps, enum hdspe_freq f)
     return offset;
 }
 
-static void hdspe_tco_start_timecode(struct hdspe* hdspe)
+/* Set time code and start running LTC output. In relocation mode
+ * (c->ltc_out_relocate), the time code is set only once the requested
+ * start time is within reach from the next period interrupt, so that the
+ * requested time code is output at exactly the requested time, and a
+ * running generator is not stopped: the output jumps to the new time code
+ * at that time. Returns false if that time is still too far away, and the
+ * request is kept for a later period interrupt. */
+static bool hdspe_tco_start_timecode(struct hdspe* hdspe)
 {
 	struct hdspe_tco* c = hdspe->tco;
 	u64 cfc = hdspe->frame_count;           /* current frame count       */
@@ -569,6 +659,7 @@ static void hdspe_tco_start_timecode(struct hdspe* hdspe)
 	s32 offset;       /* nr of samples to delay LTC start at next period */
 	u32 sr = hdspe_tco_get_sample_rate(hdspe);            /* sample rate */
 	u32 speedfactor = hdspe_speed_factor(hdspe);            /* 1, 2 or 4 */
+	u32 hw_offset;     /* card LTC start delay, in single speed samples */
 
 	struct hdspe_ltc ltc;
 	ltc.tc = c->ltc_out;
@@ -598,10 +689,25 @@ static void hdspe_tco_start_timecode(struct hdspe* hdspe)
 	if (ltc.fc == (u64)-1)    /* means 'now' */
 		ltc.fc = cfc;
 
+	hw_offset = hdspe_ltc_offset(ltc.fps, hdspe_sample_rate_freq(sr));
+
+	/* Relocation: wait until the requested start time can be reached
+	 * with an offset from the next period interrupt. */
+	if (c->ltc_out_relocate &&
+	    ltc.fc > cfc + ps + hw_offset + 0x3fff) {
+		hdspe_dbg_hot(hdspe, "%s: relocate at %llu, now %llu: wait.\n",
+			      __func__, ltc.fc, cfc);
+		return false;
+	}
+
 	/* reduce ltc.fc to valid offset, taking into account it will be picked
-	 * up by the hardware only at the next period interrupt */
+	 * up by the hardware only at the next period interrupt. In relocation
+	 * mode, only if the requested time is too close or in the past. */
 	n = 0;
-	if (ltc.fc > cfc + 2 * ps + fs) {
+	if (c->ltc_out_relocate) {
+		if (ltc.fc < cfc + 2 * ps)
+			n = ((cfc + 2 * ps) - ltc.fc) / fs + 1;
+	} else if (ltc.fc > cfc + 2 * ps + fs) {
 		n = -(ltc.fc - (cfc + 2 * ps)) / fs;
 	} else if (ltc.fc < cfc + 2 * ps) {
 		n = ((cfc + 2 * ps) - ltc.fc) / fs + 1;
@@ -609,11 +715,11 @@ static void hdspe_tco_start_timecode(struct hdspe* hdspe)
 	ltc.fc += n * fs;
 	ltc.tc = hdspe_ltc32_add_frames(n, ltc.tc, ltc.fps, ltc.df);
 	offset = ltc.fc - (cfc + ps);      /* pickup at next audio period */
-	dev_dbg(hdspe->card->dev,
+	hdspe_dbg_hot(hdspe,
 		"%s: compensate %d frames: tc=%08x, fc=%llu, offset=%d\n",
 		__func__, n, ltc.tc&0x3f7f7f3f, ltc.fc, offset);
 
-	offset -= hdspe_ltc_offset(ltc.fps, hdspe_sample_rate_freq(sr));
+	offset -= hw_offset;
 
 	if (offset < 0 || (offset & ~0x3fff) != 0) { 
 		dev_warn(hdspe->card->dev,
@@ -623,10 +729,18 @@ static void hdspe_tco_start_timecode(struct hdspe* hdspe)
 
 	hdspe_tco_set_timecode(hdspe, ltc.tc, offset);
 	c->ltc_out = 0xffffffff;
-	
-	hdspe_write_tco(hdspe, 2, c->reg[2] |= HDSPE_TCO2_TC_run);
-	c->ltc_run = true;
-	HDSPE_CTL_NOTIFY(ltc_run);
+
+	/* Time code and frame count at which it will actually start. */
+	c->ltc_out_set = ltc.tc;
+	c->ltc_out_set_frame_count = ltc.fc * speedfactor;
+	HDSPE_CTL_NOTIFY(ltc_out_status);
+
+	if (!c->ltc_run) {
+		hdspe_tco_set_reg(c, 2, c->reg[2] | HDSPE_TCO2_TC_run);
+		c->ltc_run = true;
+		HDSPE_CTL_NOTIFY(ltc_run);
+	}
+	return true;
 }
 
 static void hdspe_tco_stop_timecode(struct hdspe* hdspe)
@@ -634,7 +748,7 @@ static void hdspe_tco_stop_timecode(struct hdspe* hdspe)
 	struct hdspe_tco* c = hdspe->tco;
 	dev_dbg(hdspe->card->dev, "%s\n", __func__);
 	
-	hdspe_write_tco(hdspe, 2, c->reg[2] &= ~HDSPE_TCO2_TC_run);
+	hdspe_tco_set_reg(c, 2, c->reg[2] & ~HDSPE_TCO2_TC_run);
 	c->ltc_run = false;
 }
 
@@ -699,6 +813,38 @@ void hdspe_tco_qmtc(struct hdspe* hdspe, u8 quarter_frame_msg)
 }
 #endif /*DEBUG_MTC*/
 
+/* Period interrupts are needed while LTC input is being received, and
+ * for scheduling LTC output. */
+static void hdspe_tco_period_irq_get(struct hdspe* hdspe)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&hdspe->lock, flags);
+	if (!hdspe->tco->period_irq) {
+		hdspe->tco->period_irq = true;
+		hdspe_period_irq_get(hdspe);
+	}
+	spin_unlock_irqrestore(&hdspe->lock, flags);
+}
+
+/* Called from the interrupt handler. Not while a control register commit
+ * is pending: see hdspe_tco_schedule_commit(). c->dirty is written under
+ * c->lock and c->period_irq under hdspe->lock, so both are held here, in
+ * the same order as hdspe_tco_set_app_sample_rate() takes them. */
+static void hdspe_tco_period_irq_put(struct hdspe* hdspe)
+{
+	struct hdspe_tco* c = hdspe->tco;
+
+	spin_lock(&hdspe->lock);
+	spin_lock(&c->lock);
+	if (c->period_irq && !c->dirty) {
+		c->period_irq = false;
+		hdspe_period_irq_put(hdspe);
+	}
+	spin_unlock(&c->lock);
+	spin_unlock(&hdspe->lock);
+}
+
 void hdspe_tco_mtc(struct hdspe* hdspe, const u8* buf, int count)
 {
 	struct hdspe_tco *c = hdspe->tco;
@@ -739,7 +885,210 @@ void hdspe_tco_mtc(struct hdspe* hdspe, const u8* buf, int count)
 		
 		hdspe->tco->ltc_changed = true;		
 		spin_unlock(&hdspe->tco->lock);
+
+		if (!c->period_irq)
+			hdspe_tco_period_irq_get(hdspe);
+	}
+}
+
+/* The fs period counter counts periods of this clock (25 MHz x 16)
+ * during one period of the word clock / video derived sample clock. */
+#define HDSPE_TCO_FS_PERIOD_CLOCK	400000000ULL
+
+u64 hdspe_tco_fs_freq(struct hdspe* hdspe)
+{
+	struct hdspe_tco_status s;
+
+	hdspe_tco_read_status2(hdspe, &s);
+	if (s.fs_period_counter == 0 || s.fs_period_counter >= 0x3fff)
+		return 0;	/* no input, or below the counter range */
+	return div_u64(HDSPE_TCO_FS_PERIOD_CLOCK * 1000, s.fs_period_counter);
+}
+
+/* Video frame rates as a fraction frames / seconds. */
+static const u16 hdspe_video_fps_tab[HDSPE_VIDEO_FPS_COUNT][2] = {
+	[HDSPE_VIDEO_FPS_23_98] = { 24000, 1001 },
+	[HDSPE_VIDEO_FPS_24]    = {    24,    1 },
+	[HDSPE_VIDEO_FPS_25]    = {    25,    1 },
+	[HDSPE_VIDEO_FPS_29_97] = { 30000, 1001 },
+	[HDSPE_VIDEO_FPS_30]    = {    30,    1 },
+	[HDSPE_VIDEO_FPS_47_95] = { 48000, 1001 },
+	[HDSPE_VIDEO_FPS_48]    = {    48,    1 },
+	[HDSPE_VIDEO_FPS_50]    = {    50,    1 },
+	[HDSPE_VIDEO_FPS_59_94] = { 60000, 1001 },
+	[HDSPE_VIDEO_FPS_60]    = {    60,    1 }
+};
+
+/* Re-check the video reference every this many audio frames. */
+#define HDSPE_TCO_VIDEO_CHECK	32768
+
+/* Video frames are looked up at most this many audio frames away from
+ * the last edge. */
+#define HDSPE_TCO_VIDEO_RANGE	(1LL << 40)
+
+/* floor(x / d) for negative x as well. */
+static s64 hdspe_div_floor(s64 x, u32 d)
+{
+	s64 q = div64_s64(x, d);
+	return (x < 0 && q * d != x) ? q - 1 : q;
+}
+
+/* Number of video frame edges after the last one, up to and including
+ * audio frame video_edge + delta. Negative if delta is before the last
+ * video frame edge. */
+static s64 hdspe_tco_video_edges(struct hdspe_tco* c, s64 delta)
+{
+	return hdspe_div_floor((delta + 1) * c->video_spf_den
+			       - c->video_edge_rem - 1, c->video_spf_num);
+}
+
+/* Audio frame of video frame edge video_frame + n, relative to
+ * video_edge. */
+static s64 hdspe_tco_video_edge_pos(struct hdspe_tco* c, s64 n)
+{
+	return hdspe_div_floor(c->video_edge_rem + n * c->video_spf_num,
+			       c->video_spf_den);
+}
+
+/* Nominal samples per video frame, as a reduced fraction. The card is
+ * locked to the video reference, or not: either way, pull up/down affects
+ * video and audio rate alike. Returns false if there is no video
+ * reference. */
+static bool hdspe_tco_video_spf(struct hdspe* hdspe, u32* num, u32* den)
+{
+	struct hdspe_tco_status s;
+	u32 rate, fps_num, fps_den, g;
+
+	hdspe_tco_read_status1(hdspe, &s);
+	if (hdspe->tco->fw_version >= 11) {
+		hdspe_tco_read_status2(hdspe, &s);
+		if (s.video_in_fps <= HDSPE_VIDEO_FPS_NO_VIDEO ||
+		    s.video_in_fps >= HDSPE_VIDEO_FPS_COUNT)
+			return false;
+		fps_num = hdspe_video_fps_tab[s.video_in_fps][0];
+		fps_den = hdspe_video_fps_tab[s.video_in_fps][1];
+	} else if (s.video == HDSPE_VIDEO_FORMAT_PAL) {
+		fps_num = 25; fps_den = 1;
+	} else if (s.video == HDSPE_VIDEO_FORMAT_NTSC) {
+		fps_num = 30000; fps_den = 1001;
+	} else
+		return false;
+
+	rate = hdspe_nominal_sample_rate(hdspe_read_system_sample_rate(hdspe));
+	g = gcd(rate * fps_den, fps_num);
+	*num = rate * fps_den / g;
+	*den = fps_num / g;
+	return true;
+}
+
+/* Check the video reference and (re)start the timeline at the current
+ * frame count if it changed. Phase is arbitrary until aligned to LTC.
+ * Called with the TCO lock held. */
+static void hdspe_tco_video_check(struct hdspe* hdspe)
+{
+	struct hdspe_tco* c = hdspe->tco;
+	u32 num = 0, den = 1;
+
+	c->video_check = hdspe->frame_count;
+	if (!hdspe_tco_video_spf(hdspe, &num, &den))
+		num = 0;
+	if (num == c->video_spf_num && den == c->video_spf_den)
+		return;
+
+	c->video_spf_num = num;
+	c->video_spf_den = den;
+	c->video_edge = hdspe->frame_count;
+	c->video_edge_rem = 0;
+	c->video_frame = 0;
+	c->video_phase = 0;
+	c->video_ltc_aligned = false;
+
+	dev_dbg(hdspe->card->dev, "%s: %u/%u samples per video frame.\n",
+		__func__, num, den);
+	snd_ctl_notify(hdspe->card, SNDRV_CTL_EVENT_MASK_VALUE,
+		       hdspe->cid.video_timeline);
+}
+
+/* Align the video timeline to the start of incoming LTC frame at audio
+ * frame <fc>, if not yet done or if it drifted away by more than one
+ * sample. LTC frames start at a video frame edge when LTC and video are
+ * genlocked. Called with the TCO lock held. */
+static void hdspe_tco_video_align(struct hdspe* hdspe, u64 fc)
+{
+	struct hdspe_tco* c = hdspe->tco;
+	s64 delta = fc - c->video_edge;
+	s64 n = hdspe_tco_video_edges(c, delta);
+	s64 d0 = delta - hdspe_tco_video_edge_pos(c, n);
+	s64 d1 = hdspe_tco_video_edge_pos(c, n + 1) - delta;
+
+	if (d1 < d0) {
+		n++;
+		d0 = -d1;
+	}
+	if (c->video_ltc_aligned && abs(d0) <= 1)
+		return;
+
+	c->video_edge = fc;
+	c->video_edge_rem = 0;
+	c->video_frame += n;
+	c->video_phase = 0;
+	c->video_ltc_aligned = true;
+
+	snd_ctl_notify(hdspe->card, SNDRV_CTL_EVENT_MASK_VALUE,
+		       hdspe->cid.video_timeline);
+}
+
+/* Move the timeline to the last video frame edge at or before the
+ * current frame count. Called with the TCO lock held. */
+static void hdspe_tco_video_advance(struct hdspe* hdspe)
+{
+	struct hdspe_tco* c = hdspe->tco;
+	s64 n = hdspe_tco_video_edges(c, hdspe->frame_count - c->video_edge);
+	u64 t;
+
+	if (n <= 0)
+		return;
+
+	t = c->video_edge_rem + (u64)n * c->video_spf_num;
+	c->video_edge += div_u64_rem(t, c->video_spf_den, &c->video_edge_rem);
+	c->video_frame += n;
+	div_u64_rem(c->video_phase + n, c->video_spf_den, &c->video_phase);
+}
+
+int hdspe_tco_video_frame_at(struct hdspe* hdspe, struct hdspe_video_frame* v)
+{
+	struct hdspe_tco* c = hdspe->tco;
+	unsigned long flags;
+	s32 phase;
+	s64 n, delta;
+	int err = 0;
+
+	if (!c)
+		return -ENODEV;
+
+	spin_lock_irqsave(&c->lock, flags);
+	if (c->video_spf_num == 0) {
+		err = -ENODATA;
+		goto unlock;
 	}
+	/* Keeps the edge arithmetic within 64 bits. */
+	delta = v->frame - c->video_edge;
+	if (delta < -HDSPE_TCO_VIDEO_RANGE || delta > HDSPE_TCO_VIDEO_RANGE) {
+		err = -ERANGE;
+		goto unlock;
+	}
+	n = hdspe_tco_video_edges(c, delta);
+	v->index = c->video_frame + n;
+	v->edge = c->video_edge + hdspe_tco_video_edge_pos(c, n);
+	div_s64_rem(c->video_phase + n, c->video_spf_den, &phase);
+	v->phase = phase < 0 ? phase + c->video_spf_den : phase;
+	v->spf_num = c->video_spf_num;
+	v->spf_den = c->video_spf_den;
+	v->ltc_aligned = c->video_ltc_aligned;
+
+unlock:
+	spin_unlock_irqrestore(&c->lock, flags);
+	return err;
 }
 
 /* Invoked at every audio interrupt */
@@ -751,6 +1100,9 @@ void hdspe_tco_period_elapsed(struct hdspe* hdspe)
 	/* clock by which LTC frame start is measured. */
 	c->ltc_time = hdspe->frame_count;
 
+	if (hdspe->frame_count - c->video_check >= HDSPE_TCO_VIDEO_CHECK)
+		hdspe_tco_video_check(hdspe);
+
 	/* Incoming time code and offset are accurate only at this time of an
 	 * audio period interrupt, when audio interrupts are enabled.
 	 * Check for changes and notify here. */
@@ -765,6 +1117,8 @@ void hdspe_tco_period_elapsed(struct hdspe* hdspe)
 
 		c->ltc_in = ltc.tc;
 		c->ltc_in_frame_count = ltc.fc;
+		if (c->video_spf_num)
+			hdspe_tco_video_align(hdspe, ltc.fc);
 		//		if (hdspe->period_size >= 2048)
 		//		  c->ltc_in_frame_count -= hdspe->period_size / 2;
 		
@@ -787,27 +1141,40 @@ void hdspe_tco_period_elapsed(struct hdspe* hdspe)
 				       hdspe->cid.ltc_in_pullfac);
 		c->last_ltc_in_pullfac = c->ltc_in_pullfac;
 	}
+
+	if (c->video_spf_num)
+		hdspe_tco_video_advance(hdspe);
 	spin_unlock(&hdspe->tco->lock);
 
+	spin_lock(&hdspe->tco->lock);
 	if (c->ltc_set) {
 		/* Output time code set at the previous audio interrupt
 		 * is now picked up by the hardware. Reset the TCO1_set_TC 
-		 * control bit and frame offset. */
-		spin_lock(&hdspe->tco->lock);
+		 * control bit and frame offset. The card shall see the bit
+		 * drop before it may be raised again below. */
 		hdspe_tco_reset_timecode(hdspe);
-		spin_unlock(&hdspe->tco->lock);
+		hdspe_tco_commit(hdspe);
 		/* c->ltc_set is reset to false at this time. */
 	}
 
 	if (c->ltc_out != 0xffffffff) { /* set timecode and start running LTC */
-		spin_lock(&hdspe->tco->lock);		
 		hdspe_tco_start_timecode(hdspe);
-		spin_unlock(&hdspe->tco->lock);
 		/* Output time code is picked up by the hardware at the next 
 		 * audio period interrupt. 
 		 * c->ltc_set is true at this point. 
 		 * ltc_out is reset to 0xffffffff. */
 	}
+
+	/* Time code to set and control changes since the previous
+	 * interrupt, in one go. */
+	hdspe_tco_commit(hdspe);
+	spin_unlock(&hdspe->tco->lock);
+
+	/* No more need for period interrupts if no LTC came in for a
+	 * second and no LTC output is being scheduled. */
+	if (c->period_irq && !c->ltc_set && c->ltc_out == 0xffffffff &&
+	    ktime_get_real_ns() - c->prev_ltc_time > NSEC_PER_SEC)
+		hdspe_tco_period_irq_put(hdspe);
 }
 
 #ifdef DEBUG_LTC
@@ -895,6 +1262,14 @@ void snd_hdspe_proc_read_tco(struct snd_info_entry *entry,
 		    c->ltc_flywheel, HDSPE_BOOL_NAME(c->ltc_flywheel));
 	snd_iprintf(buffer, "LTC Set           : %d %s\n",
 		    c->ltc_set, HDSPE_BOOL_NAME(c->ltc_set));
+	snd_iprintf(buffer, "LTC Out Set       : %02x:%02x:%02x%c%02x at %llu%s\n",
+		    (c->ltc_out_set>>24) & 0x3f,
+		    (c->ltc_out_set>>16) & 0x7f,
+		    (c->ltc_out_set>> 8) & 0x7f,
+		    (c->ltc_drop) ? '.' : ':',
+		    (c->ltc_out_set    ) & 0x3f,
+		    c->ltc_out_set_frame_count,
+		    c->ltc_out_relocate ? " (relocate)" : "");
 
 	snd_iprintf(buffer, "TCO FW version    : %d\n",
 		    (tco3 >> 24) & 0x7f);
@@ -902,6 +1277,19 @@ void snd_hdspe_proc_read_tco(struct snd_info_entry *entry,
 		    ((tco2 & 0x7f00)>>1) | (tco2&0x7f), 25000000);
 	snd_iprintf(buffer, "Video Input FPS   : %d %s\n",
 		    (tco2 >> 27) & 0x0f, "");
+	snd_iprintf(buffer, "Video Frame Edge  : %llu frame %llu phase %u%s\n",
+		    c->video_edge, c->video_frame, c->video_phase,
+		    c->video_ltc_aligned ? " (LTC aligned)" : "");
+	snd_iprintf(buffer, "Video Frame Size  : %u/%u\n",
+		    c->video_spf_num, c->video_spf_den);
+
+	snd_iprintf(buffer, "\n");
+	snd_iprintf(buffer, "Control Registers : %08x %08x %08x %08x%s\n",
+		    c->hw_reg[0], c->hw_reg[1], c->hw_reg[2], c->hw_reg[3],
+		    c->dirty ? " (commit pending)" : "");
+	snd_iprintf(buffer, "Register Writes   : %u %u %u %u\n",
+		    c->reg_writes[0], c->reg_writes[1],
+		    c->reg_writes[2], c->reg_writes[3]);
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -945,8 +1333,10 @@ static int hdspe_tco_put_control(struct hdspe* hdspe,
 	spin_lock_irq(&hdspe->tco->lock);
 	changed = putter(hdspe->tco, val);
 	if (changed)
-		hdspe_tco_write_settings(hdspe);
+		hdspe_tco_update_settings(hdspe);
 	spin_unlock_irq(&hdspe->tco->lock);
+	if (changed)
+		hdspe_tco_schedule_commit(hdspe);
 	dev_dbg(hdspe->card->dev, "... changed=%d.\n", changed);
 	return changed;
 }
@@ -1258,22 +1648,10 @@ static int snd_hdspe_get_ltc_in(struct snd_kcontrol *kcontrol,
 {
 	struct hdspe *hdspe = snd_kcontrol_chip(kcontrol);
 	
-	u32 ltc = hdspe->tco->ltc_in;
-	u64 tc;
-	
 	spin_lock_irq(&hdspe->tco->lock);
 	//	dev_dbg(hdspe->card->dev, "%s ...\n", __func__);
-	/* The TCO module reports no user bits. They will be 0. */
-	tc = ((u64)(ltc&0xf0000000) << 28) |
-	     ((u64)(ltc&0x0f000000) << 24) |
-	     ((u64)(ltc&0x00f00000) << 20) |
-	     ((u64)(ltc&0x000f0000) << 16) |
-	     ((u64)(ltc&0x0000f000) << 12) |
-	     ((u64)(ltc&0x00000f00) <<  8) |
-	     ((u64)(ltc&0x000000f0) <<  4) |
-	     ((u64)(ltc&0x0000000f) <<  0);
-
-	ucontrol->value.integer64.value[0] = tc;
+	ucontrol->value.integer64.value[0] =
+		hdspe_ltc32_to_ltc64(hdspe->tco->ltc_in);
 	ucontrol->value.integer64.value[1] = hdspe->tco->ltc_in_frame_count;
 	spin_unlock_irq(&hdspe->tco->lock);
 
@@ -1298,11 +1676,36 @@ static int snd_hdspe_get_ltc_time(struct snd_kcontrol *kcontrol,
 	return 0;
 }
 
+static int snd_hdspe_info_video_timeline(struct snd_kcontrol* kcontrol,
+					 struct snd_ctl_elem_info *uinfo)
+{
+	uinfo->type = SNDRV_CTL_ELEM_TYPE_INTEGER64;
+	uinfo->count = 7;
+	return 0;
+}
+
+static int snd_hdspe_get_video_timeline(struct snd_kcontrol *kcontrol,
+					struct snd_ctl_elem_value *ucontrol)
+{
+	struct hdspe *hdspe = snd_kcontrol_chip(kcontrol);
+	struct hdspe_tco *c = hdspe->tco;
+	spin_lock_irq(&c->lock);
+	ucontrol->value.integer64.value[0] = c->video_edge;
+	ucontrol->value.integer64.value[1] = c->video_frame;
+	ucontrol->value.integer64.value[2] = c->video_spf_num;
+	ucontrol->value.integer64.value[3] = c->video_spf_den;
+	ucontrol->value.integer64.value[4] = c->video_edge_rem;
+	ucontrol->value.integer64.value[5] = c->video_phase;
+	ucontrol->value.integer64.value[6] = c->video_ltc_aligned;
+	spin_unlock_irq(&c->lock);
+	return 0;
+}
+
 static int snd_hdspe_info_ltc_out(struct snd_kcontrol* kcontrol,
 				  struct snd_ctl_elem_info *uinfo)
 {
 	uinfo->type = SNDRV_CTL_ELEM_TYPE_INTEGER64;
-	uinfo->count = 2;
+	uinfo->count = 3;
 	return 0;
 }
 
@@ -1313,20 +1716,39 @@ static int snd_hdspe_put_ltc_out(struct snd_kcontrol *kcontrol,
 	u64 tc = ucontrol->value.integer64.value[0];
 	spin_lock_irq(&hdspe->tco->lock);
 	/* Discard the user bits. The TCO module does not handle them. */
-	hdspe->tco->ltc_out =
-		((tc >> 28) & 0xf0000000) |
-		((tc >> 24) & 0x0f000000) |
-		((tc >> 20) & 0x00f00000) |
-		((tc >> 16) & 0x000f0000) |
-		((tc >> 12) & 0x0000f000) |
-		((tc >>  8) & 0x00000f00) |
-		((tc >>  4) & 0x000000f0) |
-		((tc >>  0) & 0x0000000f);
+	hdspe->tco->ltc_out = hdspe_ltc64_to_ltc32(tc);
 	hdspe->tco->ltc_out_frame_count = ucontrol->value.integer64.value[1];
+	hdspe->tco->ltc_out_relocate = ucontrol->value.integer64.value[2] != 0;
 	spin_unlock_irq(&hdspe->tco->lock);
+
+	/* LTC output is started from the period interrupt handler. */
+	hdspe_tco_period_irq_get(hdspe);
 	return 0;    /* do not notify */
 }
 
+static int snd_hdspe_info_ltc_out_status(struct snd_kcontrol* kcontrol,
+					 struct snd_ctl_elem_info *uinfo)
+{
+	uinfo->type = SNDRV_CTL_ELEM_TYPE_INTEGER64;
+	uinfo->count = 3;
+	return 0;
+}
+
+static int snd_hdspe_get_ltc_out_status(struct snd_kcontrol *kcontrol,
+					struct snd_ctl_elem_value *ucontrol)
+{
+	struct hdspe *hdspe = snd_kcontrol_chip(kcontrol);
+	struct hdspe_tco *c = hdspe->tco;
+
+	spin_lock_irq(&c->lock);
+	ucontrol->value.integer64.value[0] = hdspe_ltc32_to_ltc64(c->ltc_out_set);
+	ucontrol->value.integer64.value[1] = c->ltc_out_set_frame_count;
+	ucontrol->value.integer64.value[2] = c->ltc_out != 0xffffffff;
+	spin_unlock_irq(&c->lock);
+
+	return 0;
+}
+
 #ifdef NEVER
 static int snd_hdspe_info_wck_out_rate(struct snd_kcontrol* kcontrol,
 				  struct snd_ctl_elem_info *uinfo)
@@ -1395,6 +1817,7 @@ bool hdspe_tco_notify_status_change(struct hdspe* hdspe)
 	struct hdspe_tco_status o = hdspe->tco->last_status;
 	struct hdspe_tco_status n;
 	hdspe_tco_read_status1(hdspe, &n);
+	hdspe_tco_read_status2(hdspe, &n);
 
 	CHECK_STATUS_CHANGE(ltc_valid);
 	CHECK_STATUS_CHANGE(ltc_in_fps);
@@ -1422,6 +1845,7 @@ int hdspe_create_tco_controls(struct hdspe* hdspe)
 	HDSPE_ADD_RV_CONTROL_ID(CARD, "LTC In Pull Factor", ltc_in_pullfac);
 	HDSPE_ADD_RV_CONTROL_ID(CARD, "TCO Video Format", video);
 	HDSPE_ADD_RV_CONTROL_ID(CARD, "TCO Video Frame Rate", video_in_fps);
+	HDSPE_ADD_RV_CONTROL_ID(CARD, "TCO Video Timeline", video_timeline);
 	HDSPE_ADD_RV_BOOL_CONTROL_ID(CARD, "TCO WordClk Valid", wck_valid);
 	HDSPE_ADD_RV_CONTROL_ID(CARD, "TCO WordClk Speed", wck_speed);
 	HDSPE_ADD_RV_BOOL_CONTROL_ID(CARD, "TCO Lock", tco_lock);
@@ -1430,6 +1854,7 @@ int hdspe_create_tco_controls(struct hdspe* hdspe)
 #endif /*NEVER*/
 
 	HDSPE_ADD_RW_BOOL_CONTROL_ID(CARD, "LTC Run", ltc_run);
+	HDSPE_ADD_RV_CONTROL_ID(CARD, "LTC Out Status", ltc_out_status);
 	
 	return hdspe_add_controls(
 		hdspe, ARRAY_SIZE(snd_hdspe_controls_tco),
@@ -1471,7 +1896,11 @@ int hdspe_init_tco(struct hdspe* hdspe)
 	hdspe->midiPorts++;
 
 /*	hdspe->tco->ltc_out = 0xffffffff;      would not set LTC output */
-	hdspe_tco_write_settings(hdspe);
+	/* Write all registers once: nothing is known about their contents. */
+	memset(hdspe->tco->hw_reg, 0xff, sizeof(hdspe->tco->hw_reg));
+	hdspe->tco->dirty = 0xf;
+	hdspe_tco_update_settings(hdspe);
+	hdspe_tco_commit(hdspe);
 
 	hdspe->tco->fw_version = (hdspe_read_tco(hdspe, 3) >> 24) & 0x7f;
 	dev_info(hdspe->card->dev, "TCO module found. Firmware version %d.\n",
@@ -1486,6 +1915,23 @@ bailout:
 	return 0;
 }
 
+/* After resume, the TCO registers hold whatever the module powered up
+ * with: write all of them again. */
+void hdspe_tco_resume(struct hdspe* hdspe)
+{
+	struct hdspe_tco* c = hdspe->tco;
+	unsigned long flags;
+
+	if (!c)
+		return;
+
+	spin_lock_irqsave(&c->lock, flags);
+	memset(c->hw_reg, 0xff, sizeof(c->hw_reg));
+	c->dirty = 0xf;
+	hdspe_tco_commit(hdspe);
+	spin_unlock_irqrestore(&c->lock, flags);
+}
+
 void hdspe_terminate_tco(struct hdspe* hdspe)
 {
 	if (!hdspe->tco)
@@ -1497,6 +1943,7 @@ void hdspe_terminate_tco(struct hdspe* hdspe)
 
 	hdspe_tco_stop_timecode(hdspe);
 	hdspe_tco_reset_timecode(hdspe);
+	hdspe_tco_commit(hdspe);
 	
 	kfree(hdspe->tco);
 }
@@ -0,0 +1,430 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * hdspe_tms.c
+ * @brief RME HDSPe capture side channels: AES channel status and
+ * IEC 61937 non-PCM bursts.
+ *
+ * After every audio interrupt, the samples captured since the previous
+ * one are scanned, for selected capture channels only.
+ *
+ * With Clear TMS (track marker / status) off, the cards pass the AES
+ * channel status and user bits of each subframe in the least significant
+ * byte of the captured 32-bit sample. For the capture channels selected
+ * with the SNDRV_HDSPE_IOCTL_SET_AES_CS hwdep ioctl, complete 192-bit
+ * channel status and user bit blocks are queued for reading from the
+ * hwdep device. Optionally, the status bits are cleared in the captured
+ * audio, for the selected channels only.
+ *
+ * For the channel pairs selected with the 'IEC61937 Pairs' control,
+ * burst sync words are looked for (see hdspe_iec61937.c). The 'IEC61937
+ * Bursts' control reports the data type and burst length per pair, and
+ * is notified when the sync word size or data type changes.
+ */
+
+#include "hdspe.h"
+#include "hdspe_core.h"
+#include "hdspe_control.h"
+#include "hdspe_iec61937.h"
+
+#include <linux/bitmap.h>
+#include <linux/kfifo.h>
+#include <linux/mutex.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+
+/* Track marker / status bits in a captured sample */
+#define HDSPE_TMS_MASK		0x000000ff
+#define HDSPE_TMS_BLOCK_START	0x00000010  /* first subframe of a block */
+#define HDSPE_TMS_C		0x00000008  /* channel status bit */
+#define HDSPE_TMS_U		0x00000004  /* user bit */
+
+#define HDSPE_TMS_BLOCK_BITS	192
+#define HDSPE_TMS_NO_BLOCK	(HDSPE_TMS_BLOCK_BITS + 1) /* wait for start */
+
+#define HDSPE_IEC61937_PAIRS	(HDSPE_MAX_CHANNELS / 2)
+
+struct hdspe_tms_channel {
+	u32 bit;                  /* next bit in the block, or NO_BLOCK */
+	u64 frame;                /* frame count at block start */
+	u8 status[HDSPE_TMS_BLOCK_BITS / 8];
+	u8 user[HDSPE_TMS_BLOCK_BITS / 8];
+};
+
+struct hdspe_tms {
+	DECLARE_BITMAP(channels, HDSPE_MAX_CHANNELS); /* selected channels */
+	bool mask;                /* clear the bits in the captured audio */
+	u64 frame;                /* next frame to scan */
+	u32 lost;                 /* blocks lost because the fifo was full */
+
+	DECLARE_KFIFO(fifo, struct hdspe_aes_cs, 256);
+	struct mutex read_mutex;  /* single kfifo reader */
+	wait_queue_head_t wait;   /* for poll() */
+
+	struct hdspe_tms_channel ch[HDSPE_MAX_CHANNELS];
+
+	unsigned long pairs;      /* channel pairs selected for bursts */
+	struct hdspe_iec61937 burst[HDSPE_IEC61937_PAIRS];
+};
+
+static void hdspe_tms_reset(struct hdspe_tms* t)
+{
+	int i;
+
+	for (i = 0; i < HDSPE_MAX_CHANNELS; i++)
+		t->ch[i].bit = HDSPE_TMS_NO_BLOCK;
+}
+
+/* Allocate hdspe->tms, if not done yet. It is freed with the card. */
+static int hdspe_tms_alloc(struct hdspe* hdspe)
+{
+	struct hdspe_tms* new;
+
+	if (READ_ONCE(hdspe->tms))
+		return 0;
+
+	new = vzalloc(sizeof(*new));
+	if (!new)
+		return -ENOMEM;
+	INIT_KFIFO(new->fifo);
+	mutex_init(&new->read_mutex);
+	init_waitqueue_head(&new->wait);
+	hdspe_tms_reset(new);
+
+	spin_lock_irq(&hdspe->lock);
+	if (!hdspe->tms) {
+		new->frame = hdspe->frame_count;
+		hdspe->tms = new;
+		new = NULL;
+	}
+	spin_unlock_irq(&hdspe->lock);
+
+	vfree(new);	/* lost a race with another caller */
+	return 0;
+}
+
+int hdspe_tms_configure(struct hdspe* hdspe,
+			const struct hdspe_aes_cs_config* cfg)
+{
+	struct hdspe_tms* t;
+	int err = hdspe_tms_alloc(hdspe);
+
+	if (err < 0)
+		return err;
+
+	spin_lock_irq(&hdspe->lock);
+	t = hdspe->tms;
+	bitmap_from_u64(t->channels, cfg->channels);
+	t->mask = cfg->mask;
+	hdspe_tms_reset(t);
+	spin_unlock_irq(&hdspe->lock);
+
+	return 0;
+}
+
+/* Collect the status and user bits of <n> samples of channel <ch>,
+ * starting at frame count <frame>. */
+static void hdspe_tms_scan(struct hdspe_tms* t, int ch,
+			   const __le32* p, u32 n, u64 frame)
+{
+	struct hdspe_tms_channel* c = &t->ch[ch];
+	struct hdspe_aes_cs cs;
+	u32 i;
+
+	for (i = 0; i < n; i++) {
+		u32 s = le32_to_cpu(p[i]);
+
+		if (s & HDSPE_TMS_BLOCK_START) {
+			c->bit = 0;
+			c->frame = frame + i;
+			memset(c->status, 0, sizeof(c->status));
+			memset(c->user, 0, sizeof(c->user));
+		}
+		if (c->bit >= HDSPE_TMS_BLOCK_BITS)
+			continue;
+
+		if (s & HDSPE_TMS_C)
+			c->status[c->bit / 8] |= 1 << (c->bit % 8);
+		if (s & HDSPE_TMS_U)
+			c->user[c->bit / 8] |= 1 << (c->bit % 8);
+		if (++c->bit < HDSPE_TMS_BLOCK_BITS)
+			continue;
+
+		cs.channel = ch;
+		cs.frame = c->frame;
+		memcpy(cs.status, c->status, sizeof(cs.status));
+		memcpy(cs.user, c->user, sizeof(cs.user));
+		if (!kfifo_is_full(&t->fifo)) {
+			cs.lost = t->lost;
+			kfifo_put(&t->fifo, cs);
+		} else
+			t->lost++;
+		c->bit = HDSPE_TMS_NO_BLOCK;
+	}
+}
+
+/* Clear the status bits of <n> samples, two samples at a time. */
+static void hdspe_tms_clear(__le32* p, u32 n)
+{
+	const __le64 mask2 = cpu_to_le64(~(((u64)HDSPE_TMS_MASK << 32) |
+					   HDSPE_TMS_MASK));
+	const __le32 mask = cpu_to_le32(~HDSPE_TMS_MASK);
+	__le64* q;
+	u32 i;
+
+	if (n > 0 && ((uintptr_t)p & 7)) {
+		*p++ &= mask;
+		n--;
+	}
+	q = (__le64*)p;
+	for (i = 0; i < n / 2; i++)
+		q[i] &= mask2;
+	if (n & 1)
+		p[n - 1] &= mask;
+}
+
+/* Scan frames <from> up to <end> of capture channel <ch> for channel
+ * status bits. */
+static void hdspe_tms_scan_channel(struct hdspe* hdspe, struct hdspe_tms* t,
+				   int ch, u64 from, u64 end)
+{
+	u32 size = hdspe->hw_buffer_size;
+	__le32* buf = (__le32*)(hdspe->capture_buffer +
+				hdspe->channel_map_in[ch] *
+				HDSPE_CHANNEL_BUFFER_BYTES);
+
+	/* The hardware buffer wraps at most once in between. */
+	while (from < end) {
+		u32 pos = from & (size - 1);
+		u32 n = min_t(u64, end - from, size - pos);
+
+		hdspe_tms_scan(t, ch, buf + pos, n, from);
+		if (t->mask)
+			hdspe_tms_clear(buf + pos, n);
+		from += n;
+	}
+}
+
+/* Scan frames <from> up to <end> of capture channel pair <p> for
+ * IEC 61937 bursts. Returns true if the burst type changed. */
+static bool hdspe_tms_scan_pair(struct hdspe* hdspe, struct hdspe_tms* t,
+				int p, u64 from, u64 end)
+{
+	u32 size = hdspe->hw_buffer_size;
+	__le32* l = (__le32*)(hdspe->capture_buffer +
+			      hdspe->channel_map_in[2*p] *
+			      HDSPE_CHANNEL_BUFFER_BYTES);
+	__le32* r = (__le32*)(hdspe->capture_buffer +
+			      hdspe->channel_map_in[2*p+1] *
+			      HDSPE_CHANNEL_BUFFER_BYTES);
+	bool changed = false;
+
+	while (from < end) {
+		u32 pos = from & (size - 1);
+		u32 n = min_t(u64, end - from, size - pos);
+
+		changed |= hdspe_iec61937_scan(&t->burst[p],
+					       l + pos, r + pos, n, from);
+		from += n;
+	}
+	return changed;
+}
+
+void hdspe_tms_period(struct hdspe* hdspe)
+{
+	struct hdspe_tms* t;
+	struct snd_pcm_substream* substream;
+	bool changed = false;
+	u64 end;
+	int ch, nchannels;
+
+	spin_lock(&hdspe->lock);
+	t = hdspe->tms;
+	substream = hdspe->capture_substream;
+	if (!t)
+		goto unlock;
+	if (bitmap_empty(t->channels, HDSPE_MAX_CHANNELS) && !t->pairs)
+		goto unlock;
+
+	end = hdspe->frame_count;
+	if (!(hdspe->running & (1 << SNDRV_PCM_STREAM_CAPTURE)) ||
+	    !hdspe->capture_buffer || !substream ||
+	    hdspe->m.get_float_format(hdspe)) {
+		t->frame = end;
+		goto unlock;
+	}
+	if (end - t->frame > hdspe->hw_buffer_size) {
+		/* Overwritten before we got here: blocks are broken. */
+		hdspe_tms_reset(t);
+		t->frame = end - hdspe->hw_buffer_size;
+	}
+	if (end == t->frame)
+		goto unlock;
+
+	nchannels = min_t(int, substream->runtime->channels,
+			  hdspe->max_channels_in);
+
+	for_each_set_bit(ch, t->channels, HDSPE_MAX_CHANNELS) {
+		if (ch >= nchannels)
+			break;
+		if (hdspe->channel_map_in[ch] >= 0)
+			hdspe_tms_scan_channel(hdspe, t, ch, t->frame, end);
+	}
+
+	for_each_set_bit(ch, &t->pairs, HDSPE_IEC61937_PAIRS) {
+		if (2*ch + 1 >= nchannels)
+			break;
+		if (hdspe->channel_map_in[2*ch] >= 0 &&
+		    hdspe->channel_map_in[2*ch+1] >= 0)
+			changed |= hdspe_tms_scan_pair(hdspe, t, ch,
+						       t->frame, end);
+	}
+
+	t->frame = end;
+
+	if (!kfifo_is_empty(&t->fifo))
+		wake_up_interruptible(&t->wait);
+
+unlock:
+	spin_unlock(&hdspe->lock);
+
+	if (changed)
+		snd_ctl_notify(hdspe->card, SNDRV_CTL_EVENT_MASK_VALUE,
+			       hdspe->cid.iec61937_bursts);
+}
+
+long hdspe_tms_read(struct hdspe* hdspe, char __user *buf, long count)
+{
+	struct hdspe_tms* t = hdspe->tms;
+	unsigned int copied;
+	int err;
+
+	if (!t)
+		return -EAGAIN;
+	if (count < (long)sizeof(struct hdspe_aes_cs))
+		return -EINVAL;
+
+	mutex_lock(&t->read_mutex);
+	err = kfifo_to_user(&t->fifo, buf, count, &copied);
+	mutex_unlock(&t->read_mutex);
+
+	if (err)
+		return err;
+	/* Not with ?:, which would make -EAGAIN unsigned. */
+	if (copied == 0)
+		return -EAGAIN;
+	return copied;
+}
+
+__poll_t hdspe_tms_poll(struct hdspe* hdspe, struct file *file,
+			poll_table *wait)
+{
+	struct hdspe_tms* t = hdspe->tms;
+
+	if (!t)
+		return 0;
+	poll_wait(file, &t->wait, wait);
+	return kfifo_is_empty(&t->fifo) ? 0 : EPOLLIN | EPOLLRDNORM;
+}
+
+void hdspe_tms_free(struct hdspe* hdspe)
+{
+	struct hdspe_tms* t;
+
+	spin_lock_irq(&hdspe->lock);
+	t = hdspe->tms;
+	hdspe->tms = NULL;
+	spin_unlock_irq(&hdspe->lock);
+
+	vfree(t);
+}
+
+static int snd_hdspe_info_iec61937_pairs(struct snd_kcontrol* kcontrol,
+					 struct snd_ctl_elem_info *uinfo)
+{
+	uinfo->type = SNDRV_CTL_ELEM_TYPE_INTEGER64;
+	uinfo->count = 1;
+	uinfo->value.integer64.min = 0;
+	uinfo->value.integer64.max = (1ULL << HDSPE_IEC61937_PAIRS) - 1;
+	uinfo->value.integer64.step = 1;
+	return 0;
+}
+
+static int snd_hdspe_get_iec61937_pairs(struct snd_kcontrol *kcontrol,
+					struct snd_ctl_elem_value *ucontrol)
+{
+	struct hdspe *hdspe = snd_kcontrol_chip(kcontrol);
+
+	spin_lock_irq(&hdspe->lock);
+	ucontrol->value.integer64.value[0] = hdspe->tms ? hdspe->tms->pairs : 0;
+	spin_unlock_irq(&hdspe->lock);
+	return 0;
+}
+
+static int snd_hdspe_put_iec61937_pairs(struct snd_kcontrol *kcontrol,
+					struct snd_ctl_elem_value *ucontrol)
+{
+	struct hdspe *hdspe = snd_kcontrol_chip(kcontrol);
+	u64 val = ucontrol->value.integer64.value[0];
+	struct hdspe_tms* t;
+	int changed, p, err;
+
+	if (val >= (1ULL << HDSPE_IEC61937_PAIRS))
+		return -EINVAL;
+	err = hdspe_tms_alloc(hdspe);
+	if (err < 0)
+		return err;
+
+	spin_lock_irq(&hdspe->lock);
+	t = hdspe->tms;
+	changed = t->pairs != val;
+	for (p = 0; p < HDSPE_IEC61937_PAIRS; p++) {
+		if (!(t->pairs & BIT(p)) || !(val & BIT(p)))
+			memset(&t->burst[p], 0, sizeof(t->burst[p]));
+	}
+	t->pairs = val;
+	spin_unlock_irq(&hdspe->lock);
+
+	return changed;
+}
+
+static int snd_hdspe_info_iec61937_bursts(struct snd_kcontrol* kcontrol,
+					  struct snd_ctl_elem_info *uinfo)
+{
+	uinfo->type = SNDRV_CTL_ELEM_TYPE_INTEGER;
+	uinfo->count = 3 * HDSPE_IEC61937_PAIRS;
+	uinfo->value.integer.min = 0;
+	uinfo->value.integer.max = 0xffffff;
+	uinfo->value.integer.step = 1;
+	return 0;
+}
+
+static int snd_hdspe_get_iec61937_bursts(struct snd_kcontrol *kcontrol,
+					 struct snd_ctl_elem_value *ucontrol)
+{
+	struct hdspe *hdspe = snd_kcontrol_chip(kcontrol);
+	struct hdspe_tms* t;
+	int p;
+
+	spin_lock_irq(&hdspe->lock);
+	t = hdspe->tms;
+	for (p = 0; t && p < HDSPE_IEC61937_PAIRS; p++) {
+		ucontrol->value.integer.value[3*p]   = t->burst[p].size;
+		ucontrol->value.integer.value[3*p+1] = t->burst[p].pc;
+		ucontrol->value.integer.value[3*p+2] = t->burst[p].pd;
+	}
+	spin_unlock_irq(&hdspe->lock);
+	return 0;
+}
+
+static const struct snd_kcontrol_new snd_hdspe_controls_tms[] = {
+	HDSPE_RW_KCTL(CARD, "IEC61937 Pairs", iec61937_pairs)
+};
+
+int hdspe_create_tms_controls(struct hdspe* hdspe)
+{
+	HDSPE_ADD_RV_CONTROL_ID(CARD, "IEC61937 Bursts", iec61937_bursts);
+
+	return hdspe_add_controls(
+		hdspe, ARRAY_SIZE(snd_hdspe_controls_tms),
+		snd_hdspe_controls_tms);
+}
@@ -0,0 +1,488 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file hdspe_bench.c
+ * @brief Micro benchmarks of the HDSPe control, status and mixer paths on
+ * test cards. See hdspe_test.h. Build and run with 'make bench' in the top
+ * level directory, or under perf or valgrind:
+ *
+ *   perf record -g test/hdspe_bench --filter=mixer
+ *   valgrind --tool=callgrind test/hdspe_bench --min-time=0
+ *
+ * Each benchmark runs its body state->iterations times. The iteration count
+ * doubles until a run takes --min-time seconds (default 0.5). Reported are
+ * the time and the number of register reads and writes, and of kernel log
+ * messages, per iteration. 'make clean bench HDSPE_DEBUG=1' builds with the
+ * debug output of the hot paths compiled in, see hdspe_dbg_hot().
+ *
+ * The ioctl/ benchmarks call the hwdep ioctl handler directly, without the
+ * system call and snd_hwdep_ioctl() around it, which add about the same for
+ * every call type.
+ *
+ * The vstereo/ benchmarks compare the CPU cost of a virtual stereo device
+ * per 256 frame period (5.3 ms at 48 kHz): dmix mixing in software, versus
+ * the hdspe plugin of alsa-plugin/ copying into its own channels and
+ * routing them in the card's mixer, which it sets up once per open.
+ */
+
+#include "hdspe_test.h"
+#include "hdspe_route.h"
+
+int hdspe_test_failures;
+
+static u64 hdspe_bench_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static int hdspe_bench_put(struct snd_kcontrol *k, long v0, long v1, long v2)
+{
+	struct snd_ctl_elem_value v;
+
+	memset(&v, 0, sizeof(v));
+	v.value.integer.value[0] = v0;
+	v.value.integer.value[1] = v1;
+	v.value.integer.value[2] = v2;
+	return k->put(k, &v);
+}
+
+/* One mixer cross point gain change, through the control element. */
+static void bm_mixer_put(struct hdspe_bench_state *state)
+{
+	struct snd_kcontrol *k = hdspe_shim_find_kctl("Mixer");
+	u64 i;
+
+	for (i = 0; i < state->iterations; i++)
+		hdspe_bench_put(k, 64 + (i & 7), i & 7, i & 0x7fff);
+}
+
+/* Export of the full mixer state. */
+static void bm_mixer_csv_read(struct hdspe_bench_state *state)
+{
+	static char buf[64 * 1024];
+	u64 i;
+
+	for (i = 0; i < state->iterations; i++)
+		hdspe_shim_proc_read("mixer.csv", buf, sizeof(buf));
+}
+
+/* Import of a full mixer state: one line per cross point. */
+static void bm_mixer_csv_write(struct hdspe_bench_state *state)
+{
+	static char text[16 * 1024];
+	unsigned int dest, src;
+	int n = 0;
+	u64 i;
+
+	for (dest = 0; dest < 16; dest++)
+		for (src = 0; src < 64; src++)
+			n += snprintf(text + n, sizeof(text) - n, "%u,%u,%u\n",
+				      dest, src, (dest * 64 + src) & 0x7fff);
+	for (i = 0; i < state->iterations; i++)
+		hdspe_shim_proc_write("mixer.csv", text);
+}
+
+/* Sync source status decoding, as for the status controls. */
+static void bm_read_status(struct hdspe_bench_state *state)
+{
+	struct hdspe *hdspe = &state->tc->hdspe;
+	struct hdspe_status s;
+	u64 i;
+
+	for (i = 0; i < state->iterations; i++)
+		hdspe->m.read_status(hdspe, &s);
+}
+
+/* Status polling work without status changes. */
+static void bm_status_work(struct hdspe_bench_state *state)
+{
+	struct hdspe *hdspe = &state->tc->hdspe;
+	u64 i;
+
+	for (i = 0; i < state->iterations; i++)
+		hdspe_status_work(&hdspe->status_work);
+}
+
+/* Speed mode change: control register, DDS, channel maps and mixer. */
+static void bm_set_sample_rate(struct hdspe_bench_state *state)
+{
+	struct hdspe *hdspe = &state->tc->hdspe;
+	u64 i;
+
+	for (i = 0; i < state->iterations; i++)
+		hdspe_set_sample_rate(hdspe, (i & 1) ? 96000 : 48000);
+}
+
+/* TCO setting change, through the control element. */
+static void bm_tco_pull_put(struct hdspe_bench_state *state)
+{
+	struct snd_kcontrol *k = hdspe_shim_find_kctl("TCO Pull");
+	struct snd_ctl_elem_value v;
+	u64 i;
+
+	memset(&v, 0, sizeof(v));
+	for (i = 0; i < state->iterations; i++) {
+		v.value.enumerated.item[0] = i & 1;
+		k->put(k, &v);
+	}
+}
+
+/* Capture running, as for the period benchmarks, or stopped again. */
+static void hdspe_bench_capture(struct hdspe_bench_state *state, bool on)
+{
+	struct hdspe *hdspe = &state->tc->hdspe;
+	struct snd_pcm_substream *ss =
+		hdspe->pcm->streams[SNDRV_PCM_STREAM_CAPTURE].substream;
+	/* Two periods on MADI and AES, a fixed size on RayDAT and AIO. */
+	bool raio = hdspe->io_type == HDSPE_RAYDAT ||
+		hdspe->io_type == HDSPE_AIO || hdspe->io_type == HDSPE_AIO_PRO;
+
+	if (!on) {
+		ss->ops->trigger(ss, SNDRV_PCM_TRIGGER_STOP);
+		ss->ops->hw_free(ss);
+		hdspe_shim_pcm_close(ss);
+		return;
+	}
+	hdspe_test_set_buf_ptr(state->tc, 0, false);
+	if (hdspe_shim_pcm_open(ss) < 0 ||
+	    hdspe_shim_pcm_hw_params(ss, 48000, hdspe->max_channels_in, 256,
+				     raio ? HDSPE_TEST_BUFFER_FRAMES : 2 * 256) < 0 ||
+	    ss->ops->trigger(ss, SNDRV_PCM_TRIGGER_START) < 0) {
+		fprintf(stderr, "cannot start capture\n");
+		exit(1);
+	}
+}
+
+/* Period interrupt with capture running: the audio part of
+ * snd_hdspe_interrupt(), which is not built in user space. */
+static void bm_period(struct hdspe_bench_state *state)
+{
+	struct hdspe *hdspe = &state->tc->hdspe;
+	u64 i;
+
+	hdspe_bench_capture(state, true);
+	for (i = 0; i < state->iterations; i++) {
+		hdspe_test_set_buf_ptr(state->tc, (i + 1) * 256, true);
+		spin_lock(&hdspe->lock);
+		hdspe->reg.status0 = hdspe_read_status0_nocache(hdspe);
+		hdspe_update_frame_count(hdspe);
+		spin_unlock(&hdspe->lock);
+		hdspe_write(hdspe, HDSPE_interruptConfirmation, 0);
+		if (hdspe->tco)
+			hdspe_tco_period_elapsed(hdspe);
+		hdspe_timing_update(hdspe);
+		if (hdspe_pcm_period_elapsed(hdspe))
+			snd_pcm_period_elapsed(hdspe->capture_substream);
+	}
+	hdspe_bench_capture(state, false);
+}
+
+/* Capture start and stop, from the prepared state. */
+static void bm_pcm_trigger(struct hdspe_bench_state *state)
+{
+	struct hdspe *hdspe = &state->tc->hdspe;
+	struct snd_pcm_substream *ss =
+		hdspe->pcm->streams[SNDRV_PCM_STREAM_CAPTURE].substream;
+	u64 i;
+
+	hdspe_bench_capture(state, true);
+	for (i = 0; i < state->iterations; i++) {
+		ss->ops->trigger(ss, SNDRV_PCM_TRIGGER_STOP);
+		ss->ops->trigger(ss, SNDRV_PCM_TRIGGER_START);
+	}
+	hdspe_bench_capture(state, false);
+}
+
+/* One hwdep ioctl, the command is passed as argument. */
+static void bm_ioctl(struct hdspe_bench_state *state)
+{
+	struct snd_hwdep *hw = state->tc->hdspe.hwdep;
+	unsigned int cmd = (unsigned long)state->arg;
+	static union {
+		struct hdspe_status status;
+		struct hdspe_peak_rms peak_rms;
+		struct hdspe_config config;
+		struct hdspe_tco_status ltc;
+		struct hdspe_version version;
+		struct hdspe_mixer_ioctl mixer;
+		struct hdspe_ref_stats ref_stats;
+		struct hdspe_aes_cs_config aes_cs_config;
+		struct hdspe_latency latency;
+		struct hdspe_dma_pos dma_pos;
+		struct hdspe_video_frame video_frame;
+	} arg;
+	static struct hdspe_mixer mixer;
+	struct file file = { };
+	u64 i;
+
+	memset(&arg, 0, sizeof(arg));
+	if (cmd == SNDRV_HDSPE_IOCTL_GET_MIXER)
+		arg.mixer.mixer = &mixer;
+	if (cmd == SNDRV_HDSPE_IOCTL_SET_AES_CS)
+		arg.aes_cs_config.channels = 3;
+	for (i = 0; i < state->iterations; i++)
+		if (hw->ops.ioctl(hw, &file, cmd, (unsigned long)&arg) < 0) {
+			fprintf(stderr, "ioctl %#x failed\n", cmd);
+			exit(1);
+		}
+}
+
+/* A scheduled gain change, from SCHEDULE_CTL to the result. */
+static void bm_ioctl_sched(struct hdspe_bench_state *state)
+{
+	struct hdspe *hdspe = &state->tc->hdspe;
+	struct snd_hwdep *hw = hdspe->hwdep;
+	struct snd_kcontrol *k = hdspe_shim_find_kctl("Mixer");
+	struct hdspe_sched_ctl ctl;
+	struct file file = { };
+	u64 i;
+
+	for (i = 0; i < state->iterations; i++) {
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.numid = k->id.numid;
+		ctl.value[0] = 64 + (i & 7);
+		ctl.value[1] = i & 7;
+		ctl.value[2] = i & 0x7fff;
+		hw->ops.ioctl(hw, &file, SNDRV_HDSPE_IOCTL_SCHEDULE_CTL,
+			      (unsigned long)&ctl);
+		hdspe_sched_period(hdspe);
+		hdspe_shim_run_work();
+		if (hw->ops.ioctl(hw, &file, SNDRV_HDSPE_IOCTL_GET_SCHED_CTL,
+				  (unsigned long)&ctl) < 0 || ctl.result < 0) {
+			fprintf(stderr, "scheduled change failed: %d\n",
+				ctl.result);
+			exit(1);
+		}
+	}
+}
+
+/* Virtual stereo devices, one 256 frame period of a client each: mixed
+ * in software by dmix, or copied into its own channels by the hdspe
+ * plugin of alsa-plugin/, with the card's mixer doing the sum. The slave
+ * buffer is interleaved S32 with all playback channels of the card. */
+#define BM_VSTEREO_FRAMES	256
+
+static s32 bm_vstereo_client[BM_VSTEREO_FRAMES * 2];
+static s32 bm_vstereo_slave[BM_VSTEREO_FRAMES * HDSPE_MAX_CHANNELS];
+static s32 bm_vstereo_sum[BM_VSTEREO_FRAMES * HDSPE_MAX_CHANNELS];
+
+static void bm_vstereo_init(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(bm_vstereo_client); i++)
+		bm_vstereo_client[i] = (i * 2654435761u) & 0x7fffff00;
+}
+
+/* The generic S32 loop of alsa-lib's dmix, generic_mix_areas_32(): each
+ * sample added atomically to a sum buffer shared with the other clients,
+ * saturated to 24 bits and stored in the slave buffer, again if another
+ * client got in between. The first client after the card played a sample
+ * resets its sum. The sum and slave buffers are cleared once played. */
+static void bm_vstereo_dmix_mix(s32 *dst, s32 *sum, const s32 *src,
+				unsigned int frames, unsigned int dst_step,
+				unsigned int src_step)
+{
+	s32 sample, old_sample;
+
+	while (frames--) {
+		sample = *src / 256;
+		old_sample = *(volatile s32 *)sum;
+		if (__sync_val_compare_and_swap(dst, 0, 1) == 0)
+			sample -= old_sample;
+		__sync_fetch_and_add(sum, sample);
+		do {
+			old_sample = *(volatile s32 *)sum;
+			if (old_sample > 0x7fffff)
+				sample = 0x7fffffff;
+			else if (old_sample < -0x800000)
+				sample = -0x80000000;
+			else
+				sample = old_sample * 256;
+			*(volatile s32 *)dst = sample;
+		} while (old_sample != *(volatile s32 *)sum);
+		src += src_step;
+		dst += dst_step;
+		sum += dst_step;
+	}
+}
+
+/* Two clients mixed by dmix into the two channels of the outputs,
+ * (long)state->arg channels: 2, or 4 for a fan-out to two output pairs,
+ * which takes a route plugin in front of dmix. One iteration is one
+ * period of one client. */
+static void bm_vstereo_dmix(struct hdspe_bench_state *state)
+{
+	unsigned int stride = state->tc->hdspe.max_channels_out;
+	unsigned int channels = (unsigned long)state->arg;
+	unsigned int ch;
+	u64 i;
+
+	bm_vstereo_init();
+	for (i = 0; i < state->iterations; i++) {
+		for (ch = 0; ch < channels; ch++)
+			bm_vstereo_dmix_mix(bm_vstereo_slave + ch,
+					    bm_vstereo_sum + ch,
+					    bm_vstereo_client + (ch & 1),
+					    BM_VSTEREO_FRAMES, stride, 2);
+		if (i & 1) {
+			memset(bm_vstereo_slave, 0,
+			       BM_VSTEREO_FRAMES * stride * sizeof(s32));
+			memset(bm_vstereo_sum, 0,
+			       BM_VSTEREO_FRAMES * stride * sizeof(s32));
+		}
+	}
+}
+
+/* A client of the hdspe plugin, on its own two channels of a dshare slave:
+ * snd_pcm_areas_copy() of the plugin's transfer callback. Fan-out is done
+ * by the card's mixer, at no cost per period. */
+static void bm_vstereo_copy(struct hdspe_bench_state *state)
+{
+	unsigned int stride = state->tc->hdspe.max_channels_out;
+	volatile s32 *dst;
+	const s32 *src;
+	unsigned int f;
+	u64 i;
+
+	bm_vstereo_init();
+	for (i = 0; i < state->iterations; i++) {
+		dst = bm_vstereo_slave + 12;
+		src = bm_vstereo_client;
+		for (f = 0; f < BM_VSTEREO_FRAMES; f++) {
+			dst[0] = src[0];
+			dst[1] = src[1];
+			dst += stride;
+			src += 2;
+		}
+	}
+}
+
+static int bm_vstereo_ioctl(void *ctx, unsigned int cmd, void *arg)
+{
+	return hdspe_test_dev_ctl_ioctl(cmd, arg);
+}
+
+/* Open and close of a hdspe plugin device: the channel mapping from the
+ * proc file, a stereo route to two output pairs, with the own outputs
+ * muted, and its restore, through control ioctls without the system
+ * call. */
+static void bm_vstereo_route(struct hdspe_bench_state *state)
+{
+	static const unsigned int ch[2] = { 12, 13 };
+	static const unsigned int out[4] = { 0, 1, 14, 15 };
+	static char text[64 * 1024];
+	static struct hdspe_route r;
+	u64 i;
+
+	for (i = 0; i < state->iterations; i++) {
+		memset(&r, 0, sizeof(r));
+		r.ioctl = bm_vstereo_ioctl;
+		hdspe_shim_proc_read("hdspe", text, sizeof(text));
+		if (hdspe_route_parse_map(&r, text) < 0 ||
+		    hdspe_route_stereo(&r, ch, out, 4, HDSPE_UNITY_GAIN,
+				       true) < 0 ||
+		    hdspe_route_restore(&r) < 0) {
+			fprintf(stderr, "route failed\n");
+			exit(1);
+		}
+	}
+}
+
+#define BM_IOCTL(name, type, tco) \
+	{ "ioctl/" #name, bm_ioctl, type, tco, \
+	  (void *)(unsigned long)SNDRV_HDSPE_IOCTL_ ## name }
+
+static const struct hdspe_bench hdspe_benchmarks[] = {
+	{ "mixer_put/AIO", bm_mixer_put, HDSPE_AIO },
+	{ "mixer_csv_read/MADI", bm_mixer_csv_read, HDSPE_MADI },
+	{ "mixer_csv_write/MADI", bm_mixer_csv_write, HDSPE_MADI },
+	{ "read_status/MADI", bm_read_status, HDSPE_MADI },
+	{ "read_status/AES", bm_read_status, HDSPE_AES },
+	{ "read_status/RayDAT", bm_read_status, HDSPE_RAYDAT },
+	{ "read_status/AIO_Pro", bm_read_status, HDSPE_AIO_PRO },
+	{ "status_work/RayDAT+TCO", bm_status_work, HDSPE_RAYDAT, true },
+	{ "set_sample_rate/AIO", bm_set_sample_rate, HDSPE_AIO },
+	{ "tco_pull_put/MADI+TCO", bm_tco_pull_put, HDSPE_MADI, true },
+	{ "period/AIO", bm_period, HDSPE_AIO },
+	{ "period/MADI+TCO", bm_period, HDSPE_MADI, true },
+	{ "pcm_trigger/AIO", bm_pcm_trigger, HDSPE_AIO },
+	BM_IOCTL(GET_CARD_INFO, HDSPE_MADI, true),
+	BM_IOCTL(GET_STATUS, HDSPE_MADI, true),
+	BM_IOCTL(GET_LTC, HDSPE_MADI, true),
+	BM_IOCTL(GET_PEAK_RMS, HDSPE_MADI, true),
+	BM_IOCTL(GET_CONFIG, HDSPE_MADI, true),
+	BM_IOCTL(GET_VERSION, HDSPE_MADI, true),
+	BM_IOCTL(GET_MIXER, HDSPE_MADI, true),
+	BM_IOCTL(GET_REF_STATS, HDSPE_MADI, true),
+	BM_IOCTL(SET_AES_CS, HDSPE_AES, false),
+	BM_IOCTL(GET_LATENCY, HDSPE_MADI, true),
+	BM_IOCTL(GET_DMA_POS, HDSPE_MADI, true),
+	{ "ioctl/SCHEDULE_CTL+run", bm_ioctl_sched, HDSPE_MADI, true },
+	{ "vstereo/dmix_2ch/AIO", bm_vstereo_dmix, HDSPE_AIO, false,
+	  (void *)2UL },
+	{ "vstereo/dmix_4ch/AIO", bm_vstereo_dmix, HDSPE_AIO, false,
+	  (void *)4UL },
+	{ "vstereo/hdspe_copy/AIO", bm_vstereo_copy, HDSPE_AIO },
+	{ "vstereo/hdspe_route/AIO", bm_vstereo_route, HDSPE_AIO },
+};
+
+int main(int argc, char **argv)
+{
+	const char *filter = NULL;
+	double min_time = 0.5;
+	unsigned int b;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strncmp(argv[i], "--filter=", 9))
+			filter = argv[i] + 9;
+		else if (!strncmp(argv[i], "--min-time=", 11))
+			min_time = atof(argv[i] + 11);
+		else {
+			fprintf(stderr, "usage: %s [--filter=substring] "
+				"[--min-time=seconds]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	printf("%-28s %12s %12s %10s %10s %8s\n", "Benchmark", "Time",
+	       "Iterations", "Reads", "Writes", "Msgs");
+	for (b = 0; b < ARRAY_SIZE(hdspe_benchmarks); b++) {
+		const struct hdspe_bench *bm = &hdspe_benchmarks[b];
+		struct hdspe_bench_state state = { .arg = bm->arg };
+		unsigned long reads, writes, msgs;
+		u64 t;
+
+		if (filter && !strstr(bm->name, filter))
+			continue;
+		state.tc = hdspe_test_card_new(bm->type, bm->tco);
+		if (!state.tc) {
+			fprintf(stderr, "%s: no test card\n", bm->name);
+			return 1;
+		}
+
+		for (state.iterations = 1; ; state.iterations *= 2) {
+			reads = hdspe_shim_reads;
+			writes = hdspe_shim_writes;
+			msgs = hdspe_shim_msgs;
+			t = hdspe_bench_ns();
+			bm->fn(&state);
+			t = hdspe_bench_ns() - t;
+			if (t >= min_time * NSEC_PER_SEC ||
+			    state.iterations >= (1ULL << 40))
+				break;
+		}
+
+		printf("%-28s %9.1f ns %12llu %10.1f %10.1f %8.1f\n", bm->name,
+		       (double)t / state.iterations,
+		       (unsigned long long)state.iterations,
+		       (double)(hdspe_shim_reads - reads) / state.iterations,
+		       (double)(hdspe_shim_writes - writes) / state.iterations,
+		       (double)(hdspe_shim_msgs - msgs) / state.iterations);
+		hdspe_test_card_free(state.tc);
+	}
+	return 0;
+}
@@ -0,0 +1,187 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file hdspe_client_bench.cpp
+ * @brief System calls and CPU time of a client following the clock
+ * status of a card, with the event-driven model of client/ versus reading
+ * the status elements at a fixed rate, as mixer applications do. Run by
+ * 'make bench'.
+ *
+ * A RayDAT test card runs for a minute of simulated time, at 256 frames per
+ * period, with its AES and SPDIF inputs losing and regaining sync about
+ * every 5 seconds. The naive client
+ * reads 'Raw Sample Rate', 'AutoSync Status', 'AutoSync Frequency' and
+ * 'Current AutoSync Reference' at every tick. The event-driven one asks
+ * the driver for status checks at 10 or 50 Hz, and re-reads what it is
+ * notified of.
+ *
+ * System calls are counted by hdspe_test_transport: they are ioctl(),
+ * read() and the wake-ups of poll(). CPU time is that of the client and
+ * the driver code it calls while awake, without the cost of entering the
+ * kernel, and without the status checks, which run off the period
+ * interrupt. Latency is from a sync change to the client seeing it, in
+ * simulated time.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "hdspe_test_transport.h"
+
+#define BENCH_SECONDS	60
+#define BENCH_TOGGLE	4987	/* ms between sync changes */
+#define BENCH_RATE	48000
+#define BENCH_PERIOD	256	/* frames */
+
+static uint64_t bench_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+struct bench_result {
+	unsigned long syscalls;
+	uint64_t cpu_ns;
+	uint64_t latency_ns;
+	int changes;
+	int seen;
+};
+
+/* Runs the card, and after each period interrupt the client if it would
+ * wake up then: it returns true when it saw a sync change. */
+template <typename W, typename F>
+static void bench_run(struct hdspe_test_card *tc, hdspe_test_transport &t,
+		      struct bench_result &r, W wake, F client)
+{
+	const uint64_t toggle_ns = BENCH_TOGGLE * 1000000ULL;
+	const struct hdspe_timing *timing = hdspe_test_dev_timing(tc);
+	uint64_t now = 0, changed = 0, period_ns, t0;
+	bool sync = false, pending = false;
+
+	hdspe_test_dev_period(tc);
+	period_ns = (uint64_t)timing->period_size * 1000000000 / BENCH_RATE;
+	t.syscalls = 0;
+	memset(&r, 0, sizeof(r));
+	for (now = 0; now < BENCH_SECONDS * 1000000000ULL; now += period_ns) {
+		if (now / toggle_ns != (now + period_ns) / toggle_ns) {
+			sync = !sync;
+			hdspe_test_dev_set_sync(tc, sync ? 3 : 0,
+						sync ? 3 : 0);
+			changed = now;
+			pending = true;
+			r.changes++;
+		}
+		hdspe_test_dev_period(tc);
+		if (!wake(now))
+			continue;
+
+		t0 = bench_ns();
+		bool seen = client();
+		r.cpu_ns += bench_ns() - t0;
+		if (seen && pending) {
+			r.latency_ns += now - changed;
+			r.seen++;
+			pending = false;
+		}
+	}
+	r.syscalls = t.syscalls;
+}
+
+static void bench_naive(struct bench_result &r, int hz)
+{
+	static const char *const names[] = {
+		"Raw Sample Rate", "AutoSync Status", "AutoSync Frequency",
+		"Current AutoSync Reference",
+	};
+	struct hdspe_test_card *tc = hdspe_test_dev_new(HDSPE_RAYDAT, 0);
+	hdspe_test_transport t(tc);
+	struct snd_ctl_elem_value v[4], status;
+	uint64_t next = 0;
+
+	hdspe_test_dev_set_period(tc, BENCH_PERIOD);
+	{
+		hdspe::card card(t);
+
+		/* Element ids only: the naive client does its own reads. */
+		card.refresh();
+		for (int i = 0; i < 4; i++) {
+			memset(&v[i], 0, sizeof(v[i]));
+			v[i].id = card.find(names[i])->id();
+		}
+	}
+	status = v[1];
+	hdspe_test_dev_ctl_ioctl(SNDRV_CTL_IOCTL_ELEM_READ, &status);
+
+	auto wake = [&](uint64_t now) {
+		if (now < next)
+			return false;
+		next += 1000000000 / hz;
+		return true;
+	};
+	bench_run(tc, t, r, wake, [&]() {
+		bool seen;
+
+		for (int i = 0; i < 4; i++)
+			t.ctl_ioctl(SNDRV_CTL_IOCTL_ELEM_READ, &v[i]);
+		seen = memcmp(&v[1].value, &status.value,
+			      sizeof(status.value)) != 0;
+		status = v[1];
+		return seen;
+	});
+	hdspe_test_dev_free(tc);
+}
+
+static void bench_events(struct bench_result &r, int hz)
+{
+	struct hdspe_test_card *tc = hdspe_test_dev_new(HDSPE_RAYDAT, 0);
+	hdspe_test_transport t(tc);
+
+	hdspe_test_dev_set_period(tc, BENCH_PERIOD);
+	{
+		hdspe::card card(t);
+		bool seen = false;
+
+		card.refresh();
+		card.on_change([&](const hdspe::element &e, unsigned int) {
+			if (e.name() == "AutoSync Status")
+				seen = true;
+		});
+		card.set_status_polling(hz);
+
+		auto wake = [&](uint64_t) { return t.ctl_wait(-1) > 0; };
+		bench_run(tc, t, r, wake, [&]() {
+			seen = false;
+			card.dispatch();
+			return seen;
+		});
+	}
+	hdspe_test_dev_free(tc);
+}
+
+static void bench_print(const char *name, const struct bench_result &r)
+{
+	printf("%-24s %10.1f %12.2f %12.1f %6d/%d\n", name,
+	       (double)r.syscalls / BENCH_SECONDS,
+	       (double)r.cpu_ns / 1000 / BENCH_SECONDS,
+	       r.seen ? (double)r.latency_ns / r.seen / 1000000 : 0.0,
+	       r.seen, r.changes);
+}
+
+int main()
+{
+	struct bench_result r;
+
+	printf("%-24s %10s %12s %12s %8s\n", "Client", "Syscalls/s",
+	       "CPU us/s", "Latency ms", "Seen");
+	bench_naive(r, 10);
+	bench_print("poll 4 elements @ 10 Hz", r);
+	bench_naive(r, 50);
+	bench_print("poll 4 elements @ 50 Hz", r);
+	bench_events(r, 10);
+	bench_print("events, checks @ 10 Hz", r);
+	bench_events(r, 50);
+	bench_print("events, checks @ 50 Hz", r);
+	return 0;
+}
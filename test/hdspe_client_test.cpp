@@ -0,0 +1,205 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file hdspe_client_test.cpp
+ * @brief Unit tests of the C++ client library in client/, on test cards
+ * through hdspe_test_transport. Built and run by 'make test'.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hdspe_ltc_math.h"
+#include "hdspe_test_transport.h"
+
+static int failures;
+
+#define CHECK(cond)							\
+	do {								\
+		if (!(cond)) {						\
+			fprintf(stderr, "%s:%d: CHECK(%s) failed\n",	\
+				__FILE__, __LINE__, #cond);		\
+			failures++;					\
+		}							\
+	} while (0)
+
+/* Values as the driver reports them. */
+static void test_decode(void)
+{
+	struct snd_ctl_elem_value v;
+	hdspe::ltc_time t, u;
+
+	memset(&v, 0, sizeof(v));
+	v.value.integer64.value[0] = 1ULL << 36;
+	v.value.integer64.value[1] = 28125;
+	CHECK(hdspe::decode_sample_rate(v).num == 1ULL << 36);
+	CHECK(hdspe::decode_sample_rate(v).hz() ==
+	      (double)(1ULL << 36) / 28125);
+
+	v.value.integer64.value[0] =
+		hdspe_ltc32_to_ltc64(hdspe_ltc32_compose(12, 34, 56, 10));
+	v.value.integer64.value[1] = 48000;
+	t = hdspe::decode_ltc(v, 25, false);
+	CHECK(t.h == 12 && t.m == 34 && t.s == 56 && t.f == 10);
+	CHECK(t.frame == 48000);
+	CHECK(t.str() == "12:34:56:10");
+	CHECK(t.frames() == ((12 * 60 + 34) * 60 + 56) * 25u + 10);
+
+	/* One second and a half frame later, at 48 kHz. */
+	u = t.at(48000 + 48000 + 960, 48000.0);
+	CHECK(u.str() == "12:34:57:10");
+	CHECK(u.frame == 96000);
+	CHECK(t.at(0, 48000.0).ltc == t.ltc);
+
+	t = hdspe::decode_ltc(v, 30, true);
+	CHECK(t.str() == "12:34:56;10");
+
+	CHECK(hdspe::decode_fps("24 fps") == 24);
+	CHECK(hdspe::decode_fps("25 fps") == 25);
+	CHECK(hdspe::decode_fps("29.97 fps") == 30);
+	CHECK(hdspe::decode_fps("30 fps") == 30);
+}
+
+/* The model holds every element, and decodes the status elements. */
+static void test_model(void)
+{
+	struct hdspe_test_card *tc = hdspe_test_dev_new(HDSPE_RAYDAT, 1);
+	hdspe_test_transport t(tc);
+	struct hdspe_card_info info;
+	struct hdspe_timing timing;
+
+	{
+		hdspe::card card(t);
+		const hdspe::element *e;
+
+		CHECK(card.refresh() == 0);
+		CHECK(card.elements().size() > 20);
+
+		e = card.find("Current AutoSync Reference");
+		CHECK(e && e->items().size() > 2);
+		CHECK(e && e->items().back() == "Intern");
+		CHECK(card.autosync_ref().has_value());
+
+		auto sources = card.autosync();
+		CHECK(e && sources.size() == e->items().size() - 1);
+		for (auto &s : sources) {
+			CHECK(!s.name.empty());
+			CHECK(s.status != hdspe::sync_status::sync);
+		}
+
+		/* Without a reference, at the internal frequency. */
+		e = card.find("Internal Frequency");
+		CHECK(e && card.raw_sample_rate().has_value());
+		if (e && card.raw_sample_rate()) {
+			double hz = strtod(std::string(e->item()).c_str(),
+					   nullptr) * 1000;
+
+			CHECK(card.raw_sample_rate()->hz() > hz - 1);
+			CHECK(card.raw_sample_rate()->hz() < hz + 1);
+		}
+
+		auto ltc = card.ltc_in();
+		CHECK(ltc.has_value());
+		CHECK(ltc && (ltc->fps == 24 || ltc->fps == 25 ||
+			      ltc->fps == 30));
+
+		memset(&info, 0, sizeof(info));
+		CHECK(card.card_info(info) == 0);
+		CHECK(info.card_type == HDSPE_RAYDAT);
+
+		/* Written through, and back from the change event. */
+		CHECK(e && e->writable());
+		if (e) {
+			long item = e->integer() == 2 ? 1 : 2;
+
+			CHECK(card.write(*e, item) == 0);
+			CHECK(e->integer() == item);
+			CHECK(card.dispatch() >= 1);
+			CHECK(e->integer() == item);
+		}
+
+		hdspe_test_dev_period(tc);
+		CHECK(card.timing(timing));
+		CHECK(timing.irq_count == 1);
+		CHECK(timing.frame_count > 0);
+	}
+	hdspe_test_dev_free(tc);
+}
+
+/* Status changes come in as events, each element re-read once, and status
+ * polling is re-enabled after the driver stops it. */
+static void test_events(void)
+{
+	struct hdspe_test_card *tc = hdspe_test_dev_new(HDSPE_RAYDAT, 0);
+	hdspe_test_transport t(tc);
+	int status_changes = 0, i;
+
+	hdspe_test_dev_set_period(tc, 256);
+	{
+		hdspe::card card(t);
+		const hdspe::element *polling;
+
+		CHECK(card.refresh() == 0);
+		card.on_change([&](const hdspe::element &e, unsigned int mask) {
+			CHECK(mask & SNDRV_CTL_EVENT_MASK_VALUE);
+			if (e.name() == "AutoSync Status")
+				status_changes++;
+		});
+		polling = card.find("Status Polling");
+		CHECK(polling != nullptr);
+		CHECK(card.set_status_polling(10) == 0);
+		CHECK(polling && polling->integer() == 10);
+		CHECK(card.dispatch() == 1);	/* our own write */
+
+		/* The first status check, 100 ms later, notifies the status at
+		 * the time, and stops status polling. */
+		for (i = 0; i < 1000 && !t.ctl_wait(0); i++)
+			hdspe_test_dev_period(tc);
+		CHECK(i < 40);
+		CHECK(card.dispatch() >= 2);
+		CHECK(polling && polling->integer() == 10);
+		CHECK(card.dispatch() == 1);	/* our own write */
+		status_changes = 0;
+
+		/* Nothing changes: no events. */
+		for (i = 0; i < 10; i++)
+			hdspe_test_dev_period(tc);
+		CHECK(t.ctl_wait(0) == 0);
+
+		/* AES and SPDIF lock and sync. The next status check
+		 * notifies the change and stops status polling. */
+		hdspe_test_dev_set_sync(tc, 3, 3);
+		for (i = 0; i < 1000 && !t.ctl_wait(0); i++)
+			hdspe_test_dev_period(tc);
+		CHECK(i < 40);
+		CHECK(card.dispatch() == 2);
+		CHECK(status_changes == 1);
+		CHECK(polling && polling->integer() == 10);
+
+		int synced = 0;
+		for (auto &s : card.autosync())
+			synced += s.status == hdspe::sync_status::sync;
+		CHECK(synced == 2);
+
+		/* Without changes, the driver stops status polling after two
+		 * seconds: re-enabled as well. */
+		CHECK(card.dispatch() == 1);	/* our own write */
+		for (i = 0; i < 1000 && !t.ctl_wait(0); i++)
+			hdspe_test_dev_period(tc);
+		CHECK(i * 256 > 2 * 48000 && i * 256 < 3 * 48000);
+		CHECK(card.dispatch() == 1);
+		CHECK(polling && polling->integer() == 10);
+		CHECK(status_changes == 1);
+	}
+	hdspe_test_dev_free(tc);
+}
+
+int main()
+{
+	test_decode();
+	test_model();
+	test_events();
+
+	printf("C++ client %s\n", failures ? "FAILED" : "ok");
+	return failures ? 1 : 0;
+}
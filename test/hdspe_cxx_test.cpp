@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file hdspe_cxx_test.cpp
+ * @brief Checks that the user space API headers build in a C++ client, the
+ * way hdspmixer and hdspeconf include them: with the system linux/ headers,
+ * not the shims of the test harness. Built and run by 'make test'.
+ */
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <cstdio>
+#include <string_view>
+
+#include "hdspe.h"
+#include "hdspe_ltc_math.h"
+
+static_assert(sizeof(enum hdspe_io_type) == 4, "hdspe_io_type is 32-bit");
+static_assert(HDSPE_MAX_CHANNELS == 64, "HDSPE_MAX_CHANNELS");
+
+int main()
+{
+	static const unsigned long ioctls[] = {
+		SNDRV_HDSPE_IOCTL_GET_VERSION,
+		SNDRV_HDSPE_IOCTL_GET_STATUS,
+		SNDRV_HDSPE_IOCTL_GET_CARD_INFO,
+		SNDRV_HDSPE_IOCTL_GET_MIXER,
+		SNDRV_HDSPE_IOCTL_GET_LATENCY,
+		SNDRV_HDSPE_IOCTL_GET_DMA_POS,
+	};
+	struct hdspe_version v = {};
+	struct hdspe_status s = {};
+	int h, m, sec, f, failed = 0;
+	uint32_t ltc;
+
+	v.card_type = HDSPE_AIO_PRO;
+	s.version = HDSPE_VERSION;
+	if (s.version != 3 || s.sync[HDSPE_CLOCK_SOURCE_INTERN] != 0)
+		failed++;
+	if (std::string_view(HDSPE_IO_TYPE_NAME(v.card_type)) != "AIO Pro")
+		failed++;
+	for (unsigned long cmd : ioctls)
+		if (_IOC_TYPE(cmd) != 'H')
+			failed++;
+
+	ltc = hdspe_ltc32_compose(23, 59, 59, 29);
+	hdspe_ltc32_parse(hdspe_ltc32_incr(ltc, 30, 0), &h, &m, &sec, &f);
+	if (h != 0 || m != 0 || sec != 0 || f != 0)
+		failed++;
+
+	std::printf("C++ API %s\n", failed ? "FAILED" : "ok");
+	return failed ? 1 : 0;
+}
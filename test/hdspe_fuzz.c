@@ -0,0 +1,779 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file hdspe_fuzz.c
+ * @brief Fuzzer of the HDSPe hwdep interface on test cards, after
+ * syzkaller: ioctl(), read(), poll() and mmap() of the hwdep device with
+ * arguments generated from descriptions of the ioctls, interleaved with
+ * period interrupts. hdspe.syz has the same descriptions in syzlang, to
+ * fuzz the driver on a card with syzkaller. Build and run with
+ * 'make fuzz' in the top level directory:
+ *
+ *   test/hdspe_fuzz [-v] [-s seed] [-n iterations]
+ *
+ * The argument structs are placed in user memory (see hdspe_test.h):
+ * usually inside it, sometimes running off its end, at NULL or at a kernel
+ * address. The same goes for the mixer pointer of GET_MIXER. After each
+ * call, the fuzzer checks that
+ *
+ * - the result is 0 or a negative error code, -EINVAL for unknown ioctls,
+ *   and no snd_BUG() was hit,
+ * - nothing was copied to user memory outside the output of the ioctl,
+ * - an ioctl that could not copy its input or output failed with -EFAULT,
+ *   and one that could did not,
+ * - ioctls without side effects copy out the same bytes whatever was on
+ *   the stack before: no uninitialized padding or fields.
+ *
+ * A failing iteration is reported with the seed and iteration number:
+ * rerun with that seed and -v to see the calls leading up to it.
+ */
+
+#include "hdspe_test.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+int hdspe_test_failures;
+
+/* --- Descriptions --- */
+
+enum hdspe_fuzz_kind {
+	HDSPE_FUZZ_INT,		/* integer in [min, max], mostly */
+	HDSPE_FUZZ_NUMID,	/* control element numid */
+	HDSPE_FUZZ_VALUE,	/* value of that element, mostly in range */
+	HDSPE_FUZZ_FRAME,	/* frame count around the current one */
+	HDSPE_FUZZ_SEQ,		/* sequence number handed out before */
+	HDSPE_FUZZ_PTR,		/* user pointer to <max> bytes of output */
+};
+
+struct hdspe_fuzz_field {
+	const char *name;
+	unsigned int offset;
+	unsigned int size;
+	enum hdspe_fuzz_kind kind;
+	s64 min, max;
+};
+
+struct hdspe_fuzz_ioctl {
+	const char *name;
+	unsigned int cmd;
+	size_t in;		/* bytes copied from the argument */
+	size_t out;		/* bytes copied to the argument, at most */
+	bool pure;		/* no side effects: same output every time */
+	const struct hdspe_fuzz_field *fields;	/* of the input */
+};
+
+#define FIELD(type, member, kind, lo, hi)				\
+	{ #member, offsetof(struct type, member),			\
+	  sizeof(((struct type *)0)->member), kind, lo, hi }
+
+static const struct hdspe_fuzz_field hdspe_fuzz_mixer_ioctl[] = {
+	FIELD(hdspe_mixer_ioctl, mixer, HDSPE_FUZZ_PTR, 0,
+	      sizeof(struct hdspe_mixer)),
+	{ }
+};
+
+static const struct hdspe_fuzz_field hdspe_fuzz_ref_stats_config[] = {
+	FIELD(hdspe_ref_stats_config, window[0], HDSPE_FUZZ_INT, 0, 1000000),
+	FIELD(hdspe_ref_stats_config, window[1], HDSPE_FUZZ_INT, 0, 1000000),
+	FIELD(hdspe_ref_stats_config, window[2], HDSPE_FUZZ_INT, 0, 1000000),
+	FIELD(hdspe_ref_stats_config, window[3], HDSPE_FUZZ_INT, 0, 1000000),
+	{ }
+};
+
+static const struct hdspe_fuzz_field hdspe_fuzz_aes_cs_config[] = {
+	FIELD(hdspe_aes_cs_config, channels, HDSPE_FUZZ_INT, 0, -1),
+	FIELD(hdspe_aes_cs_config, mask, HDSPE_FUZZ_INT, 0, 1),
+	{ }
+};
+
+static const struct hdspe_fuzz_field hdspe_fuzz_sched_ctl[] = {
+	FIELD(hdspe_sched_ctl, numid, HDSPE_FUZZ_NUMID, 0, 0),
+	FIELD(hdspe_sched_ctl, seq, HDSPE_FUZZ_SEQ, 0, 0),
+	FIELD(hdspe_sched_ctl, frame, HDSPE_FUZZ_FRAME, 0, 0),
+	FIELD(hdspe_sched_ctl, value[0], HDSPE_FUZZ_VALUE, 0, 0),
+	FIELD(hdspe_sched_ctl, value[1], HDSPE_FUZZ_VALUE, 0, 0),
+	FIELD(hdspe_sched_ctl, value[2], HDSPE_FUZZ_VALUE, 0, 0),
+	FIELD(hdspe_sched_ctl, value[3], HDSPE_FUZZ_VALUE, 0, 0),
+	{ }
+};
+
+static const struct hdspe_fuzz_field hdspe_fuzz_latency[] = {
+	FIELD(hdspe_latency, speed, HDSPE_FUZZ_INT, 0, HDSPE_SPEED_INVALID),
+	{ }
+};
+
+static const struct hdspe_fuzz_field hdspe_fuzz_dmabuf[] = {
+	FIELD(hdspe_dmabuf, stream, HDSPE_FUZZ_INT, 0, SNDRV_PCM_STREAM_LAST),
+	{ }
+};
+
+static const struct hdspe_fuzz_field hdspe_fuzz_video_frame[] = {
+	FIELD(hdspe_video_frame, frame, HDSPE_FUZZ_FRAME, 0, 0),
+	{ }
+};
+
+#define IOCTL(cmd, in, out, pure, fields)				\
+	{ #cmd, SNDRV_HDSPE_IOCTL_##cmd, in, out, pure, fields }
+#define IOCTL_R(cmd, type, pure)					\
+	IOCTL(cmd, 0, sizeof(struct type), pure, NULL)
+#define IOCTL_W(cmd, type, fields)					\
+	IOCTL(cmd, sizeof(struct type), 0, false, fields)
+#define IOCTL_WR(cmd, type, pure, fields)				\
+	IOCTL(cmd, sizeof(struct type), sizeof(struct type), pure, fields)
+
+static const struct hdspe_fuzz_ioctl hdspe_fuzz_ioctls[] = {
+	/* Declared with the size of struct hdspe_status, copies less. */
+	IOCTL_R(GET_CARD_INFO, hdspe_card_info, true),
+	IOCTL_R(GET_STATUS, hdspe_status, true),
+	IOCTL_R(GET_LTC, hdspe_tco_status, true),
+	IOCTL_R(GET_PEAK_RMS, hdspe_peak_rms, true),
+	IOCTL_R(GET_CONFIG, hdspe_config, true),
+	IOCTL_R(GET_VERSION, hdspe_version, true),
+	/* Declared _IOR: reads the pointer, copies the mixer to it. */
+	IOCTL(GET_MIXER, sizeof(struct hdspe_mixer_ioctl), 0, true,
+	      hdspe_fuzz_mixer_ioctl),
+	IOCTL_W(SET_REF_STATS, hdspe_ref_stats_config,
+		hdspe_fuzz_ref_stats_config),
+	IOCTL_R(GET_REF_STATS, hdspe_ref_stats, true),
+	IOCTL_W(SET_AES_CS, hdspe_aes_cs_config, hdspe_fuzz_aes_cs_config),
+	IOCTL_WR(SCHEDULE_CTL, hdspe_sched_ctl, false, hdspe_fuzz_sched_ctl),
+	IOCTL_WR(GET_SCHED_CTL, hdspe_sched_ctl, true, hdspe_fuzz_sched_ctl),
+	IOCTL_WR(GET_LATENCY, hdspe_latency, true, hdspe_fuzz_latency),
+	/* -EOPNOTSUPP after the argument checks: no dma-buf in user space. */
+	IOCTL_WR(EXPORT_DMABUF, hdspe_dmabuf, false, hdspe_fuzz_dmabuf),
+	IOCTL_R(GET_DMA_POS, hdspe_dma_pos, true),
+	IOCTL_WR(GET_VIDEO_FRAME, hdspe_video_frame, true,
+		 hdspe_fuzz_video_frame),
+};
+
+/* --- Random numbers: xorshift64* --- */
+
+static u64 hdspe_fuzz_state;
+
+static u64 hdspe_fuzz_rand(void)
+{
+	hdspe_fuzz_state ^= hdspe_fuzz_state >> 12;
+	hdspe_fuzz_state ^= hdspe_fuzz_state << 25;
+	hdspe_fuzz_state ^= hdspe_fuzz_state >> 27;
+	return hdspe_fuzz_state * 0x2545f4914f6cdd1dULL;
+}
+
+/* Random number in [0, n). */
+static u64 hdspe_fuzz_below(u64 n)
+{
+	return n ? hdspe_fuzz_rand() % n : 0;
+}
+
+static bool hdspe_fuzz_chance(unsigned int percent)
+{
+	return hdspe_fuzz_below(100) < percent;
+}
+
+/* --- User memory: an arena between two inaccessible guard pages --- */
+
+#define HDSPE_FUZZ_ARENA	(16 * PAGE_SIZE)
+
+static char *hdspe_fuzz_arena;
+
+static int hdspe_fuzz_arena_init(void)
+{
+	char *p = mmap(NULL, HDSPE_FUZZ_ARENA + 2 * PAGE_SIZE,
+		       PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+		       -1, 0);
+
+	if (p == MAP_FAILED)
+		return -ENOMEM;
+	mprotect(p, PAGE_SIZE, PROT_NONE);
+	mprotect(p + PAGE_SIZE + HDSPE_FUZZ_ARENA, PAGE_SIZE, PROT_NONE);
+	hdspe_fuzz_arena = p + PAGE_SIZE;
+	hdspe_shim_set_user(hdspe_fuzz_arena, HDSPE_FUZZ_ARENA);
+	return 0;
+}
+
+/* Accessible bytes of the <n> at <p>. */
+static size_t hdspe_fuzz_user_ok(const char *p, size_t n)
+{
+	if (p < hdspe_fuzz_arena || p >= hdspe_fuzz_arena + HDSPE_FUZZ_ARENA)
+		return 0;
+	return min_t(size_t, n, hdspe_fuzz_arena + HDSPE_FUZZ_ARENA - p);
+}
+
+/* Where to put <n> bytes: mostly in user memory, sometimes running off
+ * its end, at NULL, or at an address that is no user memory. */
+static char *hdspe_fuzz_place(size_t n, void *kernel)
+{
+	u64 r = hdspe_fuzz_below(100);
+
+	if (n > HDSPE_FUZZ_ARENA)
+		n = HDSPE_FUZZ_ARENA;
+	if (r < 84)
+		return hdspe_fuzz_arena +
+			hdspe_fuzz_below(HDSPE_FUZZ_ARENA - n + 1);
+	if (r < 92 && n > 1)
+		return hdspe_fuzz_arena + HDSPE_FUZZ_ARENA - n +
+			1 + hdspe_fuzz_below(n - 1);
+	if (r < 96)
+		return NULL;
+	return kernel;
+}
+
+/* --- The fuzzer --- */
+
+struct hdspe_fuzz {
+	struct hdspe_test_card *tc;
+	struct snd_hwdep *hw;
+	struct file file;
+	u64 frames;		/* emulated buffer pointer position */
+	u32 seq;		/* last sequence number handed out */
+	u32 numids;		/* one past the last control numid */
+	u32 numid;		/* last one generated */
+	unsigned long iteration;
+	unsigned long calls, faults, errors;
+	unsigned long ioctl_calls[ARRAY_SIZE(hdspe_fuzz_ioctls)];
+	unsigned long ioctl_ok[ARRAY_SIZE(hdspe_fuzz_ioctls)];
+};
+
+static u64 hdspe_fuzz_seed;
+
+#define FUZZ_CHECK(f, cond, fmt, ...)					\
+	do {								\
+		if (!(cond)) {						\
+			fprintf(stderr, "seed %llu iteration %lu: %s: "	\
+				fmt "\n",				\
+				(unsigned long long)hdspe_fuzz_seed,	\
+				(f)->iteration, #cond, ##__VA_ARGS__);	\
+			hdspe_test_failures++;				\
+		}							\
+	} while (0)
+
+static s64 hdspe_fuzz_int(s64 min, s64 max)
+{
+	static const s64 special[] = { 0, 1, -1, 0x7fffffff, 0x80000000LL };
+	u64 r = hdspe_fuzz_below(16);
+
+	if (r == 0)
+		return hdspe_fuzz_rand();
+	if (r == 1)
+		return special[hdspe_fuzz_below(ARRAY_SIZE(special))];
+	if (r == 2)
+		return min - 1;
+	if (r == 3)
+		return max + 1;
+	if (r < 6)
+		return hdspe_fuzz_chance(50) ? min : max;
+	if (max < min)		/* whole range of the type */
+		return hdspe_fuzz_rand();
+	return min + hdspe_fuzz_below(max - min + 1);
+}
+
+/* A value for control element f->numid: in the range its info() reports,
+ * 4 times out of 5. */
+static s64 hdspe_fuzz_value(struct hdspe_fuzz *f)
+{
+	struct snd_kcontrol *k = snd_ctl_find_numid(f->tc->hdspe.card,
+						    f->numid);
+	struct snd_ctl_elem_info info;
+
+	memset(&info, 0, sizeof(info));
+	if (!k || hdspe_fuzz_chance(20) || k->info(k, &info) < 0)
+		return hdspe_fuzz_int(-1, 0x10000);
+
+	switch (info.type) {
+	case SNDRV_CTL_ELEM_TYPE_INTEGER:
+		return hdspe_fuzz_int(info.value.integer.min,
+				      info.value.integer.max);
+	case SNDRV_CTL_ELEM_TYPE_INTEGER64:
+		return hdspe_fuzz_int(info.value.integer64.min,
+				      info.value.integer64.max);
+	case SNDRV_CTL_ELEM_TYPE_ENUMERATED:
+		return hdspe_fuzz_below(info.value.enumerated.items);
+	default:
+		return hdspe_fuzz_below(2);
+	}
+}
+
+/* Generate field <d> of an argument in <buf>. Returns the pointer
+ * generated for PTR fields. */
+static char *hdspe_fuzz_field(struct hdspe_fuzz *f,
+			      const struct hdspe_fuzz_field *d, u8 *buf)
+{
+	struct hdspe *hdspe = &f->tc->hdspe;
+	char *ptr = NULL;
+	s64 v;
+
+	switch (d->kind) {
+	case HDSPE_FUZZ_INT:
+		v = hdspe_fuzz_int(d->min, d->max);
+		break;
+	case HDSPE_FUZZ_NUMID:
+		v = hdspe_fuzz_chance(90) ? (s64)hdspe_fuzz_below(f->numids)
+			: hdspe_fuzz_int(f->numids, f->numids);
+		f->numid = v;
+		break;
+	case HDSPE_FUZZ_VALUE:
+		v = hdspe_fuzz_value(f);
+		break;
+	case HDSPE_FUZZ_FRAME:
+		v = hdspe_fuzz_chance(90)
+			? (s64)(hdspe->frame_count +
+				hdspe_fuzz_below(4 * HDSPE_TEST_BUFFER_FRAMES)) -
+			  HDSPE_TEST_BUFFER_FRAMES
+			: hdspe_fuzz_int(0, -1);
+		break;
+	case HDSPE_FUZZ_SEQ:
+		v = hdspe_fuzz_chance(90)
+			? (s64)(f->seq - hdspe_fuzz_below(80))
+			: hdspe_fuzz_int(0, -1);
+		break;
+	case HDSPE_FUZZ_PTR:
+		ptr = hdspe_fuzz_place(d->max, hdspe);
+		memcpy(buf + d->offset, &ptr, sizeof(ptr));
+		return ptr;
+	}
+	memcpy(buf + d->offset, &v, d->size);	/* little endian */
+	return NULL;
+}
+
+static int hdspe_fuzz_ioctl(struct hdspe_fuzz *f, unsigned int cmd,
+			    char *arg)
+{
+	return f->hw->ops.ioctl(f->hw, &f->file, cmd, (unsigned long)arg);
+}
+
+/* Fill the stack below the caller with <poison>. */
+static __attribute__((noinline)) void hdspe_fuzz_poison(u8 poison)
+{
+	u8 stack[32 * 1024];
+
+	memset(stack, poison, sizeof(stack));
+	__asm__ volatile("" : : "r"(stack) : "memory");
+}
+
+/* Run <cmd> on <in> at <arg>, with the stack under the driver filled with
+ * <poison> first. */
+static __attribute__((noinline)) int
+hdspe_fuzz_poisoned(struct hdspe_fuzz *f, unsigned int cmd, char *arg,
+		    const u8 *in, size_t n, u8 poison)
+{
+	memcpy(arg, in, n);
+	hdspe_fuzz_poison(poison);
+	return hdspe_fuzz_ioctl(f, cmd, arg);
+}
+
+/* Same output whatever was on the stack: no uninitialized bytes. */
+static void hdspe_fuzz_check_leak(struct hdspe_fuzz *f,
+				  const struct hdspe_fuzz_ioctl *d,
+				  char *arg, const u8 *in, size_t n)
+{
+	static u8 out[2][4096];
+	size_t i;
+	int k;
+
+	for (k = 0; k < 2; k++) {
+		if (hdspe_fuzz_poisoned(f, d->cmd, arg, in, n,
+					k ? 0xa5 : 0x5a) != 0)
+			return;
+		memcpy(out[k], arg, d->out);
+	}
+	for (i = 0; i < d->out; i++)
+		if (out[0][i] != out[1][i])
+			break;
+	FUZZ_CHECK(f, i == d->out, "%s: uninitialized byte at offset %zu",
+		   d->name, i);
+}
+
+static void hdspe_fuzz_one_ioctl(struct hdspe_fuzz *f)
+{
+	static u8 in[4096];
+	const struct hdspe_fuzz_ioctl *d = NULL;
+	const struct hdspe_fuzz_field *fd;
+	unsigned int cmd;
+	size_t size, in_ok, out_ok, ptr_size = 0, ptr_ok = 0;
+	char *arg, *ptr = NULL;
+	bool indirect = false;
+	unsigned long bugs = hdspe_shim_bugs;
+	int ret;
+
+	if (hdspe_fuzz_chance(95)) {
+		d = &hdspe_fuzz_ioctls[hdspe_fuzz_below(
+			ARRAY_SIZE(hdspe_fuzz_ioctls))];
+		cmd = d->cmd;
+		size = max(d->in, d->out);
+	} else {
+		/* Anything, mostly in the 'H' range of the driver. */
+		cmd = hdspe_fuzz_chance(75)
+			? _IOC(hdspe_fuzz_below(4), 'H', hdspe_fuzz_below(32) +
+			       0x40, hdspe_fuzz_below(1024))
+			: (unsigned int)hdspe_fuzz_rand();
+		for (size = 0; size < ARRAY_SIZE(hdspe_fuzz_ioctls); size++)
+			if (hdspe_fuzz_ioctls[size].cmd == cmd)
+				d = &hdspe_fuzz_ioctls[size];
+		size = d ? max(d->in, d->out) : _IOC_SIZE(cmd);
+	}
+	size = min_t(size_t, size, sizeof(in));
+
+	/* Random bytes, with the described fields generated. */
+	for (in_ok = 0; in_ok < size; in_ok++)
+		in[in_ok] = hdspe_fuzz_rand();
+	for (fd = d ? d->fields : NULL; fd && fd->name; fd++) {
+		char *p = hdspe_fuzz_field(f, fd, in);
+		if (fd->kind == HDSPE_FUZZ_PTR) {
+			indirect = true;
+			ptr = p;
+			ptr_size = fd->max;
+			ptr_ok = hdspe_fuzz_user_ok(p, ptr_size);
+		}
+	}
+
+	arg = hdspe_fuzz_place(max_t(size_t, size, 1), &f->tc->hdspe);
+	in_ok = hdspe_fuzz_user_ok(arg, size);
+	if (in_ok)
+		memcpy(arg, in, in_ok);
+	if (hdspe_shim_verbose)
+		fprintf(stderr, "%lu: ioctl(%s, %p) [%zu of %zu bytes]\n",
+			f->iteration, d ? d->name : "?", arg, in_ok, size);
+
+	hdspe_shim_set_user(hdspe_fuzz_arena, HDSPE_FUZZ_ARENA);
+	ret = hdspe_fuzz_ioctl(f, cmd, arg);
+	f->calls++;
+	f->faults += ret == -EFAULT;
+	f->errors += ret < 0;
+	if (ret == 0 && cmd == SNDRV_HDSPE_IOCTL_SCHEDULE_CTL)
+		memcpy(&f->seq, arg + offsetof(struct hdspe_sched_ctl, seq),
+		       sizeof(f->seq));
+
+	FUZZ_CHECK(f, ret <= 0 && ret >= -MAX_ERRNO, "ioctl %#x: %d",
+		   cmd, ret);
+	FUZZ_CHECK(f, hdspe_shim_bugs == bugs, "ioctl %#x: snd_BUG()", cmd);
+
+	if (d) {
+		f->ioctl_calls[d - hdspe_fuzz_ioctls]++;
+		f->ioctl_ok[d - hdspe_fuzz_ioctls] += ret == 0;
+	} else {
+		FUZZ_CHECK(f, ret == -EINVAL, "unknown ioctl %#x: %d",
+			   cmd, ret);
+		FUZZ_CHECK(f, !hdspe_shim_user_wlo, "unknown ioctl %#x: "
+			   "copied out", cmd);
+		return;
+	}
+
+	/* Copied out: only to the output of the ioctl. */
+	FUZZ_CHECK(f, !hdspe_shim_user_wlo ||
+		   (hdspe_shim_user_wlo >= arg &&
+		    hdspe_shim_user_whi <= arg + d->out) ||
+		   (indirect && hdspe_shim_user_wlo >= ptr &&
+		    hdspe_shim_user_whi <= ptr + ptr_size),
+		   "%s: copied to [%p, %p), argument at %p", d->name,
+		   hdspe_shim_user_wlo, hdspe_shim_user_whi, arg);
+
+	/* -EFAULT if and only if some copy could not be done. */
+	out_ok = in_ok >= d->out;
+	if (in_ok < d->in) {
+		FUZZ_CHECK(f, ret == -EFAULT, "%s: input not readable: %d",
+			   d->name, ret);
+		FUZZ_CHECK(f, !hdspe_shim_user_wlo, "%s: copied out "
+			   "without input", d->name);
+	} else if (!out_ok) {
+		FUZZ_CHECK(f, ret != 0, "%s: output not writable, no error",
+			   d->name);
+	} else if (indirect && ptr_ok < ptr_size) {
+		FUZZ_CHECK(f, ret == -EFAULT, "%s: pointer to %zu of %zu "
+			   "writable bytes: %d", d->name, ptr_ok, ptr_size,
+			   ret);
+	} else {
+		FUZZ_CHECK(f, ret != -EFAULT, "%s: spurious -EFAULT",
+			   d->name);
+	}
+
+	if (ret == 0 && d->pure && d->out > 0 && out_ok && !indirect)
+		hdspe_fuzz_check_leak(f, d, arg, in, size);
+}
+
+/* read() of the channel status blocks, and poll(). */
+static void hdspe_fuzz_one_read(struct hdspe_fuzz *f)
+{
+	const long rec = sizeof(struct hdspe_aes_cs);
+	long count = hdspe_fuzz_chance(80) ? hdspe_fuzz_below(8 * rec + 1)
+		: (long)hdspe_fuzz_rand();
+	char *buf = hdspe_fuzz_place(min_t(u64, count, HDSPE_FUZZ_ARENA),
+				     &f->tc->hdspe);
+	loff_t offset = 0;
+	__poll_t mask;
+	long ret;
+
+	if (hdspe_shim_verbose)
+		fprintf(stderr, "%lu: read(%p, %ld)\n", f->iteration, buf,
+			count);
+	hdspe_shim_set_user(hdspe_fuzz_arena, HDSPE_FUZZ_ARENA);
+	ret = f->hw->ops.read(f->hw, buf, count, &offset);
+	f->calls++;
+
+	FUZZ_CHECK(f, ret == -EAGAIN || ret == -EINVAL || ret == -EFAULT ||
+		   (ret > 0 && ret % rec == 0 && ret <= count),
+		   "read(%ld): %ld", count, ret);
+	FUZZ_CHECK(f, !hdspe_shim_user_wlo ||
+		   (hdspe_shim_user_wlo >= buf &&
+		    hdspe_shim_user_whi <= buf + count),
+		   "read(%ld): copied out of the buffer", count);
+
+	mask = f->hw->ops.poll(f->hw, &f->file, NULL);
+	FUZZ_CHECK(f, mask == 0 || mask == (EPOLLIN | EPOLLRDNORM),
+		   "poll(): %#x", mask);
+}
+
+/* mmap() of the timing page or the mixer ring, with random bounds. */
+static void hdspe_fuzz_one_mmap(struct hdspe_fuzz *f)
+{
+	static const unsigned long pgoff[] = {
+		0, HDSPE_MIXER_RING_OFFSET >> PAGE_SHIFT, 1,
+	};
+	struct vm_area_struct vma = { .vm_start = 0x10000000 };
+	int ret;
+
+	vma.vm_pgoff = hdspe_fuzz_chance(90)
+		? pgoff[hdspe_fuzz_below(ARRAY_SIZE(pgoff))]
+		: hdspe_fuzz_rand();
+	vma.vm_end = vma.vm_start + PAGE_SIZE * (1 + hdspe_fuzz_below(
+		2 * HDSPE_MIXER_RING_BYTES / PAGE_SIZE));
+	vma.vm_flags = hdspe_fuzz_rand() &
+		(VM_WRITE | VM_MAYWRITE | VM_DONTEXPAND | VM_DONTDUMP);
+
+	if (hdspe_shim_verbose)
+		fprintf(stderr, "%lu: mmap(%#lx pages at %#lx, %#lx)\n",
+			f->iteration, (vma.vm_end - vma.vm_start) / PAGE_SIZE,
+			vma.vm_pgoff, vma.vm_flags);
+	ret = f->hw->ops.mmap(f->hw, &f->file, &vma);
+	f->calls++;
+
+	FUZZ_CHECK(f, ret <= 0, "mmap: %d", ret);
+	if (ret == 0 && vma.vm_pgoff == 0)
+		FUZZ_CHECK(f, !(vma.vm_flags & (VM_WRITE | VM_MAYWRITE)),
+			   "timing page mapped writable: %#lx", vma.vm_flags);
+	if (ret == 0 && vma.vm_ops && vma.vm_ops->close)
+		vma.vm_ops->close(&vma);
+}
+
+/* The client part of snd_hdspe_interrupt(), and the work it queues. */
+static void hdspe_fuzz_one_period(struct hdspe_fuzz *f)
+{
+	struct hdspe *hdspe = &f->tc->hdspe;
+	struct hdspe_timing *t = hdspe->timing_page;
+	unsigned long bugs = hdspe_shim_bugs;
+
+	f->frames += hdspe->period_size;
+	hdspe_test_set_buf_ptr(f->tc, f->frames, true);
+	hdspe->reg.status0 = hdspe_read_status0_nocache(hdspe);
+	hdspe_update_frame_count(hdspe);
+	if (hdspe->tco)
+		hdspe_tco_period_elapsed(hdspe);
+	if (hdspe->ref_stats)
+		hdspe_ref_stats_period(hdspe);
+	hdspe_timing_update(hdspe);
+	if (hdspe->tms)
+		hdspe_tms_period(hdspe);
+	if (hdspe->sched)
+		hdspe_sched_period(hdspe);
+	hdspe_shim_run_work();
+
+	FUZZ_CHECK(f, t->seq % 2 == 0, "timing page seq %u", t->seq);
+	FUZZ_CHECK(f, t->frame_count == hdspe->frame_count,
+		   "timing page frame %llu", (unsigned long long)t->frame_count);
+	FUZZ_CHECK(f, hdspe_shim_bugs == bugs, "period: snd_BUG()");
+}
+
+static void hdspe_fuzz_card(struct hdspe_fuzz *f, unsigned long iterations)
+{
+	struct hdspe *hdspe = &f->tc->hdspe;
+	struct snd_pcm_substream *ss =
+		hdspe->pcm->streams[SNDRV_PCM_STREAM_CAPTURE].substream;
+	int i;
+
+	f->hw = hdspe->hwdep;
+	f->frames = 0;
+	f->seq = 0;
+	f->numids = 1;
+	for (i = 1; snd_ctl_find_numid(hdspe->card, i); i++)
+		f->numids = i + 1;
+
+	/* Video in on the TCO module half of the time, for the video frame
+	 * timeline. */
+	if (hdspe->tco && hdspe_fuzz_chance(50)) {
+		hdspe->tco->fw_version = 11;
+		*hdspe_test_reg(hdspe, true, HDSPE_RD_TCO + 8) =
+			(u32)hdspe_fuzz_below(8) << 27;
+	}
+
+	/* Capture running half of the time, for the channel status and
+	 * burst scanners, and for the DMA buffer export. */
+	hdspe_test_set_buf_ptr(f->tc, 0, false);
+	if (hdspe_fuzz_chance(50) && hdspe_shim_pcm_open(ss) == 0) {
+		/* Two periods on MADI and AES, a fixed size on RayDAT and
+		 * AIO. */
+		bool raio = hdspe->io_type == HDSPE_RAYDAT ||
+			hdspe->io_type == HDSPE_AIO ||
+			hdspe->io_type == HDSPE_AIO_PRO;
+
+		FUZZ_CHECK(f, hdspe_shim_pcm_hw_params(ss, 48000,
+				hdspe->max_channels_in, 256,
+				raio ? HDSPE_TEST_BUFFER_FRAMES : 2 * 256) == 0,
+			   "capture hw_params");
+		ss->ops->trigger(ss, SNDRV_PCM_TRIGGER_START);
+	}
+
+	for (; iterations > 0; iterations--, f->iteration++) {
+		u64 r = hdspe_fuzz_below(100);
+
+		if (r < 75)
+			hdspe_fuzz_one_ioctl(f);
+		else if (r < 85)
+			hdspe_fuzz_one_period(f);
+		else if (r < 95)
+			hdspe_fuzz_one_read(f);
+		else
+			hdspe_fuzz_one_mmap(f);
+	}
+	hdspe_shim_set_user(NULL, 0);
+}
+
+/* The two ioctls that do not copy what their number says, checked
+ * directly rather than left to chance. */
+static void hdspe_fuzz_quirks(struct hdspe_fuzz *f)
+{
+	const size_t info = sizeof(struct hdspe_card_info);
+	char *end = hdspe_fuzz_arena + HDSPE_FUZZ_ARENA;
+	struct hdspe_mixer_ioctl m;
+	char *arg;
+
+	f->hw = f->tc->hdspe.hwdep;
+	BUILD_BUG_ON(_IOC_SIZE(SNDRV_HDSPE_IOCTL_GET_CARD_INFO) !=
+		     sizeof(struct hdspe_status));
+
+	/* GET_CARD_INFO copies struct hdspe_card_info only. */
+	arg = hdspe_fuzz_arena;
+	memset(arg, 0xee, sizeof(struct hdspe_status));
+	hdspe_shim_set_user(hdspe_fuzz_arena, HDSPE_FUZZ_ARENA);
+	FUZZ_CHECK(f, hdspe_fuzz_ioctl(f, SNDRV_HDSPE_IOCTL_GET_CARD_INFO,
+				       arg) == 0, "GET_CARD_INFO");
+	FUZZ_CHECK(f, hdspe_shim_user_whi == arg + info, "GET_CARD_INFO "
+		   "copied %td bytes", hdspe_shim_user_whi - arg);
+	FUZZ_CHECK(f, (u8)arg[info] == 0xee, "GET_CARD_INFO: beyond");
+	/* ... so it works with just that much user memory, not less. */
+	FUZZ_CHECK(f, hdspe_fuzz_ioctl(f, SNDRV_HDSPE_IOCTL_GET_CARD_INFO,
+				       end - info) == 0, "GET_CARD_INFO at end");
+	FUZZ_CHECK(f, hdspe_fuzz_ioctl(f, SNDRV_HDSPE_IOCTL_GET_CARD_INFO,
+				       end - info + 1) == -EFAULT,
+		   "GET_CARD_INFO short");
+
+	/* GET_MIXER copies the mixer to the pointer in its argument. */
+	arg = hdspe_fuzz_arena;
+	m.mixer = (struct hdspe_mixer *)(hdspe_fuzz_arena + PAGE_SIZE);
+	memcpy(arg, &m, sizeof(m));
+	hdspe_shim_set_user(hdspe_fuzz_arena, HDSPE_FUZZ_ARENA);
+	FUZZ_CHECK(f, hdspe_fuzz_ioctl(f, SNDRV_HDSPE_IOCTL_GET_MIXER,
+				       arg) == 0, "GET_MIXER");
+	FUZZ_CHECK(f, hdspe_shim_user_wlo == (char *)m.mixer &&
+		   hdspe_shim_user_whi == (char *)(m.mixer + 1),
+		   "GET_MIXER copied to [%p, %p)", hdspe_shim_user_wlo,
+		   hdspe_shim_user_whi);
+	FUZZ_CHECK(f, !memcmp(m.mixer, f->tc->hdspe.mixer, sizeof(*m.mixer)),
+		   "GET_MIXER content");
+	m.mixer = (struct hdspe_mixer *)(end - sizeof(*m.mixer) + 4);
+	memcpy(arg, &m, sizeof(m));
+	FUZZ_CHECK(f, hdspe_fuzz_ioctl(f, SNDRV_HDSPE_IOCTL_GET_MIXER,
+				       arg) == -EFAULT, "GET_MIXER short");
+	m.mixer = NULL;
+	memcpy(arg, &m, sizeof(m));
+	FUZZ_CHECK(f, hdspe_fuzz_ioctl(f, SNDRV_HDSPE_IOCTL_GET_MIXER,
+				       arg) == -EFAULT, "GET_MIXER NULL");
+	m.mixer = (struct hdspe_mixer *)f->tc->hdspe.mixer;
+	memcpy(arg, &m, sizeof(m));
+	FUZZ_CHECK(f, hdspe_fuzz_ioctl(f, SNDRV_HDSPE_IOCTL_GET_MIXER,
+				       arg) == -EFAULT, "GET_MIXER kernel");
+	FUZZ_CHECK(f, hdspe_fuzz_ioctl(f, SNDRV_HDSPE_IOCTL_GET_MIXER,
+				       end - 4) == -EFAULT, "GET_MIXER arg");
+	hdspe_shim_set_user(NULL, 0);
+}
+
+/* The descriptions agree with the ioctl numbers: direction and size. */
+static void hdspe_fuzz_check_descriptions(struct hdspe_fuzz *f)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(hdspe_fuzz_ioctls); i++) {
+		const struct hdspe_fuzz_ioctl *d = &hdspe_fuzz_ioctls[i];
+		unsigned int dir = _IOC_DIR(d->cmd);
+		bool indirect = d->fields &&
+			d->fields[0].kind == HDSPE_FUZZ_PTR;
+
+		FUZZ_CHECK(f, _IOC_SIZE(d->cmd) >= max(d->in, d->out),
+			   "%s: size", d->name);
+		FUZZ_CHECK(f, !d->out || (dir & _IOC_READ), "%s: _IOR",
+			   d->name);
+		FUZZ_CHECK(f, !d->in || indirect || (dir & _IOC_WRITE),
+			   "%s: _IOW", d->name);
+	}
+}
+
+static const enum hdspe_io_type hdspe_fuzz_models[] = {
+	HDSPE_MADI, HDSPE_AES, HDSPE_RAYDAT, HDSPE_AIO, HDSPE_AIO_PRO
+};
+
+int main(int argc, char **argv)
+{
+	unsigned long iterations = 200000, per_card;
+	struct hdspe_fuzz f = { };
+	int c;
+
+	hdspe_fuzz_seed = 1;
+	while ((c = getopt(argc, argv, "vs:n:")) != -1) {
+		switch (c) {
+		case 'v':
+			hdspe_shim_verbose = 1;
+			break;
+		case 's':
+			hdspe_fuzz_seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'n':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-v] [-s seed] "
+				"[-n iterations]\n", argv[0]);
+			return 2;
+		}
+	}
+	hdspe_fuzz_state = hdspe_fuzz_seed * 0x9e3779b97f4a7c15ULL + 1;
+	if (hdspe_fuzz_arena_init() < 0)
+		return 1;
+	hdspe_fuzz_check_descriptions(&f);
+
+	/* A fresh card every 1000 iterations, of every model, with and
+	 * without TCO. */
+	while (f.iteration < iterations) {
+		enum hdspe_io_type type = hdspe_fuzz_models[hdspe_fuzz_below(
+			ARRAY_SIZE(hdspe_fuzz_models))];
+
+		f.tc = hdspe_test_card_new(type, hdspe_fuzz_chance(50));
+		if (!f.tc) {
+			fprintf(stderr, "no test card\n");
+			return 1;
+		}
+		if (f.iteration == 0)
+			hdspe_fuzz_quirks(&f);
+		per_card = min(iterations - f.iteration, 1000UL);
+		hdspe_fuzz_card(&f, per_card);
+		hdspe_test_card_free(f.tc);
+	}
+
+	for (c = 0; c < (int)ARRAY_SIZE(hdspe_fuzz_ioctls); c++)
+		if (hdspe_shim_verbose || (!f.ioctl_ok[c] &&
+		    hdspe_fuzz_ioctls[c].cmd != SNDRV_HDSPE_IOCTL_EXPORT_DMABUF))
+			printf("%-16s %8lu calls %8lu ok\n",
+			       hdspe_fuzz_ioctls[c].name, f.ioctl_calls[c],
+			       f.ioctl_ok[c]);
+	printf("seed %llu: %lu iterations, %lu calls, %lu errors "
+	       "(%lu -EFAULT), %d failed checks\n",
+	       (unsigned long long)hdspe_fuzz_seed, f.iteration, f.calls,
+	       f.errors, f.faults, hdspe_test_failures);
+	return hdspe_test_failures ? 1 : 0;
+}
@@ -0,0 +1,1188 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file hdspe_shim.c
+ * @brief User space implementation of the kernel and ALSA stand-ins declared
+ * in shim/hdspe_shim.h, and of the driver functions living in source files
+ * the test harness does not build (MIDI).
+ */
+
+#include "hdspe_test.h"
+
+#include <stdarg.h>
+
+unsigned long hdspe_shim_reads, hdspe_shim_writes;
+unsigned long hdspe_shim_msgs;
+unsigned long hdspe_shim_bugs;
+int hdspe_shim_verbose;
+unsigned long jiffies;
+u64 hdspe_shim_ns;
+
+/* --- Register file --- */
+
+/* readl() and writel() see the same addresses, as on the card. The card
+ * however has distinct read and write registers at those addresses: reads
+ * are redirected to the rd[] half of the register file. */
+u32 *hdspe_test_reg(struct hdspe *hdspe, bool read, u32 reg)
+{
+	struct hdspe_test_card *tc = container_of(hdspe, struct hdspe_test_card,
+						  hdspe);
+
+	return (read ? tc->rd : tc->wr) + reg / 4;
+}
+
+u32 hdspe_shim_readl(const volatile void *addr)
+{
+	const struct hdspe_test_card *tc = hdspe_test_current;
+	ptrdiff_t off = (const volatile u32 *)addr - tc->wr;
+
+	hdspe_shim_reads++;
+	if (off < 0 || off >= HDSPE_TEST_REGS) {
+		fprintf(stderr, "readl: address %p out of range\n", addr);
+		abort();
+	}
+	return tc->rd[off];
+}
+
+void hdspe_shim_writel(u32 val, volatile void *addr)
+{
+	const struct hdspe_test_card *tc = hdspe_test_current;
+	ptrdiff_t off = (volatile u32 *)addr - tc->wr;
+
+	hdspe_shim_writes++;
+	if (off < 0 || off >= HDSPE_TEST_REGS) {
+		fprintf(stderr, "writel: address %p out of range\n", addr);
+		abort();
+	}
+	((volatile u32 *)tc->wr)[off] = val;
+}
+
+/* --- Bitmaps --- */
+
+unsigned long find_next_bit(const unsigned long *addr, unsigned long size,
+			    unsigned long offset)
+{
+	for (; offset < size; offset++)
+		if (test_bit(offset, addr))
+			return offset;
+	return size;
+}
+
+void bitmap_complement(unsigned long *dst, const unsigned long *src,
+		       unsigned int nbits)
+{
+	unsigned int i;
+
+	for (i = 0; i < BITS_TO_LONGS(nbits); i++)
+		dst[i] = ~src[i];
+}
+
+void bitmap_xor(unsigned long *dst, const unsigned long *a,
+		const unsigned long *b, unsigned int nbits)
+{
+	unsigned int i;
+
+	for (i = 0; i < BITS_TO_LONGS(nbits); i++)
+		dst[i] = a[i] ^ b[i];
+}
+
+void bitmap_and(unsigned long *dst, const unsigned long *a,
+		const unsigned long *b, unsigned int nbits)
+{
+	unsigned int i;
+
+	for (i = 0; i < BITS_TO_LONGS(nbits); i++)
+		dst[i] = a[i] & b[i];
+}
+
+void bitmap_or(unsigned long *dst, const unsigned long *a,
+	       const unsigned long *b, unsigned int nbits)
+{
+	unsigned int i;
+
+	for (i = 0; i < BITS_TO_LONGS(nbits); i++)
+		dst[i] = a[i] | b[i];
+}
+
+unsigned int bitmap_weight(const unsigned long *src, unsigned int nbits)
+{
+	unsigned int i, n = 0;
+
+	for (i = 0; i < nbits; i++)
+		n += test_bit(i, src);
+	return n;
+}
+
+int remap_vmalloc_range(struct vm_area_struct *vma, void *addr,
+			unsigned long pgoff)
+{
+	return 0;
+}
+
+int vm_insert_page(struct vm_area_struct *vma, unsigned long addr,
+		   struct page *page)
+{
+	return 0;
+}
+
+unsigned long get_zeroed_page(gfp_t gfp)
+{
+	void *p = aligned_alloc(PAGE_SIZE, PAGE_SIZE);
+
+	if (p)
+		memset(p, 0, PAGE_SIZE);
+	return (unsigned long)p;
+}
+
+void free_page(unsigned long addr)
+{
+	free((void *)addr);
+}
+
+/* --- User memory --- */
+
+static const char *hdspe_shim_user_lo, *hdspe_shim_user_hi;
+const char *hdspe_shim_user_wlo, *hdspe_shim_user_whi;
+unsigned long hdspe_shim_user_faults;
+
+void hdspe_shim_set_user(const void *base, size_t size)
+{
+	hdspe_shim_user_lo = base;
+	hdspe_shim_user_hi = base ? (const char *)base + size : NULL;
+	hdspe_shim_user_wlo = hdspe_shim_user_whi = NULL;
+	hdspe_shim_user_faults = 0;
+}
+
+/* Number of accessible bytes of the <n> at user address <p>. */
+static unsigned long hdspe_shim_user_ok(const char *p, unsigned long n)
+{
+	if (!hdspe_shim_user_lo)
+		return n;
+	if (p < hdspe_shim_user_lo || p >= hdspe_shim_user_hi)
+		return 0;
+	return min_t(unsigned long, n, hdspe_shim_user_hi - p);
+}
+
+unsigned long copy_to_user(void __user *to, const void *from,
+			   unsigned long n)
+{
+	unsigned long ok = hdspe_shim_user_ok(to, n);
+
+	if (ok > 0) {
+		memcpy(to, from, ok);
+		if (!hdspe_shim_user_wlo || (char *)to < hdspe_shim_user_wlo)
+			hdspe_shim_user_wlo = to;
+		if ((char *)to + ok > hdspe_shim_user_whi)
+			hdspe_shim_user_whi = (char *)to + ok;
+	}
+	if (ok < n)
+		hdspe_shim_user_faults++;
+	return n - ok;
+}
+
+unsigned long copy_from_user(void *to, const void __user *from,
+			     unsigned long n)
+{
+	unsigned long ok = hdspe_shim_user_ok(from, n);
+
+	if (ok > 0)
+		memcpy(to, from, ok);
+	if (ok < n) {
+		/* The kernel zeroes what it could not copy. */
+		memset((char *)to + ok, 0, n - ok);
+		hdspe_shim_user_faults++;
+	}
+	return n - ok;
+}
+
+/* --- Work queues --- */
+
+struct workqueue_struct *system_highpri_wq;
+static struct work_struct *hdspe_shim_work_head, **hdspe_shim_work_tail =
+	&hdspe_shim_work_head;
+
+bool queue_work(struct workqueue_struct *wq, struct work_struct *w)
+{
+	if (w->pending)
+		return false;
+	w->pending = true;
+	w->next = NULL;
+	*hdspe_shim_work_tail = w;
+	hdspe_shim_work_tail = &w->next;
+	return true;
+}
+
+static bool hdspe_shim_unqueue(struct work_struct *w)
+{
+	struct work_struct **p;
+
+	for (p = &hdspe_shim_work_head; *p; p = &(*p)->next) {
+		if (*p != w)
+			continue;
+		*p = w->next;
+		if (!*p)
+			hdspe_shim_work_tail = p;
+		w->pending = false;
+		return true;
+	}
+	return false;
+}
+
+bool cancel_work_sync(struct work_struct *w)
+{
+	return hdspe_shim_unqueue(w);
+}
+
+int hdspe_shim_run_work(void)
+{
+	struct work_struct *w;
+	int n = 0;
+
+	while ((w = hdspe_shim_work_head)) {
+		hdspe_shim_unqueue(w);
+		w->func(w);
+		n++;
+	}
+	return n;
+}
+
+/* --- ALSA controls --- */
+
+unsigned long hdspe_shim_notifies;
+int hdspe_shim_kctl_count;
+struct snd_kcontrol *hdspe_shim_kctl[HDSPE_TEST_MAX_KCTL];
+
+struct snd_kcontrol *snd_ctl_new1(const struct snd_kcontrol_new *n,
+				  void *private_data)
+{
+	unsigned int i, count = n->count ? n->count : 1;
+	struct snd_kcontrol *k = calloc(1, sizeof(*k) + count * sizeof(k->vd[0]));
+
+	if (!k)
+		return NULL;
+	k->id.iface = n->iface;
+	k->id.device = n->device;
+	k->id.subdevice = n->subdevice;
+	k->id.index = n->index;
+	snprintf((char *)k->id.name, sizeof(k->id.name), "%s", n->name);
+	k->count = count;
+	k->info = n->info;
+	k->get = n->get;
+	k->put = n->put;
+	k->private_value = n->private_value;
+	k->private_data = private_data;
+	for (i = 0; i < count; i++)
+		k->vd[i].access = n->access ? n->access :
+			SNDRV_CTL_ELEM_ACCESS_READWRITE;
+	return k;
+}
+
+int snd_ctl_add(struct snd_card *card, struct snd_kcontrol *k)
+{
+	if (hdspe_shim_kctl_count >= HDSPE_TEST_MAX_KCTL) {
+		free(k);
+		return -ENOMEM;
+	}
+	/* One numid per element, as by the ALSA core. */
+	k->id.numid = hdspe_shim_kctl_count > 0
+		? hdspe_shim_kctl[hdspe_shim_kctl_count - 1]->id.numid +
+		  hdspe_shim_kctl[hdspe_shim_kctl_count - 1]->count
+		: 1;
+	hdspe_shim_kctl[hdspe_shim_kctl_count++] = k;
+	return 0;
+}
+
+struct snd_kcontrol *snd_ctl_find_numid(struct snd_card *card,
+					unsigned int numid)
+{
+	int i;
+
+	for (i = 0; i < hdspe_shim_kctl_count; i++) {
+		struct snd_kcontrol *k = hdspe_shim_kctl[i];
+		if (numid >= k->id.numid && numid < k->id.numid + k->count)
+			return k;
+	}
+	return NULL;
+}
+
+struct snd_kcontrol *hdspe_shim_find_kctl(const char *name)
+{
+	int i;
+
+	for (i = 0; i < hdspe_shim_kctl_count; i++)
+		if (!strcmp((const char *)hdspe_shim_kctl[i]->id.name, name))
+			return hdspe_shim_kctl[i];
+	return NULL;
+}
+
+void hdspe_shim_free_kctls(void)
+{
+	while (hdspe_shim_kctl_count > 0)
+		free(hdspe_shim_kctl[--hdspe_shim_kctl_count]);
+}
+
+/* --- Control device ---
+ * snd_ctl_ioctl() and snd_ctl_read() of the ALSA core, for one control
+ * file: the element list, info, read and write, and value change events.
+ * Events for an element already queued are merged, as by the core. */
+
+#define HDSPE_SHIM_EVENTS	256
+
+static bool hdspe_shim_ctl_subscribed;
+static struct snd_ctl_event hdspe_shim_events[HDSPE_SHIM_EVENTS];
+static int hdspe_shim_event_count;
+
+void snd_ctl_notify(struct snd_card *card, unsigned int mask,
+		    struct snd_ctl_elem_id *id)
+{
+	struct snd_ctl_event *ev;
+	int i;
+
+	hdspe_shim_notifies++;
+	if (!hdspe_shim_ctl_subscribed)
+		return;
+	for (i = 0; i < hdspe_shim_event_count; i++) {
+		ev = &hdspe_shim_events[i];
+		if (ev->data.elem.id.numid == id->numid) {
+			ev->data.elem.mask |= mask;
+			return;
+		}
+	}
+	if (hdspe_shim_event_count >= HDSPE_SHIM_EVENTS) {
+		hdspe_shim_msg((struct device *)0, "warn",
+			       "control event queue full\n");
+		return;
+	}
+	ev = &hdspe_shim_events[hdspe_shim_event_count++];
+	memset(ev, 0, sizeof(*ev));
+	ev->type = SNDRV_CTL_EVENT_ELEM;
+	ev->data.elem.mask = mask;
+	ev->data.elem.id = *id;
+}
+
+static int hdspe_shim_ctl_list(struct snd_ctl_elem_list *list)
+{
+	unsigned int i, n = 0;
+	int k;
+
+	list->used = 0;
+	for (k = 0; k < hdspe_shim_kctl_count; k++)
+		for (i = 0; i < hdspe_shim_kctl[k]->count; i++, n++)
+			if (n >= list->offset && list->used < list->space)
+				snd_ctl_build_ioff(&list->pids[list->used++],
+						   hdspe_shim_kctl[k], i);
+	list->count = n;
+	return 0;
+}
+
+/* By numid, or if 0 by interface, name and index, as snd_ctl_find_id(). */
+static struct snd_kcontrol *hdspe_shim_ctl_find(struct snd_ctl_elem_id *id,
+						unsigned int *ioff)
+{
+	struct snd_kcontrol *k;
+	int i;
+
+	if (id->numid) {
+		k = snd_ctl_find_numid(NULL, id->numid);
+		if (k)
+			*ioff = id->numid - k->id.numid;
+		return k;
+	}
+	for (i = 0; i < hdspe_shim_kctl_count; i++) {
+		k = hdspe_shim_kctl[i];
+		if (k->id.iface == id->iface &&
+		    !strcmp((const char *)k->id.name, (const char *)id->name) &&
+		    id->index >= k->id.index &&
+		    id->index < k->id.index + k->count) {
+			*ioff = id->index - k->id.index;
+			return k;
+		}
+	}
+	return NULL;
+}
+
+static int hdspe_shim_ctl_info(struct snd_ctl_elem_info *info)
+{
+	unsigned int ioff;
+	struct snd_kcontrol *k = hdspe_shim_ctl_find(&info->id, &ioff);
+	int err;
+
+	if (!k)
+		return -ENOENT;
+	err = k->info(k, info);
+	if (err < 0)
+		return err;
+	snd_ctl_build_ioff(&info->id, k, ioff);
+	info->access = k->vd[ioff].access;
+	return 0;
+}
+
+static int hdspe_shim_ctl_read(struct snd_ctl_elem_value *value)
+{
+	unsigned int ioff;
+	struct snd_kcontrol *k = hdspe_shim_ctl_find(&value->id, &ioff);
+
+	if (!k)
+		return -ENOENT;
+	if (!(k->vd[ioff].access & SNDRV_CTL_ELEM_ACCESS_READ) || !k->get)
+		return -EPERM;
+	snd_ctl_build_ioff(&value->id, k, ioff);
+	return k->get(k, value);
+}
+
+static int hdspe_shim_ctl_write(struct snd_ctl_elem_value *value)
+{
+	unsigned int ioff;
+	struct snd_kcontrol *k = hdspe_shim_ctl_find(&value->id, &ioff);
+	int changed;
+
+	if (!k)
+		return -ENOENT;
+	if (!(k->vd[ioff].access & SNDRV_CTL_ELEM_ACCESS_WRITE) || !k->put)
+		return -EPERM;
+	snd_ctl_build_ioff(&value->id, k, ioff);
+	changed = k->put(k, value);
+	if (changed < 0)
+		return changed;
+	if (changed > 0)
+		snd_ctl_notify(NULL, SNDRV_CTL_EVENT_MASK_VALUE, &value->id);
+	return 0;
+}
+
+int hdspe_test_dev_ctl_ioctl(unsigned int cmd, void *arg)
+{
+	int *subscribe = arg;
+
+	switch (cmd) {
+	case SNDRV_CTL_IOCTL_ELEM_LIST:
+		return hdspe_shim_ctl_list(arg);
+	case SNDRV_CTL_IOCTL_ELEM_INFO:
+		return hdspe_shim_ctl_info(arg);
+	case SNDRV_CTL_IOCTL_ELEM_READ:
+		return hdspe_shim_ctl_read(arg);
+	case SNDRV_CTL_IOCTL_ELEM_WRITE:
+		return hdspe_shim_ctl_write(arg);
+	case SNDRV_CTL_IOCTL_SUBSCRIBE_EVENTS:
+		if (*subscribe < 0) {
+			*subscribe = hdspe_shim_ctl_subscribed;
+			return 0;
+		}
+		hdspe_shim_ctl_subscribed = *subscribe > 0;
+		if (!hdspe_shim_ctl_subscribed)
+			hdspe_shim_event_count = 0;
+		return 0;
+	}
+	return -ENOTTY;
+}
+
+long hdspe_test_dev_ctl_read(void *buf, unsigned long count)
+{
+	unsigned long n = min_t(unsigned long, count / sizeof(struct snd_ctl_event),
+				hdspe_shim_event_count);
+
+	if (count < sizeof(struct snd_ctl_event))
+		return -EINVAL;
+	if (n == 0)
+		return -EAGAIN;
+	memcpy(buf, hdspe_shim_events, n * sizeof(struct snd_ctl_event));
+	hdspe_shim_event_count -= n;
+	memmove(hdspe_shim_events, hdspe_shim_events + n,
+		hdspe_shim_event_count * sizeof(struct snd_ctl_event));
+	return n * sizeof(struct snd_ctl_event);
+}
+
+int hdspe_test_dev_ctl_pending(void)
+{
+	return hdspe_shim_event_count;
+}
+
+void hdspe_shim_free_ctl(void)
+{
+	hdspe_shim_ctl_subscribed = false;
+	hdspe_shim_event_count = 0;
+}
+
+int snd_ctl_enum_info(struct snd_ctl_elem_info *info, unsigned int channels,
+		      unsigned int items, const char *const names[])
+{
+	info->type = SNDRV_CTL_ELEM_TYPE_ENUMERATED;
+	info->count = channels;
+	info->value.enumerated.items = items;
+	if (!items)
+		return 0;
+	if (info->value.enumerated.item >= items)
+		info->value.enumerated.item = items - 1;
+	snprintf(info->value.enumerated.name,
+		 sizeof(info->value.enumerated.name), "%s",
+		 names[info->value.enumerated.item]);
+	return 0;
+}
+
+int snd_ctl_boolean_mono_info(struct snd_kcontrol *k,
+			      struct snd_ctl_elem_info *info)
+{
+	info->type = SNDRV_CTL_ELEM_TYPE_BOOLEAN;
+	info->count = 1;
+	info->value.integer.min = 0;
+	info->value.integer.max = 1;
+	return 0;
+}
+
+/* --- ALSA info (proc) files --- */
+
+/* As in the kernel, len is the buffer size and size the number of bytes
+ * in it. The kernel grows the buffer, here output stops when it is full. */
+void snd_iprintf(struct snd_info_buffer *buffer, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	if (buffer->stop || buffer->error)
+		return;
+	va_start(ap, fmt);
+	n = vsnprintf(buffer->buffer + buffer->curr,
+		      buffer->len - buffer->curr, fmt, ap);
+	va_end(ap);
+	if (n < 0 || (unsigned int)n >= buffer->len - buffer->curr) {
+		buffer->stop = 1;
+		return;
+	}
+	buffer->curr += n;
+	buffer->size += n;
+}
+
+/* As in the kernel: the rest of a line that does not fit is dropped. */
+int snd_info_get_line(struct snd_info_buffer *buffer, char *line, int len)
+{
+	int c;
+
+	if (len <= 0 || buffer->stop || buffer->error)
+		return 1;
+	while (!buffer->stop) {
+		c = buffer->buffer[buffer->curr++];
+		if (buffer->curr >= buffer->size)
+			buffer->stop = 1;
+		if (c == '\n')
+			break;
+		if (len > 1) {
+			len--;
+			*line++ = c;
+		}
+	}
+	*line = '\0';
+	return 0;
+}
+
+/* Proc files made with snd_card_rw_proc_new() have read / write methods
+ * on an snd_info_buffer, those made with proc_create_data() proc_ops. */
+static struct hdspe_shim_proc {
+	const char *name;
+	struct snd_info_entry entry;
+	void (*read)(struct snd_info_entry *, struct snd_info_buffer *);
+	void (*write)(struct snd_info_entry *, struct snd_info_buffer *);
+	const struct proc_ops *ops;
+} hdspe_shim_proc[HDSPE_TEST_MAX_PROC];
+static int hdspe_shim_proc_count;
+
+int snd_card_rw_proc_new(struct snd_card *card, const char *name,
+	void *private_data,
+	void (*read)(struct snd_info_entry *, struct snd_info_buffer *),
+	void (*write)(struct snd_info_entry *, struct snd_info_buffer *))
+{
+	struct hdspe_shim_proc *p;
+
+	if (hdspe_shim_proc_count >= HDSPE_TEST_MAX_PROC)
+		return -ENOMEM;
+	p = &hdspe_shim_proc[hdspe_shim_proc_count++];
+	memset(p, 0, sizeof(*p));
+	p->name = name;
+	p->entry.name = name;
+	p->entry.private_data = private_data;
+	p->read = read;
+	p->write = write;
+	return 0;
+}
+
+int snd_card_ro_proc_new(struct snd_card *card, const char *name,
+	void *private_data,
+	void (*read)(struct snd_info_entry *, struct snd_info_buffer *))
+{
+	return snd_card_rw_proc_new(card, name, private_data, read, NULL);
+}
+
+struct proc_dir_entry *proc_create_data(const char *name,
+	unsigned short mode, struct proc_dir_entry *parent,
+	const struct proc_ops *ops, void *data)
+{
+	struct hdspe_shim_proc *p;
+
+	if (!parent || hdspe_shim_proc_count >= HDSPE_TEST_MAX_PROC)
+		return NULL;
+	p = &hdspe_shim_proc[hdspe_shim_proc_count++];
+	memset(p, 0, sizeof(*p));
+	p->name = name;
+	p->entry.name = name;
+	p->entry.private_data = data;
+	p->ops = ops;
+	return (struct proc_dir_entry *)p;
+}
+
+static struct hdspe_shim_proc *hdspe_shim_find_proc(const char *name)
+{
+	int i;
+
+	for (i = 0; i < hdspe_shim_proc_count; i++)
+		if (!strcmp(hdspe_shim_proc[i].name, name))
+			return &hdspe_shim_proc[i];
+	return NULL;
+}
+
+/* open(), read() in chunks the size of a page until EOF, close(). */
+static int hdspe_shim_proc_ops_read(struct hdspe_shim_proc *p, char *buf,
+				    int size)
+{
+	struct inode inode = { .i_private = p->entry.private_data };
+	struct file file = { .f_mode = FMODE_READ };
+	loff_t pos = 0;
+	ssize_t n;
+	int len = 0;
+
+	if (!p->ops->proc_read)
+		return -ENOENT;
+	n = p->ops->proc_open(&inode, &file);
+	if (n < 0)
+		return n;
+	while (len < size - 1) {
+		n = p->ops->proc_read(&file, buf + len,
+				      min(size - 1 - len, 4096), &pos);
+		if (n <= 0)
+			break;
+		len += n;
+	}
+	buf[len] = '\0';
+	p->ops->proc_release(&inode, &file);
+	return n < 0 ? n : len;
+}
+
+/* open(), one write() of the whole text, close(). */
+static int hdspe_shim_proc_ops_write(struct hdspe_shim_proc *p,
+				     const char *text)
+{
+	struct inode inode = { .i_private = p->entry.private_data };
+	struct file file = { .f_mode = FMODE_WRITE };
+	loff_t pos = 0;
+	ssize_t n;
+
+	if (!p->ops->proc_write)
+		return -ENOENT;
+	n = p->ops->proc_open(&inode, &file);
+	if (n < 0)
+		return n;
+	n = p->ops->proc_write(&file, text, strlen(text), &pos);
+	p->ops->proc_release(&inode, &file);
+	return n;
+}
+
+int hdspe_shim_proc_read(const char *name, char *buf, int size)
+{
+	struct hdspe_shim_proc *p = hdspe_shim_find_proc(name);
+	struct snd_info_buffer b = { .buffer = buf, .len = size };
+
+	if (p && p->ops)
+		return hdspe_shim_proc_ops_read(p, buf, size);
+	if (!p || !p->read)
+		return -ENOENT;
+	p->read(&p->entry, &b);
+	buf[b.size] = '\0';
+	return b.size;
+}
+
+/* Like a write() followed by close(). For snd_info files, the text is
+ * handed to the write method in one buffer, holding at most the 16 KiB
+ * the kernel accepts. As there, size is the number of bytes written, len
+ * the buffer size. proc_ops files get all of it. */
+int hdspe_shim_proc_write(const char *name, const char *text)
+{
+	struct hdspe_shim_proc *p = hdspe_shim_find_proc(name);
+	static char buf[16 * 1024];
+	struct snd_info_buffer b = { .buffer = buf };
+
+	if (p && p->ops)
+		return hdspe_shim_proc_ops_write(p, text);
+	if (!p || !p->write)
+		return -ENOENT;
+	b.size = min(strlen(text), sizeof(buf));
+	b.len = sizeof(buf);
+	memcpy(buf, text, b.size);
+	if (b.size > 0)
+		p->write(&p->entry, &b);
+	return b.size;
+}
+
+/* --- seq_file: as in the kernel, start() / show() / next() / stop(), but
+ * one record per step, each formatted into m->buf and copied out before
+ * the next. --- */
+
+void seq_printf(struct seq_file *m, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	if (m->overflow)
+		return;
+	va_start(ap, fmt);
+	n = vsnprintf(m->buf + m->count, sizeof(m->buf) - m->count, fmt, ap);
+	va_end(ap);
+	if (n < 0 || (size_t)n >= sizeof(m->buf) - m->count) {
+		m->overflow = true;
+		snd_BUG();
+		return;
+	}
+	m->count += n;
+}
+
+void seq_puts(struct seq_file *m, const char *s)
+{
+	seq_printf(m, "%s", s);
+}
+
+ssize_t seq_read(struct file *file, char __user *buf, size_t size,
+		 loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+	size_t copied = 0, n;
+	void *v;
+
+	while (copied < size) {
+		if (m->from < m->count) {
+			n = min(m->count - m->from, size - copied);
+			memcpy(buf + copied, m->buf + m->from, n);
+			m->from += n;
+			copied += n;
+			continue;
+		}
+		m->count = m->from = 0;
+		v = m->op->start(m, &m->index);
+		if (v) {
+			m->op->show(m, v);
+			v = m->op->next(m, v, &m->index);
+		}
+		m->op->stop(m, v);
+		if (m->count == 0)
+			break;
+	}
+	*ppos += copied;
+	return copied;
+}
+
+loff_t seq_lseek(struct file *file, loff_t offset, int whence)
+{
+	return -EINVAL;
+}
+
+void *__seq_open_private(struct file *file, const struct seq_operations *ops,
+			 int psize)
+{
+	struct seq_file *m = calloc(1, sizeof(*m));
+	void *private = calloc(1, psize);
+
+	if (!m || !private) {
+		free(m);
+		free(private);
+		return NULL;
+	}
+	m->op = ops;
+	m->private = private;
+	file->private_data = m;
+	return private;
+}
+
+int seq_release_private(struct inode *inode, struct file *file)
+{
+	struct seq_file *m = file->private_data;
+
+	free(m->private);
+	free(m);
+	return 0;
+}
+
+void hdspe_shim_free_procs(void)
+{
+	hdspe_shim_proc_count = 0;
+}
+
+/* --- PCM --- */
+
+struct task_struct hdspe_shim_current = { .pid = 1000 };
+
+static struct snd_pcm *hdspe_shim_pcm[HDSPE_TEST_MAX_PCM];
+static int hdspe_shim_pcm_count;
+
+int snd_pcm_new(struct snd_card *card, const char *id, int device,
+		int playback_count, int capture_count, struct snd_pcm **rpcm)
+{
+	int count[2] = { playback_count, capture_count };
+	struct snd_pcm_substream **link;
+	struct snd_pcm *pcm;
+	int dir, i;
+
+	if (hdspe_shim_pcm_count >= HDSPE_TEST_MAX_PCM)
+		return -ENOMEM;
+	pcm = calloc(1, sizeof(*pcm));
+	if (!pcm)
+		return -ENOMEM;
+	pcm->card = card;
+	pcm->device = device;
+	for (dir = 0; dir < 2; dir++) {
+		pcm->streams[dir].stream = dir;
+		pcm->streams[dir].pcm = pcm;
+		pcm->streams[dir].substream_count = count[dir];
+		link = &pcm->streams[dir].substream;
+		for (i = 0; i < count[dir]; i++) {
+			*link = calloc(1, sizeof(**link));
+			(*link)->pcm = pcm;
+			(*link)->pstr = &pcm->streams[dir];
+			(*link)->number = i;
+			(*link)->stream = dir;
+			link = &(*link)->next;
+		}
+	}
+	hdspe_shim_pcm[hdspe_shim_pcm_count++] = pcm;
+	*rpcm = pcm;
+	return 0;
+}
+
+void snd_pcm_set_ops(struct snd_pcm *pcm, int direction,
+		     const struct snd_pcm_ops *ops)
+{
+	struct snd_pcm_substream *s;
+
+	for (s = pcm->streams[direction].substream; s; s = s->next)
+		s->ops = ops;
+}
+
+void snd_pcm_lib_preallocate_pages_for_all(struct snd_pcm *pcm, int type,
+					   void *data, size_t size, size_t max)
+{
+	struct snd_pcm_substream *s;
+	int dir;
+
+	for (dir = 0; dir < 2; dir++)
+		for (s = pcm->streams[dir].substream; s; s = s->next) {
+			s->dma_buffer.area = calloc(1, size);
+			s->dma_buffer.addr = (uintptr_t)s->dma_buffer.area;
+			s->dma_buffer.bytes = s->dma_buffer.area ? size : 0;
+		}
+}
+
+void snd_pcm_set_runtime_buffer(struct snd_pcm_substream *substream,
+				struct snd_dma_buffer *bufp)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+
+	runtime->dma_buffer_p = bufp;
+	runtime->dma_area = bufp ? bufp->area : NULL;
+	runtime->dma_bytes = bufp ? bufp->bytes : 0;
+}
+
+int snd_pcm_lib_malloc_pages(struct snd_pcm_substream *substream, size_t size)
+{
+	if (!substream->dma_buffer.area || size > substream->dma_buffer.bytes)
+		return -ENOMEM;
+	snd_pcm_set_runtime_buffer(substream, &substream->dma_buffer);
+	substream->runtime->dma_bytes = size;
+	return 0;
+}
+
+int snd_pcm_lib_free_pages(struct snd_pcm_substream *substream)
+{
+	snd_pcm_set_runtime_buffer(substream, NULL);
+	return 0;
+}
+
+dma_addr_t snd_pcm_sgbuf_get_addr(struct snd_pcm_substream *substream,
+				  unsigned int ofs)
+{
+	return substream->runtime->dma_buffer_p->addr + ofs;
+}
+
+int snd_pcm_lib_ioctl(struct snd_pcm_substream *substream,
+		      unsigned int cmd, void *arg)
+{
+	return 0;
+}
+
+void snd_pcm_period_elapsed(struct snd_pcm_substream *substream)
+{
+	substream->periods_elapsed++;
+}
+
+void snd_dma_buffer_sync(struct snd_dma_buffer *dmab,
+			 enum snd_dma_sync_mode mode)
+{
+}
+
+int snd_interval_refine(struct snd_interval *i, const struct snd_interval *v)
+{
+	struct snd_interval old = *i;
+
+	if (i->empty)
+		return -EINVAL;
+	if (v->min > i->min) {
+		i->min = v->min;
+		i->openmin = v->openmin;
+	}
+	if (v->max < i->max) {
+		i->max = v->max;
+		i->openmax = v->openmax;
+	}
+	if (i->min > i->max) {
+		i->empty = 1;
+		return -EINVAL;
+	}
+	return memcmp(&old, i, sizeof(old)) != 0;
+}
+
+int snd_interval_list(struct snd_interval *i, unsigned int count,
+		      const unsigned int *list, unsigned int mask)
+{
+	struct snd_interval v = { .min = UINT32_MAX, .max = 0 };
+	unsigned int k;
+
+	for (k = 0; k < count; k++) {
+		if (mask && !(mask & (1U << k)))
+			continue;
+		if (list[k] < i->min || list[k] > i->max)
+			continue;
+		v.min = min(v.min, list[k]);
+		v.max = max(v.max, list[k]);
+	}
+	if (v.min > v.max) {
+		i->empty = 1;
+		return -EINVAL;
+	}
+	return snd_interval_refine(i, &v);
+}
+
+void _snd_pcm_hw_param_setempty(struct snd_pcm_hw_params *params, int var)
+{
+	hw_param_interval(params, var)->empty = 1;
+}
+
+#define HDSPE_SHIM_IVAL(var)	((var) - SNDRV_PCM_HW_PARAM_FIRST_INTERVAL)
+
+int snd_pcm_hw_constraint_minmax(struct snd_pcm_runtime *runtime, int var,
+				 unsigned int min, unsigned int max)
+{
+	struct snd_interval v = { .min = min, .max = max };
+
+	return snd_interval_refine(&runtime->hw_ival[HDSPE_SHIM_IVAL(var)], &v);
+}
+
+int snd_pcm_hw_constraint_single(struct snd_pcm_runtime *runtime, int var,
+				 unsigned int val)
+{
+	return snd_pcm_hw_constraint_minmax(runtime, var, val, val);
+}
+
+int snd_pcm_hw_constraint_step(struct snd_pcm_runtime *runtime,
+			       unsigned int cond, int var, unsigned long step)
+{
+	runtime->hw_step[HDSPE_SHIM_IVAL(var)] = step;
+	return 0;
+}
+
+int snd_pcm_hw_constraint_pow2(struct snd_pcm_runtime *runtime,
+			       unsigned int cond, int var)
+{
+	runtime->hw_pow2[HDSPE_SHIM_IVAL(var)] = true;
+	return 0;
+}
+
+int snd_pcm_hw_constraint_msbits(struct snd_pcm_runtime *runtime,
+				 unsigned int cond, unsigned int width,
+				 unsigned int msbits)
+{
+	return 0;
+}
+
+int snd_pcm_hw_constraint_list(struct snd_pcm_runtime *runtime,
+			       unsigned int cond, int var,
+			       const struct snd_pcm_hw_constraint_list *l)
+{
+	return snd_interval_list(&runtime->hw_ival[HDSPE_SHIM_IVAL(var)],
+				 l->count, l->list, l->mask);
+}
+
+int snd_pcm_hw_rule_add(struct snd_pcm_runtime *runtime, unsigned int cond,
+			int var, snd_pcm_hw_rule_func_t func, void *private,
+			int dep, ...)
+{
+	return 0;
+}
+
+/* As snd_pcm_open_substream() and the open() system call. */
+int hdspe_shim_pcm_open(struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_runtime *runtime;
+	int var, err;
+
+	runtime = calloc(1, sizeof(*runtime));
+	if (!runtime)
+		return -ENOMEM;
+	runtime->status = calloc(1, sizeof(*runtime->status));
+	for (var = SNDRV_PCM_HW_PARAM_FIRST_INTERVAL;
+	     var <= SNDRV_PCM_HW_PARAM_LAST_INTERVAL; var++)
+		runtime->hw_ival[HDSPE_SHIM_IVAL(var)].max = UINT32_MAX;
+	substream->runtime = runtime;
+	substream->private_data = substream->pcm->private_data;
+	substream->periods_elapsed = 0;
+	err = substream->ops->open(substream);
+	if (err < 0)
+		hdspe_shim_pcm_close(substream);
+	return err;
+}
+
+void hdspe_shim_pcm_close(struct snd_pcm_substream *substream)
+{
+	if (substream->runtime && substream->ops->close)
+		substream->ops->close(substream);
+	if (substream->runtime) {
+		free(substream->runtime->status);
+		free(substream->runtime);
+	}
+	substream->runtime = NULL;
+}
+
+static bool hdspe_shim_pcm_param_ok(struct snd_pcm_runtime *runtime, int var,
+				    unsigned int val)
+{
+	int k = HDSPE_SHIM_IVAL(var);
+
+	return val >= runtime->hw_ival[k].min &&
+		val <= runtime->hw_ival[k].max &&
+		(!runtime->hw_step[k] || val % runtime->hw_step[k] == 0) &&
+		(!runtime->hw_pow2[k] || (val & (val - 1)) == 0);
+}
+
+/* As the HW_PARAMS ioctl with all parameters fixed: -EINVAL if the
+ * constraints set by the open callback reject one of them. */
+int hdspe_shim_pcm_hw_params(struct snd_pcm_substream *substream,
+			     unsigned int rate, unsigned int channels,
+			     unsigned int period_size,
+			     unsigned int buffer_size)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct snd_pcm_hw_params params;
+	struct snd_mask *format;
+	int err;
+
+	if (!hdspe_shim_pcm_param_ok(runtime, SNDRV_PCM_HW_PARAM_RATE, rate) ||
+	    !hdspe_shim_pcm_param_ok(runtime, SNDRV_PCM_HW_PARAM_PERIOD_SIZE,
+				     period_size) ||
+	    !hdspe_shim_pcm_param_ok(runtime, SNDRV_PCM_HW_PARAM_BUFFER_SIZE,
+				     buffer_size) ||
+	    !hdspe_shim_pcm_param_ok(runtime, SNDRV_PCM_HW_PARAM_PERIODS,
+				     buffer_size / period_size))
+		return -EINVAL;
+
+	memset(&params, 0, sizeof(params));
+	hw_param_interval(&params, SNDRV_PCM_HW_PARAM_RATE)->min = rate;
+	hw_param_interval(&params, SNDRV_PCM_HW_PARAM_RATE)->max = rate;
+	hw_param_interval(&params, SNDRV_PCM_HW_PARAM_CHANNELS)->min = channels;
+	hw_param_interval(&params, SNDRV_PCM_HW_PARAM_CHANNELS)->max = channels;
+	hw_param_interval(&params, SNDRV_PCM_HW_PARAM_PERIOD_SIZE)->min =
+		period_size;
+	hw_param_interval(&params, SNDRV_PCM_HW_PARAM_PERIOD_SIZE)->max =
+		period_size;
+	hw_param_interval(&params, SNDRV_PCM_HW_PARAM_BUFFER_SIZE)->min =
+		buffer_size;
+	hw_param_interval(&params, SNDRV_PCM_HW_PARAM_BUFFER_SIZE)->max =
+		buffer_size;
+	format = &params.masks[SNDRV_PCM_HW_PARAM_FORMAT -
+			       SNDRV_PCM_HW_PARAM_FIRST_MASK];
+	format->bits[0] = 1U << (__force int)SNDRV_PCM_FORMAT_S32_LE;
+
+	err = substream->ops->hw_params(substream, &params);
+	if (err < 0)
+		return err;
+	runtime->rate = rate;
+	runtime->channels = channels;
+	runtime->period_size = period_size;
+	runtime->buffer_size = buffer_size;
+	return 0;
+}
+
+void hdspe_shim_free_pcms(void)
+{
+	struct snd_pcm_substream *s, *next;
+	int i, dir;
+
+	for (i = 0; i < hdspe_shim_pcm_count; i++) {
+		for (dir = 0; dir < 2; dir++)
+			for (s = hdspe_shim_pcm[i]->streams[dir].substream; s;
+			     s = next) {
+				next = s->next;
+				hdspe_shim_pcm_close(s);
+				free(s->dma_buffer.area);
+				free(s);
+			}
+		free(hdspe_shim_pcm[i]);
+	}
+	hdspe_shim_pcm_count = 0;
+}
+
+/* --- hwdep --- */
+
+static struct snd_hwdep *hdspe_shim_hwdep;
+
+int snd_hwdep_new(struct snd_card *card, char *id, int device,
+		  struct snd_hwdep **rhwdep)
+{
+	struct snd_hwdep *hw;
+
+	if (hdspe_shim_hwdep)
+		return -EBUSY;
+	hw = calloc(1, sizeof(*hw));
+	if (!hw)
+		return -ENOMEM;
+	hw->card = card;
+	hw->device = device;
+	snprintf(hw->id, sizeof(hw->id), "%s", id);
+	*rhwdep = hdspe_shim_hwdep = hw;
+	return 0;
+}
+
+int hdspe_test_dev_hwdep_ioctl(unsigned int cmd, void *arg)
+{
+	struct file file = { };
+
+	if (!hdspe_shim_hwdep)
+		return -ENODEV;
+	return hdspe_shim_hwdep->ops.ioctl(hdspe_shim_hwdep, &file, cmd,
+					   (unsigned long)arg);
+}
+
+void hdspe_shim_free_hwdeps(void)
+{
+	free(hdspe_shim_hwdep);
+	hdspe_shim_hwdep = NULL;
+}
+
+/* --- Stand-in for hdspe_midi.c.
+ * Same effect on struct hdspe and the registers, no ALSA devices. --- */
+
+void hdspe_init_midi(struct hdspe *hdspe, int count, struct hdspe_midi *list)
+{
+	int i;
+
+	hdspe->midiPorts = count;
+	hdspe->midiInterruptEnableMask = 0;
+	hdspe->midiIRQPendingMask = 0;
+	for (i = 0; i < count; i++) {
+		hdspe->midi[i] = list[i];
+		hdspe->midi[i].hdspe = hdspe;
+		hdspe->midi[i].id = i;
+		hdspe->midiInterruptEnableMask |= hdspe->midi[i].ie;
+		hdspe->midiIRQPendingMask |= hdspe->midi[i].irq;
+	}
+}
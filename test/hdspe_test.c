@@ -0,0 +1,840 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file hdspe_test.c
+ * @brief Unit tests of the HDSPe card model, rate, mixer and TCO code, in
+ * user space on test cards. See hdspe_test.h. Build and run with
+ * 'make test' in the top level directory.
+ */
+
+#include "hdspe_test.h"
+#include "hdspe_route.h"
+
+int hdspe_test_failures;
+
+static const enum hdspe_io_type hdspe_test_models[] = {
+	HDSPE_MADI, HDSPE_AES, HDSPE_RAYDAT, HDSPE_AIO, HDSPE_AIO_PRO
+};
+
+static char hdspe_test_buf[64 * 1024];
+
+static int hdspe_test_ctl_put(const char *name, long v0, long v1, long v2)
+{
+	struct snd_kcontrol *k = hdspe_shim_find_kctl(name);
+	struct snd_ctl_elem_value v;
+
+	if (!k)
+		return -ENOENT;
+	memset(&v, 0, sizeof(v));
+	v.value.integer.value[0] = v0;
+	v.value.integer.value[1] = v1;
+	v.value.integer.value[2] = v2;
+	return k->put(k, &v);
+}
+
+static int hdspe_test_ctl_put_enum(const char *name, unsigned int item)
+{
+	struct snd_kcontrol *k = hdspe_shim_find_kctl(name);
+	struct snd_ctl_elem_value v;
+
+	if (!k)
+		return -ENOENT;
+	memset(&v, 0, sizeof(v));
+	v.value.enumerated.item[0] = item;
+	return k->put(k, &v);
+}
+
+/* Each model comes up with its tables, controls and proc files, without
+ * hitting a snd_BUG(). */
+static void test_models(void)
+{
+	unsigned int i;
+	int tco;
+
+	for (i = 0; i < ARRAY_SIZE(hdspe_test_models); i++) {
+		for (tco = 0; tco <= 1; tco++) {
+			unsigned long bugs = hdspe_shim_bugs;
+			struct hdspe_test_card *tc =
+				hdspe_test_card_new(hdspe_test_models[i], tco);
+			struct hdspe *hdspe;
+
+			CHECK(tc != NULL);
+			if (!tc)
+				continue;
+			hdspe = &tc->hdspe;
+			CHECK_EQ(!!hdspe->tco, tco);
+			CHECK(hdspe->card_name != NULL);
+			CHECK(hdspe->max_channels_in > 0);
+			CHECK(hdspe->max_channels_in <= HDSPE_MAX_CHANNELS);
+			CHECK(hdspe->max_channels_out > 0);
+			CHECK(hdspe->max_channels_out <= HDSPE_MAX_CHANNELS);
+			CHECK(hdspe_shim_find_kctl("Mixer") != NULL);
+			CHECK(hdspe_shim_find_kctl("Internal Frequency") != NULL);
+			CHECK_EQ(!!hdspe_shim_find_kctl("TCO Pull"), tco);
+
+			CHECK(hdspe_shim_proc_read("hdspe", hdspe_test_buf,
+				sizeof(hdspe_test_buf)) > 0);
+			CHECK(strstr(hdspe_test_buf, "RME HDSPe ") == hdspe_test_buf);
+			CHECK(hdspe_shim_proc_read("ports.in", hdspe_test_buf,
+				sizeof(hdspe_test_buf)) > 0);
+			CHECK(hdspe_shim_proc_read("ports.out", hdspe_test_buf,
+				sizeof(hdspe_test_buf)) > 0);
+			CHECK_EQ(hdspe_shim_proc_read("tco", hdspe_test_buf,
+				sizeof(hdspe_test_buf)) > 0, tco);
+
+			CHECK_EQ(hdspe_shim_bugs, bugs);
+			hdspe_test_card_free(tc);
+		}
+	}
+}
+
+/* The DMA <-> logical channel maps invert each other. */
+static void test_channel_maps(void)
+{
+	unsigned int i, s, ch;
+
+	for (i = 0; i < ARRAY_SIZE(hdspe_test_models); i++) {
+		struct hdspe_test_card *tc =
+			hdspe_test_card_new(hdspe_test_models[i], false);
+		struct hdspe *hdspe = &tc->hdspe;
+
+		for (s = 0; s < HDSPE_SPEED_COUNT; s++) {
+			const struct hdspe_channel_map *maps[2] = {
+				&hdspe->chmap_in[s], &hdspe->chmap_out[s]
+			};
+			int d;
+
+			for (d = 0; d < 2; d++) {
+				const struct hdspe_channel_map *m = maps[d];
+
+				CHECK_EQ(bitmap_weight(m->used,
+					HDSPE_MAX_CHANNELS), m->channels);
+				for (ch = 0; ch < HDSPE_MAX_CHANNELS; ch++) {
+					int l = m->logical[ch];
+
+					CHECK_EQ(l >= 0, test_bit(ch, m->used));
+					CHECK(l < m->channels);
+				}
+			}
+		}
+		hdspe_test_card_free(tc);
+	}
+}
+
+/* RayDAT, AIO and AIO Pro hardware period sizes. */
+static void test_period_interval(void)
+{
+	u32 p;
+
+	for (p = 32; p <= 8192; p++) {
+		u32 irq = hdspe_raio_interrupt_interval(p);
+
+		CHECK(irq >= 32 && irq <= 4096);
+		CHECK_EQ(irq & (irq - 1), 0);
+		CHECK(p % irq == 0 || irq == 32);
+	}
+	CHECK_EQ(hdspe_raio_interrupt_interval(96), 32);
+	CHECK_EQ(hdspe_raio_interrupt_interval(1024), 1024);
+	CHECK_EQ(hdspe_raio_interrupt_interval(1920), 128);
+	CHECK_EQ(hdspe_raio_interrupt_interval(3072), 1024);
+	CHECK_EQ(hdspe_raio_interrupt_interval(8192), 4096);
+	CHECK_EQ(hdspe_raio_interrupt_interval(48), 32);
+	CHECK_EQ(hdspe_raio_interrupt_interval(100), 32);
+}
+
+/* The PCM part of snd_hdspe_interrupt(): true if an ALSA period ended. */
+static bool hdspe_test_pcm_irq(struct hdspe *hdspe)
+{
+	hdspe->reg.status0 = hdspe_read_status0_nocache(hdspe);
+	if (!hdspe->reg.status0.common.IRQ)
+		return false;
+	hdspe_update_frame_count(hdspe);
+	return hdspe_pcm_period_elapsed(hdspe);
+}
+
+/* ALSA period boundaries reported by hdspe_pcm_period_elapsed(), with
+ * period interrupts from the emulated buffer pointer over 8 wraps of the
+ * buffer, each serviced with a random delay of less than a hardware
+ * period. Returns the reported periods, and the minimum and maximum
+ * number of frames boundaries were reported late. */
+static unsigned int hdspe_test_period_jitter(struct hdspe_test_card *tc,
+					     u32 pcm_frames, u64 *late_min,
+					     u64 *late_max)
+{
+	struct hdspe *hdspe = &tc->hdspe;
+	struct snd_pcm_substream *ss =
+		hdspe->pcm->streams[SNDRV_PCM_STREAM_PLAYBACK].substream;
+	unsigned int seed = pcm_frames, reported = 0;
+	u64 frames, boundary = pcm_frames, late;
+	u32 irq;
+
+	*late_min = U64_MAX;
+	*late_max = 0;
+	if (hdspe_shim_pcm_open(ss) < 0)
+		return 0;
+	if (hdspe_shim_pcm_hw_params(ss, 48000, 2, pcm_frames,
+				     HDSPE_TEST_BUFFER_FRAMES) < 0)
+		goto out;
+	irq = hdspe->period_size;
+
+	hdspe_test_set_buf_ptr(tc, 0, false);
+	CHECK_EQ(ss->ops->trigger(ss, SNDRV_PCM_TRIGGER_START), 0);
+	for (frames = irq; frames <= 8 * HDSPE_TEST_BUFFER_FRAMES;
+	     frames += irq) {
+		u32 delay = (rand_r(&seed) % (irq / 16)) * 16;
+
+		hdspe_test_set_buf_ptr(tc, frames + delay, true);
+		if (!hdspe_test_pcm_irq(hdspe)) {
+			CHECK(frames < boundary);
+			continue;
+		}
+		/* Never early, and none skipped. */
+		CHECK_EQ(hdspe->frame_count, frames);
+		CHECK(frames >= boundary);
+		late = frames - boundary;
+		*late_min = min(*late_min, late);
+		*late_max = max(*late_max, late);
+		boundary += pcm_frames;
+		CHECK(boundary > frames);
+		reported++;
+	}
+	CHECK_EQ(hdspe->pcm_period_late_max, *late_max);
+	CHECK_EQ(ss->ops->trigger(ss, SNDRV_PCM_TRIGGER_STOP), 0);
+	ss->ops->hw_free(ss);
+out:
+	hdspe_shim_pcm_close(ss);
+	return reported;
+}
+
+/* Any period size on RayDAT, AIO and AIO Pro: video frames (1920, 1600
+ * and 800 frames at 48 kHz), 1 ms (48 frames). Multiples of 32 frames
+ * end on a hardware period interrupt, others are reported less than 32
+ * frames late. Powers of two only on MADI and AES. */
+static void test_period_jitter(void)
+{
+	static const u32 sizes[] = {
+		32, 48, 64, 100, 800, 1000, 1024, 1600, 1920, 3000, 8192
+	};
+	struct hdspe_test_card *tc;
+	struct snd_pcm_substream *ss;
+	u64 late_min, late_max;
+	unsigned int i, n;
+
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		u32 p = sizes[i];
+
+		tc = hdspe_test_card_new(HDSPE_RAYDAT, false);
+		n = hdspe_test_period_jitter(tc, p, &late_min, &late_max);
+		CHECK_EQ(n, 8 * HDSPE_TEST_BUFFER_FRAMES / p);
+		CHECK_EQ(tc->hdspe.pcm_period_size, p);
+		CHECK_EQ(tc->hdspe.period_size,
+			 hdspe_raio_interrupt_interval(p));
+		if (p % 32 == 0) {
+			CHECK_EQ(late_max, 0);
+		} else {
+			CHECK(late_max < 32);
+			CHECK(late_max > late_min);
+		}
+		if (hdspe_shim_verbose)
+			printf("  %4u frames: %u periods, %llu..%llu frames late\n",
+			       p, n, late_min, late_max);
+		hdspe_test_card_free(tc);
+	}
+
+	tc = hdspe_test_card_new(HDSPE_MADI, false);
+	ss = tc->hdspe.pcm->streams[SNDRV_PCM_STREAM_PLAYBACK].substream;
+	CHECK_EQ(hdspe_shim_pcm_open(ss), 0);
+	CHECK_EQ(hdspe_shim_pcm_hw_params(ss, 48000, 2, 1920, 3840), -EINVAL);
+	CHECK_EQ(hdspe_shim_pcm_hw_params(ss, 48000, 2, 48, 96), -EINVAL);
+	CHECK_EQ(hdspe_shim_pcm_hw_params(ss, 48000, 2, 1024, 2048), 0);
+	CHECK_EQ(tc->hdspe.period_size, 1024);
+	hdspe_test_card_free(tc);
+}
+
+/* Frequency classes, speed modes and the DDS register. */
+static void test_rates(void)
+{
+	struct hdspe_test_card *tc = hdspe_test_card_new(HDSPE_AIO, false);
+	struct hdspe *hdspe = &tc->hdspe;
+	u32 ddsmin, ddsmax, dds;
+	union hdspe_control_reg control;
+
+	CHECK_EQ(hdspe_sample_rate_freq(32000), HDSPE_FREQ_32KHZ);
+	CHECK_EQ(hdspe_sample_rate_freq(38049), HDSPE_FREQ_32KHZ);
+	CHECK_EQ(hdspe_sample_rate_freq(38050), HDSPE_FREQ_44_1KHZ);
+	CHECK_EQ(hdspe_sample_rate_freq(46050), HDSPE_FREQ_48KHZ);
+	CHECK_EQ(hdspe_sample_rate_freq(55999), HDSPE_FREQ_48KHZ);
+	CHECK_EQ(hdspe_sample_rate_freq(56000), HDSPE_FREQ_64KHZ);
+	CHECK_EQ(hdspe_sample_rate_freq(88200), HDSPE_FREQ_88_2KHZ);
+	CHECK_EQ(hdspe_sample_rate_freq(112000), HDSPE_FREQ_128KHZ);
+	CHECK_EQ(hdspe_sample_rate_freq(192000), HDSPE_FREQ_192KHZ);
+	CHECK_EQ(hdspe_speed_adapt(HDSPE_FREQ_48KHZ, HDSPE_SPEED_QUAD),
+		 HDSPE_FREQ_192KHZ);
+	CHECK_EQ(hdspe_speed_adapt(HDSPE_FREQ_176_4KHZ, HDSPE_SPEED_SINGLE),
+		 HDSPE_FREQ_44_1KHZ);
+	CHECK_EQ(hdspe_speed_adapt(HDSPE_FREQ_NO_LOCK, HDSPE_SPEED_DOUBLE),
+		 HDSPE_FREQ_NO_LOCK);
+	CHECK_EQ(hdspe_nominal_sample_rate(47990), 48000);
+	CHECK_EQ(hdspe_nominal_sample_rate(100000), 96000);
+
+	/* Initial state of hdspe_init(): 44.1 kHz, neutral pitch. */
+	CHECK_EQ(hdspe_internal_freq(hdspe), HDSPE_FREQ_44_1KHZ);
+	CHECK_EQ(hdspe_internal_pitch(hdspe), 1000000);
+
+	/* Double speed: control register, DDS and channel map follow. */
+	CHECK_EQ(hdspe_set_sample_rate(hdspe, 96000), 1);
+	CHECK_EQ(hdspe_speed_mode(hdspe), HDSPE_SPEED_DOUBLE);
+	CHECK_EQ(hdspe_speed_factor(hdspe), 2);
+	CHECK_EQ(hdspe_internal_freq(hdspe), HDSPE_FREQ_96KHZ);
+	control.raw = *hdspe_test_reg(hdspe, false, HDSPE_WR_CONTROL);
+	CHECK_EQ(control.common.ds, 1);
+	CHECK_EQ(control.common.qs, 0);
+	CHECK_EQ(control.common.freq, HDSPE_FREQ_48KHZ);
+	CHECK_EQ(hdspe->max_channels_out, hdspe->t.ds_out_channels);
+	CHECK_EQ(hdspe->channel_map_speed, HDSPE_SPEED_DOUBLE);
+	CHECK_EQ(hdspe_set_sample_rate(hdspe, 96000), 0);
+
+	/* The card runs on the internal clock: it reports the DDS value
+	 * written as its PLL frequency. */
+	dds = *hdspe_test_reg(hdspe, false, HDSPE_WR_PLL_FREQ);
+	CHECK_EQ(dds, hdspe_get_dds(hdspe));
+	*hdspe_test_reg(hdspe, true, HDSPE_RD_PLL_FREQ) = dds;
+	CHECK(abs((int)hdspe_read_system_sample_rate(hdspe) - 96000) <= 1);
+	CHECK(abs((int)hdspe_read_system_pitch(hdspe) - 1000000) <= 1);
+
+	/* DDS range: 27 kHz ... 51.75 kHz single speed. */
+	hdspe_dds_range(hdspe, &ddsmin, &ddsmax);
+	CHECK(ddsmin < dds && dds < ddsmax);
+	CHECK_EQ(hdspe_write_dds(hdspe, ddsmin - 1), -EINVAL);
+	CHECK_EQ(hdspe_write_dds(hdspe, ddsmax + 1), -EINVAL);
+	CHECK_EQ(hdspe_write_dds(hdspe, dds), 0);
+	CHECK_EQ(hdspe_write_dds(hdspe, dds + 1), 1);
+	CHECK_EQ(*hdspe_test_reg(hdspe, false, HDSPE_WR_PLL_FREQ), dds + 1);
+
+	/* A pitch of +1000 ppm */
+	CHECK_EQ(hdspe_set_sample_rate(hdspe, 48000), 1);
+	CHECK_EQ(hdspe_write_internal_pitch(hdspe, 1001000), 1);
+	CHECK(abs((int)hdspe_internal_pitch(hdspe) - 1001000) <= 1);
+
+	/* Quad speed */
+	CHECK_EQ(hdspe_set_sample_rate(hdspe, 176400), 1);
+	CHECK_EQ(hdspe_internal_freq(hdspe), HDSPE_FREQ_176_4KHZ);
+	CHECK_EQ(hdspe->max_channels_out, hdspe->t.qs_out_channels);
+
+	hdspe_test_card_free(tc);
+}
+
+/* DDS register and PLL frequency conversions, for each card model and
+ * standard sample rate, on the internal clock. */
+static void test_dds(void)
+{
+	static const enum hdspe_io_type models[] = {
+		HDSPE_MADI, HDSPE_MADIFACE, HDSPE_AES, HDSPE_RAYDAT, HDSPE_AIO,
+		HDSPE_AIO_PRO
+	};
+	static const u32 rates[] = {
+		32000, 44100, 48000, 64000, 88200, 96000, 128000, 176400, 192000
+	};
+	static const int pitches[] = {
+		960000, 999000, 1000000, 1000001, 1001000, 1040000
+	};
+	unsigned int i, r, p;
+
+	for (i = 0; i < ARRAY_SIZE(models); i++) {
+		struct hdspe_test_card *tc = hdspe_test_card_new(models[i],
+								 false);
+		struct hdspe *hdspe = &tc->hdspe;
+		u32 *wr_pll = hdspe_test_reg(hdspe, false, HDSPE_WR_PLL_FREQ);
+		u32 *rd_pll = hdspe_test_reg(hdspe, true, HDSPE_RD_PLL_FREQ);
+		u32 ddsmin, ddsmax;
+
+		for (r = 0; r < ARRAY_SIZE(rates); r++) {
+			u32 rate = rates[r];
+
+			hdspe_set_sample_rate(hdspe, rate);
+			CHECK_EQ(hdspe_internal_freq(hdspe),
+				 hdspe_sample_rate_freq(rate));
+			CHECK_EQ(hdspe_speed_factor(hdspe) *
+				 hdspe_freq_sample_rate(
+				 hdspe->reg.control.common.freq), rate);
+			*rd_pll = *wr_pll;
+			CHECK(abs((int)hdspe_read_system_sample_rate(hdspe)
+				  - (int)rate) <= 1);
+			CHECK(abs((int)hdspe_internal_pitch(hdspe)
+				  - 1000000) <= 1);
+
+			/* Pitch: round trip through the DDS register, to
+			 * about 1 ppm. */
+			for (p = 0; p < ARRAY_SIZE(pitches); p++) {
+				int pitch = pitches[p];
+
+				CHECK(hdspe_write_internal_pitch(hdspe,
+								 pitch) >= 0);
+				CHECK(abs((int)hdspe_internal_pitch(hdspe)
+					  - pitch) <= 1);
+				*rd_pll = *wr_pll;
+				CHECK(abs((int)hdspe_read_system_pitch(hdspe)
+					  - pitch) <= 1);
+			}
+			hdspe_write_internal_pitch(hdspe, 1000000);
+		}
+
+		/* The DDS range is 27 kHz ... 51.75 kHz single speed, and
+		 * from 30.52 kHz on MADIface, for which the period at lower
+		 * rates does not fit the register. */
+		hdspe_set_sample_rate(hdspe, 48000);
+		hdspe_dds_range(hdspe, &ddsmin, &ddsmax);
+		CHECK_EQ(hdspe_write_dds(hdspe, ddsmax), 1);
+		*rd_pll = *wr_pll;
+		CHECK(abs((int)hdspe_read_system_sample_rate(hdspe)
+			  - (models[i] == HDSPE_MADIFACE ? 30518 : 27000)) <= 1);
+		CHECK_EQ(hdspe_write_dds(hdspe, ddsmin), 1);
+		*rd_pll = *wr_pll;
+		CHECK(abs((int)hdspe_read_system_sample_rate(hdspe)
+			  - 51750) <= 1);
+		CHECK_EQ(hdspe_write_dds(hdspe, ddsmin - 1), -EINVAL);
+		CHECK_EQ(*wr_pll, ddsmin);
+
+		hdspe_test_card_free(tc);
+	}
+}
+
+/* RayDAT and AES sync source status decoding. */
+static void test_status(void)
+{
+	struct hdspe_test_card *tc = hdspe_test_card_new(HDSPE_RAYDAT, false);
+	struct hdspe *hdspe = &tc->hdspe;
+	struct hdspe_status s;
+	union hdspe_status1_reg s1 = { 0 };
+	union hdspe_status2_reg s2 = { 0 };
+	unsigned long notifies;
+
+	/* ADAT1 (input 3) locked and in sync at 48 kHz and the AutoSync
+	 * reference, SPDIF (input 2) locked only, at 44.1 kHz. */
+	s1.raio.lock = 0x04 | 0x02;
+	s1.raio.sync = 0x04;
+	s1.raio.sync_ref = HDSPE_CLOCK_SOURCE_3;
+	*hdspe_test_reg(hdspe, true, HDSPE_RD_STATUS1) = s1.raw;
+	*hdspe_test_reg(hdspe, true, HDSPE_RD_FBITS) =
+		(HDSPE_FREQ_48KHZ << 8) | (HDSPE_FREQ_44_1KHZ << 4);
+	s2.raio.AEBO_D = s2.raio.AEBI_D = 1;
+	*hdspe_test_reg(hdspe, true, HDSPE_RD_STATUS2) = s2.raw;
+
+	hdspe->m.read_status(hdspe, &s);
+	CHECK_EQ(s.version, HDSPE_VERSION);
+	CHECK_EQ(s.autosync_ref, HDSPE_CLOCK_SOURCE_3);
+	CHECK_EQ(s.sync[HDSPE_CLOCK_SOURCE_3], HDSPE_SYNC_STATUS_SYNC);
+	CHECK_EQ(s.freq[HDSPE_CLOCK_SOURCE_3], HDSPE_FREQ_48KHZ);
+	CHECK_EQ(s.sync[HDSPE_CLOCK_SOURCE_2], HDSPE_SYNC_STATUS_LOCK);
+	CHECK_EQ(s.freq[HDSPE_CLOCK_SOURCE_2], HDSPE_FREQ_44_1KHZ);
+	CHECK_EQ(s.sync[HDSPE_CLOCK_SOURCE_1], HDSPE_SYNC_STATUS_NO_LOCK);
+	CHECK_EQ(s.sync[HDSPE_CLOCK_SOURCE_TCO],
+		 HDSPE_SYNC_STATUS_NOT_AVAILABLE);
+	CHECK_EQ(s.external_freq, HDSPE_FREQ_48KHZ);
+	CHECK_EQ(s.raio.aebo, 0);
+	CHECK_EQ(s.raio.aebi, 0);
+
+	/* hdspe_status_work() notifies changes only. */
+	hdspe->last_status = s;
+	notifies = hdspe_shim_notifies;
+	hdspe_status_work(&hdspe->status_work);
+	CHECK_EQ(hdspe_shim_notifies, notifies);
+	s1.raio.lock &= ~0x04;
+	*hdspe_test_reg(hdspe, true, HDSPE_RD_STATUS1) = s1.raw;
+	hdspe_status_work(&hdspe->status_work);
+	CHECK(hdspe_shim_notifies > notifies);
+	CHECK_EQ(hdspe->last_status.sync[HDSPE_CLOCK_SOURCE_3],
+		 HDSPE_SYNC_STATUS_NO_LOCK);
+
+	/* The timing page PLL frequency follows status checks. */
+	*hdspe_test_reg(hdspe, true, HDSPE_RD_PLL_FREQ) += 1000;
+	CHECK(hdspe->timing_pll_freq !=
+	      *hdspe_test_reg(hdspe, true, HDSPE_RD_PLL_FREQ));
+	hdspe_status_work(&hdspe->status_work);
+	CHECK_EQ(hdspe->timing_pll_freq,
+		 *hdspe_test_reg(hdspe, true, HDSPE_RD_PLL_FREQ));
+	hdspe_test_card_free(tc);
+
+	/* AES: input n has bit 7-n in the lock and sync fields. */
+	tc = hdspe_test_card_new(HDSPE_AES, false);
+	hdspe = &tc->hdspe;
+	s2.raw = 0;
+	s2.aes.lock = 0x80 >> 2;
+	s2.aes.sync = 0x80 >> 2;
+	*hdspe_test_reg(hdspe, true, HDSPE_RD_STATUS2) = s2.raw;
+	*hdspe_test_reg(hdspe, true, HDSPE_RD_FBITS) = HDSPE_FREQ_96KHZ << 8;
+	hdspe->m.read_status(hdspe, &s);
+	CHECK_EQ(s.sync[HDSPE_CLOCK_SOURCE_3], HDSPE_SYNC_STATUS_SYNC);
+	CHECK_EQ(s.freq[HDSPE_CLOCK_SOURCE_3], HDSPE_FREQ_96KHZ);
+	CHECK_EQ(s.sync[HDSPE_CLOCK_SOURCE_1], HDSPE_SYNC_STATUS_NO_LOCK);
+	CHECK_EQ(s.sync[HDSPE_CLOCK_SOURCE_TCO],
+		 HDSPE_SYNC_STATUS_NOT_AVAILABLE);
+	hdspe_test_card_free(tc);
+}
+
+static u32 hdspe_test_xpoint(struct hdspe *hdspe, unsigned int dest,
+			     unsigned int src)
+{
+	return *hdspe_test_reg(hdspe, false, HDSPE_MADI_mixerBase +
+			       (src + 128 * dest) * 4);
+}
+
+/* Mixer control, monitoring routes and mixer.csv. */
+static void test_mixer(void)
+{
+	struct hdspe_test_card *tc = hdspe_test_card_new(HDSPE_AIO, false);
+	struct hdspe *hdspe = &tc->hdspe;
+	const struct hdspe_channel_map *out = &hdspe->chmap_out[0];
+	static char dump[64 * 1024];
+	static char full[256 * 1024], dump2[256 * 1024];
+	unsigned int ch, dest, src;
+	unsigned long msgs;
+	int n;
+
+	/* DAW profile: each playback channel to the output of the same
+	 * hardware channel, unused channels muted. */
+	for (ch = 0; ch < HDSPE_MAX_CHANNELS; ch++) {
+		CHECK_EQ(hdspe_test_xpoint(hdspe, ch, 64 + ch),
+			 test_bit(ch, out->used) ? HDSPE_UNITY_GAIN : 0);
+		CHECK_EQ(hdspe->mixer->ch[ch].pb[ch],
+			 hdspe_test_xpoint(hdspe, ch, 64 + ch));
+	}
+
+	/* [ source destination gain ] */
+	CHECK_EQ(hdspe_test_ctl_put("Mixer", 64 + 2, 5, 1234), 1);
+	CHECK_EQ(hdspe_test_xpoint(hdspe, 5, 64 + 2), 1234);
+	CHECK_EQ(hdspe_test_ctl_put("Mixer", 64 + 2, 5, 1234), 0);
+	CHECK_EQ(hdspe_test_ctl_put("Mixer", 3, 7, 99), 1);
+	CHECK_EQ(hdspe_test_xpoint(hdspe, 7, 3), 99);
+	CHECK(hdspe_test_ctl_put("Mixer", 128, 0, 1) < 0);
+	CHECK(hdspe_test_ctl_put("Mixer", 0, 64, 1) < 0);
+	hdspe->playback_pid = 100;
+	hdspe->capture_pid = 101;
+	CHECK_EQ(hdspe_test_ctl_put("Mixer", 0, 0, 1), -EBUSY);
+	hdspe->playback_pid = hdspe->capture_pid = -1;
+
+	/* Export, reset and import restore the same mixer. */
+	n = hdspe_shim_proc_read("mixer.csv", dump, sizeof(dump));
+	CHECK(n > 0);
+	CHECK(strstr(dump, "\n5,66,1234\n") != NULL);
+	CHECK(strstr(dump, "\n7,3,99\n") != NULL);
+	hdspe_shim_proc_write("mixer.csv", "reset\n");
+	CHECK_EQ(hdspe_shim_proc_read("mixer.csv", hdspe_test_buf,
+		sizeof(hdspe_test_buf)), strlen("# destination,source,gain\n"));
+	CHECK_EQ(hdspe_test_xpoint(hdspe, 5, 64 + 2), 0);
+	hdspe_shim_proc_write("mixer.csv", dump);
+	hdspe_shim_proc_read("mixer.csv", hdspe_test_buf,
+			     sizeof(hdspe_test_buf));
+	CHECK(!strcmp(hdspe_test_buf, dump));
+	CHECK_EQ(hdspe_test_xpoint(hdspe, 5, 64 + 2), 1234);
+
+	/* Bad and over-long records are skipped, with one warning; the
+	 * rest is applied, without clearing the mixer. */
+	msgs = hdspe_shim_msgs;
+	hdspe_shim_proc_write("mixer.csv",
+		"1,2,3\n"
+		"64,0,1\n"
+		"0,0,70000\n"
+		"garbage\n"
+		"   # comment\n"
+		"\n"
+		"2,3,                                                            4\n"
+		"4,5,6");
+	CHECK_EQ(hdspe_test_xpoint(hdspe, 1, 2), 3);
+	CHECK_EQ(hdspe_test_xpoint(hdspe, 4, 5), 6);
+	CHECK_EQ(hdspe_test_xpoint(hdspe, 2, 3), 0);
+	CHECK_EQ(hdspe_test_xpoint(hdspe, 0, 0), 0);
+	CHECK_EQ(hdspe_test_xpoint(hdspe, 5, 64 + 2), 1234);
+	CHECK_EQ(hdspe_shim_msgs, msgs + 1);
+
+	/* Writing needs exclusive use of the card. */
+	hdspe->playback_pid = 100;
+	hdspe->capture_pid = 101;
+	CHECK_EQ(hdspe_shim_proc_write("mixer.csv", "reset\n"), -EBUSY);
+	CHECK_EQ(hdspe_test_xpoint(hdspe, 5, 64 + 2), 1234);
+	hdspe->playback_pid = hdspe->capture_pid = -1;
+
+	/* A dump of the full matrix, some 90 KB, streams out and is
+	 * restored by a single write, after "reset". */
+	for (dest = 0; dest < HDSPE_MIXER_CHANNELS; dest++)
+		for (src = 0; src < 2 * HDSPE_MIXER_CHANNELS; src++)
+			hdspe_test_ctl_put("Mixer", src, dest,
+					   1 + ((dest * 131 + src * 7) & 0x7fff));
+	n = hdspe_shim_proc_read("mixer.csv", full + 6, sizeof(full) - 6);
+	CHECK(n > 64 * 1024);
+	CHECK_EQ(strlen(full + 6), n);
+	memcpy(full, "reset\n", 6);
+	hdspe_shim_proc_write("mixer.csv", "reset\n");
+	CHECK_EQ(hdspe_test_xpoint(hdspe, 63, 127), 0);
+	CHECK_EQ(hdspe_shim_proc_write("mixer.csv", full), n + 6);
+	CHECK_EQ(hdspe_shim_proc_read("mixer.csv", dump2, sizeof(dump2)), n);
+	CHECK(!strcmp(dump2, full + 6));
+	CHECK_EQ(hdspe_test_xpoint(hdspe, 63, 127),
+		 1 + ((63 * 131 + 127 * 7) & 0x7fff));
+	hdspe_shim_proc_write("mixer.csv", "reset\n");
+
+	/* Monitoring profile off: the DAW routes go. */
+	CHECK_EQ(hdspe_test_ctl_put_enum("Monitoring Profile",
+					 HDSPE_MONITOR_OFF), 1);
+	for_each_set_bit(ch, out->used, HDSPE_MAX_CHANNELS)
+		CHECK_EQ(hdspe_test_xpoint(hdspe, ch, 64 + ch), 0);
+
+	hdspe_test_card_free(tc);
+}
+
+static int hdspe_test_route_ioctl(void *ctx, unsigned int cmd, void *arg)
+{
+	return hdspe_test_dev_ctl_ioctl(cmd, arg);
+}
+
+/* Virtual stereo devices of alsa-plugin/: routes through the 'Mixer'
+ * control, by ALSA playback channel, restored on close. */
+static void test_route(void)
+{
+	struct hdspe_test_card *tc = hdspe_test_card_new(HDSPE_AIO, false);
+	struct hdspe *hdspe = &tc->hdspe;
+	static const unsigned int ch[2] = { 12, 13 };
+	static const unsigned int out[4] = { 0, 1, 14, 15 };
+	static struct hdspe_route r;
+
+	memset(&r, 0, sizeof(r));
+	r.ioctl = hdspe_test_route_ioctl;
+	CHECK(hdspe_shim_proc_read("hdspe", hdspe_test_buf,
+		sizeof(hdspe_test_buf)) > 0);
+	CHECK_EQ(hdspe_route_parse_map(&r, hdspe_test_buf), 0);
+	CHECK_EQ(r.channels, hdspe->max_channels_out);
+	CHECK_EQ(r.map[0], 0);
+	CHECK_EQ(r.map[12], 18);
+	CHECK_EQ(r.map[14], 6);
+	CHECK_EQ(hdspe_route_parse_map(&r, "garbage"), -ENOENT);
+	hdspe_route_parse_map(&r, hdspe_test_buf);
+
+	/* Left to outputs 0 and 14, right to 1 and 15, the own outputs
+	 * muted. */
+	CHECK_EQ(hdspe_route_gain(&r, 12, 12), HDSPE_UNITY_GAIN);
+	CHECK_EQ(hdspe_route_gain(&r, 12, 0), 0);
+	CHECK_EQ(hdspe_route_stereo(&r, ch, out, 4, HDSPE_UNITY_GAIN, true), 0);
+	CHECK_EQ(r.n, 6);
+	CHECK_EQ(hdspe_route_gain(&r, 12, 0), HDSPE_UNITY_GAIN);
+	CHECK_EQ(hdspe_route_gain(&r, 12, 14), HDSPE_UNITY_GAIN);
+	CHECK_EQ(hdspe_route_gain(&r, 13, 1), HDSPE_UNITY_GAIN);
+	CHECK_EQ(hdspe_route_gain(&r, 13, 15), HDSPE_UNITY_GAIN);
+	CHECK_EQ(hdspe_route_gain(&r, 12, 1), 0);
+	CHECK_EQ(hdspe_route_gain(&r, 12, 12), 0);
+	CHECK_EQ(hdspe_route_gain(&r, 13, 13), 0);
+	CHECK_EQ(hdspe_test_xpoint(hdspe, 6, 64 + 18), HDSPE_UNITY_GAIN);
+	CHECK_EQ(hdspe_test_xpoint(hdspe, 18, 64 + 18), 0);
+
+	/* Set again: one crosspoint, the first gain kept. */
+	CHECK_EQ(hdspe_route_add(&r, 12, 0, 1000), 0);
+	CHECK_EQ(r.n, 6);
+	CHECK_EQ(hdspe_route_gain(&r, 12, 0), 1000);
+	CHECK_EQ(hdspe_route_add(&r, 12, 64, 1000), -EINVAL);
+
+	/* Changed by someone else in between: left alone. */
+	CHECK_EQ(hdspe_test_ctl_put("Mixer", 64 + r.map[13], r.map[15], 777),
+		 1);
+	CHECK_EQ(hdspe_route_restore(&r), 0);
+	CHECK_EQ(r.n, 0);
+	CHECK_EQ(hdspe_route_gain(&r, 12, 0), 0);
+	CHECK_EQ(hdspe_route_gain(&r, 12, 14), 0);
+	CHECK_EQ(hdspe_route_gain(&r, 12, 12), HDSPE_UNITY_GAIN);
+	CHECK_EQ(hdspe_route_gain(&r, 13, 13), HDSPE_UNITY_GAIN);
+	CHECK_EQ(hdspe_route_gain(&r, 13, 15), 777);
+
+	/* Without mute, and a list of outputs holding the own ones. */
+	CHECK_EQ(hdspe_route_stereo(&r, ch, out, 3, HDSPE_UNITY_GAIN, true),
+		 -EINVAL);
+	CHECK_EQ(hdspe_route_stereo(&r, ch, ch, 2, 100, true), 0);
+	CHECK_EQ(r.n, 2);
+	CHECK_EQ(hdspe_route_gain(&r, 13, 13), 100);
+	CHECK_EQ(hdspe_route_restore(&r), 0);
+	CHECK_EQ(hdspe_route_stereo(&r, ch, out, 2, 100, false), 0);
+	CHECK_EQ(r.n, 2);
+	CHECK_EQ(hdspe_route_gain(&r, 12, 12), HDSPE_UNITY_GAIN);
+	CHECK_EQ(hdspe_route_restore(&r), 0);
+
+	/* Writing needs exclusive use of the card. */
+	hdspe->playback_pid = 100;
+	hdspe->capture_pid = 101;
+	CHECK_EQ(hdspe_route_add(&r, 12, 0, 1), -EBUSY);
+	CHECK_EQ(r.n, 0);
+	hdspe->playback_pid = hdspe->capture_pid = -1;
+
+	hdspe_test_card_free(tc);
+}
+
+/* TCO register shadow: one write per changed register. */
+static void test_tco(void)
+{
+	struct hdspe_test_card *tc = hdspe_test_card_new(HDSPE_RAYDAT, true);
+	struct hdspe *hdspe = &tc->hdspe;
+	struct hdspe_tco *c = hdspe->tco;
+	u32 writes[4];
+	unsigned long notifies;
+
+	CHECK(c != NULL);
+	if (!c) {
+		hdspe_test_card_free(tc);
+		return;
+	}
+	CHECK_EQ(c->dirty, 0);
+	memcpy(writes, c->reg_writes, sizeof(writes));
+
+	/* Pull up 0.1%: register 2 only. */
+	CHECK_EQ(hdspe_test_ctl_put_enum("TCO Pull", 1), 1);
+	CHECK_EQ(c->reg_writes[0], writes[0]);
+	CHECK_EQ(c->reg_writes[1], writes[1]);
+	CHECK_EQ(c->reg_writes[2], writes[2] + 1);
+	CHECK_EQ(c->reg_writes[3], writes[3]);
+	CHECK_EQ(*hdspe_test_reg(hdspe, false, HDSPE_WR_TCO + 8),
+		 c->reg[2]);
+	CHECK(c->reg[2] & 0x04000000);
+	CHECK_EQ(hdspe_test_ctl_put_enum("TCO Pull", 1), 0);
+	CHECK_EQ(c->reg_writes[2], writes[2] + 1);
+
+	/* Deferred to the period interrupt while it is enabled. */
+	hdspe_period_irq_get(hdspe);
+	CHECK_EQ(hdspe_test_ctl_put_enum("TCO Pull", 0), 1);
+	CHECK_EQ(c->reg_writes[2], writes[2] + 1);
+	CHECK(c->dirty != 0);
+	CHECK(c->period_irq);
+	hdspe_tco_period_elapsed(hdspe);
+	CHECK_EQ(c->dirty, 0);
+	CHECK_EQ(c->reg_writes[2], writes[2] + 2);
+	CHECK(!(c->reg[2] & 0x04000000));
+	hdspe_period_irq_put(hdspe);
+
+	/* The sample rate from the application is driver state in the sync
+	 * bit 31 of the register 2 shadow: kept there, never written, and
+	 * still there when the shadow is rewritten on resume. */
+	CHECK_EQ(hdspe_test_ctl_put_enum("LTC Sample Rate",
+					 HDSPE_TCO_SAMPLE_RATE_FROM_APP), 1);
+	CHECK(c->reg[2] & 0x80000000);
+	CHECK_EQ(*hdspe_test_reg(hdspe, false, HDSPE_WR_TCO + 8),
+		 c->reg[2] & 0x7f7f7f7f);
+	*hdspe_test_reg(hdspe, false, HDSPE_WR_TCO + 8) = 0;
+	hdspe_tco_resume(hdspe);
+	CHECK(c->reg[2] & 0x80000000);
+	CHECK_EQ(*hdspe_test_reg(hdspe, false, HDSPE_WR_TCO + 8),
+		 c->reg[2] & 0x7f7f7f7f);
+	CHECK_EQ(c->hw_reg[2], c->reg[2] & 0x7f7f7f7f);
+
+	/* Status change notifications, also for the video input frame
+	 * rate from the second status register. */
+	hdspe_tco_notify_status_change(hdspe);
+	notifies = hdspe_shim_notifies;
+	CHECK(!hdspe_tco_notify_status_change(hdspe));
+	CHECK_EQ(hdspe_shim_notifies, notifies);
+	*hdspe_test_reg(hdspe, true, HDSPE_RD_TCO + 8) = 2 << 27;
+	CHECK(hdspe_tco_notify_status_change(hdspe));
+	CHECK_EQ(hdspe_shim_notifies, notifies + 1);
+	CHECK(!hdspe_tco_notify_status_change(hdspe));
+
+	hdspe_test_card_free(tc);
+}
+
+/* The video frame timeline of a 29.97 fps reference, queried through
+ * hdspe_tco_video_frame_at(), as by SNDRV_HDSPE_IOCTL_GET_VIDEO_FRAME, and
+ * through hdspe_timing_video_frame() on the timing page fields. */
+static void test_tco_video(void)
+{
+	struct hdspe_test_card *tc = hdspe_test_card_new(HDSPE_AIO, true);
+	struct hdspe *hdspe = &tc->hdspe;
+	struct hdspe_tco *c = hdspe->tco;
+	struct hdspe_video_frame v = { .frame = 0 };
+	struct hdspe_timing t;
+	s64 n, edge = 0;
+	u64 frame;
+
+	CHECK_EQ(hdspe_tco_video_frame_at(hdspe, &v), -ENODATA);
+
+	c->fw_version = 11;
+	*hdspe_test_reg(hdspe, true, HDSPE_RD_TCO + 8) =
+		HDSPE_VIDEO_FPS_29_97 << 27;
+	hdspe->frame_count = 100000;
+	hdspe_tco_period_elapsed(hdspe);
+
+	/* 44100 * 1001 / 30000 = 7357.35 / 5 audio frames per video frame */
+	v.frame = 100000;
+	CHECK_EQ(hdspe_tco_video_frame_at(hdspe, &v), 0);
+	CHECK_EQ(v.spf_num, 147147);
+	CHECK_EQ(v.spf_den, 100);
+	CHECK_EQ(v.index, 0);
+	CHECK_EQ(v.edge, 100000);
+	CHECK_EQ(v.phase, 0);
+
+	memset(&t, 0, sizeof(t));
+	t.video_edge = c->video_edge;
+	t.video_frame = c->video_frame;
+	t.video_spf_num = c->video_spf_num;
+	t.video_spf_den = c->video_spf_den;
+	t.video_edge_rem = c->video_edge_rem;
+	t.video_phase = c->video_phase;
+
+	/* Edges at floor(n * 1471.47) after frame 100000, before as well. */
+	for (n = -200; n <= 200; n++) {
+		edge = 100000 + (n * 147147 - (n < 0 ? 99 : 0)) / 100;
+		for (frame = edge - 1; frame <= (u64)edge; frame++) {
+			v.frame = frame;
+			CHECK_EQ(hdspe_tco_video_frame_at(hdspe, &v), 0);
+			CHECK_EQ(v.index, frame == (u64)edge ? n : n - 1);
+			CHECK_EQ(hdspe_timing_video_frame(&t, frame), v.index);
+		}
+		CHECK_EQ(v.edge, edge);
+		CHECK_EQ(v.phase, ((n % 100) + 100) % 100);
+	}
+
+	/* The timeline moves along with the frame count. */
+	hdspe->frame_count = 100000 + 10 * 147147 / 100 + 5;
+	hdspe_tco_period_elapsed(hdspe);
+	CHECK_EQ(c->video_frame, 10);
+	v.frame = 100000;
+	CHECK_EQ(hdspe_tco_video_frame_at(hdspe, &v), 0);
+	CHECK_EQ(v.index, 0);
+	CHECK_EQ(v.edge, 100000);
+
+	hdspe_test_card_free(tc);
+
+	tc = hdspe_test_card_new(HDSPE_AIO, false);
+	CHECK_EQ(hdspe_tco_video_frame_at(&tc->hdspe, &v), -ENODEV);
+	hdspe_test_card_free(tc);
+}
+
+static const struct {
+	const char *name;
+	void (*fn)(void);
+} hdspe_tests[] = {
+	{ "models", test_models },
+	{ "channel_maps", test_channel_maps },
+	{ "period_interval", test_period_interval },
+	{ "period_jitter", test_period_jitter },
+	{ "rates", test_rates },
+	{ "dds", test_dds },
+	{ "status", test_status },
+	{ "mixer", test_mixer },
+	{ "route", test_route },
+	{ "tco", test_tco },
+	{ "tco_video", test_tco_video },
+};
+
+int main(int argc, char **argv)
+{
+	unsigned int i;
+	int failed = 0;
+
+	if (argc > 1 && !strcmp(argv[1], "-v"))
+		hdspe_shim_verbose = 1;
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	for (i = 0; i < ARRAY_SIZE(hdspe_tests); i++) {
+		int before = hdspe_test_failures;
+
+		hdspe_tests[i].fn();
+		printf("%-16s %s\n", hdspe_tests[i].name,
+		       hdspe_test_failures == before ? "ok" : "FAILED");
+		failed += hdspe_test_failures != before;
+	}
+	printf("%u tests, %d failed\n", (unsigned int)ARRAY_SIZE(hdspe_tests),
+	       failed);
+	return failed ? 1 : 0;
+}
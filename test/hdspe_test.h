@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file hdspe_test.h
+ * @brief User space test and benchmark harness for the HDSPe driver.
+ *
+ * The card model, mixer, TCO, rate, PCM and hwdep code is built unmodified
+ * against the kernel stand-ins in shim/. A test card is a struct hdspe with a
+ * register file instead of PCI memory: tests set the read registers, run
+ * driver code, and check the write registers and the driver state.
+ */
+
+#ifndef HDSPE_TEST_H
+#define HDSPE_TEST_H
+
+#include "hdspe.h"
+#include "hdspe_core.h"
+#include "hdspe_test_dev.h"
+
+/* 64 KiB of registers, as mapped from the card's PCI BAR. */
+#define HDSPE_TEST_REGS		(65536 / 4)
+#define HDSPE_TEST_MAX_KCTL	1024
+#define HDSPE_TEST_MAX_PROC	16
+#define HDSPE_TEST_MAX_PCM	4
+
+struct hdspe_test_card {
+	struct hdspe hdspe;
+	struct snd_card card;
+	struct snd_info_entry proc_root;	/* card proc directory */
+	struct device dev;
+	u32 wr[HDSPE_TEST_REGS];	/* registers written by the driver */
+	u32 rd[HDSPE_TEST_REGS];	/* registers read by the driver */
+	u64 frames;			/* hdspe_test_dev_period() position */
+};
+
+/* The card readl() and writel() go to. */
+extern struct hdspe_test_card *hdspe_test_current;
+
+/* Create a card of the given model, the way snd_hdspe_create() does, with
+ * or without TCO module. Returns NULL on failure. */
+extern struct hdspe_test_card *hdspe_test_card_new(enum hdspe_io_type type,
+						   bool tco);
+extern void hdspe_test_card_free(struct hdspe_test_card *tc);
+
+/* The hardware buffer pointer, which wraps every 16K frames and counts
+ * in steps of 16 frames, at @frames frames, with the audio interrupt
+ * pending or not. */
+#define HDSPE_TEST_BUFFER_FRAMES	16384
+extern void hdspe_test_set_buf_ptr(struct hdspe_test_card *tc, u64 frames,
+				   bool irq);
+
+/* Register in the write (<read> false) or read half of the register file. */
+extern u32 *hdspe_test_reg(struct hdspe *hdspe, bool read, u32 reg);
+
+/* Control elements, as created by snd_hdspe_create_controls(). */
+extern struct snd_kcontrol *hdspe_shim_find_kctl(const char *name);
+extern void hdspe_shim_free_kctls(void);
+extern unsigned long hdspe_shim_notifies;
+
+/* Drop the control device subscription and its queued events. */
+extern void hdspe_shim_free_ctl(void);
+
+/* Read proc file <name> into <buf>, or write <text> to it. Return the
+ * number of bytes read or written, or -ENOENT. */
+extern int hdspe_shim_proc_read(const char *name, char *buf, int size);
+extern int hdspe_shim_proc_write(const char *name, const char *text);
+extern void hdspe_shim_free_procs(void);
+
+/* PCM substreams, as created by snd_hdspe_create_pcm(): open() and
+ * close() them, and set their hardware parameters as an application
+ * would. hdspe_shim_pcm_hw_params() returns -EINVAL if the constraints
+ * from the open callback do not allow the values, or the error from the
+ * hw_params callback. */
+extern int hdspe_shim_pcm_open(struct snd_pcm_substream *substream);
+extern void hdspe_shim_pcm_close(struct snd_pcm_substream *substream);
+extern int hdspe_shim_pcm_hw_params(struct snd_pcm_substream *substream,
+				    unsigned int rate, unsigned int channels,
+				    unsigned int period_size,
+				    unsigned int buffer_size);
+extern void hdspe_shim_free_pcms(void);
+
+/* The hwdep device, as created by snd_hdspe_create_hwdep(). */
+extern void hdspe_shim_free_hwdeps(void);
+
+/* Restrict user memory for copy_to_user() and copy_from_user() to the
+ * <size> bytes at <base>, or lift the restriction with NULL. Copies that
+ * reach outside fail, as on a page fault, and are counted in
+ * hdspe_shim_user_faults. hdspe_shim_user_wlo and _whi are the lowest and
+ * one past the highest user address copied to since. */
+extern void hdspe_shim_set_user(const void *base, size_t size);
+extern const char *hdspe_shim_user_wlo, *hdspe_shim_user_whi;
+extern unsigned long hdspe_shim_user_faults;
+
+/* Run the work queued with queue_work(). Returns the number of items. */
+extern int hdspe_shim_run_work(void);
+
+/* --- Tests: CHECK() failures are counted in hdspe_test_failures. --- */
+
+extern int hdspe_test_failures;
+
+#define CHECK(cond)							\
+	do {								\
+		if (!(cond)) {						\
+			fprintf(stderr, "%s:%d: %s: check failed: %s\n", \
+				__FILE__, __LINE__, __func__, #cond);	\
+			hdspe_test_failures++;				\
+		}							\
+	} while (0)
+
+#define CHECK_EQ(a, b)							\
+	do {								\
+		long long __a = (long long)(a), __b = (long long)(b);	\
+		if (__a != __b) {					\
+			fprintf(stderr, "%s:%d: %s: %s == %s failed: "	\
+				"%lld != %lld\n", __FILE__, __LINE__,	\
+				__func__, #a, #b, __a, __b);		\
+			hdspe_test_failures++;				\
+		}							\
+	} while (0)
+
+/* --- Benchmarks, after Google Benchmark: the body runs state->iterations
+ * times; the driver picks the iteration count. --- */
+
+struct hdspe_bench_state {
+	u64 iterations;
+	struct hdspe_test_card *tc;
+	void *arg;
+};
+
+struct hdspe_bench {
+	const char *name;
+	void (*fn)(struct hdspe_bench_state *state);
+	enum hdspe_io_type type;
+	bool tco;
+	void *arg;
+};
+
+#endif /* HDSPE_TEST_H */
@@ -0,0 +1,227 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file hdspe_test_card.c
+ * @brief Test cards: struct hdspe on a register file, initialized the way
+ * snd_hdspe_create() initializes a real card.
+ */
+
+#include "hdspe_test.h"
+
+struct hdspe_test_card *hdspe_test_current;
+
+/* Firmware revision and PCI vendor ID hdspe_get_io_type() maps to <type>. */
+static const struct {
+	u16 firmware_rev;
+	int vendor_id;
+} hdspe_test_ids[HDSPE_IO_TYPE_COUNT] = {
+	[HDSPE_MADI]     = { 0xd2, 0x10ee },
+	[HDSPE_MADIFACE] = { HDSPE_MADIFACE_REV, 0x10ee },
+	[HDSPE_AIO]      = { HDSPE_AIO_REV, 0x10ee },
+	[HDSPE_AES]      = { 0xf0, 0x10ee },
+	[HDSPE_RAYDAT]   = { HDSPE_RAYDAT_REV, 0x10ee },
+	[HDSPE_AIO_PRO]  = { HDSPE_AIO_REV, PCI_VENDOR_ID_RME },
+};
+
+/* Register the TCO module presence where hdspe_tco_detect() looks. */
+static void hdspe_test_set_tco_detect(struct hdspe_test_card *tc)
+{
+	struct hdspe *hdspe = &tc->hdspe;
+	union hdspe_status0_reg s0;
+	union hdspe_status2_reg s2;
+
+	switch (hdspe->io_type) {
+	case HDSPE_MADI:
+	case HDSPE_AES:
+		s0.raw = *hdspe_test_reg(hdspe, true, HDSPE_RD_STATUS0);
+		s0.madi.tco_detect = 1;
+		*hdspe_test_reg(hdspe, true, HDSPE_RD_STATUS0) = s0.raw;
+		break;
+	default:
+		s2.raw = *hdspe_test_reg(hdspe, true, HDSPE_RD_STATUS2);
+		s2.raio.tco_detect = 1;
+		*hdspe_test_reg(hdspe, true, HDSPE_RD_STATUS2) = s2.raw;
+	}
+}
+
+/* hdspe_init() of hdspe_core.c: registers, methods, tables, channel maps. */
+static int hdspe_test_init(struct hdspe *hdspe)
+{
+	int err;
+
+	hdspe->capture_pid = hdspe->playback_pid = -1;
+
+	hdspe->reg.control.common.LAT = 6;
+	hdspe->reg.control.common.freq = HDSPE_FREQ_44_1KHZ;
+	hdspe->reg.control.common.LineOut = true;
+	hdspe_write_control(hdspe);
+
+	switch (hdspe->io_type) {
+	case HDSPE_MADI:
+	case HDSPE_MADIFACE: err = hdspe_init_madi(hdspe); break;
+	case HDSPE_AES: err = hdspe_init_aes(hdspe); break;
+	default: err = hdspe_init_raio(hdspe);
+	}
+	if (err < 0)
+		return err;
+
+	err = hdspe_init_channel_maps(hdspe);
+	if (err < 0)
+		return err;
+	hdspe_init_latency(hdspe);
+	hdspe_read_status0_nocache(hdspe);
+	hdspe_write_internal_pitch(hdspe, 1000000);
+	/* A card on its internal clock reports the DDS value as PLL frequency. */
+	*hdspe_test_reg(hdspe, true, HDSPE_RD_PLL_FREQ) =
+		*hdspe_test_reg(hdspe, false, HDSPE_WR_PLL_FREQ);
+	hdspe_set_channel_map(hdspe, hdspe_speed_mode(hdspe));
+	return 0;
+}
+
+struct hdspe_test_card *hdspe_test_card_new(enum hdspe_io_type type, bool tco)
+{
+	struct hdspe_test_card *tc = calloc(1, sizeof(*tc));
+	struct hdspe *hdspe;
+
+	if (!tc)
+		return NULL;
+	hdspe_test_current = tc;
+	hdspe = &tc->hdspe;
+
+	tc->dev.name = "hdspe-test";
+	tc->card.dev = &tc->dev;
+	tc->card.private_data = hdspe;
+	hdspe->card = &tc->card;
+	tc->card.proc_root = &tc->proc_root;
+	hdspe->iobase = (void __iomem *)tc->wr;
+	hdspe->io_type = type;
+	hdspe->firmware_rev = hdspe_test_ids[type].firmware_rev;
+	hdspe->vendor_id = hdspe_test_ids[type].vendor_id;
+	hdspe->irq = -1;
+	spin_lock_init(&hdspe->lock);
+	INIT_LIST_HEAD(&hdspe->dmabufs);
+	if (tco)
+		hdspe_test_set_tco_detect(tc);
+
+	/* snd_hdspe_init_all() */
+	if (hdspe_init_mixer(hdspe, HDSPE_MONITOR_DAW) < 0 ||
+	    hdspe_init_tco(hdspe) < 0 ||
+	    hdspe_test_init(hdspe) < 0 ||
+	    snd_hdspe_create_pcm(&tc->card, hdspe) < 0 ||
+	    snd_hdspe_create_hwdep(&tc->card, hdspe) < 0 ||
+	    snd_hdspe_create_controls(&tc->card, hdspe) < 0) {
+		hdspe_test_card_free(tc);
+		return NULL;
+	}
+	snd_hdspe_proc_init(hdspe);
+
+	/* snd_card_register() */
+	tc->proc_root.p = (struct proc_dir_entry *)&tc->proc_root;
+	hdspe_mixer_proc_init(hdspe);
+
+	return tc;
+}
+
+void hdspe_test_set_buf_ptr(struct hdspe_test_card *tc, u64 frames, bool irq)
+{
+	u32 *reg = hdspe_test_reg(&tc->hdspe, true, HDSPE_RD_STATUS0);
+	union hdspe_status0_reg s0 = { .raw = *reg };
+
+	s0.common.BUF_PTR = (frames % HDSPE_TEST_BUFFER_FRAMES) >> 4;
+	s0.common.IRQ = irq;
+	*reg = s0.raw;
+}
+
+void hdspe_test_card_free(struct hdspe_test_card *tc)
+{
+	struct hdspe *hdspe = &tc->hdspe;
+
+	switch (hdspe->io_type) {
+	case HDSPE_MADI:
+	case HDSPE_MADIFACE: hdspe_terminate_madi(hdspe); break;
+	case HDSPE_AES: hdspe_terminate_aes(hdspe); break;
+	default: hdspe_terminate_raio(hdspe);
+	}
+	hdspe_tms_free(hdspe);
+	hdspe_sched_free(hdspe);
+	hdspe_timing_free(hdspe);
+	hdspe_terminate_tco(hdspe);
+	hdspe_terminate_mixer(hdspe);
+	hdspe_shim_free_kctls();
+	hdspe_shim_free_ctl();
+	hdspe_shim_free_procs();
+	hdspe_shim_free_pcms();
+	hdspe_shim_free_hwdeps();
+	if (hdspe_test_current == tc)
+		hdspe_test_current = NULL;
+	free(tc);
+}
+
+/* --- The devices of a test card, see hdspe_test_dev.h --- */
+
+struct hdspe_test_card *hdspe_test_dev_new(enum hdspe_io_type type, int tco)
+{
+	return hdspe_test_card_new(type, tco);
+}
+
+void hdspe_test_dev_free(struct hdspe_test_card *tc)
+{
+	hdspe_test_card_free(tc);
+}
+
+const struct hdspe_timing *hdspe_test_dev_timing(struct hdspe_test_card *tc)
+{
+	return tc->hdspe.timing_page;
+}
+
+void hdspe_test_dev_set_sync(struct hdspe_test_card *tc, unsigned int lock,
+			     unsigned int sync)
+{
+	u32 *reg = hdspe_test_reg(&tc->hdspe, true, HDSPE_RD_STATUS1);
+	union hdspe_status1_reg s1 = { .raw = *reg };
+
+	s1.raio.lock = lock;
+	s1.raio.sync = sync;
+	*reg = s1.raw;
+}
+
+void hdspe_test_dev_set_period(struct hdspe_test_card *tc, unsigned int frames)
+{
+	struct hdspe *hdspe = &tc->hdspe;
+	int n = 0;
+
+	/* The latency field, as hw_params sets it. */
+	for (frames >>= 7; frames; frames >>= 1)
+		n++;
+	spin_lock_irq(&hdspe->lock);
+	hdspe->reg.control.common.LAT = n;
+	hdspe_write_control(hdspe);
+	hdspe->period_size = hdspe_period_size(hdspe);
+	hdspe->pcm_period_size = hdspe->period_size;
+	spin_unlock_irq(&hdspe->lock);
+}
+
+void hdspe_test_dev_period(struct hdspe_test_card *tc)
+{
+	struct hdspe *hdspe = &tc->hdspe;
+
+	tc->frames += hdspe->period_size;
+	hdspe_shim_ns += div_u64((u64)hdspe->period_size * NSEC_PER_SEC, 48000);
+	jiffies = div_u64(hdspe_shim_ns, NSEC_PER_SEC / HZ);
+	hdspe_test_set_buf_ptr(tc, tc->frames, true);
+
+	spin_lock(&hdspe->lock);
+	hdspe->reg.status0 = hdspe_read_status0_nocache(hdspe);
+	hdspe_update_frame_count(hdspe);
+	spin_unlock(&hdspe->lock);
+	if (hdspe->tco)
+		hdspe_tco_period_elapsed(hdspe);
+	hdspe_timing_update(hdspe);
+
+	/* The status polling of snd_hdspe_interrupt(), with the work run
+	 * right away. */
+	if (hdspe->status_polling > 0 &&
+	    jiffies >= hdspe->last_status_jiffies + HZ/hdspe->status_polling) {
+		hdspe->last_status_jiffies = jiffies;
+		hdspe_status_work(&hdspe->status_work);
+	}
+}
@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file hdspe_test_dev.h
+ * @brief The control and hwdep devices of a test card, as user space sees
+ * them through the ALSA core. For clients built against the system headers,
+ * like the C++ client library in client/: no kernel stand-ins needed.
+ */
+
+#ifndef HDSPE_TEST_DEV_H
+#define HDSPE_TEST_DEV_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+
+#include "hdspe.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct hdspe_test_card;
+
+/* hdspe_test_card_new() and hdspe_test_card_free(). */
+extern struct hdspe_test_card *hdspe_test_dev_new(enum hdspe_io_type type,
+						  int tco);
+extern void hdspe_test_dev_free(struct hdspe_test_card *tc);
+
+/* ioctl() on the control device, for the element list, info, read and
+ * write and the event subscription, and non-blocking read() of the events
+ * of the one control file: -EAGAIN if none is queued. Errors are negative
+ * error codes, as returned by the kernel. */
+extern int hdspe_test_dev_ctl_ioctl(unsigned int cmd, void *arg);
+extern long hdspe_test_dev_ctl_read(void *buf, unsigned long count);
+/* Number of events queued: what poll() on the control file waits for. */
+extern int hdspe_test_dev_ctl_pending(void);
+
+/* ioctl() on the hwdep device, and the timing page it maps. */
+extern int hdspe_test_dev_hwdep_ioctl(unsigned int cmd, void *arg);
+extern const struct hdspe_timing *
+hdspe_test_dev_timing(struct hdspe_test_card *tc);
+
+/* Lock and sync bits of the RayDAT and AIO inputs, as in the status1
+ * register: bit 0 AES, 1 SPDIF, 2.. ADAT. */
+extern void hdspe_test_dev_set_sync(struct hdspe_test_card *tc,
+				    unsigned int lock, unsigned int sync);
+
+/* The hardware period, as hw_params sets it: a power of two from 64 to
+ * 4096 frames. */
+extern void hdspe_test_dev_set_period(struct hdspe_test_card *tc,
+				      unsigned int frames);
+
+/* A period interrupt at 48 kHz, with the status check the interrupt
+ * handler schedules at the rate of the 'Status Polling' control. */
+extern void hdspe_test_dev_period(struct hdspe_test_card *tc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HDSPE_TEST_DEV_H */
@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file hdspe_test_transport.h
+ * @brief The devices of a test card as an hdspe::transport of the client
+ * library, counting the calls: each is one system call on a real card.
+ * ctl_wait() counts when it returns events only, as a blocking poll()
+ * wakes up once per batch of events.
+ */
+
+#ifndef HDSPE_TEST_TRANSPORT_H
+#define HDSPE_TEST_TRANSPORT_H
+
+#include <errno.h>
+
+#include "hdspe_client.h"
+#include "hdspe_test_dev.h"
+
+class hdspe_test_transport : public hdspe::transport {
+public:
+	explicit hdspe_test_transport(struct hdspe_test_card *tc) : tc_(tc) {}
+
+	int ctl_ioctl(unsigned long cmd, void *arg) override
+	{
+		syscalls++;
+		return hdspe_test_dev_ctl_ioctl(cmd, arg);
+	}
+
+	long ctl_read(void *buf, size_t count) override
+	{
+		syscalls++;
+		return hdspe_test_dev_ctl_read(buf, count);
+	}
+
+	int ctl_wait(int) override
+	{
+		if (!hdspe_test_dev_ctl_pending())
+			return 0;
+		syscalls++;
+		return 1;
+	}
+
+	int hwdep_ioctl(unsigned long cmd, void *arg) override
+	{
+		syscalls++;
+		return hdspe_test_dev_hwdep_ioctl(cmd, arg);
+	}
+
+	const struct hdspe_timing *timing() const override
+	{
+		return hdspe_test_dev_timing(tc_);
+	}
+
+	unsigned long syscalls = 0;
+
+private:
+	struct hdspe_test_card *tc_;
+};
+
+#endif /* HDSPE_TEST_TRANSPORT_H */
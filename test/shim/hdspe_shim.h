@@ -0,0 +1,940 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file hdspe_shim.h
+ * @brief Thin user space stand-ins for the kernel and ALSA interfaces used
+ * by the HDSPe driver sources built into the test harness.
+ *
+ * Only what hdspe_common.c, hdspe_mixer.c, hdspe_tco.c, hdspe_madi.c,
+ * hdspe_aes.c, hdspe_raio.c, hdspe_channels.c, hdspe_latency.c,
+ * hdspe_pcm.c, hdspe_hwdep.c, hdspe_sched.c, hdspe_tms.c and hdspe_dmabuf.c
+ * need.
+ * Registers are a plain array (see hdspe_shim.c), locks are no-ops, control
+ * notifications and debug messages are counted. The linux/ and sound/
+ * headers next to this one just include it.
+ */
+
+#ifndef HDSPE_SHIM_H
+#define HDSPE_SHIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include <linux/types.h>
+#include <sound/asound.h>
+
+/* --- Compiler, types --- */
+
+#define __iomem
+#define __user
+#define __force
+#define __maybe_unused		__attribute__((unused))
+#define __always_unused		__attribute__((unused))
+#define __printf(a, b)		__attribute__((format(printf, a, b)))
+#define likely(x)		__builtin_expect(!!(x), 1)
+#define unlikely(x)		__builtin_expect(!!(x), 0)
+#define fallthrough		__attribute__((fallthrough))
+#define EXPORT_SYMBOL(sym)
+#define MODULE_LICENSE(s)
+#define BUILD_BUG_ON(c)		((void)sizeof(char[1 - 2 * !!(c)]))
+
+/* linux/kconfig.h: options defined to 1 are enabled. */
+#define __ARG_PLACEHOLDER_1	0,
+#define __take_second_arg(__ignored, val, ...)	val
+#define ____is_defined(arg1_or_junk)	__take_second_arg(arg1_or_junk 1, 0)
+#define ___is_defined(val)	____is_defined(__ARG_PLACEHOLDER_##val)
+#define IS_ENABLED(option)	___is_defined(option)
+
+typedef unsigned int __poll_t;
+typedef int64_t ktime_t;
+typedef unsigned long snd_pcm_uframes_t;
+typedef long snd_pcm_sframes_t;
+typedef unsigned int gfp_t;
+typedef int irqreturn_t;
+typedef irqreturn_t (*irq_handler_t)(int, void *);
+
+#define GFP_KERNEL		0
+#define GFP_ATOMIC		1
+
+#define ARRAY_SIZE(a)		(sizeof(a) / sizeof((a)[0]))
+#define BIT(n)			(1UL << (n))
+#define BITS_PER_LONG		(8 * (int)sizeof(long))
+#define BITS_TO_LONGS(n)	(((n) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+#define DECLARE_BITMAP(name, bits)	unsigned long name[BITS_TO_LONGS(bits)]
+#define U32_MAX			((u32)~0U)
+#define U64_MAX			((u64)~0ULL)
+
+#define min(a, b)		((a) < (b) ? (a) : (b))
+#define max(a, b)		((a) > (b) ? (a) : (b))
+#define min_t(t, a, b)		((t)(a) < (t)(b) ? (t)(a) : (t)(b))
+#define max_t(t, a, b)		((t)(a) > (t)(b) ? (t)(a) : (t)(b))
+#define clamp(v, lo, hi)	min(max(v, lo), hi)
+#define clamp_t(t, v, lo, hi)	min_t(t, max_t(t, v, lo), hi)
+#define abs(x)			((x) < 0 ? -(x) : (x))
+#define DIV_ROUND_UP(n, d)	(((n) + (d) - 1) / (d))
+#define DIV_ROUND_CLOSEST(n, d)	(((n) + (d) / 2) / (d))
+
+#define READ_ONCE(x)		(*(const volatile __typeof__(x) *)&(x))
+#define WRITE_ONCE(x, v)	(*(volatile __typeof__(x) *)&(x) = (v))
+#define smp_load_acquire(p)	__atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define smp_store_release(p, v)	__atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define smp_wmb()		__atomic_thread_fence(__ATOMIC_RELEASE)
+#define smp_rmb()		__atomic_thread_fence(__ATOMIC_ACQUIRE)
+
+#define le16_to_cpu(x)		((u16)(x))
+#define le32_to_cpu(x)		((u32)(x))
+#define cpu_to_le32(x)		((__le32)(x))
+#define cpu_to_le64(x)		((__le64)(x))
+
+/* linux/bitfield.h */
+#define __bf_shf(m)		__builtin_ctzll(m)
+#define FIELD_PREP(m, v)	(((u64)(v) << __bf_shf(m)) & (m))
+#define FIELD_GET(m, r)		(((r) & (m)) >> __bf_shf(m))
+
+/* --- Errors --- */
+
+#define MAX_ERRNO		4095
+#define ERR_PTR(err)		((void *)(long)(err))
+#define PTR_ERR(ptr)		((long)(ptr))
+#define IS_ERR(ptr)		((unsigned long)(ptr) >= (unsigned long)-MAX_ERRNO)
+
+#define EPERM		1
+#define ENOENT		2
+#define EIO		5
+#define ENXIO		6
+#define E2BIG		7
+#define EAGAIN		11
+#define ENOMEM		12
+#define EFAULT		14
+#define EBUSY		16
+#define ENODEV		19
+#define EINVAL		22
+#define ENOSPC		28
+#define ERANGE		34
+#define ENOTTY		25
+#define ENOSYS		38
+#define ENODATA		61
+#define EOVERFLOW	75
+#define EOPNOTSUPP	95
+#define EINPROGRESS	115
+
+/* --- linux/math64.h, linux/gcd.h --- */
+
+static inline u64 div_u64_rem(u64 n, u32 d, u32 *rem)
+{
+	*rem = n % d;
+	return n / d;
+}
+static inline u64 div_u64(u64 n, u32 d) { return n / d; }
+static inline s64 div_s64_rem(s64 n, s32 d, s32 *rem)
+{
+	*rem = n % d;
+	return n / d;
+}
+static inline s64 div_s64(s64 n, s32 d) { return n / d; }
+static inline u64 div64_u64(u64 n, u64 d) { return n / d; }
+static inline s64 div64_s64(s64 n, s64 d) { return n / d; }
+#define do_div(n, base) ({ u32 __r = (n) % (base); (n) /= (base); __r; })
+
+static inline u64 mul_u64_u32_div(u64 a, u32 mul, u32 div)
+{
+	return (u64)(((unsigned __int128)a * mul) / div);
+}
+
+static inline u64 int_sqrt64(u64 x)
+{
+	u64 r = 0, b = 1ULL << 62;
+
+	while (b > x)
+		b >>= 2;
+	while (b) {
+		if (x >= r + b) {
+			x -= r + b;
+			r = (r >> 1) + b;
+		} else {
+			r >>= 1;
+		}
+		b >>= 2;
+	}
+	return r;
+}
+
+static inline unsigned long gcd(unsigned long a, unsigned long b)
+{
+	while (b) {
+		unsigned long t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/* --- linux/string.h --- */
+
+static inline ssize_t strscpy(char *dst, const char *src, size_t size)
+{
+	size_t n = strnlen(src, size);
+
+	if (!size)
+		return -E2BIG;
+	if (n == size) {
+		memcpy(dst, src, size - 1);
+		dst[size - 1] = '\0';
+		return -E2BIG;
+	}
+	memcpy(dst, src, n + 1);
+	return n;
+}
+
+static inline char *strim(char *s)
+{
+	char *end;
+
+	while (isspace((unsigned char)*s))
+		s++;
+	end = s + strlen(s);
+	while (end > s && isspace((unsigned char)end[-1]))
+		*--end = '\0';
+	return s;
+}
+
+/* --- linux/bitmap.h --- */
+
+static inline bool test_bit(long nr, const unsigned long *addr)
+{
+	return (addr[nr / BITS_PER_LONG] >> (nr % BITS_PER_LONG)) & 1;
+}
+static inline void __set_bit(long nr, unsigned long *addr)
+{
+	addr[nr / BITS_PER_LONG] |= 1UL << (nr % BITS_PER_LONG);
+}
+static inline void __clear_bit(long nr, unsigned long *addr)
+{
+	addr[nr / BITS_PER_LONG] &= ~(1UL << (nr % BITS_PER_LONG));
+}
+#define set_bit(nr, addr)	__set_bit(nr, addr)
+#define clear_bit(nr, addr)	__clear_bit(nr, addr)
+
+extern unsigned long find_next_bit(const unsigned long *addr,
+				   unsigned long size, unsigned long offset);
+#define find_first_bit(addr, size)	find_next_bit(addr, size, 0)
+#define for_each_set_bit(bit, addr, size)			\
+	for ((bit) = find_next_bit((addr), (size), 0);		\
+	     (bit) < (size);					\
+	     (bit) = find_next_bit((addr), (size), (bit) + 1))
+
+static inline void bitmap_zero(unsigned long *dst, unsigned int nbits)
+{
+	memset(dst, 0, BITS_TO_LONGS(nbits) * sizeof(long));
+}
+static inline void bitmap_copy(unsigned long *dst, const unsigned long *src,
+			       unsigned int nbits)
+{
+	memcpy(dst, src, BITS_TO_LONGS(nbits) * sizeof(long));
+}
+extern void bitmap_complement(unsigned long *dst, const unsigned long *src,
+			      unsigned int nbits);
+extern void bitmap_xor(unsigned long *dst, const unsigned long *a,
+		       const unsigned long *b, unsigned int nbits);
+extern void bitmap_and(unsigned long *dst, const unsigned long *a,
+		       const unsigned long *b, unsigned int nbits);
+extern void bitmap_or(unsigned long *dst, const unsigned long *a,
+		      const unsigned long *b, unsigned int nbits);
+extern unsigned int bitmap_weight(const unsigned long *src,
+				  unsigned int nbits);
+
+static inline bool bitmap_empty(const unsigned long *src, unsigned int nbits)
+{
+	return find_first_bit(src, nbits) >= nbits;
+}
+
+static inline void bitmap_from_u64(unsigned long *dst, u64 mask)
+{
+	memcpy(dst, &mask, sizeof(mask));	/* little endian, 64-bit */
+}
+
+/* --- linux/io.h: a register file, see hdspe_shim.c --- */
+
+extern unsigned long hdspe_shim_reads, hdspe_shim_writes;
+extern u32 hdspe_shim_readl(const volatile void *addr);
+extern void hdspe_shim_writel(u32 val, volatile void *addr);
+#define readl(addr)			hdspe_shim_readl(addr)
+#define writel(val, addr)		hdspe_shim_writel(val, addr)
+
+/* --- Locks, work, timers: single threaded, no-ops --- */
+
+typedef struct { int locked; } spinlock_t;
+struct mutex { int locked; };
+
+#define DEFINE_SPINLOCK(x)		spinlock_t x = { 0 }
+#define DEFINE_MUTEX(x)			struct mutex x = { 0 }
+#define spin_lock_init(l)		((l)->locked = 0)
+#define spin_lock(l)			((l)->locked++)
+#define spin_unlock(l)			((l)->locked--)
+#define spin_lock_irq(l)		((l)->locked++)
+#define spin_unlock_irq(l)		((l)->locked--)
+#define spin_lock_irqsave(l, f)		((f) = 0, (l)->locked++)
+#define spin_unlock_irqrestore(l, f)	((void)(f), (l)->locked--)
+#define mutex_init(m)			((m)->locked = 0)
+#define mutex_lock(m)			((m)->locked++)
+#define mutex_unlock(m)			((m)->locked--)
+#define lockdep_assert_held(l)		((void)(l))
+
+struct rw_semaphore { int readers; };
+#define down_read(s)			((s)->readers++)
+#define up_read(s)			((s)->readers--)
+
+typedef struct { unsigned long wakeups; } wait_queue_head_t;
+#define init_waitqueue_head(w)		((w)->wakeups = 0)
+#define wake_up_interruptible(w)	((w)->wakeups++)
+#define poll_wait(file, w, pt)		((void)(file), (void)(w), (void)(pt))
+
+#define EPOLLIN				0x00000001
+#define EPOLLRDNORM			0x00000040
+
+struct list_head { struct list_head *next, *prev; };
+#define INIT_LIST_HEAD(h)		((h)->next = (h)->prev = (h))
+
+struct work_struct {
+	void (*func)(struct work_struct *);
+	struct work_struct *next;	/* queued, see queue_work() */
+	bool pending;
+};
+#define INIT_WORK(w, f)			((w)->func = (f), (w)->pending = false)
+#define schedule_work(w)		((void)(w), true)
+
+/* Work queued with queue_work() runs when the test calls
+ * hdspe_shim_run_work(), as if the work queue thread ran then. */
+struct workqueue_struct;
+extern struct workqueue_struct *system_highpri_wq;
+extern bool queue_work(struct workqueue_struct *wq, struct work_struct *w);
+extern bool cancel_work_sync(struct work_struct *w);
+
+struct timer_list {
+	void (*function)(struct timer_list *);
+	unsigned long expires;
+};
+#define timer_setup(t, f, fl)		((t)->function = (f))
+#define mod_timer(t, e)			((t)->expires = (e), 0)
+#define del_timer_sync(t)		((void)(t), 0)
+#define from_timer(var, t, field)	container_of(t, __typeof__(*var), field)
+
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define HZ 250
+extern unsigned long jiffies;
+#define msecs_to_jiffies(ms)		((ms) * HZ / 1000)
+#define time_after(a, b)		((long)((b) - (a)) < 0)
+#define time_before(a, b)		time_after(b, a)
+
+extern u64 hdspe_shim_ns;
+static inline u64 ktime_get_ns(void) { return hdspe_shim_ns; }
+static inline u64 ktime_get_real_ns(void) { return hdspe_shim_ns; }
+static inline u64 ktime_get_raw_ns(void) { return hdspe_shim_ns; }
+static inline ktime_t ktime_get(void) { return hdspe_shim_ns; }
+#define ktime_to_ns(t)			((s64)(t))
+#define ktime_sub(a, b)			((a) - (b))
+
+#define NSEC_PER_USEC			1000ULL
+#define NSEC_PER_MSEC			1000000ULL
+#define NSEC_PER_SEC			1000000000ULL
+
+struct timespec64 {
+	s64 tv_sec;
+	long tv_nsec;
+};
+
+static inline void ktime_get_real_ts64(struct timespec64 *ts)
+{
+	ts->tv_sec = hdspe_shim_ns / NSEC_PER_SEC;
+	ts->tv_nsec = hdspe_shim_ns % NSEC_PER_SEC;
+}
+
+static inline void time64_to_tm(s64 t, int offset, struct tm *tm)
+{
+	time_t tt = t + offset;
+
+	gmtime_r(&tt, tm);
+}
+
+#define udelay(us)			((void)(us))
+#define mdelay(ms)			((void)(ms))
+#define msleep(ms)			((void)(ms))
+
+/* --- Memory --- */
+
+#define kmalloc(n, gfp)			malloc(n)
+#define kzalloc(n, gfp)			calloc(1, n)
+#define kcalloc(n, s, gfp)		calloc(n, s)
+#define kfree(p)			free((void *)(p))
+#define vmalloc(n)			malloc(n)
+#define vzalloc(n)			calloc(1, n)
+#define vmalloc_user(n)			calloc(1, n)
+#define vfree(p)			free((void *)(p))
+#define PAGE_SIZE			4096UL
+#define PAGE_SHIFT			12
+#define PAGE_ALIGN(n)			(((n) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+
+struct page;
+#define virt_to_page(p)			((struct page *)(p))
+extern unsigned long get_zeroed_page(gfp_t gfp);
+extern void free_page(unsigned long addr);
+
+#define VM_WRITE			0x00000002UL
+#define VM_MAYWRITE			0x00000020UL
+#define VM_DONTEXPAND			0x00040000UL
+#define VM_DONTDUMP			0x04000000UL
+
+struct vm_area_struct;
+struct vm_operations_struct {
+	void (*open)(struct vm_area_struct *);
+	void (*close)(struct vm_area_struct *);
+};
+struct vm_area_struct {
+	unsigned long vm_start, vm_end, vm_pgoff, vm_flags;
+	const struct vm_operations_struct *vm_ops;
+	void *vm_private_data;
+};
+extern int remap_vmalloc_range(struct vm_area_struct *vma, void *addr,
+			       unsigned long pgoff);
+extern int vm_insert_page(struct vm_area_struct *vma, unsigned long addr,
+			  struct page *page);
+
+static inline void vm_flags_mod(struct vm_area_struct *vma,
+				unsigned long set, unsigned long clear)
+{
+	vma->vm_flags = (vma->vm_flags | set) & ~clear;
+}
+
+struct file;
+struct poll_table_struct;
+typedef struct poll_table_struct poll_table;
+
+/* --- Messages --- */
+
+struct device { const char *name; };
+
+extern int hdspe_shim_verbose;
+extern unsigned long hdspe_shim_msgs;
+extern unsigned long hdspe_shim_bugs;
+
+#define hdspe_shim_msg(dev, lvl, fmt, ...)				\
+	do {								\
+		hdspe_shim_msgs++;					\
+		if (hdspe_shim_verbose)					\
+			fprintf(stderr, "%s %s: " fmt, lvl,		\
+				(dev) ? (dev)->name : "-", ##__VA_ARGS__); \
+	} while (0)
+#define dev_dbg(dev, fmt, ...)	hdspe_shim_msg(dev, "dbg", fmt, ##__VA_ARGS__)
+#define dev_info(dev, fmt, ...)	hdspe_shim_msg(dev, "info", fmt, ##__VA_ARGS__)
+#define dev_warn(dev, fmt, ...)	hdspe_shim_msg(dev, "warn", fmt, ##__VA_ARGS__)
+#define dev_err(dev, fmt, ...)	hdspe_shim_msg(dev, "err", fmt, ##__VA_ARGS__)
+#define dev_warn_ratelimited	dev_warn
+#define dev_err_ratelimited	dev_err
+#define pr_debug(fmt, ...)	hdspe_shim_msg((struct device *)0, "dbg", fmt, ##__VA_ARGS__)
+#define pr_info(fmt, ...)	hdspe_shim_msg((struct device *)0, "info", fmt, ##__VA_ARGS__)
+#define pr_warn(fmt, ...)	hdspe_shim_msg((struct device *)0, "warn", fmt, ##__VA_ARGS__)
+#define pr_err(fmt, ...)	hdspe_shim_msg((struct device *)0, "err", fmt, ##__VA_ARGS__)
+#define no_printk(fmt, ...)	({ if (0) printf(fmt, ##__VA_ARGS__); 0; })
+#define snd_BUG()							\
+	do {								\
+		hdspe_shim_bugs++;					\
+		hdspe_shim_msg((struct device *)0, "bug", "%s\n", __func__); \
+	} while (0)
+#define snd_BUG_ON(c)		({ int __c = !!(c); if (__c) snd_BUG(); __c; })
+#define WARN_ON(c)		({ int __c = !!(c); if (__c) snd_BUG(); __c; })
+#define WARN_ON_ONCE(c)		WARN_ON(c)
+
+/* --- ALSA core, controls, info --- */
+
+struct snd_info_entry;
+
+struct snd_card {
+	struct device *dev;
+	struct snd_info_entry *proc_root;
+	struct rw_semaphore controls_rwsem;
+	int number;
+	char id[16];
+	char shortname[32];
+	char longname[80];
+	void *private_data;
+};
+
+struct snd_kcontrol;
+typedef int (snd_kcontrol_info_t)(struct snd_kcontrol *,
+				  struct snd_ctl_elem_info *);
+typedef int (snd_kcontrol_get_t)(struct snd_kcontrol *,
+				 struct snd_ctl_elem_value *);
+typedef int (snd_kcontrol_put_t)(struct snd_kcontrol *,
+				 struct snd_ctl_elem_value *);
+
+struct snd_kcontrol_new {
+	snd_ctl_elem_iface_t iface;
+	unsigned int device;
+	unsigned int subdevice;
+	const char *name;
+	unsigned int index;
+	unsigned int access;
+	unsigned int count;
+	snd_kcontrol_info_t *info;
+	snd_kcontrol_get_t *get;
+	snd_kcontrol_put_t *put;
+	union { const unsigned int *p; } tlv;
+	unsigned long private_value;
+};
+
+struct snd_ctl_file;
+
+struct snd_kcontrol_volatile {
+	struct snd_ctl_file *owner;
+	unsigned int access;
+};
+
+struct snd_kcontrol {
+	struct snd_ctl_elem_id id;
+	unsigned int count;
+	snd_kcontrol_info_t *info;
+	snd_kcontrol_get_t *get;
+	snd_kcontrol_put_t *put;
+	unsigned long private_value;
+	void *private_data;
+	struct snd_kcontrol_volatile vd[];	/* count of them */
+};
+
+#define snd_kcontrol_chip(k)		((k)->private_data)
+
+extern struct snd_kcontrol *snd_ctl_new1(const struct snd_kcontrol_new *n,
+					 void *private_data);
+extern int snd_ctl_add(struct snd_card *card, struct snd_kcontrol *k);
+extern struct snd_kcontrol *snd_ctl_find_numid(struct snd_card *card,
+					       unsigned int numid);
+
+static inline struct snd_ctl_elem_id *
+snd_ctl_build_ioff(struct snd_ctl_elem_id *dst_id, struct snd_kcontrol *kctl,
+		   unsigned int offset)
+{
+	*dst_id = kctl->id;
+	dst_id->index += offset;
+	dst_id->numid += offset;
+	return dst_id;
+}
+extern void snd_ctl_notify(struct snd_card *card, unsigned int mask,
+			   struct snd_ctl_elem_id *id);
+extern int snd_ctl_enum_info(struct snd_ctl_elem_info *info,
+			     unsigned int channels, unsigned int items,
+			     const char *const names[]);
+extern int snd_ctl_boolean_mono_info(struct snd_kcontrol *k,
+				     struct snd_ctl_elem_info *info);
+
+struct snd_info_buffer {
+	char *buffer;
+	unsigned int curr;
+	unsigned int size;
+	unsigned int len;
+	int stop;
+	int error;
+};
+
+struct proc_dir_entry;
+
+struct snd_info_entry {
+	const char *name;
+	void *private_data;
+	struct proc_dir_entry *p;
+};
+
+extern __printf(2, 3) void snd_iprintf(struct snd_info_buffer *buffer,
+				       const char *fmt, ...);
+extern int snd_info_get_line(struct snd_info_buffer *buffer, char *line,
+			     int len);
+extern int snd_card_ro_proc_new(struct snd_card *card, const char *name,
+	void *private_data,
+	void (*read)(struct snd_info_entry *, struct snd_info_buffer *));
+extern int snd_card_rw_proc_new(struct snd_card *card, const char *name,
+	void *private_data,
+	void (*read)(struct snd_info_entry *, struct snd_info_buffer *),
+	void (*write)(struct snd_info_entry *, struct snd_info_buffer *));
+
+/* --- PCM: substreams as set up by the ALSA core for the driver ops, see
+ * hdspe_shim.c --- */
+
+typedef u64 dma_addr_t;
+
+struct task_struct { pid_t pid; };
+extern struct task_struct hdspe_shim_current;
+#define current				(&hdspe_shim_current)
+
+#define array_index_nospec(i, n)	(i)
+
+#define SNDRV_PCM_TRIGGER_STOP		0
+#define SNDRV_PCM_TRIGGER_START		1
+#define SNDRV_PCM_TRIGGER_PAUSE_PUSH	3
+#define SNDRV_PCM_TRIGGER_PAUSE_RELEASE	4
+#define SNDRV_PCM_TRIGGER_SUSPEND	5
+#define SNDRV_PCM_TRIGGER_RESUME	6
+
+#define SNDRV_PCM_IOCTL1_RESET		0
+#define SNDRV_PCM_IOCTL1_CHANNEL_INFO	2
+
+#define SNDRV_PCM_RATE_32000		(1U << 5)
+#define SNDRV_PCM_RATE_44100		(1U << 6)
+#define SNDRV_PCM_RATE_48000		(1U << 7)
+#define SNDRV_PCM_RATE_64000		(1U << 8)
+#define SNDRV_PCM_RATE_88200		(1U << 9)
+#define SNDRV_PCM_RATE_96000		(1U << 10)
+#define SNDRV_PCM_RATE_176400		(1U << 11)
+#define SNDRV_PCM_RATE_192000		(1U << 12)
+#define SNDRV_PCM_RATE_KNOT		(1U << 31)
+
+#define _SNDRV_PCM_FMTBIT(fmt)		(1ULL << (__force int)SNDRV_PCM_FORMAT_##fmt)
+#define SNDRV_PCM_FMTBIT_S32_LE		_SNDRV_PCM_FMTBIT(S32_LE)
+#define SNDRV_PCM_FMTBIT_FLOAT_LE	_SNDRV_PCM_FMTBIT(FLOAT_LE)
+
+#define SNDRV_DMA_TYPE_DEV_SG		3
+
+enum snd_dma_sync_mode { SNDRV_DMA_SYNC_CPU, SNDRV_DMA_SYNC_DEVICE };
+
+struct snd_dma_buffer {
+	struct device *dev;
+	unsigned char *area;
+	dma_addr_t addr;
+	size_t bytes;
+	void *private_data;
+};
+
+struct snd_pcm_hardware {
+	unsigned int info;
+	u64 formats;
+	unsigned int rates;
+	unsigned int rate_min, rate_max;
+	unsigned int channels_min, channels_max;
+	size_t buffer_bytes_max;
+	size_t period_bytes_min, period_bytes_max;
+	unsigned int periods_min, periods_max;
+	size_t fifo_size;
+};
+
+struct snd_pcm_runtime {
+	struct snd_pcm_hardware hw;
+	struct snd_pcm_mmap_status *status;
+	snd_pcm_sframes_t delay;
+	unsigned int rate;
+	unsigned int channels;
+	snd_pcm_uframes_t period_size;
+	snd_pcm_uframes_t buffer_size;
+	unsigned char *dma_area;
+	size_t dma_bytes;
+	struct snd_dma_buffer *dma_buffer_p;
+	/* Constraints on the interval parameters, see
+	 * hdspe_shim_pcm_hw_params(). Rules are not evaluated. */
+	struct snd_interval hw_ival[SNDRV_PCM_HW_PARAM_LAST_INTERVAL -
+				    SNDRV_PCM_HW_PARAM_FIRST_INTERVAL + 1];
+	unsigned long hw_step[SNDRV_PCM_HW_PARAM_LAST_INTERVAL -
+			      SNDRV_PCM_HW_PARAM_FIRST_INTERVAL + 1];
+	bool hw_pow2[SNDRV_PCM_HW_PARAM_LAST_INTERVAL -
+		     SNDRV_PCM_HW_PARAM_FIRST_INTERVAL + 1];
+};
+
+struct snd_pcm;
+struct snd_pcm_substream;
+
+struct snd_pcm_str {
+	int stream;
+	struct snd_pcm *pcm;
+	struct snd_pcm_substream *substream;	/* first of a list */
+	unsigned int substream_count;
+};
+
+struct snd_pcm_substream {
+	struct snd_pcm *pcm;
+	struct snd_pcm_str *pstr;
+	void *private_data;
+	int number;
+	int stream;
+	const struct snd_pcm_ops *ops;
+	struct snd_dma_buffer dma_buffer;
+	struct snd_pcm_runtime *runtime;
+	struct snd_pcm_substream *next;		/* in pstr */
+	struct snd_pcm_substream *group_next;	/* linked by snd_pcm_link() */
+	unsigned long periods_elapsed;		/* snd_pcm_period_elapsed() */
+};
+
+struct snd_pcm {
+	struct snd_card *card;
+	int device;
+	char name[80];
+	unsigned int info_flags;
+	void *private_data;
+	struct snd_pcm_str streams[2];
+};
+
+struct snd_pcm_ops {
+	int (*open)(struct snd_pcm_substream *substream);
+	int (*close)(struct snd_pcm_substream *substream);
+	int (*ioctl)(struct snd_pcm_substream *substream, unsigned int cmd,
+		     void *arg);
+	int (*hw_params)(struct snd_pcm_substream *substream,
+			 struct snd_pcm_hw_params *params);
+	int (*hw_free)(struct snd_pcm_substream *substream);
+	int (*prepare)(struct snd_pcm_substream *substream);
+	int (*trigger)(struct snd_pcm_substream *substream, int cmd);
+	snd_pcm_uframes_t (*pointer)(struct snd_pcm_substream *substream);
+};
+
+#define snd_pcm_substream_chip(s)	((s)->private_data)
+#define snd_pcm_group_for_each_entry(s, substream) \
+	for ((s) = (substream); (s); (s) = (s)->group_next)
+
+struct snd_pcm_hw_rule;
+typedef int (*snd_pcm_hw_rule_func_t)(struct snd_pcm_hw_params *params,
+				      struct snd_pcm_hw_rule *rule);
+
+struct snd_pcm_hw_rule {
+	unsigned int cond;
+	int var;
+	int deps[5];
+	snd_pcm_hw_rule_func_t func;
+	void *private;
+};
+
+struct snd_pcm_hw_constraint_list {
+	const unsigned int *list;
+	unsigned int count;
+	unsigned int mask;
+};
+
+static inline struct snd_interval *
+hw_param_interval(struct snd_pcm_hw_params *params, int var)
+{
+	return &params->intervals[var - SNDRV_PCM_HW_PARAM_FIRST_INTERVAL];
+}
+
+static inline const struct snd_interval *
+hw_param_interval_c(const struct snd_pcm_hw_params *params, int var)
+{
+	return &params->intervals[var - SNDRV_PCM_HW_PARAM_FIRST_INTERVAL];
+}
+
+#define params_rate(p)	hw_param_interval_c(p, SNDRV_PCM_HW_PARAM_RATE)->min
+#define params_channels(p) \
+	hw_param_interval_c(p, SNDRV_PCM_HW_PARAM_CHANNELS)->min
+#define params_period_size(p) \
+	hw_param_interval_c(p, SNDRV_PCM_HW_PARAM_PERIOD_SIZE)->min
+#define params_buffer_size(p) \
+	hw_param_interval_c(p, SNDRV_PCM_HW_PARAM_BUFFER_SIZE)->min
+
+static inline snd_pcm_format_t params_format(const struct snd_pcm_hw_params *p)
+{
+	const struct snd_mask *m =
+		&p->masks[SNDRV_PCM_HW_PARAM_FORMAT - SNDRV_PCM_HW_PARAM_FIRST_MASK];
+	int i;
+
+	for (i = 0; i < SNDRV_MASK_MAX; i++)
+		if (m->bits[i / 32] & (1U << (i % 32)))
+			return (__force snd_pcm_format_t)i;
+	return (__force snd_pcm_format_t)-1;
+}
+
+extern int snd_interval_refine(struct snd_interval *i,
+			       const struct snd_interval *v);
+extern int snd_interval_list(struct snd_interval *i, unsigned int count,
+			     const unsigned int *list, unsigned int mask);
+extern void _snd_pcm_hw_param_setempty(struct snd_pcm_hw_params *params,
+				       int var);
+
+extern int snd_pcm_new(struct snd_card *card, const char *id, int device,
+		       int playback_count, int capture_count,
+		       struct snd_pcm **rpcm);
+extern void snd_pcm_set_ops(struct snd_pcm *pcm, int direction,
+			    const struct snd_pcm_ops *ops);
+extern void snd_pcm_lib_preallocate_pages_for_all(struct snd_pcm *pcm,
+	int type, void *data, size_t size, size_t max);
+extern int snd_pcm_lib_malloc_pages(struct snd_pcm_substream *substream,
+				    size_t size);
+extern int snd_pcm_lib_free_pages(struct snd_pcm_substream *substream);
+extern void snd_pcm_set_runtime_buffer(struct snd_pcm_substream *substream,
+				       struct snd_dma_buffer *bufp);
+extern dma_addr_t snd_pcm_sgbuf_get_addr(struct snd_pcm_substream *substream,
+					 unsigned int ofs);
+extern int snd_pcm_lib_ioctl(struct snd_pcm_substream *substream,
+			     unsigned int cmd, void *arg);
+extern void snd_pcm_period_elapsed(struct snd_pcm_substream *substream);
+extern void snd_dma_buffer_sync(struct snd_dma_buffer *dmab,
+				enum snd_dma_sync_mode mode);
+#define snd_pcm_set_sync(substream)		((void)(substream))
+#define snd_pcm_trigger_done(s, master)		((void)(s), (void)(master))
+
+extern int snd_pcm_hw_constraint_minmax(struct snd_pcm_runtime *runtime,
+	int var, unsigned int min, unsigned int max);
+extern int snd_pcm_hw_constraint_step(struct snd_pcm_runtime *runtime,
+	unsigned int cond, int var, unsigned long step);
+extern int snd_pcm_hw_constraint_pow2(struct snd_pcm_runtime *runtime,
+	unsigned int cond, int var);
+extern int snd_pcm_hw_constraint_single(struct snd_pcm_runtime *runtime,
+	int var, unsigned int val);
+extern int snd_pcm_hw_constraint_msbits(struct snd_pcm_runtime *runtime,
+	unsigned int cond, unsigned int width, unsigned int msbits);
+extern int snd_pcm_hw_constraint_list(struct snd_pcm_runtime *runtime,
+	unsigned int cond, int var, const struct snd_pcm_hw_constraint_list *l);
+extern int snd_pcm_hw_rule_add(struct snd_pcm_runtime *runtime,
+	unsigned int cond, int var, snd_pcm_hw_rule_func_t func, void *private,
+	int dep, ...);
+
+/* --- proc files, seq_file --- */
+
+#define LINUX_VERSION_CODE	KERNEL_VERSION(6, 1, 0)
+#define KERNEL_VERSION(a, b, c)	(((a) << 16) + ((b) << 8) + (c))
+
+#define FMODE_READ		0x1
+#define FMODE_WRITE		0x2
+
+struct inode {
+	void *i_private;		/* pde_data() */
+};
+
+struct file {
+	unsigned int f_mode;
+	unsigned int f_flags;
+	void *private_data;
+};
+
+struct proc_ops {
+	int (*proc_open)(struct inode *, struct file *);
+	ssize_t (*proc_read)(struct file *, char __user *, size_t, loff_t *);
+	ssize_t (*proc_write)(struct file *, const char __user *, size_t,
+			      loff_t *);
+	loff_t (*proc_lseek)(struct file *, loff_t, int);
+	int (*proc_release)(struct inode *, struct file *);
+};
+
+extern struct proc_dir_entry *proc_create_data(const char *name,
+	unsigned short mode, struct proc_dir_entry *parent,
+	const struct proc_ops *ops, void *data);
+
+static inline void *pde_data(const struct inode *inode)
+{
+	return inode->i_private;
+}
+
+struct seq_file;
+
+struct seq_operations {
+	void *(*start)(struct seq_file *m, loff_t *pos);
+	void (*stop)(struct seq_file *m, void *v);
+	void *(*next)(struct seq_file *m, void *v, loff_t *pos);
+	int (*show)(struct seq_file *m, void *v);
+};
+
+/* One record is formatted into buf at a time, as by the kernel. */
+struct seq_file {
+	char buf[4096];
+	size_t count;			/* bytes in buf */
+	size_t from;			/* bytes of buf already read */
+	bool overflow;
+	loff_t index;
+	const struct seq_operations *op;
+	void *private;
+};
+
+#define SEQ_START_TOKEN		((void *)1)
+
+extern __printf(2, 3) void seq_printf(struct seq_file *m,
+				      const char *fmt, ...);
+extern void seq_puts(struct seq_file *m, const char *s);
+extern ssize_t seq_read(struct file *file, char __user *buf, size_t size,
+			loff_t *ppos);
+extern loff_t seq_lseek(struct file *file, loff_t offset, int whence);
+extern void *__seq_open_private(struct file *file,
+				const struct seq_operations *ops, int psize);
+extern int seq_release_private(struct inode *inode, struct file *file);
+
+/* --- User memory --- */
+
+/* As in the kernel, copy the bytes up to the first inaccessible user
+ * address, and return the number of bytes not copied. User memory is
+ * unrestricted unless a test sets a user arena, see hdspe_test.h. */
+extern unsigned long copy_to_user(void __user *to, const void *from,
+				  unsigned long n);
+extern unsigned long copy_from_user(void *to, const void __user *from,
+				    unsigned long n);
+#define get_user(x, ptr)						\
+	(copy_from_user(&(x), (ptr), sizeof(*(ptr))) ? -EFAULT : 0)
+
+/* --- kfifo: records of a fixed type, copied out whole --- */
+
+#define DECLARE_KFIFO(fifo, type, size)					\
+	struct {							\
+		unsigned int in, out;					\
+		type buf[size];						\
+	} fifo
+#define INIT_KFIFO(fifo)		((fifo).in = (fifo).out = 0)
+#define kfifo_size(f)			ARRAY_SIZE((f)->buf)
+#define kfifo_len(f)			((f)->in - (f)->out)
+#define kfifo_is_empty(f)		(kfifo_len(f) == 0)
+#define kfifo_is_full(f)		(kfifo_len(f) >= kfifo_size(f))
+#define kfifo_put(f, val)						\
+	({								\
+		bool __ok = !kfifo_is_full(f);				\
+		if (__ok)						\
+			(f)->buf[(f)->in++ % kfifo_size(f)] = (val);	\
+		__ok;							\
+	})
+#define kfifo_to_user(f, to, len, copied)				\
+	({								\
+		const size_t __rec = sizeof((f)->buf[0]);		\
+		char __user *__to = (char __user *)(to);		\
+		unsigned int __n = 0;					\
+		int __err = 0;						\
+		while (!kfifo_is_empty(f) && (__n + 1) * __rec <= (len)) { \
+			if (copy_to_user(__to + __n * __rec,		\
+					 &(f)->buf[(f)->out % kfifo_size(f)], \
+					 __rec)) {			\
+				__err = -EFAULT;			\
+				break;					\
+			}						\
+			(f)->out++;					\
+			__n++;						\
+		}							\
+		*(copied) = __n * __rec;				\
+		__err;							\
+	})
+
+/* --- hwdep --- */
+
+struct snd_hwdep;
+
+struct snd_hwdep_ops {
+	int (*open)(struct snd_hwdep *hw, struct file *file);
+	int (*release)(struct snd_hwdep *hw, struct file *file);
+	long (*read)(struct snd_hwdep *hw, char __user *buf, long count,
+		     loff_t *offset);
+	__poll_t (*poll)(struct snd_hwdep *hw, struct file *file,
+			 poll_table *wait);
+	int (*ioctl)(struct snd_hwdep *hw, struct file *file,
+		     unsigned int cmd, unsigned long arg);
+	int (*ioctl_compat)(struct snd_hwdep *hw, struct file *file,
+			    unsigned int cmd, unsigned long arg);
+	int (*mmap)(struct snd_hwdep *hw, struct file *file,
+		    struct vm_area_struct *vma);
+};
+
+struct snd_hwdep {
+	struct snd_card *card;
+	char id[32];
+	char name[80];
+	int device;
+	struct snd_hwdep_ops ops;
+	void *private_data;
+};
+
+extern int snd_hwdep_new(struct snd_card *card, char *id, int device,
+			 struct snd_hwdep **rhwdep);
+
+#endif /* HDSPE_SHIM_H */
@@ -0,0 +1,2 @@
+/* See hdspe_shim.h */
+#include "../../hdspe_shim.h"
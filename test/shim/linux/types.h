@@ -0,0 +1,19 @@
+/* See hdspe_shim.h: the user space API types, plus the kernel ones. */
+#ifndef HDSPE_SHIM_LINUX_TYPES_H
+#define HDSPE_SHIM_LINUX_TYPES_H
+#include_next <linux/types.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+typedef __u8 u8;
+typedef __s8 s8;
+typedef __u16 u16;
+typedef __s16 s16;
+typedef __u32 u32;
+typedef __s32 s32;
+typedef __u64 u64;
+typedef __s64 s64;
+/* The kernel's uint64_t is u64, unsigned long long, also on 64-bit. */
+#define uint64_t __u64
+#define int64_t __s64
+#endif